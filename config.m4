@@ -95,6 +95,10 @@ if test "$PHP_DDTRACE" != "no"; then
     dnl PHP 8.x
     EXTRA_PHP_SOURCES="\
         ext/handlers_curl.c \
+        ext/handlers_db.c \
+        ext/handlers_memcached.c \
+        ext/handlers_pdo.c \
+        ext/handlers_redis.c \
         ext/hook/uhook_attributes.c \
     "
     ZAI_RESOLVER_SUFFIX=""
@@ -129,28 +133,34 @@ if test "$PHP_DDTRACE" != "no"; then
     ext/configuration.c \
     ext/ddshared.c \
     ext/dogstatsd_client.c \
+    ext/dynamic_config.c \
     ext/engine_api.c \
     ext/engine_hooks.c \
     ext/excluded_modules.c \
     ext/handlers_api.c \
     ext/handlers_exception.c \
+    ext/handlers_http.c \
     ext/handlers_internal.c \
     ext/handlers_pcntl.c \
     ext/integrations/integrations.c \
+    ext/integrations/overhead.c \
     ext/ip_extraction.c \
     ext/logging.c \
     ext/memory_limit.c \
     ext/limiter/limiter.c \
     ext/priority_sampling/priority_sampling.c \
     ext/profiling.c \
+    ext/query_string_obfuscation.c \
     ext/random.c \
     ext/request_hooks.c \
     ext/serializer.c \
     ext/signals.c \
     ext/span.c \
+    ext/sql_obfuscation.c \
     ext/startup_logging.c \
     ext/telemetry.c \
     ext/tracer_tag_propagation/tracer_tag_propagation.c \
+    ext/uri_normalization.c \
     ext/hook/uhook.c \
     ext/hook/uhook_legacy.c \
   "
@@ -30,6 +30,7 @@
 #include "compatibility.h"
 #include "configuration.h"
 #include "ddshared.h"
+#include "dynamic_config.h"
 #include "ext/version.h"
 #include "logging.h"
 #include "mpack/mpack.h"
@@ -962,6 +963,8 @@ static void *_dd_writer_loop(void *_) {
             }
         }
 
+        ddtrace_dynamic_config_poll();
+
         if (atomic_load(&writer->suspended)) {
             continue;
         }
@@ -95,7 +95,11 @@ enum ddtrace_dbm_propagation_mode {
     CONFIG(BOOL, DD_INSTRUMENTATION_TELEMETRY_ENABLED, "true", .ini_change = zai_config_system_ini_change)               \
     CONFIG(BOOL, DD_TRACE_HEALTH_METRICS_ENABLED, "false", .ini_change = zai_config_system_ini_change)         \
     CONFIG(DOUBLE, DD_TRACE_HEALTH_METRICS_HEARTBEAT_SAMPLE_RATE, "0.001")                                     \
+    CONFIG(BOOL, DD_TRACE_INTEGRATION_OVERHEAD_ENABLED, "false")                                               \
+    CONFIG(INT, DD_TRACE_INTEGRATION_OVERHEAD_SAMPLE_INTERVAL, "1")                                            \
     CONFIG(BOOL, DD_TRACE_DB_CLIENT_SPLIT_BY_INSTANCE, "false")                                                \
+    CONFIG(BOOL, DD_TRACE_SQL_OBFUSCATION_ENABLED, "false")                                                    \
+    CONFIG(INT, DD_TRACE_SQL_OBFUSCATION_CACHE_SIZE, "512")                                                    \
     CONFIG(BOOL, DD_TRACE_HTTP_CLIENT_SPLIT_BY_DOMAIN, "false")                                                \
     CONFIG(BOOL, DD_TRACE_REDIS_CLIENT_SPLIT_BY_HOST, "false")                                                 \
     CONFIG(STRING, DD_TRACE_MEMORY_LIMIT, "")                                                                  \
@@ -112,6 +116,12 @@ enum ddtrace_dbm_propagation_mode {
     CONFIG(INT, DD_TRACE_RATE_LIMIT, "0", .ini_change = zai_config_system_ini_change)                          \
     CALIAS(DOUBLE, DD_TRACE_SAMPLE_RATE, "1", CALIASES("DD_SAMPLING_RATE"))                                    \
     CONFIG(JSON, DD_TRACE_SAMPLING_RULES, "[]")                                                                \
+    /* Keep rules decide when the root span closes, after the rejection may have been propagated:              \
+     * a kept trace may thus miss the spans of downstream services. Lightweight tracing of rejected            \
+     * traces is disabled while any keep rule is configured. */                                                \
+    CONFIG(INT, DD_TRACE_SAMPLING_KEEP_SLOWER_THAN_MS, "0")                                                    \
+    CONFIG(BOOL, DD_TRACE_SAMPLING_KEEP_ERRORS, "false")                                                       \
+    CONFIG(BOOL, DD_TRACE_SAMPLING_KEEP_HTTP_5XX, "false")                                                     \
     CONFIG(JSON, DD_SPAN_SAMPLING_RULES, "[]")                                                                 \
     CONFIG(STRING, DD_SPAN_SAMPLING_RULES_FILE, "", .ini_change = ddtrace_alter_sampling_rules_file_config)    \
     CONFIG(SET_LOWERCASE, DD_TRACE_HEADER_TAGS, "")                                                            \
@@ -134,6 +144,7 @@ enum ddtrace_dbm_propagation_mode {
     CONFIG(BOOL, DD_LOG_BACKTRACE, "false")                                                                    \
     CONFIG(BOOL, DD_TRACE_GENERATE_ROOT_SPAN, "true", .ini_change = ddtrace_span_alter_root_span_config)       \
     CONFIG(INT, DD_TRACE_SPANS_LIMIT, "1000")                                                                  \
+    CONFIG(BOOL, DD_TRACE_LIGHTWEIGHT_REJECTED_TRACES, "false")                                                \
     CONFIG(BOOL, DD_TRACE_128_BIT_TRACEID_GENERATION_ENABLED, "false")                                         \
     CONFIG(BOOL, DD_TRACE_128_BIT_TRACEID_LOGGING_ENABLED, "false")                                                                                                           \
     CONFIG(INT, DD_TRACE_AGENT_MAX_CONSECUTIVE_FAILURES,                                                       \
@@ -145,6 +156,7 @@ enum ddtrace_dbm_propagation_mode {
     CONFIG(INT, DD_TRACE_BGS_TIMEOUT, DD_CFG_EXPSTR(DD_TRACE_BGS_TIMEOUT_VAL),                                 \
            .ini_change = zai_config_system_ini_change)                                                         \
     CONFIG(INT, DD_TRACE_AGENT_FLUSH_INTERVAL, "5000", .ini_change = zai_config_system_ini_change)             \
+    CONFIG(STRING, DD_TRACE_DYNAMIC_CONFIG_FILE, "", .ini_change = zai_config_system_ini_change)               \
     CONFIG(INT, DD_TRACE_AGENT_FLUSH_AFTER_N_REQUESTS, "10")                                                   \
     CONFIG(INT, DD_TRACE_SHUTDOWN_TIMEOUT, "5000", .ini_change = zai_config_system_ini_change)                 \
     CONFIG(BOOL, DD_TRACE_STARTUP_LOGS, "true")                                                                \
@@ -157,6 +169,7 @@ enum ddtrace_dbm_propagation_mode {
     CONFIG(STRING, DD_TRACE_OBFUSCATION_QUERY_STRING_REGEXP, DD_TRACE_OBFUSCATION_QUERY_STRING_REGEXP_DEFAULT) \
     CONFIG(BOOL, DD_TRACE_CLIENT_IP_ENABLED, "false")                                                          \
     CONFIG(STRING, DD_TRACE_CLIENT_IP_HEADER, "")                                                              \
+    CONFIG(SET, DD_TRACE_CLIENT_IP_TRUSTED_PROXIES, "")                                                        \
     CONFIG(BOOL, DD_TRACE_FORKED_PROCESS, "true")                                                              \
     CONFIG(INT, DD_TRACE_HOOK_LIMIT, "100")                                                                    \
     CONFIG(INT, DD_TRACE_AGENT_MAX_PAYLOAD_SIZE, "52428800", .ini_change = zai_config_system_ini_change)       \
@@ -41,11 +41,13 @@
 #include "ddtrace.h"
 #include "ddtrace_string.h"
 #include "dogstatsd_client.h"
+#include "dynamic_config.h"
 #include "engine_hooks.h"
 #include "excluded_modules.h"
 #include "handlers_http.h"
 #include "handlers_internal.h"
 #include "integrations/integrations.h"
+#include "integrations/overhead.h"
 #include "ip_extraction.h"
 #include "logging.h"
 #include "memory_limit.h"
@@ -56,9 +58,11 @@
 #include "serializer.h"
 #include "signals.h"
 #include "span.h"
+#include "sql_obfuscation.h"
 #include "startup_logging.h"
 #include "telemetry.h"
 #include "tracer_tag_propagation/tracer_tag_propagation.h"
+#include "uri_normalization.h"
 #include "ext/standard/file.h"
 
 #include "../hook/uhook.h"
@@ -240,6 +244,8 @@ bool ddtrace_alter_dd_version(zval *old_value, zval *new_value) {
 static void dd_activate_once(void) {
     ddtrace_config_first_rinit();
     ddtrace_generate_runtime_id();
+    // the background sender is not running yet, so that the first requests see the overrides too
+    ddtrace_dynamic_config_poll();
 
     // must run before the first zai_hook_activate as ddtrace_telemetry_setup installs a global hook
     if (!DDTRACE_G(disable) && get_global_DD_INSTRUMENTATION_TELEMETRY_ENABLED()) {
@@ -272,6 +278,8 @@ static void ddtrace_activate(void) {
         dd_save_sampling_rules_file_config(sampling_rules_file, PHP_INI_USER, PHP_INI_STAGE_RUNTIME);
     }
 
+    ddtrace_dynamic_config_rinit();
+
     if (strcmp(sapi_module.name, "cli") == 0 && !get_DD_TRACE_CLI_ENABLED()) {
         DDTRACE_G(disable) = 2;
     }
@@ -338,6 +346,9 @@ static PHP_GINIT_FUNCTION(ddtrace) {
 static PHP_GSHUTDOWN_FUNCTION(ddtrace) {
     UNUSED(ddtrace_globals);
     zai_hook_gshutdown();
+    ddtrace_sql_obfuscation_gshutdown();
+    ddtrace_dynamic_config_gshutdown();
+    ddtrace_dogstatsd_client_gshutdown();
 }
 
 /* DDTrace\SpanLink */
@@ -683,7 +694,6 @@ static PHP_MINIT_FUNCTION(ddtrace) {
 
     ddtrace_set_coredumpfilter();
 
-    ddtrace_initialize_span_sampling_limiter();
     ddtrace_limiter_create();
 
     ddtrace_bgs_log_minit();
@@ -733,8 +743,11 @@ static PHP_MSHUTDOWN_FUNCTION(ddtrace) {
 
     ddtrace_engine_hooks_mshutdown();
 
-    ddtrace_shutdown_span_sampling_limiter();
     ddtrace_limiter_destroy();
+    ddtrace_priority_sampling_mshutdown();
+    ddtrace_uri_normalization_mshutdown();
+    dd_ip_extraction_shutdown();
+    ddtrace_dynamic_config_mshutdown();
     zai_config_mshutdown();
 
     ddtrace_telemetry_shutdown();
@@ -760,6 +773,8 @@ static void dd_initialize_request(void) {
     DDTRACE_G(additional_global_tags) = zend_new_array(0);
     DDTRACE_G(default_priority_sampling) = DDTRACE_PRIORITY_SAMPLING_UNKNOWN;
     DDTRACE_G(propagated_priority_sampling) = DDTRACE_PRIORITY_SAMPLING_UNKNOWN;
+    DDTRACE_G(lightweight_skipped_spans) = 0;
+    DDTRACE_G(lightweight_skipped_duration) = 0;
     zend_hash_init(&DDTRACE_G(root_span_tags_preset), 8, unused, ZVAL_PTR_DTOR, 0);
     zend_hash_init(&DDTRACE_G(propagated_root_span_tags), 8, unused, ZVAL_PTR_DTOR, 0);
     zend_hash_init(&DDTRACE_G(tracestate_unknown_dd_keys), 8, unused, ZVAL_PTR_DTOR, 0);
@@ -771,6 +786,7 @@ static void dd_initialize_request(void) {
         dd_request_init_hook_rinit();
     }
 
+    ddtrace_integration_overhead_rinit();
     ddtrace_internal_handlers_rinit();
     ddtrace_bgs_log_rinit(PG(error_log));
 
@@ -831,6 +847,11 @@ static void dd_clean_globals(void) {
     }
 
     ddtrace_internal_handlers_rshutdown();
+    ddtrace_integration_overhead_rshutdown();
+    ddtrace_distributed_headers_memo_rshutdown();
+    ddtrace_priority_sampling_rshutdown();
+    ddtrace_uri_normalization_rshutdown();
+    dd_ip_extraction_rshutdown();
     ddtrace_dogstatsd_client_rshutdown();
 
     ddtrace_free_span_stacks(false);
@@ -945,6 +966,10 @@ bool ddtrace_alter_dd_trace_disabled_config(zval *old_value, zval *new_value) {
         return Z_TYPE_P(new_value) == IS_FALSE;  // no changing to enabled allowed if globally disabled
     }
 
+    if (!DDTRACE_G(active_stack)) {
+        return true;  // changed before RINIT, which initializes the request according to the new value
+    }
+
     if (Z_TYPE_P(old_value) == IS_FALSE) {
         dd_initialize_request();
     } else if (!DDTRACE_G(disable)) {  // if this is true, the request has not been initialized at all
@@ -1927,10 +1952,7 @@ static void dd_apply_propagated_values_to_existing_spans(void) {
     while (span) {
         zend_array *meta = ddtrace_spandata_property_meta(span);
         if (!DDTRACE_G(distributed_trace_id).low && !DDTRACE_G(distributed_trace_id).high) {
-            span->trace_id = (ddtrace_trace_id) {
-                .low = span->root->span_id,
-                .time = get_DD_TRACE_128_BIT_TRACEID_GENERATION_ENABLED() ? span->start / UINT64_C(1000000000) : 0,
-            };
+            span->trace_id = ddtrace_generate_trace_id(span->root->span_id, span->start);
         } else {
             span->trace_id = DDTRACE_G(distributed_trace_id);
         }
@@ -2016,6 +2038,7 @@ PHP_FUNCTION(DDTrace_set_distributed_tracing_context) {
 }
 
 void ddtrace_read_distributed_tracing_ids(bool (*read_header)(zai_string_view, const char *, zend_string **header_value, void *data), void *data);
+static void dd_read_distributed_tracing_ids_from_array(zend_array *array);
 
 typedef struct {
     zend_fcall_info fci;
@@ -2042,18 +2065,6 @@ static bool dd_read_userspace_header(zai_string_view zai_header, const char *low
     return true;
 }
 
-static bool dd_read_array_header(zai_string_view zai_header, const char *lowercase_header, zend_string **header_value, void *data) {
-    UNUSED(zai_header);
-    zend_array *array = (zend_array *) data;
-    zval *value = zend_hash_str_find(array, lowercase_header, strlen(lowercase_header));
-    if (!value) {
-        return false;
-    }
-
-    *header_value = zval_get_string(value);
-    return true;
-}
-
 PHP_FUNCTION(DDTrace_consume_distributed_tracing_headers) {
     dd_fci_fcc_pair func;
     zend_array *array = NULL;
@@ -2098,7 +2109,7 @@ PHP_FUNCTION(DDTrace_consume_distributed_tracing_headers) {
     dd_clear_propagated_tags_from_root_span();
 
     if (array) {
-        ddtrace_read_distributed_tracing_ids(dd_read_array_header, array);
+        dd_read_distributed_tracing_ids_from_array(array);
     } else {
         ddtrace_read_distributed_tracing_ids(dd_read_userspace_header, &func);
     }
@@ -2120,6 +2131,12 @@ PHP_FUNCTION(DDTrace_generate_distributed_tracing_headers) {
         Z_PARAM_ARRAY_HT_EX(inject, true, false)
     ZEND_PARSE_PARAMETERS_END();
 
+    if (get_DD_TRACE_ENABLED() && !inject) {
+        zend_array *headers = ddtrace_distributed_headers_memoized_default();
+        GC_ADDREF(headers);
+        RETURN_ARR(headers);
+    }
+
     array_init(return_value);
     if (get_DD_TRACE_ENABLED()) {
         if (inject) {
@@ -2132,8 +2149,6 @@ PHP_FUNCTION(DDTrace_generate_distributed_tracing_headers) {
             } ZEND_HASH_FOREACH_END();
             ddtrace_inject_distributed_headers_config(Z_ARR_P(return_value), true, inject_set);
             zend_array_destroy(inject_set);
-        } else {
-            ddtrace_inject_distributed_headers(Z_ARR_P(return_value), true);
         }
     }
 }
@@ -2282,7 +2297,91 @@ static inline bool dd_is_hex_char(char chr) {
     return (chr >= '0' && chr <= '9') || (chr >= 'a' && chr <= 'f');
 }
 
-void ddtrace_read_distributed_tracing_ids(bool (*read_header)(zai_string_view, const char *, zend_string **header_value, void *data), void *data) {
+/*
+ Propagation headers are collected into a single struct before being parsed. Where the whole header set is at hand
+ (the request headers and arrays passed to DDTrace\consume_distributed_tracing_headers()), it is walked exactly once,
+ classifying each name through a perfect hash on its length, instead of looking up every header we might care about.
+ Userland callbacks are still asked lazily for the headers which the enabled propagation styles actually need.
+*/
+#define DD_PROPAGATION_HEADERS                                                   \
+    DD_PROPAGATION_HEADER(B3, "b3")                                              \
+    DD_PROPAGATION_HEADER(X_DATADOG_ORIGIN, "x-datadog-origin")                  \
+    DD_PROPAGATION_HEADER(X_DATADOG_TRACE_ID, "x-datadog-trace-id")              \
+    DD_PROPAGATION_HEADER(X_DATADOG_PARENT_ID, "x-datadog-parent-id")            \
+    DD_PROPAGATION_HEADER(X_DATADOG_SAMPLING_PRIORITY, "x-datadog-sampling-priority") \
+    DD_PROPAGATION_HEADER(X_DATADOG_TAGS, "x-datadog-tags")                      \
+    DD_PROPAGATION_HEADER(X_B3_TRACEID, "x-b3-traceid")                          \
+    DD_PROPAGATION_HEADER(X_B3_SPANID, "x-b3-spanid")                            \
+    DD_PROPAGATION_HEADER(X_B3_SAMPLED, "x-b3-sampled")                          \
+    DD_PROPAGATION_HEADER(X_B3_FLAGS, "x-b3-flags")                              \
+    DD_PROPAGATION_HEADER(TRACEPARENT, "traceparent")                            \
+    DD_PROPAGATION_HEADER(TRACESTATE, "tracestate")
+
+#define DD_PROPAGATION_HEADER(id, name) DD_PROPAGATION_HEADER_##id,
+typedef enum { DD_PROPAGATION_HEADERS DD_PROPAGATION_HEADERS_COUNT } dd_propagation_header;
+#undef DD_PROPAGATION_HEADER
+
+#define DD_PROPAGATION_HEADER(id, name) name,
+static const char *dd_propagation_header_names[] = { DD_PROPAGATION_HEADERS };
+#undef DD_PROPAGATION_HEADER
+
+#define DD_PROPAGATION_HEADER(id, name) #id,
+static const char *dd_propagation_header_server_names[] = { DD_PROPAGATION_HEADERS };
+#undef DD_PROPAGATION_HEADER
+
+#define DD_PROPAGATION_HEADERS_ALL ((1 << DD_PROPAGATION_HEADERS_COUNT) - 1)
+
+typedef struct {
+    zend_string *values[DD_PROPAGATION_HEADERS_COUNT];
+    uint32_t looked_up;  // bitmask of values which are known, i.e. must not be asked from read_header
+    bool (*read_header)(zai_string_view, const char *, zend_string **header_value, void *data);
+    void *data;
+} dd_propagation_headers;
+
+// Lengths are unique, except for three pairs told apart by their first or sixth character, either case and separator.
+// Returns the only header the name may be, which the caller must still compare in full.
+static int dd_classify_propagation_header(const char *name, size_t len) {
+    switch (len) {
+        case sizeof("b3") - 1: return DD_PROPAGATION_HEADER_B3;
+        case sizeof("x-b3-flags") - 1: return (name[0] | 0x20) == 't' ? DD_PROPAGATION_HEADER_TRACESTATE : DD_PROPAGATION_HEADER_X_B3_FLAGS;
+        case sizeof("x-b3-spanid") - 1: return (name[0] | 0x20) == 't' ? DD_PROPAGATION_HEADER_TRACEPARENT : DD_PROPAGATION_HEADER_X_B3_SPANID;
+        case sizeof("x-b3-traceid") - 1: return (name[5] | 0x20) == 't' ? DD_PROPAGATION_HEADER_X_B3_TRACEID : DD_PROPAGATION_HEADER_X_B3_SAMPLED;
+        case sizeof("x-datadog-tags") - 1: return DD_PROPAGATION_HEADER_X_DATADOG_TAGS;
+        case sizeof("x-datadog-origin") - 1: return DD_PROPAGATION_HEADER_X_DATADOG_ORIGIN;
+        case sizeof("x-datadog-trace-id") - 1: return DD_PROPAGATION_HEADER_X_DATADOG_TRACE_ID;
+        case sizeof("x-datadog-parent-id") - 1: return DD_PROPAGATION_HEADER_X_DATADOG_PARENT_ID;
+        case sizeof("x-datadog-sampling-priority") - 1: return DD_PROPAGATION_HEADER_X_DATADOG_SAMPLING_PRIORITY;
+        default: return -1;
+    }
+}
+
+// On success, header_value holds an owned reference
+static bool dd_read_propagation_header(dd_propagation_headers *headers, dd_propagation_header header, zend_string **header_value) {
+    if (!(headers->looked_up & (1 << header))) {
+        headers->looked_up |= 1 << header;
+        const char *name = dd_propagation_header_server_names[header];
+        if (!headers->read_header((zai_string_view){ .len = strlen(name), .ptr = name }, dd_propagation_header_names[header], &headers->values[header], headers->data)) {
+            headers->values[header] = NULL;
+        }
+    }
+
+    if (!headers->values[header]) {
+        return false;
+    }
+
+    *header_value = zend_string_copy(headers->values[header]);
+    return true;
+}
+
+static void dd_release_propagation_headers(dd_propagation_headers *headers) {
+    for (int i = 0; i < DD_PROPAGATION_HEADERS_COUNT; ++i) {
+        if (headers->values[i]) {
+            zend_string_release(headers->values[i]);
+        }
+    }
+}
+
+static void dd_extract_distributed_tracing_ids(dd_propagation_headers *headers) {
     zend_string *trace_id_str, *parent_id_str, *priority_str, *propagated_tags, *b3_header_str, *traceparent, *tracestate;
 
     DDTRACE_G(distributed_trace_id) = (ddtrace_trace_id){ 0 };
@@ -2302,7 +2401,7 @@ void ddtrace_read_distributed_tracing_ids(bool (*read_header)(zai_string_view, c
     int priority_sampling = DDTRACE_PRIORITY_SAMPLING_UNKNOWN;
     bool reset_decision_maker = false;
 
-    if (parse_b3_single && read_header(ZAI_STRL_VIEW("B3"), "b3", &b3_header_str, data)) {
+    if (parse_b3_single && dd_read_propagation_header(headers, DD_PROPAGATION_HEADER_B3, &b3_header_str)) {
         char *b3_ptr = ZSTR_VAL(b3_header_str), *b3_end = b3_ptr + ZSTR_LEN(b3_header_str);
         char *b3_traceid = b3_ptr;
         while (b3_ptr < b3_end && *b3_ptr != '-') {
@@ -2340,26 +2439,26 @@ void ddtrace_read_distributed_tracing_ids(bool (*read_header)(zai_string_view, c
     }
 
     if (parse_datadog_meta_headers) {
-        read_header(ZAI_STRL_VIEW("X_DATADOG_ORIGIN"), "x-datadog-origin", &DDTRACE_G(dd_origin), data);
+        dd_read_propagation_header(headers, DD_PROPAGATION_HEADER_X_DATADOG_ORIGIN, &DDTRACE_G(dd_origin));
     }
 
-    if (parse_datadog && read_header(ZAI_STRL_VIEW("X_DATADOG_TRACE_ID"), "x-datadog-trace-id", &trace_id_str, data)) {
+    if (parse_datadog && dd_read_propagation_header(headers, DD_PROPAGATION_HEADER_X_DATADOG_TRACE_ID, &trace_id_str)) {
         zval trace_zv;
         ZVAL_STR(&trace_zv, trace_id_str);
         DDTRACE_G(distributed_trace_id) = (ddtrace_trace_id){ .low = ddtrace_parse_userland_span_id(&trace_zv) };
         zend_string_release(trace_id_str);
-    } else if (parse_b3 && read_header(ZAI_STRL_VIEW("X_B3_TRACEID"), "x-b3-traceid", &trace_id_str, data)) {
+    } else if (parse_b3 && dd_read_propagation_header(headers, DD_PROPAGATION_HEADER_X_B3_TRACEID, &trace_id_str)) {
         DDTRACE_G(distributed_trace_id) = dd_parse_b3_trace_id(ZSTR_VAL(trace_id_str), ZSTR_LEN(trace_id_str));
         zend_string_release(trace_id_str);
     }
 
     if (DDTRACE_G(distributed_trace_id).low || DDTRACE_G(distributed_trace_id).high) {
-        if (parse_datadog && read_header(ZAI_STRL_VIEW("X_DATADOG_PARENT_ID"), "x-datadog-parent-id", &parent_id_str, data)) {
+        if (parse_datadog && dd_read_propagation_header(headers, DD_PROPAGATION_HEADER_X_DATADOG_PARENT_ID, &parent_id_str)) {
             zval parent_zv;
             ZVAL_STR(&parent_zv, parent_id_str);
             DDTRACE_G(distributed_parent_trace_id) = ddtrace_parse_userland_span_id(&parent_zv);
             zend_string_release(parent_id_str);
-        } else if (parse_b3 && read_header(ZAI_STRL_VIEW("X_B3_SPANID"), "x-b3-spanid", &parent_id_str, data)) {
+        } else if (parse_b3 && dd_read_propagation_header(headers, DD_PROPAGATION_HEADER_X_B3_SPANID, &parent_id_str)) {
             zval parent_zv;
             ZVAL_STR(&parent_zv, parent_id_str);
             DDTRACE_G(distributed_parent_trace_id) = ddtrace_parse_hex_span_id(&parent_zv);
@@ -2371,10 +2470,10 @@ void ddtrace_read_distributed_tracing_ids(bool (*read_header)(zai_string_view, c
         parse_datadog = 0;
     }
 
-    if (parse_datadog && read_header(ZAI_STRL_VIEW("X_DATADOG_SAMPLING_PRIORITY"), "x-datadog-sampling-priority", &priority_str, data)) {
+    if (parse_datadog && dd_read_propagation_header(headers, DD_PROPAGATION_HEADER_X_DATADOG_SAMPLING_PRIORITY, &priority_str)) {
         priority_sampling = strtol(ZSTR_VAL(priority_str), NULL, 10);
         zend_string_release(priority_str);
-    } else if (parse_b3 && read_header(ZAI_STRL_VIEW("X_B3_SAMPLED"), "x-b3-sampled", &priority_str, data)) {
+    } else if (parse_b3 && dd_read_propagation_header(headers, DD_PROPAGATION_HEADER_X_B3_SAMPLED, &priority_str)) {
         if (ZSTR_LEN(priority_str) == 1) {
             if (ZSTR_VAL(priority_str)[0] == '0') {
                 priority_sampling = 0;
@@ -2387,20 +2486,20 @@ void ddtrace_read_distributed_tracing_ids(bool (*read_header)(zai_string_view, c
             priority_sampling = 0;
         }
         zend_string_release(priority_str);
-    } else if (parse_b3 && read_header(ZAI_STRL_VIEW("X_B3_FLAGS"), "x-b3-flags", &priority_str, data)) {
+    } else if (parse_b3 && dd_read_propagation_header(headers, DD_PROPAGATION_HEADER_X_B3_FLAGS, &priority_str)) {
         if (ZSTR_LEN(priority_str) == 1 && ZSTR_VAL(priority_str)[1] == '1') {
             priority_sampling = PRIORITY_SAMPLING_USER_KEEP;
         }
         zend_string_release(priority_str);
     }
 
-    if (parse_datadog_meta_headers && read_header(ZAI_STRL_VIEW("X_DATADOG_TAGS"), "x-datadog-tags", &propagated_tags, data)) {
+    if (parse_datadog_meta_headers && dd_read_propagation_header(headers, DD_PROPAGATION_HEADER_X_DATADOG_TAGS, &propagated_tags)) {
         ddtrace_add_tracer_tags_from_header(propagated_tags);
         zend_string_release(propagated_tags);
     }
 
     // "{version:2}-{trace-id:32}-{parent-id:16}-{trace-flags:2}"
-    if (parse_tracestate && read_header(ZAI_STRL_VIEW("TRACEPARENT"), "traceparent", &traceparent, data)) {
+    if (parse_tracestate && dd_read_propagation_header(headers, DD_PROPAGATION_HEADER_TRACEPARENT, &traceparent)) {
         do {
             // skip whitespace
             char *ws = ZSTR_VAL(traceparent), *wsend = ws + ZSTR_LEN(traceparent);
@@ -2456,7 +2555,7 @@ void ddtrace_read_distributed_tracing_ids(bool (*read_header)(zai_string_view, c
         zend_string_release(traceparent);
 
        // header format: "[*,]dd=s:1;o:rum;t.dm:-4;t.usr.id:12345[,*]"
-        if (parse_tracestate && read_header(ZAI_STRL_VIEW("TRACESTATE"), "tracestate", &tracestate, data)) {
+        if (parse_tracestate && dd_read_propagation_header(headers, DD_PROPAGATION_HEADER_TRACESTATE, &tracestate)) {
             bool last_comma = true;
             DDTRACE_G(tracestate) = zend_string_alloc(ZSTR_LEN(tracestate), 0);
             char *persist = ZSTR_VAL(DDTRACE_G(tracestate));
@@ -2573,16 +2672,43 @@ void ddtrace_read_distributed_tracing_ids(bool (*read_header)(zai_string_view, c
     }
 }
 
-static bool dd_read_zai_header(zai_string_view zai_header, const char *lowercase_header, zend_string **header_value, void *data) {
-    UNUSED(lowercase_header, data);
-    if (zai_read_header(zai_header, header_value) != ZAI_HEADER_SUCCESS) {
-        return false;
+void ddtrace_read_distributed_tracing_ids(bool (*read_header)(zai_string_view, const char *, zend_string **header_value, void *data), void *data) {
+    dd_propagation_headers headers = { .read_header = read_header, .data = data };
+    dd_extract_distributed_tracing_ids(&headers);
+    dd_release_propagation_headers(&headers);
+}
+
+static void dd_visit_server_header(zai_string_view name, zend_string *value, void *data) {
+    dd_propagation_headers *headers = data;
+    int header = dd_classify_propagation_header(name.ptr, name.len);
+    if (header >= 0 && memcmp(name.ptr, dd_propagation_header_server_names[header], name.len) == 0) {
+        headers->values[header] = zend_string_copy(value);
     }
-    *header_value = zend_string_copy(*header_value);
-    return true;
 }
 
 static void dd_read_distributed_tracing_ids(void) {
-    ddtrace_read_distributed_tracing_ids(dd_read_zai_header, NULL);
+    dd_propagation_headers headers = { .looked_up = DD_PROPAGATION_HEADERS_ALL };
+    zai_visit_headers(dd_visit_server_header, &headers);
+    dd_extract_distributed_tracing_ids(&headers);
+    dd_release_propagation_headers(&headers);
+}
+
+static void dd_read_distributed_tracing_ids_from_array(zend_array *array) {
+    dd_propagation_headers headers = { .looked_up = DD_PROPAGATION_HEADERS_ALL };
+
+    zend_string *key;
+    zval *value;
+    ZEND_HASH_FOREACH_STR_KEY_VAL(array, key, value) {
+        if (!key) {
+            continue;
+        }
+        int header = dd_classify_propagation_header(ZSTR_VAL(key), ZSTR_LEN(key));
+        if (header >= 0 && memcmp(ZSTR_VAL(key), dd_propagation_header_names[header], ZSTR_LEN(key)) == 0) {
+            headers.values[header] = zval_get_string(value);
+        }
+    } ZEND_HASH_FOREACH_END();
+
+    dd_extract_distributed_tracing_ids(&headers);
+    dd_release_propagation_headers(&headers);
 }
 
@@ -125,6 +125,8 @@ ZEND_BEGIN_MODULE_GLOBALS(ddtrace)
 
     zend_long default_priority_sampling;
     zend_long propagated_priority_sampling;
+    uint32_t lightweight_skipped_spans;
+    uint64_t lightweight_skipped_duration;
     ddtrace_span_stack *active_stack; // never NULL except tracer is disabled
     ddtrace_span_stack *top_closed_stack;
     HashTable traced_spans; // tie a span to a specific active execute_data
@@ -1,6 +1,8 @@
 #include "dogstatsd_client.h"
 
 #include <dogstatsd_client/client.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "configuration.h"
 #include "ddtrace.h"
@@ -11,6 +13,26 @@ ZEND_EXTERN_MODULE_GLOBALS(ddtrace);
 #define METRICS_CONST_TAGS "lang:php,lang_version:" PHP_VERSION ",tracer_version:" PHP_DDTRACE_VERSION
 #define DEFAULT_UDS_PATH "/var/run/datadog/dsd.socket"
 
+/*
+ The client outlives requests: the address is resolved and the socket opened once per process (or thread), and only
+ again after DD_DOGSTATSD_URL, DD_AGENT_HOST or DD_DOGSTATSD_PORT changed, after a fork, after sending failed, or once
+ the resolution is older than DD_DOGSTATSD_CLIENT_TTL_SECONDS, so that a moved agent is eventually picked up. A failed
+ resolution is likewise kept for a while instead of being retried by every request.
+*/
+#define DD_DOGSTATSD_CLIENT_TTL_SECONDS 60
+#define DD_DOGSTATSD_CLIENT_RETRY_SECONDS 30
+
+typedef struct {
+    dogstatsd_client client;
+    // persistent copies of the configuration the client was created from, NULL if there is no client
+    zend_string *url, *host, *port;
+    pid_t pid;
+    time_t refresh_at;
+    bool reconnect;
+} dd_dogstatsd_connection;
+
+ZEND_TLS dd_dogstatsd_connection dd_dogstatsd;
+
 void ddtrace_dogstatsd_client_minit(void) { DDTRACE_G(dogstatsd_client) = dogstatsd_client_default_ctor(); }
 
 static void _set_dogstatsd_client_globals(dogstatsd_client client) { DDTRACE_G(dogstatsd_client) = client; }
@@ -29,13 +51,12 @@ static struct addrinfo *dd_alloc_unix_addr(const char *path, size_t len) {
     return addrs;
 }
 
-void ddtrace_dogstatsd_client_rinit(void) {
-    bool health_metrics_enabled = get_DD_TRACE_HEALTH_METRICS_ENABLED();
+static dogstatsd_client dd_dogstatsd_client_connect(zend_string *url_str, zend_string *host_str, zend_string *port_str) {
     dogstatsd_client client = dogstatsd_client_default_ctor();
 
-    while (health_metrics_enabled) {
+    while (true) {
         struct addrinfo *addrs;
-        char *url = ZSTR_VAL(get_DD_DOGSTATSD_URL());
+        char *url = ZSTR_VAL(url_str);
         char *host, *port;
         if (*url) {
             if (strlen(url) > 7 && strncmp("unix://", url, 7) == 0) {
@@ -70,8 +91,8 @@ void ddtrace_dogstatsd_client_rinit(void) {
             host = url;
             port = NULL;
         } else {
-            host = ZSTR_VAL(get_DD_AGENT_HOST());
-            port = ZSTR_VAL(get_DD_DOGSTATSD_PORT());
+            host = ZSTR_VAL(host_str);
+            port = ZSTR_VAL(port_str);
 
             if (!*host) {
                 if (access(DEFAULT_UDS_PATH, F_OK) == SUCCESS) {
@@ -103,6 +124,49 @@ void ddtrace_dogstatsd_client_rinit(void) {
             break;
         }
 
+        break;
+    }
+
+    return client;
+}
+
+static inline bool dd_dogstatsd_config_equals(zend_string *stored, zend_string *current) {
+    return stored && zend_string_equals(stored, current);
+}
+
+static void dd_dogstatsd_disconnect(void) {
+    dogstatsd_client_dtor(&dd_dogstatsd.client);
+    zend_string_release(dd_dogstatsd.url);
+    zend_string_release(dd_dogstatsd.host);
+    zend_string_release(dd_dogstatsd.port);
+    dd_dogstatsd.url = dd_dogstatsd.host = dd_dogstatsd.port = NULL;
+    dd_dogstatsd.reconnect = false;
+}
+
+void ddtrace_dogstatsd_client_rinit(void) {
+    if (!get_DD_TRACE_HEALTH_METRICS_ENABLED()) {
+        return;
+    }
+
+    zend_string *url = get_DD_DOGSTATSD_URL(), *host = get_DD_AGENT_HOST(), *port = get_DD_DOGSTATSD_PORT();
+    if (!dd_dogstatsd_config_equals(dd_dogstatsd.url, url) || !dd_dogstatsd_config_equals(dd_dogstatsd.host, host)
+        || !dd_dogstatsd_config_equals(dd_dogstatsd.port, port) || dd_dogstatsd.reconnect || dd_dogstatsd.pid != getpid()
+        || time(NULL) >= dd_dogstatsd.refresh_at) {
+        if (dd_dogstatsd.url) {
+            dd_dogstatsd_disconnect();
+        }
+
+        dd_dogstatsd.client = dd_dogstatsd_client_connect(url, host, port);
+        dd_dogstatsd.url = zend_string_init(ZSTR_VAL(url), ZSTR_LEN(url), 1);
+        dd_dogstatsd.host = zend_string_init(ZSTR_VAL(host), ZSTR_LEN(host), 1);
+        dd_dogstatsd.port = zend_string_init(ZSTR_VAL(port), ZSTR_LEN(port), 1);
+        dd_dogstatsd.pid = getpid();
+        dd_dogstatsd.refresh_at = time(NULL) + (dogstatsd_client_is_default_client(dd_dogstatsd.client)
+                                                ? DD_DOGSTATSD_CLIENT_RETRY_SECONDS : DD_DOGSTATSD_CLIENT_TTL_SECONDS);
+    }
+
+    dogstatsd_client client = dd_dogstatsd.client;
+    if (!dogstatsd_client_is_default_client(client)) {
         double sample_rate = get_DD_TRACE_HEALTH_METRICS_HEARTBEAT_SAMPLE_RATE();
         const char *metric = "datadog.tracer.heartbeat";
         dogstatsd_metric_t type = DOGSTATSD_METRIC_GAUGE;
@@ -111,14 +175,23 @@ void ddtrace_dogstatsd_client_rinit(void) {
             const char *status_str = dogstatsd_client_status_to_str(status) ?: "(unknown dogstatsd_client_status)";
             ddtrace_log_errf("Health metric '%s' failed to send: %s", metric, status_str);
         }
-
-        break;
+        if (status == DOGSTATSD_CLIENT_EWRITE) {
+            ddtrace_dogstatsd_client_reconnect();
+        }
     }
     _set_dogstatsd_client_globals(client);
 }
 
-void ddtrace_dogstatsd_client_rshutdown(void) {
-    dogstatsd_client_dtor(&DDTRACE_G(dogstatsd_client));
+void ddtrace_dogstatsd_client_reconnect(void) { dd_dogstatsd.reconnect = true; }
 
+void ddtrace_dogstatsd_client_rshutdown(void) {
+    // the client itself is kept for the next request
     _set_dogstatsd_client_globals(dogstatsd_client_default_ctor());
 }
+
+// the client is per thread, hence closed along with the thread's globals rather than once on mshutdown
+void ddtrace_dogstatsd_client_gshutdown(void) {
+    if (dd_dogstatsd.url) {
+        dd_dogstatsd_disconnect();
+    }
+}
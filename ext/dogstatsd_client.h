@@ -6,5 +6,8 @@
 void ddtrace_dogstatsd_client_minit(void);
 void ddtrace_dogstatsd_client_rinit(void);
 void ddtrace_dogstatsd_client_rshutdown(void);
+void ddtrace_dogstatsd_client_gshutdown(void);
+// Reopens the client on the next request, after a send failed
+void ddtrace_dogstatsd_client_reconnect(void);
 
 #endif  // DDTRACE_DOGSTATSD_CLIENT_H
@@ -0,0 +1,291 @@
+#include "dynamic_config.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "configuration.h"
+#include "logging.h"
+
+#define DD_DYNAMIC_CONFIG_MAX_FILE_SIZE (1024 * 1024)
+
+/*
+ The background sender polls the file and splits it into NAME=value pairs off the request path, then publishes them as
+ an immutable, reference counted generation. Each thread holds a reference to the generation it last picked up, hence
+ comparing it with the published pointer is enough to tell whether there is a newer one; retired generations are freed
+ along with their last reference.
+
+ The values are applied to each request like ini_set() at its start: through the ini entries, so that the ini_change
+ callbacks and ini_get() behave just as for any other runtime change, and PHP reverts them at request end. Nothing
+ shared by the process is modified, thus requests of other threads are never affected while running. Each thread
+ decodes the values once when picking up a generation and hands them to the config as predecoded, so that requests
+ share the same values and caches compiled from them (e.g. sampling rules) survive until the next generation.
+*/
+typedef enum {
+    DD_DYNAMIC_CONFIG_APPLY,
+    DD_DYNAMIC_CONFIG_UNKNOWN,
+    DD_DYNAMIC_CONFIG_SYSTEM,
+} dd_dynamic_config_entry_kind;
+
+typedef struct {
+    _Atomic(uint32_t) refcount;
+    uint32_t number;
+    uint32_t count;
+    struct {
+        zend_string *name;
+        zend_string *value;
+        zai_config_id id;
+        dd_dynamic_config_entry_kind kind;
+    } entries[];
+} dd_dynamic_config_generation;
+
+// written with dd_dynamic_config_mutex held, which must also be held to acquire a reference to it
+static _Atomic(dd_dynamic_config_generation *) dd_dynamic_config_published;
+static pthread_mutex_t dd_dynamic_config_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// only accessed by the background sender
+static struct stat dd_dynamic_config_file_stat;
+static bool dd_dynamic_config_file_exists;
+static uint32_t dd_dynamic_config_last_number;
+
+ZEND_TLS dd_dynamic_config_generation *dd_dynamic_config_current = NULL;
+// values of dd_dynamic_config_current decoded by this thread, IS_UNDEF for entries not applied
+ZEND_TLS zval *dd_dynamic_config_decoded = NULL;
+
+#if defined(__APPLE__) && defined(__MACH__)
+#define st_mtim st_mtimespec
+#define st_ctim st_ctimespec
+#endif
+
+static inline bool dd_dynamic_config_timespec_equals(struct timespec *a, struct timespec *b) {
+    return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+// a file rewritten within the same second must still be picked up, hence the nanoseconds are compared as well
+static bool dd_dynamic_config_file_changed(struct stat *st) {
+    return st->st_ino != dd_dynamic_config_file_stat.st_ino || st->st_size != dd_dynamic_config_file_stat.st_size
+        || !dd_dynamic_config_timespec_equals(&st->st_mtim, &dd_dynamic_config_file_stat.st_mtim)
+        || !dd_dynamic_config_timespec_equals(&st->st_ctim, &dd_dynamic_config_file_stat.st_ctim);
+}
+
+static inline bool dd_dynamic_config_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static void dd_dynamic_config_release(dd_dynamic_config_generation *generation) {
+    if (!generation || atomic_fetch_sub_explicit(&generation->refcount, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < generation->count; ++i) {
+        zend_string_release(generation->entries[i].name);
+        zend_string_release(generation->entries[i].value);
+    }
+    free(generation);
+}
+
+static dd_dynamic_config_generation *dd_dynamic_config_parse(char *contents, size_t len) {
+    uint32_t lines = 1;
+    for (size_t i = 0; i < len; ++i) {
+        lines += contents[i] == '\n';
+    }
+
+    dd_dynamic_config_generation *generation = malloc(sizeof(*generation) + lines * sizeof(generation->entries[0]));
+    atomic_init(&generation->refcount, 1);
+    generation->number = ++dd_dynamic_config_last_number;
+    generation->count = 0;
+
+    for (char *line = contents, *end = contents + len, *eol; line < end; line = eol + 1) {
+        if (!(eol = memchr(line, '\n', end - line))) {
+            eol = end;
+        }
+
+        char *name = line;
+        while (name < eol && dd_dynamic_config_is_space(*name)) {
+            ++name;
+        }
+        char *equals = memchr(name, '=', eol - name);
+        if (name == eol || *name == '#' || *name == ';' || !equals) {
+            continue;
+        }
+
+        char *name_end = equals, *value = equals + 1, *value_end = eol;
+        while (name_end > name && dd_dynamic_config_is_space(name_end[-1])) {
+            --name_end;
+        }
+        while (value < value_end && dd_dynamic_config_is_space(*value)) {
+            ++value;
+        }
+        while (value_end > value && dd_dynamic_config_is_space(value_end[-1])) {
+            --value_end;
+        }
+        if (name_end == name) {
+            continue;
+        }
+
+        zend_string *name_str = zend_string_init(name, name_end - name, 1);
+        zai_config_id id = 0;
+        dd_dynamic_config_entry_kind kind = DD_DYNAMIC_CONFIG_APPLY;
+        // the name map is read-only after minit
+        if (!zai_config_get_id_by_name(ZAI_STRING_FROM_ZSTR(name_str), &id)) {
+            kind = DD_DYNAMIC_CONFIG_UNKNOWN;
+        } else if (zai_config_memoized_entries[id].ini_change == zai_config_system_ini_change) {
+            kind = DD_DYNAMIC_CONFIG_SYSTEM;
+        }
+
+        generation->entries[generation->count].name = name_str;
+        generation->entries[generation->count].value = zend_string_init(value, value_end - value, 1);
+        generation->entries[generation->count].id = id;
+        generation->entries[generation->count].kind = kind;
+        ++generation->count;
+    }
+
+    return generation;
+}
+
+static void dd_dynamic_config_publish(dd_dynamic_config_generation *generation) {
+    pthread_mutex_lock(&dd_dynamic_config_mutex);
+    dd_dynamic_config_generation *retired = atomic_exchange_explicit(&dd_dynamic_config_published, generation, memory_order_release);
+    pthread_mutex_unlock(&dd_dynamic_config_mutex);
+    dd_dynamic_config_release(retired);
+}
+
+void ddtrace_dynamic_config_poll(void) {
+    zend_string *path = get_global_DD_TRACE_DYNAMIC_CONFIG_FILE();
+    if (!ZSTR_LEN(path)) {
+        return;
+    }
+
+    struct stat st;
+    bool exists = stat(ZSTR_VAL(path), &st) == 0;
+    if (exists == dd_dynamic_config_file_exists && (!exists || !dd_dynamic_config_file_changed(&st))) {
+        return;
+    }
+
+    // a removed file reverts all settings of the previous generation
+    dd_dynamic_config_generation *generation = NULL;
+    if (exists) {
+        if (st.st_size > DD_DYNAMIC_CONFIG_MAX_FILE_SIZE) {
+            return;
+        }
+
+        FILE *file = fopen(ZSTR_VAL(path), "r");
+        if (!file) {
+            return;
+        }
+        char *contents = malloc(st.st_size + 1);
+        size_t len = fread(contents, 1, st.st_size, file);
+        fclose(file);
+
+        generation = dd_dynamic_config_parse(contents, len);
+        free(contents);
+    }
+
+    dd_dynamic_config_file_exists = exists;
+    if (exists) {
+        dd_dynamic_config_file_stat = st;
+    }
+
+    dd_dynamic_config_publish(generation);
+}
+
+static void dd_dynamic_config_free_decoded(void) {
+    dd_dynamic_config_generation *generation = dd_dynamic_config_current;
+    if (!dd_dynamic_config_decoded) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < generation->count; ++i) {
+        if (!Z_ISUNDEF(dd_dynamic_config_decoded[i])) {
+            zai_config_set_predecoded_value(generation->entries[i].id, NULL, NULL);
+            zai_config_dtor_pzval(&dd_dynamic_config_decoded[i]);
+        }
+    }
+    free(dd_dynamic_config_decoded);
+    dd_dynamic_config_decoded = NULL;
+}
+
+// problems are only logged here, once per generation and thread, not on every request
+static void dd_dynamic_config_decode(dd_dynamic_config_generation *generation) {
+    zend_string *path = get_global_DD_TRACE_DYNAMIC_CONFIG_FILE();
+    dd_dynamic_config_decoded = malloc(generation->count * sizeof(zval));
+
+    for (uint32_t i = 0; i < generation->count; ++i) {
+        zval *decoded = &dd_dynamic_config_decoded[i];
+        ZVAL_UNDEF(decoded);
+
+        zend_string *name = generation->entries[i].name, *value = generation->entries[i].value;
+        switch (generation->entries[i].kind) {
+            case DD_DYNAMIC_CONFIG_UNKNOWN:
+                ddtrace_log_errf("Ignoring unknown setting '%s' in %s", ZSTR_VAL(name), ZSTR_VAL(path));
+                continue;
+            case DD_DYNAMIC_CONFIG_SYSTEM:
+                ddtrace_log_errf("Ignoring '%s' in %s, it can only be changed on startup", ZSTR_VAL(name), ZSTR_VAL(path));
+                continue;
+            case DD_DYNAMIC_CONFIG_APPLY:
+                break;
+        }
+
+        zai_config_memoized_entry *memoized = &zai_config_memoized_entries[generation->entries[i].id];
+        if (!zai_config_decode_value(ZAI_STRING_FROM_ZSTR(value), memoized->type, memoized->parser, decoded, /* persistent */ true)) {
+            ZVAL_UNDEF(decoded);
+            ddtrace_log_errf("Ignoring invalid value '%s' for %s in %s", ZSTR_VAL(value), ZSTR_VAL(name), ZSTR_VAL(path));
+            continue;
+        }
+        zai_config_set_predecoded_value(generation->entries[i].id, value, decoded);
+    }
+}
+
+void ddtrace_dynamic_config_rinit(void) {
+    dd_dynamic_config_generation *generation = dd_dynamic_config_current;
+    // the generation held by this thread cannot be freed, hence neither can its address be reused by a newer one
+    if (atomic_load_explicit(&dd_dynamic_config_published, memory_order_acquire) != generation) {
+        pthread_mutex_lock(&dd_dynamic_config_mutex);
+        generation = atomic_load_explicit(&dd_dynamic_config_published, memory_order_acquire);
+        if (generation) {
+            atomic_fetch_add_explicit(&generation->refcount, 1, memory_order_relaxed);
+        }
+        pthread_mutex_unlock(&dd_dynamic_config_mutex);
+
+        dd_dynamic_config_free_decoded();
+        dd_dynamic_config_release(dd_dynamic_config_current);
+        dd_dynamic_config_current = generation;
+        if (generation) {
+            dd_dynamic_config_decode(generation);
+        }
+    }
+
+    if (!generation) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < generation->count; ++i) {
+        if (Z_ISUNDEF(dd_dynamic_config_decoded[i])) {
+            continue;
+        }
+
+        // the generation is shared across threads, thus its strings must not be refcounted by the request
+        zend_string *value = zend_string_init(ZSTR_VAL(generation->entries[i].value), ZSTR_LEN(generation->entries[i].value), 0);
+        zend_ini_entry *ini = zai_config_memoized_entries[generation->entries[i].id].ini_entries[0];
+        zend_alter_ini_entry_ex(ini->name, value, PHP_INI_USER, PHP_INI_STAGE_RUNTIME, 0);
+        zend_string_release(value);
+    }
+}
+
+uint32_t ddtrace_dynamic_config_generation(void) {
+    return dd_dynamic_config_current ? dd_dynamic_config_current->number : 0;
+}
+
+void ddtrace_dynamic_config_gshutdown(void) {
+    dd_dynamic_config_free_decoded();
+    dd_dynamic_config_release(dd_dynamic_config_current);
+    dd_dynamic_config_current = NULL;
+}
+
+void ddtrace_dynamic_config_mshutdown(void) {
+    dd_dynamic_config_publish(NULL);
+    dd_dynamic_config_file_exists = false;
+}
@@ -0,0 +1,23 @@
+#ifndef DDTRACE_DYNAMIC_CONFIG_H
+#define DDTRACE_DYNAMIC_CONFIG_H
+
+#include <stdint.h>
+
+/* Configuration overrides read from DD_TRACE_DYNAMIC_CONFIG_FILE, one NAME=value per line, where NAME is either the
+ * environment variable or the INI name of a setting. Empty lines and lines starting with '#' or ';' are ignored.
+ * Changes to the file are applied to the following requests, without restarting the process; removing a setting or
+ * the whole file reverts to the value the process started with. Settings which can only be changed on startup are
+ * ignored. The overrides take precedence over the environment and per-directory INI, but not over ini_set(). */
+
+// Called from the background sender on each cycle, reads the file if it changed
+void ddtrace_dynamic_config_poll(void);
+
+// Applies the latest published generation like ini_set(), must run after zai_config_rinit()
+void ddtrace_dynamic_config_rinit(void);
+// Number of the generation applied to the requests of this thread, 0 if none. Values decoded from it keep their address
+// until the number changes, thus caches compiled from them are valid as long as it does not.
+uint32_t ddtrace_dynamic_config_generation(void);
+void ddtrace_dynamic_config_gshutdown(void);
+void ddtrace_dynamic_config_mshutdown(void);
+
+#endif  // DDTRACE_DYNAMIC_CONFIG_H
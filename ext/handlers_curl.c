@@ -12,6 +12,7 @@ __attribute__((weak)) zend_class_entry *curl_multi_ce = NULL;
 #include "engine_hooks.h"  // for ddtrace_backup_error_handling
 #include "handlers_http.h"
 #include "handlers_internal.h"
+#include "integrations/overhead.h"
 #include "logging.h"
 
 // True global - only modify during MINIT/MSHUTDOWN
@@ -68,17 +69,22 @@ static void dd_ch_duplicate_headers(zend_object *ch_orig, zend_object *ch_new) {
     }
 }
 
-static void dd_inject_distributed_tracing_headers(zend_object *ch) {
+static void dd_inject_distributed_tracing_headers(zend_object *ch, zend_array *distributed_headers) {
     zval headers;
     zend_array *dd_header_array;
     if ((dd_header_array = zend_hash_index_find_ptr(&dd_headers, zend_object_to_weakref_key(ch)))) {
         ZVAL_ARR(&headers, zend_array_dup(dd_header_array));
+        zval *header;
+        ZEND_HASH_FOREACH_VAL(distributed_headers, header) {
+            Z_TRY_ADDREF_P(header);
+            zend_hash_next_index_insert_new(Z_ARR(headers), header);
+        } ZEND_HASH_FOREACH_END();
     } else {
-        array_init(&headers);
+        // curl_setopt() only reads the array, so handles without own headers all share the formatted one
+        GC_ADDREF(distributed_headers);
+        ZVAL_ARR(&headers, distributed_headers);
     }
 
-    ddtrace_inject_distributed_headers(Z_ARR(headers), false);
-
     zend_function *setopt_fn = zend_hash_str_find_ptr(EG(function_table), ZEND_STRL("curl_setopt"));
 
     // avoiding going through our own function, directly calling curl_setopt
@@ -124,10 +130,15 @@ static void dd_multi_inject_headers(zend_object *mh) {
     HashTable *handles = zend_hash_index_find_ptr(&dd_multi_handles, zend_object_to_weakref_key(mh));
 
     if (handles && zend_hash_num_elements(handles) > 0) {
+        zend_array *distributed_headers = ddtrace_distributed_headers_memoized_lines();
+        GC_ADDREF(distributed_headers);
+
         zend_object *ch;
-        ZEND_HASH_FOREACH_PTR(handles, ch) { dd_inject_distributed_tracing_headers(ch); }
+        ZEND_HASH_FOREACH_PTR(handles, ch) { dd_inject_distributed_tracing_headers(ch, distributed_headers); }
         ZEND_HASH_FOREACH_END();
 
+        zend_array_release(distributed_headers);
+
         zend_weakrefs_hash_del(&dd_multi_handles, mh);
     }
 }
@@ -186,7 +197,9 @@ ZEND_FUNCTION(ddtrace_curl_exec) {
 
     if (dd_load_curl_integration() && ddtrace_peek_span_id() != 0 &&
         zend_parse_parameters_ex(ZEND_PARSE_PARAMS_QUIET, ZEND_NUM_ARGS(), "O", &ch, curl_ce) == SUCCESS) {
-        dd_inject_distributed_tracing_headers(Z_OBJ_P(ch));
+        uint64_t overhead_start = ddtrace_integration_overhead_start(DDTRACE_INTEGRATION_CURL);
+        dd_inject_distributed_tracing_headers(Z_OBJ_P(ch), ddtrace_distributed_headers_memoized_lines());
+        ddtrace_integration_overhead_stop(DDTRACE_INTEGRATION_CURL, overhead_start);
     }
 
     dd_curl_exec_handler(INTERNAL_FUNCTION_PARAM_PASSTHRU);
@@ -222,7 +235,9 @@ ZEND_FUNCTION(ddtrace_curl_multi_exec) {
     if (dd_load_curl_integration() && ddtrace_peek_span_id() != 0 &&
         zend_parse_parameters_ex(ZEND_PARSE_PARAMS_QUIET, ZEND_NUM_ARGS(), "Oz", &z_mh, curl_multi_ce,
                                  &z_still_running) == SUCCESS) {
+        uint64_t overhead_start = ddtrace_integration_overhead_start(DDTRACE_INTEGRATION_CURL);
         dd_multi_inject_headers(Z_OBJ_P(z_mh));
+        ddtrace_integration_overhead_stop(DDTRACE_INTEGRATION_CURL, overhead_start);
     }
 
     dd_curl_multi_exec_handler(INTERNAL_FUNCTION_PARAM_PASSTHRU);
@@ -0,0 +1,125 @@
+#include "handlers_db.h"
+
+#include <php.h>
+#include <stdbool.h>
+
+#include <ext/standard/php_string.h>
+
+#include "configuration.h"
+#include "ddtrace.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(ddtrace);
+
+ZEND_TLS zend_array *dd_db_peer_service_sources;
+
+zend_string *ddtrace_db_service_name(const char *fallback, size_t fallback_len) {
+    if (get_DD_TRACE_REMOVE_INTEGRATION_SERVICE_NAMES_ENABLED()) {
+        ddtrace_span_data *root_span = DDTRACE_G(active_stack) ? DDTRACE_G(active_stack)->root_span : NULL;
+        if (root_span) {
+            return zval_get_string(ddtrace_spandata_property_service(root_span));
+        }
+        if (ZSTR_LEN(get_DD_SERVICE())) {
+            return php_trim(get_DD_SERVICE(), NULL, 0, 3);
+        }
+    }
+    return zend_string_init(fallback, fallback_len, 0);
+}
+
+void ddtrace_db_append_normalized_host(smart_str *buf, zend_string *host) {
+    const char *start = ZSTR_VAL(host), *end = start + ZSTR_LEN(host);
+    for (const char *p = start; p + 3 <= end; ++p) {
+        if (p[0] == ':' && p[1] == '/' && p[2] == '/') {
+            start = p + 3;
+        }
+    }
+
+    // spaces are dropped, runs of other disallowed chars become a single dash, leading and trailing dashes are trimmed
+    bool pending_dash = false, empty = true;
+    for (const char *p = start; p < end; ++p) {
+        char c = *p;
+        if (c == ' ') {
+            continue;
+        }
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '_') {
+            if (pending_dash && !empty) {
+                smart_str_appendc(buf, '-');
+            }
+            pending_dash = false;
+            empty = false;
+            smart_str_appendc(buf, c);
+        } else {
+            pending_dash = true;
+        }
+    }
+}
+
+void ddtrace_db_set_peer_service_sources(ddtrace_span_data *span) {
+    if (!dd_db_peer_service_sources) {
+        static const char *sources[] = {"db.instance", "db.name", "mongodb.db", "_dd.cluster.name", "_dd.first.configured.host", "out.host"};
+        dd_db_peer_service_sources = zend_new_array(sizeof(sources) / sizeof(sources[0]));
+        for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); ++i) {
+            zval zv;
+            ZVAL_STRING(&zv, sources[i]);
+            zend_hash_next_index_insert_new(dd_db_peer_service_sources, &zv);
+        }
+    }
+
+    zval *prop = ddtrace_spandata_property_peerServiceSources_zval(span);
+    zval_ptr_dtor(prop);
+    GC_ADDREF(dd_db_peer_service_sources);
+    ZVAL_ARR(prop, dd_db_peer_service_sources);
+}
+
+void ddtrace_db_add_analytics(ddtrace_span_data *span, bool enabled, double sample_rate) {
+    if (enabled) {
+        ddtrace_db_add_metric(span, ZEND_STRL("_dd1.sr.eausr"), sample_rate);
+    }
+}
+
+void ddtrace_db_set_property(zval *prop, const char *str, size_t len) {
+    zval_ptr_dtor(prop);
+    ZVAL_STRINGL(prop, str, len);
+}
+
+void ddtrace_db_add_meta(ddtrace_span_data *span, const char *tag, size_t tag_len, const char *value, size_t value_len) {
+    zval zv;
+    ZVAL_STRINGL(&zv, value, value_len);
+    zend_hash_str_update(ddtrace_spandata_property_meta(span), tag, tag_len, &zv);
+}
+
+void ddtrace_db_add_meta_str(ddtrace_span_data *span, const char *tag, size_t tag_len, zend_string *value) {
+    zval zv;
+    ZVAL_STR_COPY(&zv, value);
+    zend_hash_str_update(ddtrace_spandata_property_meta(span), tag, tag_len, &zv);
+}
+
+void ddtrace_db_add_metric(ddtrace_span_data *span, const char *metric, size_t metric_len, double value) {
+    zval zv;
+    ZVAL_DOUBLE(&zv, value);
+    zend_hash_str_update(ddtrace_spandata_property_metrics(span), metric, metric_len, &zv);
+}
+
+void ddtrace_db_close_span(zend_ulong invocation, ddtrace_span_data *span) {
+    if (span->duration == DDTRACE_DROPPED_SPAN) {
+        ddtrace_clear_execute_data_span(invocation, false);
+        return;
+    }
+
+    if (span->duration != DDTRACE_SILENTLY_DROPPED_SPAN) {
+        zval *exception_zv = ddtrace_spandata_property_exception(span);
+        if (EG(exception) && Z_TYPE_P(exception_zv) <= IS_FALSE) {
+            ZVAL_OBJ_COPY(exception_zv, EG(exception));
+        }
+
+        dd_trace_stop_span_time(span);
+    }
+
+    ddtrace_clear_execute_data_span(invocation, true);
+}
+
+void ddtrace_db_handlers_rshutdown(void) {
+    if (dd_db_peer_service_sources) {
+        zend_array_release(dd_db_peer_service_sources);
+        dd_db_peer_service_sources = NULL;
+    }
+}
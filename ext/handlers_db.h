@@ -0,0 +1,33 @@
+#ifndef DD_HANDLERS_DB_H
+#define DD_HANDLERS_DB_H
+
+#include <php.h>
+#include <Zend/zend_smart_str.h>
+
+#include "span.h"
+
+/* Helpers shared by the native client integrations (PDO, phpredis, memcached), mirroring the userland helpers
+ * of DDTrace\Integrations\Integration and DatabaseIntegrationHelper. */
+
+// Mirrors Integration::handleInternalSpanServiceName()
+zend_string *ddtrace_db_service_name(const char *fallback, size_t fallback_len);
+// Mirrors Normalizer::normalizeHostUdsAsService()
+void ddtrace_db_append_normalized_host(smart_str *buf, zend_string *host);
+void ddtrace_db_set_peer_service_sources(ddtrace_span_data *span);
+void ddtrace_db_add_analytics(ddtrace_span_data *span, bool enabled, double sample_rate);
+
+void ddtrace_db_set_property(zval *prop, const char *str, size_t len);
+static inline void ddtrace_db_set_property_str(zval *prop, zend_string *str) {
+    zval_ptr_dtor(prop);
+    ZVAL_STR(prop, str);
+}
+void ddtrace_db_add_meta(ddtrace_span_data *span, const char *tag, size_t tag_len, const char *value, size_t value_len);
+void ddtrace_db_add_meta_str(ddtrace_span_data *span, const char *tag, size_t tag_len, zend_string *value);
+void ddtrace_db_add_metric(ddtrace_span_data *span, const char *metric, size_t metric_len, double value);
+
+// Finishes a span opened with ddtrace_alloc_execute_data_span() from a begin hook
+void ddtrace_db_close_span(zend_ulong invocation, ddtrace_span_data *span);
+
+void ddtrace_db_handlers_rshutdown(void);
+
+#endif  // DD_HANDLERS_DB_H
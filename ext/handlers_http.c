@@ -0,0 +1,151 @@
+#include "handlers_http.h"
+
+/*
+ Outgoing distributed tracing headers only depend on the propagation context, which rarely changes while a span is
+ active. They are formatted once into an array of header name => value and then reused for as long as the context
+ matches. Rather than hooking every place able to change the propagated tags (including userland writes to the root
+ span meta), the memo keeps references to the inputs it was formatted from and compares them by identity, which is
+ much cheaper than formatting.
+*/
+ZEND_TLS struct {
+    zend_array *headers;
+    zend_array *lines;  // the same headers as "name: value" list, formatted on first use
+    zend_array *inject;
+    ddtrace_span_data *root_span;
+    ddtrace_trace_id trace_id;
+    uint64_t span_id;
+    zend_long sampling_priority;
+    zend_long tags_max_length;
+    zend_string *origin;
+    zend_string *tracestate;
+    HashTable tags;  // propagated tag name => value at formatting time, NULL if the tag was not set
+} dd_distributed_headers_memo;
+
+static zend_array *dd_propagated_tags_source(void) {
+    ddtrace_span_data *span = DDTRACE_G(active_stack)->root_span;
+    return span ? ddtrace_spandata_property_meta(span) : &DDTRACE_G(root_span_tags_preset);
+}
+
+static void dd_distributed_headers_memo_clear(void) {
+    if (!dd_distributed_headers_memo.headers) {
+        return;
+    }
+
+    zend_array_release(dd_distributed_headers_memo.headers);
+    dd_distributed_headers_memo.headers = NULL;
+    if (dd_distributed_headers_memo.lines) {
+        zend_array_release(dd_distributed_headers_memo.lines);
+        dd_distributed_headers_memo.lines = NULL;
+    }
+    if (dd_distributed_headers_memo.origin) {
+        zend_string_release(dd_distributed_headers_memo.origin);
+    }
+    if (dd_distributed_headers_memo.tracestate) {
+        zend_string_release(dd_distributed_headers_memo.tracestate);
+    }
+    zend_hash_destroy(&dd_distributed_headers_memo.tags);
+}
+
+static bool dd_distributed_headers_memo_valid(zend_array *inject, zend_long sampling_priority) {
+    if (!dd_distributed_headers_memo.headers
+        || dd_distributed_headers_memo.inject != inject
+        || dd_distributed_headers_memo.root_span != DDTRACE_G(active_stack)->root_span
+        || dd_distributed_headers_memo.span_id != ddtrace_peek_span_id()
+        || dd_distributed_headers_memo.sampling_priority != sampling_priority
+        || dd_distributed_headers_memo.tags_max_length != get_DD_TRACE_X_DATADOG_TAGS_MAX_LENGTH()
+        || dd_distributed_headers_memo.origin != DDTRACE_G(dd_origin)
+        || dd_distributed_headers_memo.tracestate != DDTRACE_G(tracestate)) {
+        return false;
+    }
+
+    ddtrace_trace_id trace_id = ddtrace_peek_trace_id();
+    if (dd_distributed_headers_memo.trace_id.low != trace_id.low || dd_distributed_headers_memo.trace_id.high != trace_id.high) {
+        return false;
+    }
+
+    // formatting adds _dd.p.dm to the propagated tags, hence compare against the set as it is after formatting
+    if (zend_hash_num_elements(&DDTRACE_G(propagated_root_span_tags)) != zend_hash_num_elements(&dd_distributed_headers_memo.tags)) {
+        return false;
+    }
+
+    zend_array *tags = dd_propagated_tags_source();
+    zend_string *tagname;
+    ZEND_HASH_FOREACH_STR_KEY(&DDTRACE_G(propagated_root_span_tags), tagname) {
+        zval *formatted = zend_hash_find(&dd_distributed_headers_memo.tags, tagname);
+        if (!formatted) {
+            return false;
+        }
+        zval *tag = zend_hash_find(tags, tagname);
+        if (Z_TYPE_P(formatted) == IS_NULL ? tag != NULL : !tag || !zend_is_identical(formatted, tag)) {
+            return false;
+        }
+    } ZEND_HASH_FOREACH_END();
+
+    return true;
+}
+
+zend_array *ddtrace_distributed_headers_memoized(zend_array *inject) {
+    // may take the sampling decision, so do this before anything else
+    zend_long sampling_priority = ddtrace_fetch_prioritySampling_from_root();
+
+    if (dd_distributed_headers_memo_valid(inject, sampling_priority)) {
+        return dd_distributed_headers_memo.headers;
+    }
+
+    dd_distributed_headers_memo_clear();
+
+    zend_array *headers = zend_new_array(8);
+    ddtrace_inject_distributed_headers_config(headers, true, inject);
+
+    dd_distributed_headers_memo.headers = headers;
+    dd_distributed_headers_memo.inject = inject;
+    dd_distributed_headers_memo.root_span = DDTRACE_G(active_stack)->root_span;
+    dd_distributed_headers_memo.trace_id = ddtrace_peek_trace_id();
+    dd_distributed_headers_memo.span_id = ddtrace_peek_span_id();
+    dd_distributed_headers_memo.sampling_priority = sampling_priority;
+    dd_distributed_headers_memo.tags_max_length = get_DD_TRACE_X_DATADOG_TAGS_MAX_LENGTH();
+    dd_distributed_headers_memo.origin = DDTRACE_G(dd_origin) ? zend_string_copy(DDTRACE_G(dd_origin)) : NULL;
+    dd_distributed_headers_memo.tracestate = DDTRACE_G(tracestate) ? zend_string_copy(DDTRACE_G(tracestate)) : NULL;
+
+    // holding references to the values guarantees that a changed value cannot reuse the address of the old one
+    zend_hash_init(&dd_distributed_headers_memo.tags, zend_hash_num_elements(&DDTRACE_G(propagated_root_span_tags)), NULL, ZVAL_PTR_DTOR, 0);
+    zend_array *tags = dd_propagated_tags_source();
+    zend_string *tagname;
+    ZEND_HASH_FOREACH_STR_KEY(&DDTRACE_G(propagated_root_span_tags), tagname) {
+        zval *tag = zend_hash_find(tags, tagname), copy;
+        if (tag) {
+            ZVAL_COPY(&copy, tag);
+        } else {
+            ZVAL_NULL(&copy);
+        }
+        zend_hash_add_new(&dd_distributed_headers_memo.tags, tagname, &copy);
+    } ZEND_HASH_FOREACH_END();
+
+    return headers;
+}
+
+zend_array *ddtrace_distributed_headers_memoized_default(void) {
+    return ddtrace_distributed_headers_memoized(ddtrace_inject_distributed_headers_styles());
+}
+
+zend_array *ddtrace_distributed_headers_memoized_lines(void) {
+    zend_array *headers = ddtrace_distributed_headers_memoized_default();
+    if (dd_distributed_headers_memo.lines) {
+        return dd_distributed_headers_memo.lines;
+    }
+
+    zend_array *lines = zend_new_array(zend_hash_num_elements(headers));
+    zend_string *header;
+    zval *value;
+    ZEND_HASH_FOREACH_STR_KEY_VAL(headers, header, value) {
+        zval line;
+        ZVAL_STR(&line, zend_strpprintf(0, "%s: %s", ZSTR_VAL(header), Z_STRVAL_P(value)));
+        zend_hash_next_index_insert_new(lines, &line);
+    } ZEND_HASH_FOREACH_END();
+
+    return dd_distributed_headers_memo.lines = lines;
+}
+
+void ddtrace_distributed_headers_memo_rshutdown(void) {
+    dd_distributed_headers_memo_clear();
+}
@@ -183,9 +183,32 @@ static inline void ddtrace_inject_distributed_headers_config(zend_array *array,
 #undef ADD_HEADER
 }
 
+static inline zend_array *ddtrace_inject_distributed_headers_styles(void) {
+    return zai_config_is_modified(DDTRACE_CONFIG_DD_TRACE_PROPAGATION_STYLE)
+           && !zai_config_is_modified(DDTRACE_CONFIG_DD_TRACE_PROPAGATION_STYLE_INJECT)
+           ? get_DD_TRACE_PROPAGATION_STYLE() : get_DD_TRACE_PROPAGATION_STYLE_INJECT();
+}
+
+// Returns the header name => value array for the current propagation context, borrowed and not to be modified
+zend_array *ddtrace_distributed_headers_memoized(zend_array *inject);
+zend_array *ddtrace_distributed_headers_memoized_default(void);
+// Same as a list of "name: value" lines, as taken by CURLOPT_HTTPHEADER
+zend_array *ddtrace_distributed_headers_memoized_lines(void);
+void ddtrace_distributed_headers_memo_rshutdown(void);
+
 static inline void ddtrace_inject_distributed_headers(zend_array *array, bool key_value_pairs) {
-    zend_array *inject = zai_config_is_modified(DDTRACE_CONFIG_DD_TRACE_PROPAGATION_STYLE)
-                         && !zai_config_is_modified(DDTRACE_CONFIG_DD_TRACE_PROPAGATION_STYLE_INJECT)
-                         ? get_DD_TRACE_PROPAGATION_STYLE() : get_DD_TRACE_PROPAGATION_STYLE_INJECT();
-    ddtrace_inject_distributed_headers_config(array, key_value_pairs, inject);
+    zval *value;
+    if (!key_value_pairs) {
+        ZEND_HASH_FOREACH_VAL(ddtrace_distributed_headers_memoized_lines(), value) {
+            Z_ADDREF_P(value);
+            zend_hash_next_index_insert_new(array, value);
+        } ZEND_HASH_FOREACH_END();
+        return;
+    }
+
+    zend_string *header;
+    ZEND_HASH_FOREACH_STR_KEY_VAL(ddtrace_distributed_headers_memoized_default(), header, value) {
+        Z_ADDREF_P(value);
+        zend_hash_update(array, header, value);
+    } ZEND_HASH_FOREACH_END();
 }
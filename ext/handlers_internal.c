@@ -29,6 +29,11 @@ void ddtrace_free_unregistered_class(zend_class_entry *ce) {
 void ddtrace_curl_handlers_startup(void);
 void ddtrace_exception_handlers_startup(void);
 void ddtrace_pcntl_handlers_startup(void);
+#if PHP_VERSION_ID >= 80000
+void ddtrace_memcached_handlers_startup(void);
+void ddtrace_pdo_handlers_startup(void);
+void ddtrace_redis_handlers_startup(void);
+#endif
 
 #if PHP_VERSION_ID >= 80000 && PHP_VERSION_ID < 80200
 #include <hook/hook.h>
@@ -118,8 +123,19 @@ void ddtrace_exception_handlers_shutdown(void);
 
 void ddtrace_curl_handlers_rinit(void);
 void ddtrace_exception_handlers_rinit(void);
+#if PHP_VERSION_ID >= 80000
+void ddtrace_memcached_handlers_rinit(void);
+void ddtrace_pdo_handlers_rinit(void);
+void ddtrace_redis_handlers_rinit(void);
+#endif
 
 void ddtrace_curl_handlers_rshutdown(void);
+#if PHP_VERSION_ID >= 80000
+void ddtrace_db_handlers_rshutdown(void);
+void ddtrace_memcached_handlers_rshutdown(void);
+void ddtrace_pdo_handlers_rshutdown(void);
+void ddtrace_redis_handlers_rshutdown(void);
+#endif
 
 void ddtrace_internal_handlers_startup(void) {
     // On PHP 8.0 zend_execute_internal is not executed in JIT. Manually ensure internal hooks are executed.
@@ -137,6 +153,12 @@ void ddtrace_internal_handlers_startup(void) {
     ddtrace_curl_handlers_startup();
     // pcntl handlers have to run even if tracing of pcntl extension is not enabled.
     ddtrace_pcntl_handlers_startup();
+#if PHP_VERSION_ID >= 80000
+    // PDO, phpredis and memcached are instrumented natively on PHP 8, the userland integrations are only used on PHP 7.
+    ddtrace_memcached_handlers_startup();
+    ddtrace_pdo_handlers_startup();
+    ddtrace_redis_handlers_startup();
+#endif
     // exception handlers have to run otherwise wrapping will fail horribly
     ddtrace_exception_handlers_startup();
 }
@@ -155,6 +177,19 @@ void ddtrace_internal_handlers_shutdown(void) {
 void ddtrace_internal_handlers_rinit(void) {
     ddtrace_curl_handlers_rinit();
     ddtrace_exception_handlers_rinit();
+#if PHP_VERSION_ID >= 80000
+    ddtrace_memcached_handlers_rinit();
+    ddtrace_pdo_handlers_rinit();
+    ddtrace_redis_handlers_rinit();
+#endif
 }
 
-void ddtrace_internal_handlers_rshutdown(void) { ddtrace_curl_handlers_rshutdown(); }
+void ddtrace_internal_handlers_rshutdown(void) {
+    ddtrace_curl_handlers_rshutdown();
+#if PHP_VERSION_ID >= 80000
+    ddtrace_memcached_handlers_rshutdown();
+    ddtrace_pdo_handlers_rshutdown();
+    ddtrace_redis_handlers_rshutdown();
+    ddtrace_db_handlers_rshutdown();
+#endif
+}
@@ -0,0 +1,330 @@
+#include <php.h>
+#include <stdbool.h>
+
+/* Comment to prevent reordering by code style fixer */
+#include <Zend/zend_interfaces.h>
+#include <Zend/zend_smart_str.h>
+#include <Zend/zend_weakrefs.h>
+#include <hook/hook.h>
+#include <sandbox/sandbox.h>
+
+#include "configuration.h"
+#include "ddtrace.h"
+#include "handlers_db.h"
+#include "handlers_internal.h"
+#include "integrations/overhead.h"
+#include "span.h"
+#include "telemetry.h"
+
+/* Native port of DDTrace\Integrations\Memcached\MemcachedIntegration for PHP 8.
+ *
+ * Names, resources and the obfuscated query of single key commands are interned once at startup. The first server
+ * of Memcached::getServerList() is cached per instance until the server list is changed, instead of being fetched
+ * for every command.
+ */
+
+typedef enum {
+    DD_MEMCACHED_COMMAND,
+    DD_MEMCACHED_COMMAND_BY_KEY,
+    DD_MEMCACHED_MULTI,
+    DD_MEMCACHED_MULTI_BY_KEY,
+    DD_MEMCACHED_FLUSH,
+    DD_MEMCACHED_CAS,
+    DD_MEMCACHED_CAS_BY_KEY,
+    DD_MEMCACHED_SERVERS_CHANGED,
+} dd_memcached_kind;
+
+typedef struct {
+    const char *method;
+    dd_memcached_kind kind;
+    bool analytics;
+    zend_string *name;
+    zend_string *command;
+    zend_string *query;
+} dd_memcached_command;
+
+// The interned strings are only set during startup
+static dd_memcached_command dd_memcached_commands[] = {
+    {"add", DD_MEMCACHED_COMMAND, true},
+    {"addByKey", DD_MEMCACHED_COMMAND_BY_KEY, true},
+    {"append", DD_MEMCACHED_COMMAND, false},
+    {"appendByKey", DD_MEMCACHED_COMMAND_BY_KEY, false},
+    {"decrement", DD_MEMCACHED_COMMAND, false},
+    {"decrementByKey", DD_MEMCACHED_COMMAND_BY_KEY, false},
+    {"delete", DD_MEMCACHED_COMMAND, true},
+    {"deleteMulti", DD_MEMCACHED_MULTI, false},
+    {"deleteByKey", DD_MEMCACHED_COMMAND_BY_KEY, true},
+    {"deleteMultiByKey", DD_MEMCACHED_MULTI_BY_KEY, false},
+    {"get", DD_MEMCACHED_COMMAND, true},
+    {"getMulti", DD_MEMCACHED_MULTI, false},
+    {"getByKey", DD_MEMCACHED_COMMAND_BY_KEY, true},
+    {"getMultiByKey", DD_MEMCACHED_MULTI_BY_KEY, false},
+    {"set", DD_MEMCACHED_COMMAND, true},
+    {"setMulti", DD_MEMCACHED_MULTI, false},
+    {"setByKey", DD_MEMCACHED_COMMAND_BY_KEY, true},
+    {"setMultiByKey", DD_MEMCACHED_MULTI_BY_KEY, false},
+    {"increment", DD_MEMCACHED_COMMAND, false},
+    {"incrementByKey", DD_MEMCACHED_COMMAND_BY_KEY, false},
+    {"prepend", DD_MEMCACHED_COMMAND, false},
+    {"prependByKey", DD_MEMCACHED_COMMAND_BY_KEY, false},
+    {"replace", DD_MEMCACHED_COMMAND, false},
+    {"replaceByKey", DD_MEMCACHED_COMMAND_BY_KEY, false},
+    {"touch", DD_MEMCACHED_COMMAND, false},
+    {"touchByKey", DD_MEMCACHED_COMMAND_BY_KEY, false},
+    {"flush", DD_MEMCACHED_FLUSH, false},
+    {"cas", DD_MEMCACHED_CAS, false},
+    {"casByKey", DD_MEMCACHED_CAS_BY_KEY, false},
+    {"addServer", DD_MEMCACHED_SERVERS_CHANGED, false},
+    {"addServers", DD_MEMCACHED_SERVERS_CHANGED, false},
+    {"resetServerList", DD_MEMCACHED_SERVERS_CHANGED, false},
+};
+
+typedef struct {
+    zend_string *host;
+    zend_string *port;
+} dd_memcached_server;
+
+typedef struct {
+    ddtrace_span_data *span;
+} dd_memcached_dynamic;
+
+ZEND_TLS HashTable dd_memcached_servers;
+ZEND_TLS bool dd_memcached_telemetry_notified;
+
+static void dd_memcached_server_dtor(zval *zv) {
+    dd_memcached_server *server = Z_PTR_P(zv);
+    zend_string_release(server->host);
+    zend_string_release(server->port);
+    efree(server);
+}
+
+static dd_memcached_server *dd_memcached_fetch_server(zend_object *obj) {
+    dd_memcached_server *server = zend_hash_index_find_ptr(&dd_memcached_servers, zend_object_to_weakref_key(obj));
+    if (server) {
+        return server;
+    }
+
+    // Memcached::getServerByKey() would mutate the result code, Memcached::getServerList() does not
+    zai_sandbox sandbox;
+    zai_sandbox_open(&sandbox);
+
+    zval servers, *first, *host, *port;
+    zend_call_method_with_0_params(obj, obj->ce, NULL, "getserverlist", &servers);
+    if (Z_TYPE(servers) == IS_ARRAY && (first = zend_hash_index_find(Z_ARR(servers), 0)) && Z_TYPE_P(first) == IS_ARRAY
+        && (host = zend_hash_str_find(Z_ARR_P(first), ZEND_STRL("host"))) && (port = zend_hash_str_find(Z_ARR_P(first), ZEND_STRL("port")))) {
+        server = emalloc(sizeof(*server));
+        server->host = zval_get_string(host);
+        server->port = zval_get_string(port);
+        // an empty server list is not cached, servers may be added through another instance sharing the persistent id
+        if (!zend_weakrefs_hash_add_ptr(&dd_memcached_servers, obj, server)) {
+            zend_hash_index_update_ptr(&dd_memcached_servers, zend_object_to_weakref_key(obj), server);
+        }
+    }
+    zval_ptr_dtor(&servers);
+
+    zai_sandbox_close(&sandbox);
+    return server;
+}
+
+static void dd_memcached_set_server_tags(ddtrace_span_data *span, zend_object *obj) {
+    dd_memcached_server *server = dd_memcached_fetch_server(obj);
+    if (server) {
+        ddtrace_db_add_meta_str(span, ZEND_STRL("out.host"), server->host);
+        ddtrace_db_add_meta_str(span, ZEND_STRL("out.port"), server->port);
+    }
+}
+
+static void dd_memcached_set_string_meta(ddtrace_span_data *span, const char *tag, size_t tag_len, zval *value) {
+    zend_string *str = zval_get_string(value);
+    ddtrace_db_add_meta_str(span, tag, tag_len, str);
+    zend_string_release(str);
+}
+
+// Mirrors Obfuscation::toObfuscatedString($keys, ',')
+static void dd_memcached_set_multi_query(ddtrace_span_data *span, dd_memcached_command *command, zval *keys) {
+    smart_str query = {0};
+    smart_str_append(&query, command->command);
+    smart_str_appendc(&query, ' ');
+    if (keys && Z_TYPE_P(keys) == IS_ARRAY) {
+        uint32_t count = zend_hash_num_elements(Z_ARR_P(keys));
+        for (uint32_t i = 0; i < count; ++i) {
+            smart_str_appendl(&query, i ? ",?" : "?", i ? 2 : 1);
+        }
+    } else {
+        smart_str_appendc(&query, '?');
+    }
+    smart_str_0(&query);
+    ddtrace_db_add_meta_str(span, ZEND_STRL("memcached.query"), query.s);
+    smart_str_free(&query);
+}
+
+// Mirrors MemcachedIntegration::setCommonData()
+static void dd_memcached_set_common_data(ddtrace_span_data *span, dd_memcached_command *command) {
+    zval *prop_name = ddtrace_spandata_property_name(span);
+    zval_ptr_dtor(prop_name);
+    ZVAL_INTERNED_STR(prop_name, command->name);
+
+    zval *prop_resource = ddtrace_spandata_property_resource(span);
+    zval_ptr_dtor(prop_resource);
+    ZVAL_INTERNED_STR(prop_resource, command->command);
+
+    ddtrace_db_set_property(ddtrace_spandata_property_type(span), ZEND_STRL("memcached"));
+    ddtrace_db_set_property_str(ddtrace_spandata_property_service(span), ddtrace_db_service_name(ZEND_STRL("memcached")));
+
+    ddtrace_db_add_meta_str(span, ZEND_STRL("memcached.command"), command->command);
+    ddtrace_db_add_meta(span, ZEND_STRL("span.kind"), ZEND_STRL("client"));
+    ddtrace_db_add_meta(span, ZEND_STRL("component"), ZEND_STRL("memcached"));
+    ddtrace_db_add_meta(span, ZEND_STRL("db.system"), ZEND_STRL("memcached"));
+}
+
+static bool dd_memcached_run_begin(zend_ulong invocation, zend_execute_data *execute_data, void *auxiliary, void *dynamic) {
+    dd_memcached_command *command = auxiliary;
+    dd_memcached_dynamic *dyn = dynamic;
+    dyn->span = NULL;
+
+    if (command->kind == DD_MEMCACHED_SERVERS_CHANGED || !get_DD_TRACE_ENABLED()
+        || !ddtrace_config_integration_enabled(DDTRACE_INTEGRATION_MEMCACHED) || Z_TYPE(EX(This)) != IS_OBJECT) {
+        return true;
+    }
+
+    if (!dd_memcached_telemetry_notified) {
+        dd_memcached_telemetry_notified = true;
+        ddtrace_telemetry_notify_integration(ZEND_STRL("memcached"));
+    }
+
+    if (ddtrace_tracer_is_limited() || zai_hook_lightweight) {
+        return true;
+    }
+
+    zend_object *obj = Z_OBJ(EX(This));
+    zval *arg0 = EX_NUM_ARGS() >= 1 ? ZEND_CALL_ARG(execute_data, 1) : NULL;
+    zval *arg1 = EX_NUM_ARGS() >= 2 ? ZEND_CALL_ARG(execute_data, 2) : NULL;
+
+    ddtrace_span_data *span = dyn->span = ddtrace_alloc_execute_data_span(invocation, execute_data);
+    dd_memcached_set_common_data(span, command);
+
+    switch (command->kind) {
+        case DD_MEMCACHED_COMMAND:
+        case DD_MEMCACHED_COMMAND_BY_KEY:
+            if (arg0 && Z_TYPE_P(arg0) != IS_ARRAY) {
+                dd_memcached_set_server_tags(span, obj);
+                ddtrace_db_add_meta_str(span, ZEND_STRL("memcached.query"), command->query);
+                if (command->kind == DD_MEMCACHED_COMMAND_BY_KEY) {
+                    dd_memcached_set_string_meta(span, ZEND_STRL("memcached.server_key"), arg0);
+                }
+            }
+            break;
+
+        case DD_MEMCACHED_MULTI:
+            dd_memcached_set_server_tags(span, obj);
+            dd_memcached_set_multi_query(span, command, arg0);
+            break;
+
+        case DD_MEMCACHED_MULTI_BY_KEY:
+            if (arg0) {
+                dd_memcached_set_string_meta(span, ZEND_STRL("memcached.server_key"), arg0);
+            }
+            dd_memcached_set_server_tags(span, obj);
+            dd_memcached_set_multi_query(span, command, arg1);
+            break;
+
+        case DD_MEMCACHED_FLUSH:
+            dd_memcached_set_server_tags(span, obj);
+            break;
+
+        case DD_MEMCACHED_CAS:
+        case DD_MEMCACHED_CAS_BY_KEY:
+            if (arg0) {
+                dd_memcached_set_string_meta(span, ZEND_STRL("memcached.cas_token"), arg0);
+            }
+            ddtrace_db_add_meta_str(span, ZEND_STRL("memcached.query"), command->query);
+            if (command->kind == DD_MEMCACHED_CAS_BY_KEY && arg1) {
+                dd_memcached_set_string_meta(span, ZEND_STRL("memcached.server_key"), arg1);
+            }
+            dd_memcached_set_server_tags(span, obj);
+            break;
+
+        case DD_MEMCACHED_SERVERS_CHANGED:
+            break;
+    }
+
+    ddtrace_db_set_peer_service_sources(span);
+    if (command->analytics) {
+        ddtrace_db_add_analytics(span, get_DD_TRACE_MEMCACHED_ANALYTICS_ENABLED(), get_DD_TRACE_MEMCACHED_ANALYTICS_SAMPLE_RATE());
+    }
+
+    return true;
+}
+
+static void dd_memcached_run_end(zend_ulong invocation, zend_execute_data *execute_data, zval *retval, void *auxiliary, void *dynamic) {
+    dd_memcached_command *command = auxiliary;
+    dd_memcached_dynamic *dyn = dynamic;
+    ddtrace_span_data *span = dyn->span;
+
+    if (command->kind == DD_MEMCACHED_SERVERS_CHANGED) {
+        if (Z_TYPE(EX(This)) == IS_OBJECT && zend_hash_index_exists(&dd_memcached_servers, zend_object_to_weakref_key(Z_OBJ(EX(This))))) {
+            zend_weakrefs_hash_del(&dd_memcached_servers, Z_OBJ(EX(This)));
+        }
+        return;
+    }
+
+    if (!span) {
+        return;
+    }
+
+    if (!ddtrace_span_is_dropped(span)) {
+        if (command->kind == DD_MEMCACHED_COMMAND || command->kind == DD_MEMCACHED_COMMAND_BY_KEY) {
+            if (zend_string_equals_literal(command->command, "get") || zend_string_equals_literal(command->command, "getByKey")) {
+                ddtrace_db_add_metric(span, ZEND_STRL("db.row_count"), zend_is_true(retval) ? 1 : 0);
+            }
+        } else if (command->kind == DD_MEMCACHED_MULTI || command->kind == DD_MEMCACHED_MULTI_BY_KEY) {
+            if (zend_string_equals_literal(command->command, "getMulti") || zend_string_equals_literal(command->command, "getMultiByKey")) {
+                // a failed lookup returns false, which yields no rows
+                double count = Z_TYPE_P(retval) == IS_ARRAY && !EG(exception) ? zend_hash_num_elements(Z_ARR_P(retval)) : 0;
+                ddtrace_db_add_metric(span, ZEND_STRL("db.row_count"), count);
+            }
+        }
+    }
+
+    ddtrace_db_close_span(invocation, span);
+}
+
+DDTRACE_MEASURED_BEGIN_HANDLER(dd_memcached_begin, DDTRACE_INTEGRATION_MEMCACHED, dd_memcached_run_begin)
+DDTRACE_MEASURED_END_HANDLER(dd_memcached_end, DDTRACE_INTEGRATION_MEMCACHED, dd_memcached_run_end)
+
+void ddtrace_memcached_handlers_startup(void) {
+    // if we cannot find ext/memcached then do not instrument it
+    if (!zend_hash_str_exists(&module_registry, ZEND_STRL("memcached"))) {
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(dd_memcached_commands) / sizeof(dd_memcached_commands[0]); ++i) {
+        dd_memcached_command *command = &dd_memcached_commands[i];
+        size_t method_len = strlen(command->method);
+
+        char buf[64];
+        int len = snprintf(buf, sizeof(buf), "Memcached.%s", command->method);
+        command->name = zend_string_init_interned(buf, len, 1);
+        command->command = zend_string_init_interned(command->method, method_len, 1);
+        len = snprintf(buf, sizeof(buf), "%s ?", command->method);
+        command->query = zend_string_init_interned(buf, len, 1);
+
+        zai_string_view method = {.len = method_len, .ptr = command->method};
+        zai_hook_install(ZAI_STRL_VIEW("Memcached"), method, dd_memcached_begin, dd_memcached_end, ZAI_HOOK_AUX(command, NULL),
+                         sizeof(dd_memcached_dynamic));
+    }
+}
+
+void ddtrace_memcached_handlers_rinit(void) {
+    zend_hash_init(&dd_memcached_servers, 8, NULL, dd_memcached_server_dtor, 0);
+    dd_memcached_telemetry_notified = false;
+}
+
+void ddtrace_memcached_handlers_rshutdown(void) {
+    zend_ulong key;
+    ZEND_HASH_FOREACH_NUM_KEY(&dd_memcached_servers, key) { zend_weakrefs_hash_del(&dd_memcached_servers, zend_weakref_key_to_object(key)); }
+    ZEND_HASH_FOREACH_END();
+    zend_hash_destroy(&dd_memcached_servers);
+    // now ensure there's no use-after-free (zend_hash_init here is fine as memory allocation is deferred to first add)
+    zend_hash_init(&dd_memcached_servers, 8, NULL, dd_memcached_server_dtor, 0);
+}
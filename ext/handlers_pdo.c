@@ -0,0 +1,573 @@
+#include <php.h>
+#include <stdbool.h>
+
+/* Comment to prevent reordering by code style fixer */
+#include <Zend/zend_interfaces.h>
+#include <Zend/zend_smart_str.h>
+#include <Zend/zend_weakrefs.h>
+#include <ext/pdo/php_pdo_driver.h>
+#include <ext/standard/url.h>
+#include <hook/hook.h>
+#include <sandbox/sandbox.h>
+
+#include "configuration.h"
+#include "ddtrace.h"
+#include "handlers_db.h"
+#include "handlers_internal.h"
+#include "integrations/overhead.h"
+#include "priority_sampling/priority_sampling.h"
+#include "span.h"
+#include "telemetry.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(ddtrace);
+
+/* Native port of DDTrace\Integrations\PDO\PDOIntegration for PHP 8.
+ *
+ * The connection tags are parsed once from the DSN passed to PDO::__construct() and shared (refcounted) with all
+ * statements created from that connection. They live in a weakref map keyed by the PDO and PDOStatement objects,
+ * like the curl headers in handlers_curl.c, so they are dropped with the objects they describe.
+ */
+
+typedef enum {
+    DD_PDO_CONSTRUCT,
+    DD_PDO_EXEC,
+    DD_PDO_QUERY,
+    DD_PDO_PREPARE,
+    DD_PDO_COMMIT,
+    DD_PDOSTATEMENT_EXECUTE,
+} dd_pdo_method;
+
+typedef struct {
+    ddtrace_span_data *span;
+} dd_pdo_dynamic;
+
+ZEND_TLS HashTable dd_pdo_connection_tags;
+ZEND_TLS bool dd_pdo_telemetry_notified;
+
+static const struct {
+    const char *driver;
+    const char *system;
+} dd_pdo_driver_to_system[] = {
+    {"cubrid", "other_sql"},
+    {"dblib", "other_sql"},  // may be mssql or Sybase, not supported anymore so shouldn't be a problem
+    {"firebird", "firebird"},
+    {"ibm", "db2"},
+    {"informix", "informix"},
+    {"mysql", "mysql"},
+    {"sqlsrv", "mssql"},
+    {"oci", "oracle"},
+    {"odbc", "other_sql"},
+    {"pgsql", "postgresql"},
+    {"sqlite", "sqlite"},
+};
+
+static void dd_pdo_tags_dtor(zval *zv) { zend_array_release(Z_PTR_P(zv)); }
+
+static void dd_pdo_add_tag(zend_array *tags, const char *tag, const char *value, size_t value_len) {
+    zval zv;
+    ZVAL_STRINGL(&zv, value, value_len);
+    zend_hash_str_update(tags, tag, strlen(tag), &zv);
+}
+
+#define DD_PDO_DSN_KEY_IS(key) (key_len == sizeof(key) - 1 && strncasecmp(pos, key, key_len) == 0)
+
+static zend_array *dd_pdo_parse_dsn(zend_string *dsn, zval *user) {
+    zend_array *tags = zend_new_array(8);
+
+    const char *dsn_str = ZSTR_VAL(dsn), *end = dsn_str + ZSTR_LEN(dsn);
+    const char *colon = memchr(dsn_str, ':', ZSTR_LEN(dsn));
+    size_t engine_len = colon ? (size_t)(colon - dsn_str) : 0;
+    dd_pdo_add_tag(tags, "db.engine", dsn_str, engine_len);
+
+    const char *system = "other_sql";
+    for (size_t i = 0; i < sizeof(dd_pdo_driver_to_system) / sizeof(dd_pdo_driver_to_system[0]); ++i) {
+        if (strlen(dd_pdo_driver_to_system[i].driver) == engine_len && memcmp(dd_pdo_driver_to_system[i].driver, dsn_str, engine_len) == 0) {
+            system = dd_pdo_driver_to_system[i].system;
+            break;
+        }
+    }
+    dd_pdo_add_tag(tags, "db.system", system, strlen(system));
+
+    const char *pos = MIN(dsn_str + engine_len + 1, end);
+    while (pos < end) {
+        const char *part_end = memchr(pos, ';', end - pos);
+        if (!part_end) {
+            part_end = end;
+        }
+
+        const char *eq = memchr(pos, '=', part_end - pos);
+        if (eq && eq > pos) {
+            size_t key_len = eq - pos;
+            const char *value = eq + 1, *value_end = memchr(value, '=', part_end - value);
+            if (!value_end) {
+                value_end = part_end;
+            }
+
+            const char *tag = NULL;
+            if (DD_PDO_DSN_KEY_IS("charset")) {
+                tag = "db.charset";
+            } else if (DD_PDO_DSN_KEY_IS("database") || DD_PDO_DSN_KEY_IS("dbname")) {
+                tag = "db.name";
+            } else if (DD_PDO_DSN_KEY_IS("server") || DD_PDO_DSN_KEY_IS("unix_socket") || DD_PDO_DSN_KEY_IS("hostname") || DD_PDO_DSN_KEY_IS("host")) {
+                tag = "out.host";
+            } else if (DD_PDO_DSN_KEY_IS("port")) {
+                tag = "out.port";
+            }
+
+            if (tag) {
+                dd_pdo_add_tag(tags, tag, value, value_end - value);
+            }
+        }
+
+        pos = part_end + 1;
+    }
+
+    if (user && Z_TYPE_P(user) != IS_NULL) {
+        zval zv;
+        ZVAL_STR(&zv, zval_get_string(user));
+        zend_hash_str_update(tags, ZEND_STRL("db.user"), &zv);
+    }
+
+    return tags;
+}
+
+#undef DD_PDO_DSN_KEY_IS
+
+// Takes over the passed reference to tags
+static void dd_pdo_store_tags(zend_object *obj, zend_array *tags) {
+    if (!zend_weakrefs_hash_add_ptr(&dd_pdo_connection_tags, obj, tags)) {
+        zend_hash_index_update_ptr(&dd_pdo_connection_tags, zend_object_to_weakref_key(obj), tags);
+    }
+}
+
+static zend_array *dd_pdo_find_tags(zend_object *obj) {
+    return zend_hash_index_find_ptr(&dd_pdo_connection_tags, zend_object_to_weakref_key(obj));
+}
+
+static void dd_pdo_set_service(ddtrace_span_data *span, zend_array *tags) {
+    zend_string *service = ddtrace_db_service_name(ZEND_STRL("pdo"));
+
+    zval *host;
+    if (get_DD_TRACE_DB_CLIENT_SPLIT_BY_INSTANCE() && tags && (host = zend_hash_str_find(tags, ZEND_STRL("out.host"))) && Z_TYPE_P(host) == IS_STRING) {
+        smart_str buf = {0};
+        smart_str_append(&buf, service);
+        smart_str_appendc(&buf, '-');
+        ddtrace_db_append_normalized_host(&buf, Z_STR_P(host));
+        zend_string_release(service);
+        service = smart_str_extract(&buf);
+    }
+
+    ddtrace_db_set_property_str(ddtrace_spandata_property_service(span), service);
+}
+
+static void dd_pdo_set_common_span_info(ddtrace_span_data *span, zend_array *tags) {
+    zval *prop_type = ddtrace_spandata_property_type(span);
+    zval_ptr_dtor(prop_type);
+    ZVAL_STRINGL(prop_type, "sql", 3);
+
+    dd_pdo_set_service(span, tags);
+
+    zend_array *meta = ddtrace_spandata_property_meta(span);
+    dd_pdo_add_tag(meta, "span.kind", ZEND_STRL("client"));
+    dd_pdo_add_tag(meta, "component", ZEND_STRL("pdo"));
+
+    if (tags) {
+        zend_string *tag;
+        zval *value;
+        ZEND_HASH_FOREACH_STR_KEY_VAL(tags, tag, value) {
+            Z_TRY_ADDREF_P(value);
+            zend_hash_update(meta, tag, value);
+        } ZEND_HASH_FOREACH_END();
+    }
+}
+
+static void dd_pdo_add_analytics(ddtrace_span_data *span) {
+    ddtrace_db_add_analytics(span, get_DD_TRACE_PDO_ANALYTICS_ENABLED(), get_DD_TRACE_PDO_ANALYTICS_SAMPLE_RATE());
+}
+
+static void dd_pdo_set_resource_from_arg(ddtrace_span_data *span, zend_execute_data *execute_data) {
+    zval *prop_resource = ddtrace_spandata_property_resource(span);
+    zval_ptr_dtor(prop_resource);
+    zval *query = EX_NUM_ARGS() >= 1 ? ZEND_CALL_ARG(execute_data, 1) : NULL;
+    if (query && Z_TYPE_P(query) == IS_STRING) {
+        ZVAL_STR_COPY(prop_resource, Z_STR_P(query));
+    } else if (query && Z_TYPE_P(query) != IS_OBJECT) {
+        ZVAL_STR(prop_resource, zval_get_string(query));
+    } else {
+        ZVAL_EMPTY_STRING(prop_resource);
+    }
+}
+
+static void dd_pdo_set_name(ddtrace_span_data *span, const char *name, size_t name_len, bool as_resource) {
+    zval *prop_name = ddtrace_spandata_property_name(span);
+    zval_ptr_dtor(prop_name);
+    ZVAL_STRINGL(prop_name, name, name_len);
+    if (as_resource) {
+        zval *prop_resource = ddtrace_spandata_property_resource(span);
+        zval_ptr_dtor(prop_resource);
+        ZVAL_COPY(prop_resource, prop_name);
+    }
+}
+
+static void dd_pdo_append_sql_comment_tag(smart_str *comment, const char *tag, zend_string *value) {
+    if (!value || ZSTR_LEN(value) == 0) {
+        return;
+    }
+
+    smart_str_appends(comment, ZSTR_LEN(comment->s) > 2 ? ",": "");
+    smart_str_appends(comment, tag);
+    smart_str_appends(comment, "='");
+    zend_string *escaped = php_raw_url_encode(ZSTR_VAL(value), ZSTR_LEN(value));
+    smart_str_append(comment, escaped);
+    zend_string_release(escaped);
+    smart_str_appendc(comment, '\'');
+}
+
+static zend_string *dd_pdo_root_meta(ddtrace_span_data *root_span, const char *key, size_t key_len, zend_string *fallback) {
+    zval *value;
+    if (root_span && (value = zend_hash_str_find(ddtrace_spandata_property_meta(root_span), key, key_len)) && Z_TYPE_P(value) == IS_STRING && Z_STRLEN_P(value)) {
+        return zend_string_copy(Z_STR_P(value));
+    }
+    return zend_string_copy(fallback);
+}
+
+#define DD_PDO_DRIVER_IS(name) (driver_name_len == sizeof(name) - 1 && memcmp(driver_name, name, sizeof(name) - 1) == 0)
+
+// Mirrors DDTrace\Integrations\DatabaseIntegrationHelper::injectDatabaseIntegrationData()
+static void dd_pdo_inject_dbm_comment(ddtrace_span_data *span, zend_execute_data *execute_data) {
+    zend_long mode = get_DD_DBM_PROPAGATION_MODE();
+    if (mode == DD_TRACE_DBM_PROPAGATION_DISABLED) {
+        return;
+    }
+
+    // PDO::ATTR_DRIVER_NAME, the DSN prefix may be an alias (uri:) or name a different driver than the one in use
+    pdo_dbh_t *dbh = php_pdo_dbh_fetch_inner(Z_OBJ(EX(This)));
+    if (!dbh->driver) {
+        return;
+    }
+    const char *driver_name = dbh->driver->driver_name;
+    size_t driver_name_len = dbh->driver->driver_name_len;
+
+    bool full_propagation_backend = DD_PDO_DRIVER_IS("mysql") || DD_PDO_DRIVER_IS("pgsql");
+    if (!full_propagation_backend && !DD_PDO_DRIVER_IS("sqlsrv") && !DD_PDO_DRIVER_IS("mssql")
+        && !DD_PDO_DRIVER_IS("dblib") && !DD_PDO_DRIVER_IS("odbc")) {
+        return;
+    }
+    if (mode == DD_TRACE_DBM_PROPAGATION_FULL && !full_propagation_backend) {
+        mode = DD_TRACE_DBM_PROPAGATION_SERVICE;
+    }
+
+    zval *query = EX_NUM_ARGS() >= 1 ? ZEND_CALL_ARG(execute_data, 1) : NULL;
+    if (!query || Z_TYPE_P(query) != IS_STRING) {
+        return;
+    }
+
+    ddtrace_span_data *root_span = DDTRACE_G(active_stack)->root_span;
+
+    // Note: the order of the tags is relevant, they must be passed ordered alphabetically
+    smart_str comment = {0};
+    smart_str_appends(&comment, "/*");
+
+    zend_string *service = zval_get_string(ddtrace_spandata_property_service(span));
+    dd_pdo_append_sql_comment_tag(&comment, "dddbs", service);
+    zend_string_release(service);
+
+    zend_string *env = dd_pdo_root_meta(root_span, ZEND_STRL("env"), get_DD_ENV());
+    dd_pdo_append_sql_comment_tag(&comment, "dde", env);
+    zend_string_release(env);
+
+    zend_string *root_service = root_span ? zval_get_string(ddtrace_spandata_property_service(root_span)) : NULL;
+    if (!root_service || !ZSTR_LEN(root_service)) {
+        if (root_service) {
+            zend_string_release(root_service);
+        }
+        root_service = php_trim(get_DD_SERVICE(), NULL, 0, 3);
+    }
+    dd_pdo_append_sql_comment_tag(&comment, "ddps", root_service);
+    zend_string_release(root_service);
+
+    zend_string *version = dd_pdo_root_meta(root_span, ZEND_STRL("version"), get_DD_VERSION());
+    dd_pdo_append_sql_comment_tag(&comment, "ddpv", version);
+    zend_string_release(version);
+
+    if (mode == DD_TRACE_DBM_PROPAGATION_FULL) {
+        ddtrace_trace_id trace_id = ddtrace_peek_trace_id();
+        uint64_t span_id = ddtrace_peek_span_id();
+        if ((trace_id.low || trace_id.high) && span_id) {
+            zend_string *traceparent = zend_strpprintf(0, "00-%016" PRIx64 "%016" PRIx64 "-%016" PRIx64 "-%02" PRIx8,
+                                                       trace_id.high, trace_id.low, span_id,
+                                                       ddtrace_fetch_prioritySampling_from_root() > 0);
+            dd_pdo_append_sql_comment_tag(&comment, "traceparent", traceparent);
+            zend_string_release(traceparent);
+        }
+    }
+
+    if (ZSTR_LEN(comment.s) > 2) {
+        smart_str_appends(&comment, "*/");
+        if (Z_STRLEN_P(query)) {
+            smart_str_appendc(&comment, ' ');
+            smart_str_append(&comment, Z_STR_P(query));
+        }
+        zval_ptr_dtor(query);
+        ZVAL_STR(query, smart_str_extract(&comment));
+    } else {
+        smart_str_free(&comment);
+    }
+
+    dd_pdo_add_tag(ddtrace_spandata_property_meta(span), "_dd.dbm_trace_injected", ZEND_STRL("true"));
+}
+
+#undef DD_PDO_DRIVER_IS
+
+static zend_long dd_pdo_row_count(zend_object *obj) {
+    zval rv;
+    zend_long count = -1;
+    zend_call_method_with_0_params(obj, obj->ce, NULL, "rowcount", &rv);
+    if (Z_TYPE(rv) == IS_LONG) {
+        count = Z_LVAL(rv);
+    }
+    zval_ptr_dtor(&rv);
+    return count;
+}
+
+static void dd_pdo_set_row_count(ddtrace_span_data *span, zend_long count) {
+    if (count >= 0) {
+        zval zv;
+        ZVAL_LONG(&zv, count);
+        zend_hash_str_update(ddtrace_spandata_property_metrics(span), ZEND_STRL("db.row_count"), &zv);
+    }
+}
+
+// Mirrors PDOIntegration::detectError()
+static void dd_pdo_detect_error(ddtrace_span_data *span, zend_object *obj) {
+    zval code;
+    zend_call_method_with_0_params(obj, obj->ce, NULL, "errorcode", &code);
+
+    // Error codes follows the ANSI SQL-92 convention of 5 total chars: 2 chars for class value, 3 chars for subclass value
+    // Non error class values are: '00', '01', 'IM'
+    if (Z_TYPE(code) == IS_STRING && Z_STRLEN(code) == 5) {
+        char c0 = (char)toupper((unsigned char)Z_STRVAL(code)[0]), c1 = (char)toupper((unsigned char)Z_STRVAL(code)[1]);
+        if (!(c0 == '0' && (c1 == '0' || c1 == '1')) && !(c0 == 'I' && c1 == 'M')) {
+            zval info;
+            zend_call_method_with_0_params(obj, obj->ce, NULL, "errorinfo", &info);
+
+            smart_str msg = {0};
+            smart_str_appends(&msg, "SQL error: ");
+            smart_str_append(&msg, Z_STR(code));
+            smart_str_appends(&msg, ". Driver error: ");
+            if (Z_TYPE(info) == IS_ARRAY) {
+                zval *driver_error = zend_hash_index_find(Z_ARR(info), 1);
+                if (driver_error) {
+                    zend_string *str = zval_get_string(driver_error);
+                    smart_str_append(&msg, str);
+                    zend_string_release(str);
+                }
+
+                // Driver-specific error message will be in the rest of the array
+                if (zend_hash_num_elements(Z_ARR(info)) > 2) {
+                    smart_str_appends(&msg, ". Driver-specific error data: ");
+                    uint32_t position = 0;
+                    zval *val;
+                    ZEND_HASH_FOREACH_VAL(Z_ARR(info), val) {
+                        if (position++ < 2) {
+                            continue;
+                        }
+                        if (position > 3) {
+                            smart_str_appends(&msg, ". ");
+                        }
+                        zend_string *str = zval_get_string(val);
+                        smart_str_append(&msg, str);
+                        zend_string_release(str);
+                    } ZEND_HASH_FOREACH_END();
+                }
+            }
+            zval_ptr_dtor(&info);
+
+            zend_array *meta = ddtrace_spandata_property_meta(span);
+            zval zv;
+            ZVAL_STR(&zv, smart_str_extract(&msg));
+            zend_hash_str_update(meta, ZEND_STRL("error.message"), &zv);
+            ZVAL_STR(&zv, zend_strpprintf(0, "%s error", ZSTR_VAL(obj->ce->name)));
+            zend_hash_str_update(meta, ZEND_STRL("error.type"), &zv);
+        }
+    }
+
+    zval_ptr_dtor(&code);
+}
+
+static bool dd_pdo_run_begin(zend_ulong invocation, zend_execute_data *execute_data, void *auxiliary, void *dynamic) {
+    dd_pdo_method method = (dd_pdo_method)(uintptr_t)auxiliary;
+    dd_pdo_dynamic *dyn = dynamic;
+    dyn->span = NULL;
+
+    if (!get_DD_TRACE_ENABLED() || !ddtrace_config_integration_enabled(DDTRACE_INTEGRATION_PDO) || Z_TYPE(EX(This)) != IS_OBJECT) {
+        return true;
+    }
+
+    zend_object *obj = Z_OBJ(EX(This));
+    zend_array *tags;
+    if (method == DD_PDO_CONSTRUCT) {
+        if (!dd_pdo_telemetry_notified) {
+            dd_pdo_telemetry_notified = true;
+            ddtrace_telemetry_notify_integration(ZEND_STRL("pdo"));
+        }
+
+        tags = NULL;
+        if (EX_NUM_ARGS() >= 1 && Z_TYPE_P(ZEND_CALL_ARG(execute_data, 1)) == IS_STRING) {
+            tags = dd_pdo_parse_dsn(Z_STR_P(ZEND_CALL_ARG(execute_data, 1)), EX_NUM_ARGS() >= 2 ? ZEND_CALL_ARG(execute_data, 2) : NULL);
+            dd_pdo_store_tags(obj, tags);
+        }
+    } else {
+        tags = dd_pdo_find_tags(obj);
+    }
+
+    if (ddtrace_tracer_is_limited() || zai_hook_lightweight) {
+        // queries are commented regardless of whether they are traced, database monitoring does not depend on the trace
+        if (method == DD_PDO_EXEC || method == DD_PDO_QUERY || method == DD_PDO_PREPARE) {
+            ddtrace_span_data *dummy = ddtrace_init_dummy_span();
+            dd_pdo_set_service(dummy, tags);
+            dd_pdo_inject_dbm_comment(dummy, execute_data);
+            OBJ_RELEASE(&dummy->std);
+        }
+        return true;
+    }
+
+    ddtrace_span_data *span = dyn->span = ddtrace_alloc_execute_data_span(invocation, execute_data);
+
+    switch (method) {
+        case DD_PDO_CONSTRUCT:
+            dd_pdo_set_name(span, ZEND_STRL("PDO.__construct"), true);
+            dd_pdo_set_common_span_info(span, tags);
+            break;
+
+        case DD_PDO_EXEC:
+        case DD_PDO_QUERY:
+            if (method == DD_PDO_EXEC) {
+                dd_pdo_set_name(span, ZEND_STRL("PDO.exec"), false);
+            } else {
+                dd_pdo_set_name(span, ZEND_STRL("PDO.query"), false);
+            }
+            dd_pdo_set_resource_from_arg(span, execute_data);
+            ddtrace_db_set_peer_service_sources(span);
+            dd_pdo_set_common_span_info(span, tags);
+            dd_pdo_add_analytics(span);
+            dd_pdo_inject_dbm_comment(span, execute_data);
+            break;
+
+        case DD_PDO_PREPARE:
+            dd_pdo_set_name(span, ZEND_STRL("PDO.prepare"), false);
+            dd_pdo_set_resource_from_arg(span, execute_data);
+            dd_pdo_set_common_span_info(span, tags);
+            dd_pdo_inject_dbm_comment(span, execute_data);
+            break;
+
+        case DD_PDO_COMMIT:
+            dd_pdo_set_name(span, ZEND_STRL("PDO.commit"), true);
+            dd_pdo_set_common_span_info(span, tags);
+            break;
+
+        case DD_PDOSTATEMENT_EXECUTE: {
+            dd_pdo_set_name(span, ZEND_STRL("PDOStatement.execute"), false);
+            zval rv, *query_string = zend_read_property(obj->ce, obj, ZEND_STRL("queryString"), 1, &rv);
+            zval *prop_resource = ddtrace_spandata_property_resource(span);
+            zval_ptr_dtor(prop_resource);
+            if (Z_TYPE_P(query_string) == IS_STRING) {
+                ZVAL_STR_COPY(prop_resource, Z_STR_P(query_string));
+            } else {
+                ZVAL_EMPTY_STRING(prop_resource);
+            }
+            ddtrace_db_set_peer_service_sources(span);
+            dd_pdo_set_common_span_info(span, tags);
+            dd_pdo_add_analytics(span);
+            break;
+        }
+    }
+
+    return true;
+}
+
+static void dd_pdo_run_end(zend_ulong invocation, zend_execute_data *execute_data, zval *retval, void *auxiliary, void *dynamic) {
+    dd_pdo_method method = (dd_pdo_method)(uintptr_t)auxiliary;
+    dd_pdo_dynamic *dyn = dynamic;
+    ddtrace_span_data *span = dyn->span;
+
+    // statements inherit the connection tags, also while we're not creating spans
+    if ((method == DD_PDO_QUERY || method == DD_PDO_PREPARE) && Z_TYPE_P(retval) == IS_OBJECT && Z_TYPE(EX(This)) == IS_OBJECT) {
+        zend_array *tags = dd_pdo_find_tags(Z_OBJ(EX(This)));
+        if (tags) {
+            GC_ADDREF(tags);
+            dd_pdo_store_tags(Z_OBJ_P(retval), tags);
+        }
+    }
+
+    if (!span) {
+        return;
+    }
+
+    if (!ddtrace_span_is_dropped(span) && method != DD_PDO_CONSTRUCT && method != DD_PDO_PREPARE && method != DD_PDO_COMMIT
+        && Z_TYPE(EX(This)) == IS_OBJECT) {
+        // the methods invoked here must not observe a pending exception
+        zai_sandbox sandbox;
+        zai_sandbox_open(&sandbox);
+
+        zend_object *obj = Z_OBJ(EX(This));
+        if (method == DD_PDO_EXEC) {
+            if (Z_TYPE_P(retval) == IS_LONG) {
+                dd_pdo_set_row_count(span, Z_LVAL_P(retval));
+            }
+        } else if (method == DD_PDO_QUERY) {
+            zend_class_entry *statement_ce = zend_hash_str_find_ptr(CG(class_table), ZEND_STRL("pdostatement"));
+            if (Z_TYPE_P(retval) == IS_OBJECT && statement_ce && instanceof_function(Z_OBJCE_P(retval), statement_ce)) {
+                dd_pdo_set_row_count(span, dd_pdo_row_count(Z_OBJ_P(retval)));
+            }
+        } else if (Z_TYPE_P(retval) == IS_TRUE) {
+            dd_pdo_set_row_count(span, dd_pdo_row_count(obj));
+        }
+        dd_pdo_detect_error(span, obj);
+
+        zai_sandbox_close(&sandbox);
+    }
+
+    ddtrace_db_close_span(invocation, span);
+}
+
+DDTRACE_MEASURED_BEGIN_HANDLER(dd_pdo_begin, DDTRACE_INTEGRATION_PDO, dd_pdo_run_begin)
+DDTRACE_MEASURED_END_HANDLER(dd_pdo_end, DDTRACE_INTEGRATION_PDO, dd_pdo_run_end)
+
+void ddtrace_pdo_handlers_startup(void) {
+    // if we cannot find ext/pdo then do not instrument it
+    if (!zend_hash_str_exists(&module_registry, ZEND_STRL("pdo"))) {
+        return;
+    }
+
+    static const struct {
+        zai_string_view scope;
+        zai_string_view function;
+        dd_pdo_method method;
+    } hooks[] = {
+        {ZAI_STRL_VIEW("PDO"), ZAI_STRL_VIEW("__construct"), DD_PDO_CONSTRUCT},
+        {ZAI_STRL_VIEW("PDO"), ZAI_STRL_VIEW("exec"), DD_PDO_EXEC},
+        {ZAI_STRL_VIEW("PDO"), ZAI_STRL_VIEW("query"), DD_PDO_QUERY},
+        {ZAI_STRL_VIEW("PDO"), ZAI_STRL_VIEW("prepare"), DD_PDO_PREPARE},
+        {ZAI_STRL_VIEW("PDO"), ZAI_STRL_VIEW("commit"), DD_PDO_COMMIT},
+        {ZAI_STRL_VIEW("PDOStatement"), ZAI_STRL_VIEW("execute"), DD_PDOSTATEMENT_EXECUTE},
+    };
+    for (size_t i = 0; i < sizeof(hooks) / sizeof(hooks[0]); ++i) {
+        zai_hook_install(hooks[i].scope, hooks[i].function, dd_pdo_begin, dd_pdo_end,
+                         ZAI_HOOK_AUX((void *)(uintptr_t)hooks[i].method, NULL), sizeof(dd_pdo_dynamic));
+    }
+}
+
+void ddtrace_pdo_handlers_rinit(void) {
+    zend_hash_init(&dd_pdo_connection_tags, 8, NULL, dd_pdo_tags_dtor, 0);
+    dd_pdo_telemetry_notified = false;
+}
+
+void ddtrace_pdo_handlers_rshutdown(void) {
+    zend_ulong key;
+    ZEND_HASH_FOREACH_NUM_KEY(&dd_pdo_connection_tags, key) { zend_weakrefs_hash_del(&dd_pdo_connection_tags, zend_weakref_key_to_object(key)); }
+    ZEND_HASH_FOREACH_END();
+    zend_hash_destroy(&dd_pdo_connection_tags);
+    // now ensure there's no use-after-free (zend_hash_init here is fine as memory allocation is deferred to first add)
+    zend_hash_init(&dd_pdo_connection_tags, 8, NULL, dd_pdo_tags_dtor, 0);
+}
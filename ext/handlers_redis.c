@@ -0,0 +1,673 @@
+#include <php.h>
+#include <stdbool.h>
+
+/* Comment to prevent reordering by code style fixer */
+#include <SAPI.h>
+#include <Zend/zend_smart_str.h>
+#include <Zend/zend_weakrefs.h>
+#include <ext/standard/url.h>
+#include <hook/hook.h>
+#include <main/php_variables.h>
+
+#include "configuration.h"
+#include "ddtrace.h"
+#include "handlers_db.h"
+#include "handlers_internal.h"
+#include "integrations/overhead.h"
+#include "span.h"
+#include "telemetry.h"
+
+/* Native port of DDTrace\Integrations\PHPRedis\PHPRedisIntegration for PHP 8.
+ *
+ * Span names are interned once at startup per command, so a traced command does not allocate its name nor its
+ * resource. Commands issued between multi()/pipeline() and exec() are not traced individually: the transaction is
+ * recorded as a single exec span starting at multi() and carrying the number of queued commands.
+ */
+
+#define DD_REDIS_DEFAULT_HOST "127.0.0.1"
+#define DD_REDIS_DEFAULT_PORT "6379"
+#define DD_REDIS_CMD_MAX_LEN 1000
+#define DD_REDIS_VALUE_MAX_LEN 100
+#define DD_REDIS_VALUE_TOO_LONG_MARK "..."
+
+typedef enum {
+    DD_REDIS_CONNECT,
+    DD_REDIS_CLUSTER_CONSTRUCT,
+    DD_REDIS_NO_ARGS,
+    DD_REDIS_SELECT,
+    DD_REDIS_COMMAND,
+    DD_REDIS_BATCH_START,
+    DD_REDIS_BATCH_EXEC,
+    DD_REDIS_BATCH_DISCARD,
+} dd_redis_kind;
+
+typedef struct {
+    const char *method;
+    dd_redis_kind kind;
+} dd_redis_command;
+
+static const dd_redis_command dd_redis_commands[] = {
+    {"connect", DD_REDIS_CONNECT},
+    {"pconnect", DD_REDIS_CONNECT},
+    {"open", DD_REDIS_CONNECT},
+    {"popen", DD_REDIS_CONNECT},
+    {"__construct", DD_REDIS_CLUSTER_CONSTRUCT},
+    {"close", DD_REDIS_NO_ARGS},
+    {"auth", DD_REDIS_NO_ARGS},
+    {"ping", DD_REDIS_NO_ARGS},
+    {"echo", DD_REDIS_NO_ARGS},
+    {"bgRewriteAOF", DD_REDIS_NO_ARGS},
+    {"bgSave", DD_REDIS_NO_ARGS},
+    {"flushAll", DD_REDIS_NO_ARGS},
+    {"flushDb", DD_REDIS_NO_ARGS},
+    {"save", DD_REDIS_NO_ARGS},
+    {"restore", DD_REDIS_NO_ARGS},
+    {"select", DD_REDIS_SELECT},
+    {"multi", DD_REDIS_BATCH_START},
+    {"pipeline", DD_REDIS_BATCH_START},
+    {"exec", DD_REDIS_BATCH_EXEC},
+    {"discard", DD_REDIS_BATCH_DISCARD},
+    {"swapdb", DD_REDIS_COMMAND},
+    {"append", DD_REDIS_COMMAND},
+    {"decr", DD_REDIS_COMMAND},
+    {"decrBy", DD_REDIS_COMMAND},
+    {"get", DD_REDIS_COMMAND},
+    {"getBit", DD_REDIS_COMMAND},
+    {"getRange", DD_REDIS_COMMAND},
+    {"getSet", DD_REDIS_COMMAND},
+    {"incr", DD_REDIS_COMMAND},
+    {"incrBy", DD_REDIS_COMMAND},
+    {"incrByFloat", DD_REDIS_COMMAND},
+    {"mGet", DD_REDIS_COMMAND},
+    {"getMultiple", DD_REDIS_COMMAND},
+    {"mSet", DD_REDIS_COMMAND},
+    {"mSetNx", DD_REDIS_COMMAND},
+    {"set", DD_REDIS_COMMAND},
+    {"setBit", DD_REDIS_COMMAND},
+    {"setEx", DD_REDIS_COMMAND},
+    {"pSetEx", DD_REDIS_COMMAND},
+    {"setNx", DD_REDIS_COMMAND},
+    {"setRange", DD_REDIS_COMMAND},
+    {"strLen", DD_REDIS_COMMAND},
+    {"del", DD_REDIS_COMMAND},
+    {"delete", DD_REDIS_COMMAND},
+    {"dump", DD_REDIS_COMMAND},
+    {"exists", DD_REDIS_COMMAND},
+    {"keys", DD_REDIS_COMMAND},
+    {"getKeys", DD_REDIS_COMMAND},
+    {"scan", DD_REDIS_COMMAND},
+    {"migrate", DD_REDIS_COMMAND},
+    {"move", DD_REDIS_COMMAND},
+    {"persist", DD_REDIS_COMMAND},
+    {"rename", DD_REDIS_COMMAND},
+    {"object", DD_REDIS_COMMAND},
+    {"randomKey", DD_REDIS_COMMAND},
+    {"renameKey", DD_REDIS_COMMAND},
+    {"renameNx", DD_REDIS_COMMAND},
+    {"type", DD_REDIS_COMMAND},
+    {"sort", DD_REDIS_COMMAND},
+    {"expire", DD_REDIS_COMMAND},
+    {"expireAt", DD_REDIS_COMMAND},
+    {"setTimeout", DD_REDIS_COMMAND},
+    {"pexpire", DD_REDIS_COMMAND},
+    {"pexpireAt", DD_REDIS_COMMAND},
+    {"ttl", DD_REDIS_COMMAND},
+    {"pttl", DD_REDIS_COMMAND},
+    {"hDel", DD_REDIS_COMMAND},
+    {"hExists", DD_REDIS_COMMAND},
+    {"hGet", DD_REDIS_COMMAND},
+    {"hGetAll", DD_REDIS_COMMAND},
+    {"hIncrBy", DD_REDIS_COMMAND},
+    {"hIncrByFloat", DD_REDIS_COMMAND},
+    {"hKeys", DD_REDIS_COMMAND},
+    {"hLen", DD_REDIS_COMMAND},
+    {"hMGet", DD_REDIS_COMMAND},
+    {"hMSet", DD_REDIS_COMMAND},
+    {"hSet", DD_REDIS_COMMAND},
+    {"hSetNx", DD_REDIS_COMMAND},
+    {"hVals", DD_REDIS_COMMAND},
+    {"hScan", DD_REDIS_COMMAND},
+    {"hStrLen", DD_REDIS_COMMAND},
+    {"blPop", DD_REDIS_COMMAND},
+    {"brPop", DD_REDIS_COMMAND},
+    {"bRPopLPush", DD_REDIS_COMMAND},
+    {"lGet", DD_REDIS_COMMAND},
+    {"lGetRange", DD_REDIS_COMMAND},
+    {"lIndex", DD_REDIS_COMMAND},
+    {"lInsert", DD_REDIS_COMMAND},
+    {"listTrim", DD_REDIS_COMMAND},
+    {"lLen", DD_REDIS_COMMAND},
+    {"lPop", DD_REDIS_COMMAND},
+    {"lPush", DD_REDIS_COMMAND},
+    {"lPushx", DD_REDIS_COMMAND},
+    {"lRange", DD_REDIS_COMMAND},
+    {"lRem", DD_REDIS_COMMAND},
+    {"lRemove", DD_REDIS_COMMAND},
+    {"lSet", DD_REDIS_COMMAND},
+    {"lSize", DD_REDIS_COMMAND},
+    {"lTrim", DD_REDIS_COMMAND},
+    {"rPop", DD_REDIS_COMMAND},
+    {"rPopLPush", DD_REDIS_COMMAND},
+    {"rPush", DD_REDIS_COMMAND},
+    {"rPushX", DD_REDIS_COMMAND},
+    {"sAdd", DD_REDIS_COMMAND},
+    {"sCard", DD_REDIS_COMMAND},
+    {"sContains", DD_REDIS_COMMAND},
+    {"sDiff", DD_REDIS_COMMAND},
+    {"sDiffStore", DD_REDIS_COMMAND},
+    {"sGetMembers", DD_REDIS_COMMAND},
+    {"sInter", DD_REDIS_COMMAND},
+    {"sInterStore", DD_REDIS_COMMAND},
+    {"sIsMember", DD_REDIS_COMMAND},
+    {"sMembers", DD_REDIS_COMMAND},
+    {"sMove", DD_REDIS_COMMAND},
+    {"sPop", DD_REDIS_COMMAND},
+    {"sRandMember", DD_REDIS_COMMAND},
+    {"sRem", DD_REDIS_COMMAND},
+    {"sRemove", DD_REDIS_COMMAND},
+    {"sScan", DD_REDIS_COMMAND},
+    {"sSize", DD_REDIS_COMMAND},
+    {"sUnion", DD_REDIS_COMMAND},
+    {"sUnionStore", DD_REDIS_COMMAND},
+    {"zAdd", DD_REDIS_COMMAND},
+    {"zCard", DD_REDIS_COMMAND},
+    {"zSize", DD_REDIS_COMMAND},
+    {"zCount", DD_REDIS_COMMAND},
+    {"zIncrBy", DD_REDIS_COMMAND},
+    {"zInter", DD_REDIS_COMMAND},
+    {"zInterstore", DD_REDIS_COMMAND},
+    {"zPopMax", DD_REDIS_COMMAND},
+    {"zPopMin", DD_REDIS_COMMAND},
+    {"zRange", DD_REDIS_COMMAND},
+    {"zRangeByScore", DD_REDIS_COMMAND},
+    {"zRevRangeByScore", DD_REDIS_COMMAND},
+    {"zRangeByLex", DD_REDIS_COMMAND},
+    {"zRank", DD_REDIS_COMMAND},
+    {"zRevRank", DD_REDIS_COMMAND},
+    {"zRem", DD_REDIS_COMMAND},
+    {"zRemove", DD_REDIS_COMMAND},
+    {"zDelete", DD_REDIS_COMMAND},
+    {"zRemRangeByRank", DD_REDIS_COMMAND},
+    {"zDeleteRangeByRank", DD_REDIS_COMMAND},
+    {"zRemRangeByScore", DD_REDIS_COMMAND},
+    {"zDeleteRangeByScore", DD_REDIS_COMMAND},
+    {"zRemoveRangeByScore", DD_REDIS_COMMAND},
+    {"zRevRange", DD_REDIS_COMMAND},
+    {"zScore", DD_REDIS_COMMAND},
+    {"zUnion", DD_REDIS_COMMAND},
+    {"zunionstore", DD_REDIS_COMMAND},
+    {"zScan", DD_REDIS_COMMAND},
+    {"publish", DD_REDIS_COMMAND},
+    {"rawCommand", DD_REDIS_COMMAND},
+    {"eval", DD_REDIS_COMMAND},
+    {"evalSha", DD_REDIS_COMMAND},
+    {"script", DD_REDIS_COMMAND},
+    {"getLastError", DD_REDIS_COMMAND},
+    {"clearLastError", DD_REDIS_COMMAND},
+    {"_unserialize", DD_REDIS_COMMAND},
+    {"_serialize", DD_REDIS_COMMAND},
+    {"isConnected", DD_REDIS_COMMAND},
+    {"getHost", DD_REDIS_COMMAND},
+    {"getPort", DD_REDIS_COMMAND},
+    {"getDbNum", DD_REDIS_COMMAND},
+    {"getTimeout", DD_REDIS_COMMAND},
+    {"getReadTimeout", DD_REDIS_COMMAND},
+    {"geoAdd", DD_REDIS_COMMAND},
+    {"geoHash", DD_REDIS_COMMAND},
+    {"geoPos", DD_REDIS_COMMAND},
+    {"geoDist", DD_REDIS_COMMAND},
+    {"geoRadius", DD_REDIS_COMMAND},
+    {"geoRadiusByMember", DD_REDIS_COMMAND},
+    {"xAck", DD_REDIS_COMMAND},
+    {"xAdd", DD_REDIS_COMMAND},
+    {"xClaim", DD_REDIS_COMMAND},
+    {"xDel", DD_REDIS_COMMAND},
+    {"xGroup", DD_REDIS_COMMAND},
+    {"xInfo", DD_REDIS_COMMAND},
+    {"xLen", DD_REDIS_COMMAND},
+    {"xPending", DD_REDIS_COMMAND},
+    {"xRange", DD_REDIS_COMMAND},
+    {"xRead", DD_REDIS_COMMAND},
+    {"xReadGroup", DD_REDIS_COMMAND},
+    {"xRevRange", DD_REDIS_COMMAND},
+    {"xTrim", DD_REDIS_COMMAND},
+};
+
+#define DD_REDIS_COMMANDS_COUNT (sizeof(dd_redis_commands) / sizeof(dd_redis_commands[0]))
+
+typedef struct {
+    const dd_redis_command *command;
+    zend_string *name;
+    bool cluster;
+} dd_redis_hook;
+
+// Indexed by [is RedisCluster][command]; only modified during startup
+static dd_redis_hook dd_redis_hooks[2][DD_REDIS_COMMANDS_COUNT];
+
+typedef struct {
+    zend_string *host;
+    zend_string *cluster_name;
+    zend_string *first_host;
+    zend_string *first_host_or_uds;
+    zend_long first_port;
+    uint64_t batch_start;
+    uint32_t batch_commands;
+    bool in_batch;
+} dd_redis_connection;
+
+typedef struct {
+    ddtrace_span_data *span;
+    uint64_t batch_start;
+} dd_redis_dynamic;
+
+ZEND_TLS HashTable dd_redis_connections;
+ZEND_TLS bool dd_redis_telemetry_notified;
+
+static void dd_redis_replace_string(zend_string **slot, zend_string *value) {
+    if (*slot) {
+        zend_string_release(*slot);
+    }
+    *slot = value;
+}
+
+static void dd_redis_connection_dtor(zval *zv) {
+    dd_redis_connection *conn = Z_PTR_P(zv);
+    dd_redis_replace_string(&conn->host, NULL);
+    dd_redis_replace_string(&conn->cluster_name, NULL);
+    dd_redis_replace_string(&conn->first_host, NULL);
+    dd_redis_replace_string(&conn->first_host_or_uds, NULL);
+    efree(conn);
+}
+
+static dd_redis_connection *dd_redis_find_connection(zend_object *obj) {
+    return zend_hash_index_find_ptr(&dd_redis_connections, zend_object_to_weakref_key(obj));
+}
+
+static dd_redis_connection *dd_redis_get_connection(zend_object *obj) {
+    dd_redis_connection *conn = dd_redis_find_connection(obj);
+    if (!conn) {
+        conn = ecalloc(1, sizeof(*conn));
+        if (!zend_weakrefs_hash_add_ptr(&dd_redis_connections, obj, conn)) {
+            zend_hash_index_update_ptr(&dd_redis_connections, zend_object_to_weakref_key(obj), conn);
+        }
+    }
+    return conn;
+}
+
+static bool dd_redis_is_numeric(zval *zv) {
+    return Z_TYPE_P(zv) == IS_LONG || Z_TYPE_P(zv) == IS_DOUBLE
+        || (Z_TYPE_P(zv) == IS_STRING && is_numeric_string(Z_STRVAL_P(zv), Z_STRLEN_P(zv), NULL, NULL, false));
+}
+
+static void dd_redis_parse_cluster(dd_redis_connection *conn, zend_execute_data *execute_data) {
+    zval *name = EX_NUM_ARGS() >= 1 ? ZEND_CALL_ARG(execute_data, 1) : NULL;
+    zval *seeds = EX_NUM_ARGS() >= 2 ? ZEND_CALL_ARG(execute_data, 2) : NULL;
+
+    zend_string *first_host_or_uds = NULL;
+    zval *first;
+    if (seeds && Z_TYPE_P(seeds) == IS_ARRAY && (first = zend_hash_index_find(Z_ARR_P(seeds), 0))) {
+        first_host_or_uds = zval_get_string(first);
+    } else if (name && Z_TYPE_P(name) == IS_STRING && sapi_module.treat_data) {
+        // Same format as parse_str(), e.g. "mycluster[]=localhost:7000&mycluster[]=localhost:7001"
+        char *ini_seeds = zend_ini_string_ex(ZEND_STRL("redis.clusters.seeds"), 0, NULL);
+        if (ini_seeds && *ini_seeds) {
+            zval clusters, *cluster;
+            array_init(&clusters);
+            sapi_module.treat_data(PARSE_STRING, estrdup(ini_seeds), &clusters);
+            if ((cluster = zend_symtable_find(Z_ARR(clusters), Z_STR_P(name))) && Z_TYPE_P(cluster) == IS_ARRAY
+                && (first = zend_hash_index_find(Z_ARR_P(cluster), 0))) {
+                first_host_or_uds = zval_get_string(first);
+            }
+            zval_ptr_dtor(&clusters);
+        }
+    }
+    if (!first_host_or_uds || ZSTR_LEN(first_host_or_uds) == 0) {
+        dd_redis_replace_string(&first_host_or_uds, zend_string_init(ZEND_STRL(DD_REDIS_DEFAULT_HOST), 0));
+    }
+
+    dd_redis_replace_string(&conn->cluster_name, name && Z_TYPE_P(name) == IS_STRING ? zend_string_copy(Z_STR_P(name)) : NULL);
+
+    php_url *url = php_url_parse_ex(ZSTR_VAL(first_host_or_uds), ZSTR_LEN(first_host_or_uds));
+    dd_redis_replace_string(&conn->first_host, url && url->host ? zend_string_copy(url->host) : zend_string_init(ZEND_STRL(DD_REDIS_DEFAULT_HOST), 0));
+    conn->first_port = url && url->port ? url->port : 0;
+    if (url) {
+        php_url_free(url);
+    }
+
+    dd_redis_replace_string(&conn->first_host_or_uds, first_host_or_uds);
+}
+
+static void dd_redis_append_part(smart_str *buf, bool *first, const char *str, size_t len) {
+    if (!*first) {
+        smart_str_appendc(buf, ' ');
+    }
+    *first = false;
+    smart_str_appendl(buf, str, len);
+}
+
+// Mirrors PHPRedisIntegration::normalizeArgs()
+static void dd_redis_normalize_args(smart_str *buf, zval *args, uint32_t argc) {
+    bool first = true;
+    size_t total_len = 0;
+    for (uint32_t i = 0; i < argc; ++i) {
+        if (total_len > DD_REDIS_CMD_MAX_LEN) {
+            break;
+        }
+
+        zval *arg = &args[i];
+        ZVAL_DEREF(arg);
+
+        zend_string *part;
+        switch (Z_TYPE_P(arg)) {
+            case IS_STRING:
+                part = zend_string_copy(Z_STR_P(arg));
+                break;
+            case IS_LONG:
+            case IS_DOUBLE:
+                part = zval_get_string(arg);
+                break;
+            case IS_NULL:
+                part = zend_string_init(ZEND_STRL("null"), 0);
+                break;
+            case IS_TRUE:
+            case IS_FALSE:
+                // the userland integration tests the (non-empty) argument list rather than the argument
+                part = zend_string_init(ZEND_STRL("true"), 0);
+                break;
+            case IS_ARRAY: {
+                // Best effort, see the userland integration: numeric keys in sequence are considered a list
+                zend_ulong expected_index = 0, index;
+                zend_string *key;
+                zval *val;
+                ZEND_HASH_FOREACH_KEY_VAL(Z_ARR_P(arg), index, key, val) {
+                    if (key) {
+                        dd_redis_append_part(buf, &first, ZSTR_VAL(key), ZSTR_LEN(key));
+                    } else if (index != expected_index) {
+                        char num[MAX_LENGTH_OF_LONG + 1];
+                        char *num_str = zend_print_ulong_to_buf(num + sizeof(num) - 1, index);
+                        dd_redis_append_part(buf, &first, num_str, num + sizeof(num) - 1 - num_str);
+                    }
+                    ++expected_index;
+
+                    smart_str nested = {0};
+                    dd_redis_normalize_args(&nested, val, 1);
+                    if (nested.s) {
+                        dd_redis_append_part(buf, &first, ZSTR_VAL(nested.s), ZSTR_LEN(nested.s));
+                        smart_str_free(&nested);
+                    } else {
+                        dd_redis_append_part(buf, &first, "", 0);
+                    }
+                } ZEND_HASH_FOREACH_END();
+                continue;
+            }
+            default:
+                dd_redis_append_part(buf, &first, ZEND_STRL("?"));
+                continue;
+        }
+
+        size_t len = ZSTR_LEN(part), written = MIN(len, DD_REDIS_VALUE_MAX_LEN);
+        dd_redis_append_part(buf, &first, ZSTR_VAL(part), written);
+        if (len > DD_REDIS_VALUE_MAX_LEN) {
+            smart_str_appendl(buf, ZEND_STRL(DD_REDIS_VALUE_TOO_LONG_MARK));
+            written += sizeof(DD_REDIS_VALUE_TOO_LONG_MARK) - 1;
+        }
+        if (total_len + len > DD_REDIS_CMD_MAX_LEN) {
+            smart_str_appendl(buf, ZEND_STRL(DD_REDIS_VALUE_TOO_LONG_MARK));
+            written += sizeof(DD_REDIS_VALUE_TOO_LONG_MARK) - 1;
+        }
+        total_len += written;
+        zend_string_release(part);
+    }
+}
+
+static void dd_redis_set_raw_command(ddtrace_span_data *span, dd_redis_hook *hook, zend_execute_data *execute_data) {
+    smart_str args = {0};
+    if (EX_NUM_ARGS()) {
+        dd_redis_normalize_args(&args, ZEND_CALL_ARG(execute_data, 1), EX_NUM_ARGS());
+    }
+
+    smart_str raw_command = {0};
+    smart_str_appends(&raw_command, hook->command->method);
+    if (args.s && ZSTR_LEN(args.s)) {
+        smart_str_appendc(&raw_command, ' ');
+        smart_str_append(&raw_command, args.s);
+    }
+    smart_str_free(&args);
+    smart_str_0(&raw_command);
+
+    ddtrace_db_add_meta_str(span, ZEND_STRL("redis.raw_command"), raw_command.s);
+    smart_str_free(&raw_command);
+}
+
+// Mirrors PHPRedisIntegration::enrichSpan()
+static void dd_redis_enrich_span(ddtrace_span_data *span, dd_redis_hook *hook, dd_redis_connection *conn) {
+    zend_string *service = NULL;
+    if (get_DD_TRACE_REDIS_CLIENT_SPLIT_BY_HOST() && conn) {
+        zend_string *host = conn->cluster_name && ZSTR_LEN(conn->cluster_name) ? conn->cluster_name
+                          : conn->first_host_or_uds && ZSTR_LEN(conn->first_host_or_uds) ? conn->first_host_or_uds
+                          : conn->host && ZSTR_LEN(conn->host) ? conn->host : NULL;
+        if (host) {
+            smart_str buf = {0};
+            smart_str_appends(&buf, "redis-");
+            ddtrace_db_append_normalized_host(&buf, host);
+            service = smart_str_extract(&buf);
+        }
+    }
+    if (!service) {
+        service = ddtrace_db_service_name(ZEND_STRL("phpredis"));
+    }
+    ddtrace_db_set_property_str(ddtrace_spandata_property_service(span), service);
+
+    ddtrace_db_set_property(ddtrace_spandata_property_type(span), ZEND_STRL("redis"));
+    ddtrace_db_add_meta(span, ZEND_STRL("span.kind"), ZEND_STRL("client"));
+    ddtrace_db_add_meta(span, ZEND_STRL("component"), ZEND_STRL("phpredis"));
+    ddtrace_db_add_meta(span, ZEND_STRL("db.system"), ZEND_STRL("redis"));
+
+    zval *prop_name = ddtrace_spandata_property_name(span);
+    zval_ptr_dtor(prop_name);
+    ZVAL_INTERNED_STR(prop_name, hook->name);
+
+    dd_redis_kind kind = hook->command->kind;
+    if (kind != DD_REDIS_CONNECT && kind != DD_REDIS_CLUSTER_CONSTRUCT && kind != DD_REDIS_SELECT) {
+        zval *prop_resource = ddtrace_spandata_property_resource(span);
+        zval_ptr_dtor(prop_resource);
+        ZVAL_INTERNED_STR(prop_resource, hook->name);
+    }
+}
+
+static void dd_redis_set_target(ddtrace_span_data *span, dd_redis_hook *hook, dd_redis_connection *conn) {
+    if (conn) {
+        if (!hook->cluster) {
+            if (conn->host) {
+                ddtrace_db_add_meta_str(span, ZEND_STRL("out.host"), conn->host);
+            }
+        } else if (conn->cluster_name && ZSTR_LEN(conn->cluster_name)) {
+            ddtrace_db_add_meta_str(span, ZEND_STRL("_dd.cluster.name"), conn->cluster_name);
+        } else if (conn->first_host && ZSTR_LEN(conn->first_host)) {
+            ddtrace_db_add_meta_str(span, ZEND_STRL("_dd.first.configured.host"), conn->first_host);
+        }
+    }
+    ddtrace_db_set_peer_service_sources(span);
+}
+
+static bool dd_redis_run_begin(zend_ulong invocation, zend_execute_data *execute_data, void *auxiliary, void *dynamic) {
+    dd_redis_hook *hook = auxiliary;
+    dd_redis_dynamic *dyn = dynamic;
+    dd_redis_kind kind = hook->command->kind;
+    dyn->span = NULL;
+    dyn->batch_start = 0;
+
+    if (!get_DD_TRACE_ENABLED() || !ddtrace_config_integration_enabled(DDTRACE_INTEGRATION_PHPREDIS) || Z_TYPE(EX(This)) != IS_OBJECT) {
+        return true;
+    }
+
+    if (!dd_redis_telemetry_notified) {
+        dd_redis_telemetry_notified = true;
+        ddtrace_telemetry_notify_integration(ZEND_STRL("phpredis"));
+    }
+
+    zend_object *obj = Z_OBJ(EX(This));
+    dd_redis_connection *conn;
+    if (kind == DD_REDIS_CONNECT) {
+        conn = dd_redis_get_connection(obj);
+        zval *host = EX_NUM_ARGS() >= 1 ? ZEND_CALL_ARG(execute_data, 1) : NULL;
+        dd_redis_replace_string(&conn->host, host && Z_TYPE_P(host) == IS_STRING ? zend_string_copy(Z_STR_P(host))
+                                                                                   : zend_string_init(ZEND_STRL(DD_REDIS_DEFAULT_HOST), 0));
+    } else if (kind == DD_REDIS_CLUSTER_CONSTRUCT) {
+        conn = dd_redis_get_connection(obj);
+        dd_redis_parse_cluster(conn, execute_data);
+    } else if (kind == DD_REDIS_BATCH_START) {
+        // the transaction is traced by exec()
+        dyn->batch_start = ddtrace_monotonic_nanoseconds();
+        return true;
+    } else {
+        conn = dd_redis_find_connection(obj);
+        if (conn && conn->in_batch && kind != DD_REDIS_BATCH_EXEC && kind != DD_REDIS_BATCH_DISCARD) {
+            ++conn->batch_commands;
+            return true;
+        }
+    }
+
+    if (ddtrace_tracer_is_limited() || zai_hook_lightweight) {
+        return true;
+    }
+
+    ddtrace_span_data *span = dyn->span = ddtrace_alloc_execute_data_span(invocation, execute_data);
+    dd_redis_enrich_span(span, hook, conn);
+
+    switch (kind) {
+        case DD_REDIS_CONNECT: {
+            ddtrace_db_add_meta_str(span, ZEND_STRL("out.host"), conn->host);
+            zval *port = EX_NUM_ARGS() >= 2 ? ZEND_CALL_ARG(execute_data, 2) : NULL;
+            if (port && dd_redis_is_numeric(port)) {
+                zend_string *port_str = zval_get_string(port);
+                ddtrace_db_add_meta_str(span, ZEND_STRL("out.port"), port_str);
+                zend_string_release(port_str);
+            } else {
+                ddtrace_db_add_meta(span, ZEND_STRL("out.port"), ZEND_STRL(DD_REDIS_DEFAULT_PORT));
+            }
+            break;
+        }
+
+        case DD_REDIS_CLUSTER_CONSTRUCT:
+            ddtrace_db_add_meta_str(span, ZEND_STRL("out.host"), conn->first_host);
+            if (conn->first_port) {
+                zend_string *port = zend_long_to_str(conn->first_port);
+                ddtrace_db_add_meta_str(span, ZEND_STRL("out.port"), port);
+                zend_string_release(port);
+            } else {
+                ddtrace_db_add_meta(span, ZEND_STRL("out.port"), ZEND_STRL(DD_REDIS_DEFAULT_PORT));
+            }
+            break;
+
+        case DD_REDIS_SELECT: {
+            zval *index = EX_NUM_ARGS() >= 1 ? ZEND_CALL_ARG(execute_data, 1) : NULL;
+            if (index && dd_redis_is_numeric(index)) {
+                zend_string *index_str = zval_get_string(index);
+                ddtrace_db_add_meta_str(span, ZEND_STRL("db.index"), index_str);
+                zend_string_release(index_str);
+            }
+            dd_redis_set_target(span, hook, conn);
+            break;
+        }
+
+        case DD_REDIS_NO_ARGS:
+            dd_redis_set_target(span, hook, conn);
+            break;
+
+        case DD_REDIS_BATCH_EXEC:
+            if (conn && conn->in_batch) {
+                // the span covers the whole transaction, starting at multi()/pipeline()
+                span->start -= span->duration_start - conn->batch_start;
+                span->duration_start = conn->batch_start;
+                ddtrace_db_add_metric(span, ZEND_STRL("redis.pipeline_length"), (double)conn->batch_commands);
+            }
+            // fallthrough
+
+        case DD_REDIS_BATCH_DISCARD:
+        case DD_REDIS_COMMAND:
+            dd_redis_set_raw_command(span, hook, execute_data);
+            dd_redis_set_target(span, hook, conn);
+            break;
+
+        case DD_REDIS_BATCH_START:
+            break;
+    }
+
+    return true;
+}
+
+static void dd_redis_run_end(zend_ulong invocation, zend_execute_data *execute_data, zval *retval, void *auxiliary, void *dynamic) {
+    dd_redis_hook *hook = auxiliary;
+    dd_redis_dynamic *dyn = dynamic;
+    dd_redis_kind kind = hook->command->kind;
+
+    if (kind == DD_REDIS_BATCH_START) {
+        // multi() and pipeline() return the instance itself on success
+        if (dyn->batch_start && Z_TYPE_P(retval) == IS_OBJECT && !EG(exception)) {
+            dd_redis_connection *conn = dd_redis_get_connection(Z_OBJ(EX(This)));
+            if (!conn->in_batch) {
+                conn->in_batch = true;
+                conn->batch_commands = 0;
+                conn->batch_start = dyn->batch_start;
+            }
+        }
+        return;
+    }
+
+    if ((kind == DD_REDIS_BATCH_EXEC || kind == DD_REDIS_BATCH_DISCARD) && Z_TYPE(EX(This)) == IS_OBJECT) {
+        dd_redis_connection *conn = dd_redis_find_connection(Z_OBJ(EX(This)));
+        if (conn) {
+            conn->in_batch = false;
+        }
+    }
+
+    if (dyn->span) {
+        ddtrace_db_close_span(invocation, dyn->span);
+    }
+}
+
+DDTRACE_MEASURED_BEGIN_HANDLER(dd_redis_begin, DDTRACE_INTEGRATION_PHPREDIS, dd_redis_run_begin)
+DDTRACE_MEASURED_END_HANDLER(dd_redis_end, DDTRACE_INTEGRATION_PHPREDIS, dd_redis_run_end)
+
+void ddtrace_redis_handlers_startup(void) {
+    // if we cannot find ext/redis then do not instrument it
+    if (!zend_hash_str_exists(&module_registry, ZEND_STRL("redis"))) {
+        return;
+    }
+
+    static const zai_string_view classes[] = {ZAI_STRL_VIEW("Redis"), ZAI_STRL_VIEW("RedisCluster")};
+    for (int cluster = 0; cluster < 2; ++cluster) {
+        for (size_t i = 0; i < DD_REDIS_COMMANDS_COUNT; ++i) {
+            const dd_redis_command *command = &dd_redis_commands[i];
+            if ((command->kind == DD_REDIS_CONNECT && cluster) || (command->kind == DD_REDIS_CLUSTER_CONSTRUCT && !cluster)) {
+                continue;
+            }
+
+            dd_redis_hook *hook = &dd_redis_hooks[cluster][i];
+            hook->command = command;
+            hook->cluster = cluster;
+
+            char name[64];
+            int name_len = snprintf(name, sizeof(name), "%s.%s", classes[cluster].ptr, command->method);
+            hook->name = zend_string_init_interned(name, name_len, 1);
+
+            zai_string_view method = {.len = strlen(command->method), .ptr = command->method};
+            zai_hook_install(classes[cluster], method, dd_redis_begin, dd_redis_end, ZAI_HOOK_AUX(hook, NULL), sizeof(dd_redis_dynamic));
+        }
+    }
+}
+
+void ddtrace_redis_handlers_rinit(void) {
+    zend_hash_init(&dd_redis_connections, 8, NULL, dd_redis_connection_dtor, 0);
+    dd_redis_telemetry_notified = false;
+}
+
+void ddtrace_redis_handlers_rshutdown(void) {
+    zend_ulong key;
+    ZEND_HASH_FOREACH_NUM_KEY(&dd_redis_connections, key) { zend_weakrefs_hash_del(&dd_redis_connections, zend_weakref_key_to_object(key)); }
+    ZEND_HASH_FOREACH_END();
+    zend_hash_destroy(&dd_redis_connections);
+    // now ensure there's no use-after-free (zend_hash_init here is fine as memory allocation is deferred to first add)
+    zend_hash_init(&dd_redis_connections, 8, NULL, dd_redis_connection_dtor, 0);
+}
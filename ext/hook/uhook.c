@@ -6,6 +6,7 @@
 #include "../compatibility.h"
 #include "../configuration.h"
 #include "../logging.h"
+#include "../integrations/overhead.h"
 
 #define HOOK_INSTANCE 0x1
 
@@ -34,9 +35,18 @@ typedef struct {
     zend_long id[];
 } dd_closure_list;
 
+// A hook closure rebound to the scope it was last called in. Rebinding copies the op_array and allocates a fresh
+// run-time cache, so we keep the copy (and its warm cache) around as long as the called scope does not change.
+typedef struct {
+    zend_class_entry *scope;
+    zend_op_array *op_array;
+} dd_uhook_bound_closure;
+
 typedef struct {
     zend_object *begin;
     zend_object *end;
+    dd_uhook_bound_closure begin_bound;
+    dd_uhook_bound_closure end_bound;
     bool running;
     zend_long id;
 
@@ -45,6 +55,7 @@ typedef struct {
     zend_string *function;
     zend_string *file;
     zend_object *closure;
+    ddtrace_integration_name integration;
 } dd_uhook_def;
 
 typedef struct {
@@ -59,6 +70,7 @@ typedef struct {
     zval *retval_ptr;
     ddtrace_span_data *span;
     ddtrace_span_stack *prior_stack;
+    uint64_t lightweight_start;
 } dd_hook_data;
 
 typedef struct {
@@ -73,6 +85,58 @@ static zend_object *dd_hook_data_create(zend_class_entry *class_type) {
     return &hook_data->std;
 }
 
+#if PHP_VERSION_ID >= 80000
+// HookData objects which were not retained by the hook closures are recycled instead of being freed and constructed anew
+#define DD_HOOK_DATA_POOL_SIZE 32
+ZEND_TLS dd_hook_data *dd_hook_data_pool[DD_HOOK_DATA_POOL_SIZE];
+ZEND_TLS uint32_t dd_hook_data_pool_count;
+#endif
+
+static dd_hook_data *dd_hook_data_acquire(void) {
+#if PHP_VERSION_ID >= 80000
+    if (dd_hook_data_pool_count) {
+        return dd_hook_data_pool[--dd_hook_data_pool_count];
+    }
+#endif
+    return (dd_hook_data *)dd_hook_data_create(ddtrace_hook_data_ce);
+}
+
+static void dd_hook_data_release(dd_hook_data *hook_data) {
+#if PHP_VERSION_ID >= 80000
+    zend_object *obj = &hook_data->std;
+    if (GC_REFCOUNT(obj) == 1 && !obj->properties && !(GC_FLAGS(obj) & IS_OBJ_WEAKLY_REFERENCED) && dd_hook_data_pool_count < DD_HOOK_DATA_POOL_SIZE) {
+        // reset the declared properties to their defaults, mirroring zend_object_std_dtor() and object_properties_init()
+        zval *prop = obj->properties_table, *end = prop + obj->ce->default_properties_count, *default_prop = obj->ce->default_properties_table;
+        for (; prop < end; ++prop, ++default_prop) {
+            if (Z_REFCOUNTED_P(prop)) {
+                if (Z_ISREF_P(prop) && ZEND_REF_HAS_TYPE_SOURCES(Z_REF_P(prop))) {
+                    ZEND_REF_DEL_TYPE_SOURCE(Z_REF_P(prop), zend_get_typed_property_info_for_slot(obj, prop));
+                }
+                zval garbage;
+                ZVAL_COPY_VALUE(&garbage, prop);
+                ZVAL_COPY_PROP(prop, default_prop);
+                zval_ptr_dtor(&garbage);
+            } else {
+                ZVAL_COPY_PROP(prop, default_prop);
+            }
+        }
+
+        // destructors invoked above may have grabbed a reference to it
+        if (GC_REFCOUNT(obj) == 1 && !obj->properties) {
+            hook_data->invocation = 0;
+            hook_data->execute_data = NULL;
+            hook_data->retval_ptr = NULL;
+            hook_data->span = NULL;
+            hook_data->prior_stack = NULL;
+            hook_data->lightweight_start = 0;
+            dd_hook_data_pool[dd_hook_data_pool_count++] = hook_data;
+            return;
+        }
+    }
+#endif
+    OBJ_RELEASE(&hook_data->std);
+}
+
 HashTable *dd_uhook_collect_args(zend_execute_data *execute_data) {
     uint32_t num_args = EX_NUM_ARGS();
 
@@ -163,17 +227,90 @@ void dd_uhook_report_sandbox_error(zend_execute_data *execute_data, zend_object
     }
 }
 
-static void dd_uhook_call_hook(zend_execute_data *execute_data, zend_object *closure, dd_hook_data *hook_data) {
+static void dd_uhook_free_bound_closure(dd_uhook_bound_closure *bound) {
+    if (bound->op_array) {
+#if PHP_VERSION_ID >= 70400
+        efree(ZEND_MAP_PTR(bound->op_array->run_time_cache));
+#else
+        efree(bound->op_array->run_time_cache);
+#endif
+        efree(bound->op_array);
+        bound->op_array = NULL;
+    }
+    bound->scope = NULL;
+}
+
+// Returns the closure function rebound to scope, the same way zai_symbol_call() would rebind it, or NULL if it cannot be cached
+static zend_function *dd_uhook_bind_closure(dd_uhook_bound_closure *bound, zend_object *closure, zend_class_entry *scope) {
+    if (bound->scope == scope) {
+        return (zend_function *)bound->op_array;
+    }
+
+#if PHP_VERSION_ID >= 80000
+    zend_function *closure_func = (zend_function *)zend_get_closure_method_def(closure);
+#else
+    zval closure_zv;
+    ZVAL_OBJ(&closure_zv, closure);
+    zend_function *closure_func = (zend_function *)zend_get_closure_method_def(&closure_zv);
+#endif
+    if (closure_func->type != ZEND_USER_FUNCTION || (closure_func->common.fn_flags & (ZEND_ACC_FAKE_CLOSURE | ZEND_ACC_GENERATOR))) {
+        return NULL;
+    }
+
+    dd_uhook_free_bound_closure(bound);
+
+    zend_op_array *op_array = emalloc(sizeof(zend_op_array));
+    memcpy(op_array, closure_func, sizeof(zend_op_array));
+    op_array->scope = scope;
+    op_array->fn_flags &= ~ZEND_ACC_CLOSURE;
+#if PHP_VERSION_ID >= 70400
+    op_array->fn_flags |= ZEND_ACC_HEAP_RT_CACHE;
+#if PHP_VERSION_ID >= 80200
+    void *ptr = emalloc(op_array->cache_size);
+    ZEND_MAP_PTR_INIT(op_array->run_time_cache, ptr);
+#else
+    void *ptr = emalloc(op_array->cache_size + sizeof(void *));
+    ZEND_MAP_PTR_INIT(op_array->run_time_cache, ptr);
+    ptr = (char*)ptr + sizeof(void*);
+    ZEND_MAP_PTR_SET(op_array->run_time_cache, ptr);
+#endif
+    memset(ptr, 0, op_array->cache_size);
+#else
+    op_array->run_time_cache = ecalloc(1, op_array->cache_size);
+#endif
+
+    bound->scope = scope;
+    bound->op_array = op_array;
+    return (zend_function *)op_array;
+}
+
+static void dd_uhook_call_hook(zend_execute_data *execute_data, zend_object *closure, dd_uhook_bound_closure *bound, dd_hook_data *hook_data) {
     zval closure_zv, hook_data_zv;
     ZVAL_OBJ(&closure_zv, closure);
     ZVAL_OBJ(&hook_data_zv, &hook_data->std);
 
-    bool has_this = getThis() != NULL;
+    zval *object = getThis();
+    if (!object) {
+        object = zend_get_closure_this_ptr(&closure_zv);
+        if (Z_TYPE_P(object) != IS_OBJECT) {
+            object = NULL;
+        }
+    }
+
     zval rv;
     zai_sandbox sandbox;
-    bool success = zai_symbol_call(has_this ? ZAI_SYMBOL_SCOPE_OBJECT : ZAI_SYMBOL_SCOPE_GLOBAL, has_this ? &EX(This) : NULL,
-                                   ZAI_SYMBOL_FUNCTION_CLOSURE, &closure_zv,
-                                   &rv, 1 | ZAI_SYMBOL_SANDBOX, &sandbox, &hook_data_zv);
+    bool success;
+    zend_function *bound_func;
+    if (object && (bound_func = dd_uhook_bind_closure(bound, closure, Z_OBJCE_P(object)))) {
+        // fast path: the prepared function only needs a frame push, no callable resolution or rebinding
+        success = zai_symbol_call(ZAI_SYMBOL_SCOPE_OBJECT, object,
+                                  ZAI_SYMBOL_FUNCTION_KNOWN, bound_func,
+                                  &rv, 1 | ZAI_SYMBOL_SANDBOX, &sandbox, &hook_data_zv);
+    } else {
+        success = zai_symbol_call(getThis() ? ZAI_SYMBOL_SCOPE_OBJECT : ZAI_SYMBOL_SCOPE_GLOBAL, getThis(),
+                                  ZAI_SYMBOL_FUNCTION_CLOSURE, &closure_zv,
+                                  &rv, 1 | ZAI_SYMBOL_SANDBOX, &sandbox, &hook_data_zv);
+    }
     if (!success || PG(last_error_message)) {
         dd_uhook_report_sandbox_error(execute_data, closure);
     }
@@ -206,9 +343,7 @@ static bool dd_uhook_match_filepath(zend_string *file, zend_string *source) {
     return false;
 }
 
-static bool dd_uhook_begin(zend_ulong invocation, zend_execute_data *execute_data, void *auxiliary, void *dynamic) {
-    dd_uhook_def *def = auxiliary;
-    dd_uhook_dynamic *dyn = dynamic;
+static bool dd_uhook_run_begin(zend_ulong invocation, zend_execute_data *execute_data, dd_uhook_def *def, dd_uhook_dynamic *dyn) {
 
     if (def->file && (!execute_data->func->op_array.filename || !dd_uhook_match_filepath(execute_data->func->op_array.filename, def->file))) {
         dyn->hook_data = NULL;
@@ -220,7 +355,7 @@ static bool dd_uhook_begin(zend_ulong invocation, zend_execute_data *execute_dat
         return true;
     }
 
-    dyn->hook_data = (dd_hook_data *)dd_hook_data_create(ddtrace_hook_data_ce);
+    dyn->hook_data = dd_hook_data_acquire();
 
     dyn->hook_data->invocation = invocation;
     ZVAL_LONG(&dyn->hook_data->property_id, def->id);
@@ -238,7 +373,7 @@ static bool dd_uhook_begin(zend_ulong invocation, zend_execute_data *execute_dat
         dyn->hook_data->execute_data = execute_data;
 
         def->running = true;
-        dd_uhook_call_hook(execute_data, def->begin, dyn->hook_data);
+        dd_uhook_call_hook(execute_data, def->begin, &def->begin_bound, dyn->hook_data);
         def->running = false;
     }
     dyn->hook_data->execute_data = NULL;
@@ -246,9 +381,7 @@ static bool dd_uhook_begin(zend_ulong invocation, zend_execute_data *execute_dat
     return true;
 }
 
-static void dd_uhook_end(zend_ulong invocation, zend_execute_data *execute_data, zval *retval, void *auxiliary, void *dynamic) {
-    dd_uhook_def *def = auxiliary;
-    dd_uhook_dynamic *dyn = dynamic;
+static void dd_uhook_run_end(zend_ulong invocation, zend_execute_data *execute_data, zval *retval, dd_uhook_def *def, dd_uhook_dynamic *dyn) {
 
     if (!dyn->hook_data) {
         return;
@@ -303,11 +436,15 @@ static void dd_uhook_end(zend_ulong invocation, zend_execute_data *execute_data,
 
         def->running = true;
         dyn->hook_data->retval_ptr = retval;
-        dd_uhook_call_hook(execute_data, def->end, dyn->hook_data);
+        dd_uhook_call_hook(execute_data, def->end, &def->end_bound, dyn->hook_data);
         dyn->hook_data->retval_ptr = NULL;
         def->running = false;
     }
 
+    if (dyn->hook_data->lightweight_start) {
+        ddtrace_lightweight_skipped_span_end(dyn->hook_data->lightweight_start);
+    }
+
     if (span) {
         dyn->hook_data->span = NULL;
         // e.g. spans started in limited mode are never properly started
@@ -322,11 +459,37 @@ static void dd_uhook_end(zend_ulong invocation, zend_execute_data *execute_data,
         }
     }
 
-    OBJ_RELEASE(&dyn->hook_data->std);
+    dd_hook_data_release(dyn->hook_data);
+}
+
+// The time spent in the hook closures is accounted to the integration which installed the hook
+static bool dd_uhook_begin(zend_ulong invocation, zend_execute_data *execute_data, void *auxiliary, void *dynamic) {
+    dd_uhook_def *def = auxiliary;
+    uint64_t overhead_start = ddtrace_integration_overhead_start(def->integration);
+    ddtrace_integration_name previous_owner = ddtrace_integration_overhead_set_owner(def->integration);
+
+    bool result = dd_uhook_run_begin(invocation, execute_data, def, dynamic);
+
+    ddtrace_integration_overhead_set_owner(previous_owner);
+    ddtrace_integration_overhead_stop(def->integration, overhead_start);
+    return result;
+}
+
+static void dd_uhook_end(zend_ulong invocation, zend_execute_data *execute_data, zval *retval, void *auxiliary, void *dynamic) {
+    dd_uhook_def *def = auxiliary;
+    uint64_t overhead_start = ddtrace_integration_overhead_start(def->integration);
+    ddtrace_integration_name previous_owner = ddtrace_integration_overhead_set_owner(def->integration);
+
+    dd_uhook_run_end(invocation, execute_data, retval, def, dynamic);
+
+    ddtrace_integration_overhead_set_owner(previous_owner);
+    ddtrace_integration_overhead_stop(def->integration, overhead_start);
 }
 
 static void dd_uhook_dtor(void *data) {
     dd_uhook_def *def = data;
+    dd_uhook_free_bound_closure(&def->begin_bound);
+    dd_uhook_free_bound_closure(&def->end_bound);
     if (def->begin) {
         OBJ_RELEASE(def->begin);
     }
@@ -423,6 +586,8 @@ type_error:
     dd_uhook_def *def = emalloc(sizeof(*def));
     def->closure = NULL;
     def->running = false;
+    def->begin_bound = (dd_uhook_bound_closure){0};
+    def->end_bound = (dd_uhook_bound_closure){0};
     def->begin = begin ? Z_OBJ_P(begin) : NULL;
     if (def->begin) {
         GC_ADDREF(def->begin);
@@ -432,6 +597,7 @@ type_error:
         GC_ADDREF(def->end);
     }
     def->id = -1;
+    def->integration = ddtrace_integration_overhead_owner();
 
     uint32_t hook_limit = get_DD_TRACE_HOOK_LIMIT();
 
@@ -596,8 +762,11 @@ void dd_uhook_span(INTERNAL_FUNCTION_PARAMETERS, bool unlimited) {
         RETURN_OBJ_COPY(&hookData->span->std);
     }
 
-    // pre-hook check
-    if (!hookData->execute_data || (!unlimited && ddtrace_tracer_is_limited()) || !get_DD_TRACE_ENABLED()) {
+    // pre-hook check; in lightweight tracing the closure still runs, e.g. to propagate headers, but its span is never serialized
+    if (!hookData->execute_data || (!unlimited && ddtrace_tracer_is_limited()) || zai_hook_lightweight || !get_DD_TRACE_ENABLED()) {
+        if (hookData->execute_data && zai_hook_lightweight) {
+            hookData->lightweight_start = ddtrace_lightweight_skip_span();
+        }
         // dummy span, which never gets pushed
         hookData->span = ddtrace_init_dummy_span();
         RETURN_OBJ_COPY(&hookData->span->std);
@@ -729,11 +898,18 @@ ZEND_METHOD(DDTrace_HookData, overrideReturnValue) {
 }
 
 void zai_uhook_rinit() {
+#if PHP_VERSION_ID >= 80000
+    dd_hook_data_pool_count = 0;
+#endif
     zend_hash_init(&dd_active_hooks, 8, NULL, NULL, 0);
     zend_hash_init(&dd_closure_hooks, 8, NULL, NULL, 0);
 }
 
 void zai_uhook_rshutdown() {
+#if PHP_VERSION_ID >= 80000
+    // pooled objects are freed along with the objects store
+    dd_hook_data_pool_count = 0;
+#endif
     zend_hash_destroy(&dd_closure_hooks);
     zend_hash_destroy(&dd_active_hooks);
 }
@@ -406,9 +406,10 @@ void dd_uhook_on_function_resolve(zend_function *func) {
             zval_ptr_dtor(&value);
         }
 
+        // only creates a span, which would be discarded in lightweight tracing
         zai_hook_install_resolved_generator(func,
                                             dd_uhook_begin, dd_uhook_generator_resumption, dd_uhook_generator_yield, dd_uhook_end,
-                                            ZAI_HOOK_AUX(def, dd_uhook_dtor), sizeof(dd_uhook_dynamic));
+                                            ZAI_HOOK_AUX_LIGHTWEIGHT_SKIP(def, dd_uhook_dtor), sizeof(dd_uhook_dynamic));
 
     }
 }
@@ -5,6 +5,7 @@
 #include <sandbox/sandbox.h>
 
 #include "../logging.h"
+#include "../integrations/overhead.h"
 
 extern void (*profiling_interrupt_function)(zend_execute_data *);
 
@@ -15,11 +16,13 @@ typedef struct {
     bool run_if_limited;
     bool active;
     bool allow_recursion;
+    ddtrace_integration_name integration;
 } dd_uhook_def;
 
 typedef struct {
     zend_array *args;
     ddtrace_span_data *span;
+    uint64_t lightweight_start;
     bool skipped;
     bool dropped_span;
     bool was_primed;
@@ -85,9 +88,28 @@ static bool dd_uhook_call(zend_object *closure, bool tracing, dd_uhook_dynamic *
     return Z_TYPE(rv) != IS_FALSE;
 }
 
-static bool dd_uhook_begin(zend_ulong invocation, zend_execute_data *execute_data, void *auxiliary, void *dynamic) {
-    dd_uhook_def *def = auxiliary;
-    dd_uhook_dynamic *dyn = dynamic;
+// In lightweight tracing the closures still run, e.g. to propagate headers or rewrite queries, but on a dummy span
+static void dd_uhook_alloc_span(zend_ulong invocation, zend_execute_data *execute_data, dd_uhook_dynamic *dyn) {
+    if (zai_hook_lightweight) {
+        dyn->lightweight_start = ddtrace_lightweight_skip_span();
+        dyn->span = ddtrace_init_dummy_span();
+    } else {
+        dyn->lightweight_start = 0;
+        dyn->span = ddtrace_alloc_execute_data_span(invocation, execute_data);
+    }
+}
+
+static void dd_uhook_clear_span(zend_ulong invocation, dd_uhook_dynamic *dyn, bool keep) {
+    if (dyn->lightweight_start) {
+        ddtrace_lightweight_skipped_span_end(dyn->lightweight_start);
+        dyn->lightweight_start = 0;
+        OBJ_RELEASE(&dyn->span->std);
+    } else {
+        ddtrace_clear_execute_data_span(invocation, keep);
+    }
+}
+
+static bool dd_uhook_run_begin(zend_ulong invocation, zend_execute_data *execute_data, dd_uhook_def *def, dd_uhook_dynamic *dyn) {
 
     if ((!def->run_if_limited && ddtrace_tracer_is_limited()) || (def->active && !def->allow_recursion) || !get_DD_TRACE_ENABLED()) {
         dyn->skipped = true;
@@ -101,13 +123,13 @@ static bool dd_uhook_begin(zend_ulong invocation, zend_execute_data *execute_dat
     dyn->args = dd_uhook_collect_args(execute_data);
 
     if (def->tracing) {
-        dyn->span = ddtrace_alloc_execute_data_span(invocation, execute_data);
+        dd_uhook_alloc_span(invocation, execute_data, dyn);
     }
 
     if (def->begin) {
         dyn->dropped_span = !dd_uhook_call(def->begin, def->tracing, dyn, execute_data, &EG(uninitialized_zval));
         if (def->tracing && dyn->dropped_span) {
-            ddtrace_clear_execute_data_span(invocation, false);
+            dd_uhook_clear_span(invocation, dyn, false);
         }
     }
 
@@ -132,14 +154,17 @@ static void dd_uhook_generator_resumption(zend_ulong invocation, zend_execute_da
     }
 
     if (def->tracing) {
-        dyn->span = ddtrace_alloc_execute_data_span(invocation, execute_data);
+        if (!dyn->dropped_span && dyn->lightweight_start) {
+            dd_uhook_clear_span(invocation, dyn, false); // without end closure, nothing released the dummy span on yield
+        }
+        dd_uhook_alloc_span(invocation, execute_data, dyn);
         dyn->dropped_span = false;
     }
 
     if (def->begin) {
         dyn->dropped_span = !dd_uhook_call(def->begin, def->tracing, dyn, execute_data, value);
         if (def->tracing && dyn->dropped_span) {
-            ddtrace_clear_execute_data_span(invocation, false);
+            dd_uhook_clear_span(invocation, dyn, false);
         }
     }
 }
@@ -157,7 +182,7 @@ static void dd_uhook_generator_yield(zend_ulong invocation, zend_execute_data *e
     if (def->tracing && !dyn->dropped_span) {
         if (dyn->span->duration == DDTRACE_DROPPED_SPAN) {
             dyn->dropped_span = true;
-            ddtrace_clear_execute_data_span(invocation, false);
+            dd_uhook_clear_span(invocation, dyn, false);
 
             if (get_DD_TRACE_ENABLED()) {
                 ddtrace_log_errf("Cannot run tracing closure for %s(); spans out of sync", ZSTR_VAL(EX(func)->common.function_name));
@@ -175,15 +200,13 @@ static void dd_uhook_generator_yield(zend_ulong invocation, zend_execute_data *e
     if (def->end && (!def->tracing || !dyn->dropped_span)) {
         bool keep_span = dd_uhook_call(def->end, def->tracing, dyn, execute_data, value);
         if (def->tracing && !dyn->dropped_span) {
-            ddtrace_clear_execute_data_span(invocation, keep_span);
+            dd_uhook_clear_span(invocation, dyn, keep_span);
         }
         dyn->dropped_span = true;
     }
 }
 
-static void dd_uhook_end(zend_ulong invocation, zend_execute_data *execute_data, zval *retval, void *auxiliary, void *dynamic) {
-    dd_uhook_def *def = auxiliary;
-    dd_uhook_dynamic *dyn = dynamic;
+static void dd_uhook_run_end(zend_ulong invocation, zend_execute_data *execute_data, zval *retval, dd_uhook_def *def, dd_uhook_dynamic *dyn) {
     bool keep_span = true;
 
     if (dyn->skipped) {
@@ -193,7 +216,7 @@ static void dd_uhook_end(zend_ulong invocation, zend_execute_data *execute_data,
     if (def->tracing && !dyn->dropped_span) {
         if (dyn->span->duration == DDTRACE_DROPPED_SPAN) {
             dyn->dropped_span = true;
-            ddtrace_clear_execute_data_span(invocation, false);
+            dd_uhook_clear_span(invocation, dyn, false);
 
             if (get_DD_TRACE_ENABLED()) {
                 ddtrace_log_errf("Cannot run tracing closure for %s(); spans out of sync", ZSTR_VAL(EX(func)->common.function_name));
@@ -228,12 +251,36 @@ static void dd_uhook_end(zend_ulong invocation, zend_execute_data *execute_data,
     }
 
     if (def->tracing && !dyn->dropped_span) {
-        ddtrace_clear_execute_data_span(invocation, keep_span);
+        dd_uhook_clear_span(invocation, dyn, keep_span);
     }
 
     def->active = false;
 }
 
+// The time spent in the hook closures is accounted to the integration which installed the hook
+static bool dd_uhook_begin(zend_ulong invocation, zend_execute_data *execute_data, void *auxiliary, void *dynamic) {
+    dd_uhook_def *def = auxiliary;
+    uint64_t overhead_start = ddtrace_integration_overhead_start(def->integration);
+    ddtrace_integration_name previous_owner = ddtrace_integration_overhead_set_owner(def->integration);
+
+    bool result = dd_uhook_run_begin(invocation, execute_data, def, dynamic);
+
+    ddtrace_integration_overhead_set_owner(previous_owner);
+    ddtrace_integration_overhead_stop(def->integration, overhead_start);
+    return result;
+}
+
+static void dd_uhook_end(zend_ulong invocation, zend_execute_data *execute_data, zval *retval, void *auxiliary, void *dynamic) {
+    dd_uhook_def *def = auxiliary;
+    uint64_t overhead_start = ddtrace_integration_overhead_start(def->integration);
+    ddtrace_integration_name previous_owner = ddtrace_integration_overhead_set_owner(def->integration);
+
+    dd_uhook_run_end(invocation, execute_data, retval, def, dynamic);
+
+    ddtrace_integration_overhead_set_owner(previous_owner);
+    ddtrace_integration_overhead_stop(def->integration, overhead_start);
+}
+
 static void dd_uhook_dtor(void *data) {
     dd_uhook_def *def = data;
     if (def->begin) {
@@ -358,6 +405,7 @@ static void dd_uhook(INTERNAL_FUNCTION_PARAMETERS, bool tracing, bool method) {
     def->run_if_limited = !tracing || run_when_limited;
     def->active = false;
     def->allow_recursion = allow_recursion;
+    def->integration = ddtrace_integration_overhead_owner();
 
     zai_string_view class_str = method ? ZAI_STRING_FROM_ZSTR(class_name) : ZAI_STRING_EMPTY;
     zai_string_view func_str = ZAI_STRING_FROM_ZSTR(method_name);
@@ -3,24 +3,21 @@
 #include "../configuration.h"
 #include "../logging.h"
 #include "../telemetry.h"
+#include "overhead.h"
 #include <hook/hook.h>
 #undef INTEGRATION
 
-#define DDTRACE_DEFERRED_INTEGRATION_LOADER(class, fname, integration_name)             \
-    dd_hook_method_and_unhook_on_first_call(ZAI_STRL_VIEW(class), ZAI_STRL_VIEW(fname), \
-                          ZAI_STRL_VIEW(integration_name), (ddtrace_integration_name)-1, false)
+#define DD_STRING_VIEW(str) \
+    { .len = sizeof(str) - 1, .ptr = (str) }
 
-#define DD_SET_UP_DEFERRED_LOADING_BY_METHOD(name, Class, fname, integration)                                \
-    dd_set_up_deferred_loading_by_method(name, ZAI_STRL_VIEW(Class), ZAI_STRL_VIEW(fname), \
-                                         ZAI_STRL_VIEW(integration), false)
+#define DD_DEFERRED_LOADER_BY_METHOD(id, Class, fname, integration) \
+    {DDTRACE_INTEGRATION_##id, DD_STRING_VIEW(Class), DD_STRING_VIEW(fname), DD_STRING_VIEW(integration), false},
 
-#define DD_SET_UP_DEFERRED_LOADING_BY_METHOD_POST(name, Class, fname, integration)                                \
-    dd_set_up_deferred_loading_by_method(name, ZAI_STRL_VIEW(Class), ZAI_STRL_VIEW(fname), \
-                                         ZAI_STRL_VIEW(integration), true)
+#define DD_DEFERRED_LOADER_BY_METHOD_POST(id, Class, fname, integration) \
+    {DDTRACE_INTEGRATION_##id, DD_STRING_VIEW(Class), DD_STRING_VIEW(fname), DD_STRING_VIEW(integration), true},
 
-#define DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(name, fname, integration)                           \
-    dd_set_up_deferred_loading_by_method(name, ZAI_STRING_EMPTY, ZAI_STRL_VIEW(fname), \
-                                         ZAI_STRL_VIEW(integration), false)
+#define DD_DEFERRED_LOADER_BY_FUNCTION(id, fname, integration) \
+    {DDTRACE_INTEGRATION_##id, {.len = 0, .ptr = ""}, DD_STRING_VIEW(fname), DD_STRING_VIEW(integration), false},
 
 #define INTEGRATION(id, lcname, ...)                                    \
     {                                                                  \
@@ -31,7 +28,6 @@
         .is_enabled = get_DD_TRACE_##id##_ENABLED,              \
         .is_analytics_enabled = get_DD_TRACE_##id##_ANALYTICS_ENABLED, \
         .get_sample_rate = get_DD_TRACE_##id##_ANALYTICS_SAMPLE_RATE,  \
-        .aux = {0},                                                    \
     },
 ddtrace_integration ddtrace_integrations[] = {DD_INTEGRATIONS};
 size_t ddtrace_integrations_len = sizeof ddtrace_integrations / sizeof ddtrace_integrations[0];
@@ -45,32 +41,222 @@ void ddtrace_integrations_mshutdown(void) { zend_hash_destroy(&_dd_string_to_int
 
 typedef struct {
     ddtrace_integration_name name;
-    zend_string *classname;
     zai_string_view scope;
     zai_string_view function;
-    zend_long id;
-} dd_integration_aux;
+    zai_string_view loader;
+    bool posthook;
+} dd_deferred_loader;
+
+/* All deferred loaders are installed once at MINIT. ZAI only resolves them when their class or function gets linked,
+ * and on the first call all the hooks of the same integration are removed for the rest of the request. */
+static const dd_deferred_loader dd_deferred_loaders[] = {
+    DD_DEFERRED_LOADER_BY_METHOD(AMQP, "PhpAmqpLib\\Connection\\AbstractConnection", "__construct",
+        "DDTrace\\Integrations\\AMQP\\AMQPIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(CAKEPHP, "App", "init",
+        "DDTrace\\Integrations\\CakePHP\\CakePHPIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(CAKEPHP, "Dispatcher", "__construct",
+        "DDTrace\\Integrations\\CakePHP\\CakePHPIntegration")
+
+    DD_DEFERRED_LOADER_BY_FUNCTION(CURL, "curl_exec",
+        "DDTrace\\Integrations\\Curl\\CurlIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD_POST(CODEIGNITER, "CI_Router", "_set_routing",
+        "DDTrace\\Integrations\\CodeIgniter\\V2\\CodeIgniterIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(ELASTICSEARCH, "elasticsearch\\client", "__construct",
+        "DDTrace\\Integrations\\ElasticSearch\\V1\\ElasticSearchIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(ELASTICSEARCH, "elastic\\elasticsearch\\client", "__construct",
+        "DDTrace\\Integrations\\ElasticSearch\\V8\\ElasticSearchIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(ELOQUENT, "Illuminate\\Database\\Eloquent\\Builder", "__construct",
+        "DDTrace\\Integrations\\Eloquent\\EloquentIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(ELOQUENT, "Illuminate\\Database\\Eloquent\\Model", "__construct",
+        "DDTrace\\Integrations\\Eloquent\\EloquentIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(ELOQUENT, "Illuminate\\Database\\Eloquent\\Model", "destroy",
+        "DDTrace\\Integrations\\Eloquent\\EloquentIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(GUZZLE, "GuzzleHttp\\Client", "__construct",
+        "DDTrace\\Integrations\\Guzzle\\GuzzleIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(LAMINAS, "Laminas\\Mvc\\Application", "init",
+        "DDTrace\\Integrations\\Laminas\\LaminasIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LAMINAS, "Laminas\\Mvc\\Application", "__construct",
+        "DDTrace\\Integrations\\Laminas\\LaminasIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(LARAVEL, "Illuminate\\Foundation\\Application", "__construct",
+        "DDTrace\\Integrations\\Laravel\\LaravelIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LARAVEL, "Laravel\\Lumen\\Application", "__construct",
+        "DDTrace\\Integrations\\Laravel\\LaravelIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(LUMEN, "Laravel\\Lumen\\Application", "__construct",
+        "DDTrace\\Integrations\\Lumen\\LumenIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(MEMCACHE, "Memcache", "connect",
+        "DDTrace\\Integrations\\Memcache\\MemcacheIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(MEMCACHE, "Memcache", "pconnect",
+        "DDTrace\\Integrations\\Memcache\\MemcacheIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(MEMCACHE, "Memcache", "addServer",
+        "DDTrace\\Integrations\\Memcache\\MemcacheIntegration")
+    DD_DEFERRED_LOADER_BY_FUNCTION(MEMCACHE, "memcache_connect",
+        "DDTrace\\Integrations\\Memcache\\MemcacheIntegration")
+    DD_DEFERRED_LOADER_BY_FUNCTION(MEMCACHE, "memcache_pconnect",
+        "DDTrace\\Integrations\\Memcache\\MemcacheIntegration")
+    DD_DEFERRED_LOADER_BY_FUNCTION(MEMCACHE, "memcache_add_server",
+        "DDTrace\\Integrations\\Memcache\\MemcacheIntegration")
+
+#if PHP_VERSION_ID < 80000
+    // PHP 8 is instrumented natively by handlers_memcached.c
+    DD_DEFERRED_LOADER_BY_METHOD(MEMCACHED, "Memcached", "__construct",
+        "DDTrace\\Integrations\\Memcached\\MemcachedIntegration")
+#endif
+
+    DD_DEFERRED_LOADER_BY_METHOD(LOGS, "Psr\\Log\\LoggerInterface", "emergency",
+        "DDTrace\\Integrations\\Logs\\LogsIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LOGS, "Psr\\Log\\LoggerInterface", "alert",
+        "DDTrace\\Integrations\\Logs\\LogsIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LOGS, "Psr\\Log\\LoggerInterface", "critical",
+        "DDTrace\\Integrations\\Logs\\LogsIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LOGS, "Psr\\Log\\LoggerInterface", "error",
+        "DDTrace\\Integrations\\Logs\\LogsIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LOGS, "Psr\\Log\\LoggerInterface", "warning",
+        "DDTrace\\Integrations\\Logs\\LogsIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LOGS, "Psr\\Log\\LoggerInterface", "notice",
+        "DDTrace\\Integrations\\Logs\\LogsIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LOGS, "Psr\\Log\\LoggerInterface", "info",
+        "DDTrace\\Integrations\\Logs\\LogsIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LOGS, "Psr\\Log\\LoggerInterface", "debug",
+        "DDTrace\\Integrations\\Logs\\LogsIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LOGS, "Psr\\Log\\LoggerInterface", "log",
+        "DDTrace\\Integrations\\Logs\\LogsIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(MONGO, "MongoClient", "__construct",
+        "DDTrace\\Integrations\\Mongo\\MongoIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(MONGODB, "mongodb\\driver\\manager", "__construct",
+        "DDTrace\\Integrations\\MongoDB\\MongoDBIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(MONGODB, "mongodb\\driver\\query", "__construct",
+        "DDTrace\\Integrations\\MongoDB\\MongoDBIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(MONGODB, "mongodb\\driver\\command", "__construct",
+        "DDTrace\\Integrations\\MongoDB\\MongoDBIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(MONGODB, "mongodb\\driver\\bulkwrite", "__construct",
+        "DDTrace\\Integrations\\MongoDB\\MongoDBIntegration")
+
+    DD_DEFERRED_LOADER_BY_FUNCTION(MYSQLI, "mysqli_init",
+        "DDTrace\\Integrations\\Mysqli\\MysqliIntegration")
+    DD_DEFERRED_LOADER_BY_FUNCTION(MYSQLI, "mysqli_connect",
+        "DDTrace\\Integrations\\Mysqli\\MysqliIntegration")
+    DD_DEFERRED_LOADER_BY_FUNCTION(MYSQLI, "mysqli_real_connect",
+        "DDTrace\\Integrations\\Mysqli\\MysqliIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(MYSQLI, "mysqli", "__construct",
+        "DDTrace\\Integrations\\Mysqli\\MysqliIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(NETTE, "Nette\\Configurator", "__construct",
+        "DDTrace\\Integrations\\Nette\\NetteIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(NETTE, "Nette\\Bootstrap\\Configurator", "__construct",
+        "DDTrace\\Integrations\\Nette\\NetteIntegration")
+
+    DD_DEFERRED_LOADER_BY_FUNCTION(PCNTL, "pcntl_fork",
+        "DDTrace\\Integrations\\Pcntl\\PcntlIntegration")
+#if PHP_VERSION_ID >= 80100
+    DD_DEFERRED_LOADER_BY_FUNCTION(PCNTL, "pcntl_rfork",
+        "DDTrace\\Integrations\\Pcntl\\PcntlIntegration")
+#endif
+#if PHP_VERSION_ID >= 80200
+    DD_DEFERRED_LOADER_BY_FUNCTION(PCNTL, "pcntl_forkx",
+        "DDTrace\\Integrations\\Pcntl\\PcntlIntegration")
+#endif
+
+#if PHP_VERSION_ID < 80000
+    // PHP 8 is instrumented natively by handlers_pdo.c
+    DD_DEFERRED_LOADER_BY_METHOD(PDO, "PDO", "__construct",
+        "DDTrace\\Integrations\\PDO\\PDOIntegration")
+#endif
+
+#if PHP_VERSION_ID < 80000
+    // PHP 8 is instrumented natively by handlers_redis.c
+    DD_DEFERRED_LOADER_BY_METHOD(PHPREDIS, "Redis", "__construct",
+        "DDTrace\\Integrations\\PHPRedis\\PHPRedisIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(PHPREDIS, "RedisCluster", "__construct",
+        "DDTrace\\Integrations\\PHPRedis\\PHPRedisIntegration")
+#endif
+
+    DD_DEFERRED_LOADER_BY_METHOD(PREDIS, "Predis\\Client", "__construct",
+        "DDTrace\\Integrations\\Predis\\PredisIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(PSR18, "Psr\\Http\\Client\\ClientInterface", "sendRequest",
+        "DDTrace\\Integrations\\Psr18\\Psr18Integration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(ROADRUNNER, "Spiral\\RoadRunner\\Http\\HttpWorker", "waitRequest",
+        "DDTrace\\Integrations\\Roadrunner\\RoadrunnerIntegration")
 
-void dd_integration_aux_free(void *auxiliary) {
-    dd_integration_aux *aux = auxiliary;
-    zend_string_release(aux->classname);
-    free(aux);
+    DD_DEFERRED_LOADER_BY_METHOD(SLIM, "Slim\\App", "__construct",
+        "DDTrace\\Integrations\\Slim\\SlimIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(LARAVELQUEUE, "Illuminate\\Queue\\Worker", "__construct",
+        "DDTrace\\Integrations\\LaravelQueue\\LaravelQueueIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LARAVELQUEUE, "Illuminate\\Contracts\\Queue\\Queue", "push",
+        "DDTrace\\Integrations\\LaravelQueue\\LaravelQueueIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LARAVELQUEUE, "Illuminate\\Contracts\\Queue\\Queue", "later",
+        "DDTrace\\Integrations\\LaravelQueue\\LaravelQueueIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LARAVELQUEUE, "Illuminate\\Bus\\PendingBatch", "__construct",
+        "DDTrace\\Integrations\\LaravelQueue\\LaravelQueueIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(LARAVELQUEUE, "Illuminate\\Foundation\\Bus\\PendingChain", "__construct",
+        "DDTrace\\Integrations\\LaravelQueue\\LaravelQueueIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(SYMFONY, "Symfony\\Component\\HttpKernel\\Kernel", "__construct",
+        "DDTrace\\Integrations\\Symfony\\SymfonyIntegration")
+    DD_DEFERRED_LOADER_BY_METHOD(SYMFONY, "Symfony\\Component\\HttpKernel\\HttpKernel", "__construct",
+        "DDTrace\\Integrations\\Symfony\\SymfonyIntegration")
+
+    DD_DEFERRED_LOADER_BY_FUNCTION(SQLSRV, "sqlsrv_connect",
+        "DDTrace\\Integrations\\SQLSRV\\SQLSRVIntegration")
+
+    DD_DEFERRED_LOADER_BY_FUNCTION(WORDPRESS, "wp_check_php_mysql_versions",
+        "DDTrace\\Integrations\\WordPress\\WordPressIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(YII, "yii\\di\\Container", "__construct",
+        "DDTrace\\Integrations\\Yii\\YiiIntegration")
+
+    DD_DEFERRED_LOADER_BY_METHOD(ZENDFRAMEWORK, "Zend_Controller_Plugin_Broker", "preDispatch",
+        "DDTrace\\Integrations\\ZendFramework\\ZendFrameworkIntegration")
+};
+
+#define DD_DEFERRED_LOADERS_COUNT (sizeof(dd_deferred_loaders) / sizeof(dd_deferred_loaders[0]))
+
+static const dd_deferred_loader dd_test_deferred_loader = {
+    (ddtrace_integration_name)-1, DD_STRING_VIEW("test"), DD_STRING_VIEW("public_static_method"),
+    DD_STRING_VIEW("ddtrace\\test\\testsandboxedintegration"), false,
+};
+
+// Written during MINIT only; the test loader uses the last slot
+static zend_long dd_deferred_loader_ids[DD_DEFERRED_LOADERS_COUNT + 1];
+static zend_string *dd_deferred_loader_classes[DD_DEFERRED_LOADERS_COUNT + 1];
+
+static inline size_t dd_deferred_loader_index(const dd_deferred_loader *loader) {
+    return loader == &dd_test_deferred_loader ? DD_DEFERRED_LOADERS_COUNT : (size_t)(loader - dd_deferred_loaders);
 }
 
 static void dd_invoke_integration_loader_and_unhook_posthook(zend_ulong invocation, zend_execute_data *execute_data, zval *retval, void *auxiliary, void *dynamic) {
     (void) dynamic, (void) retval, (void) invocation;
 
-    dd_integration_aux *aux = auxiliary;
+    const dd_deferred_loader *loader = auxiliary;
+    size_t index = dd_deferred_loader_index(loader);
     zval integration;
-    ZVAL_STR(&integration, aux->classname);
+    ZVAL_INTERNED_STR(&integration, dd_deferred_loader_classes[index]);
 
-    if (aux->name == -1u || ddtrace_config_integration_enabled(aux->name)) {
-        if (aux->name != -1u) {
-            ddtrace_telemetry_notify_integration(ddtrace_integrations[aux->name].name_lcase, ddtrace_integrations[aux->name].name_len);
+    if (loader->name == -1u || ddtrace_config_integration_enabled(loader->name)) {
+        if (loader->name != -1u) {
+            ddtrace_telemetry_notify_integration(ddtrace_integrations[loader->name].name_lcase, ddtrace_integrations[loader->name].name_len);
         } else {
-            ddtrace_telemetry_notify_integration(ZSTR_VAL(aux->classname), ZSTR_LEN(aux->classname));
+            ddtrace_telemetry_notify_integration(loader->loader.ptr, loader->loader.len);
         }
 
+        // hooks installed by the integration are accounted to it
+        ddtrace_integration_name previous_owner = ddtrace_integration_overhead_set_owner(loader->name);
+
         zval rv;
         bool success;
         zval *thisp = getThis();
@@ -80,6 +266,8 @@ static void dd_invoke_integration_loader_and_unhook_posthook(zend_ulong invocati
             success = zai_symbol_call_literal(ZEND_STRL("ddtrace\\integrations\\load_deferred_integration"), &rv, 1, &integration);
         }
 
+        ddtrace_integration_overhead_set_owner(previous_owner);
+
         if (UNEXPECTED(!success)) {
             ddtrace_log_debugf(
                     "Error loading deferred integration '%s' from DDTrace\\Integrations\\load_deferred_integration",
@@ -87,12 +275,14 @@ static void dd_invoke_integration_loader_and_unhook_posthook(zend_ulong invocati
         }
     }
 
-    if (aux->name != -1u) {
-        for (dd_integration_aux **auxArray = (dd_integration_aux **) ddtrace_integrations[aux->name].aux; *auxArray; ++auxArray) {
-            zai_hook_remove((*auxArray)->scope, (*auxArray)->function, (*auxArray)->id);
+    if (loader->name != -1u) {
+        for (size_t i = 0; i < DD_DEFERRED_LOADERS_COUNT; ++i) {
+            if (dd_deferred_loaders[i].name == loader->name) {
+                zai_hook_remove(dd_deferred_loaders[i].scope, dd_deferred_loaders[i].function, dd_deferred_loader_ids[i]);
+            }
         }
     } else {
-        zai_hook_remove_resolved(zai_hook_install_address(EX(func)), aux->id);
+        zai_hook_remove_resolved(zai_hook_install_address(EX(func)), dd_deferred_loader_ids[index]);
     }
 }
 
@@ -101,219 +291,32 @@ static bool dd_invoke_integration_loader_and_unhook_prehook(zend_ulong invocatio
     return true;
 }
 
-static void dd_hook_method_and_unhook_on_first_call(zai_string_view Class, zai_string_view method, zai_string_view callback, ddtrace_integration_name name, bool posthook) {
-    dd_integration_aux *aux = malloc(sizeof(*aux));
-    aux->name = name;
-    aux->classname = zend_string_init(callback.ptr, callback.len, 1);
-    aux->id = zai_hook_install(Class, method,
-            posthook ? NULL : dd_invoke_integration_loader_and_unhook_prehook,
-            posthook ? dd_invoke_integration_loader_and_unhook_posthook : NULL,
-            ZAI_HOOK_AUX(aux, dd_integration_aux_free),
+static void dd_install_deferred_loader(const dd_deferred_loader *loader) {
+    size_t index = dd_deferred_loader_index(loader);
+    dd_deferred_loader_classes[index] = zend_string_init_interned(loader->loader.ptr, loader->loader.len, 1);
+    dd_deferred_loader_ids[index] = zai_hook_install(loader->scope, loader->function,
+            loader->posthook ? NULL : dd_invoke_integration_loader_and_unhook_prehook,
+            loader->posthook ? dd_invoke_integration_loader_and_unhook_posthook : NULL,
+            ZAI_HOOK_AUX((void *) loader, NULL),
             0);
-    aux->scope = Class;
-    aux->function = method;
-
-    if (name != -1u) {
-        void **auxArray = ddtrace_integrations[name].aux;
-        while (*auxArray) {
-            ++auxArray;
-        }
-        *auxArray = aux;
-    }
-}
-
-static void dd_load_test_integrations(void) {
-    char* test_deferred = getenv("_DD_LOAD_TEST_INTEGRATIONS");
-    if (!test_deferred) {
-        return;
-    }
-
-    DDTRACE_DEFERRED_INTEGRATION_LOADER("test", "public_static_method", "ddtrace\\test\\testsandboxedintegration");
-    // DDTRACE_INTEGRATION_TRACE("test", "automaticaly_traced_method", "tracing_function", DDTRACE_DISPATCH_POSTHOOK);
-}
-
-static void dd_set_up_deferred_loading_by_method(ddtrace_integration_name name, zai_string_view Class,
-                                                 zai_string_view method, zai_string_view integration, bool posthook) {
-    // We unconditionally install our hooks. We skip it on hit.
-    dd_hook_method_and_unhook_on_first_call(Class, method, integration, name, posthook);
 }
 
 void ddtrace_integrations_minit(void) {
     zend_hash_init(&_dd_string_to_integration_name_map, ddtrace_integrations_len, NULL, NULL, 1);
 
     for (size_t i = 0; i < ddtrace_integrations_len; ++i) {
-        memset(ddtrace_integrations[i].aux, 0, sizeof(ddtrace_integrations[i].aux));
         char *name = ddtrace_integrations[i].name_lcase;
         size_t name_len = ddtrace_integrations[i].name_len;
         _dd_add_integration_to_map(name, name_len, &ddtrace_integrations[i]);
     }
 
-    dd_load_test_integrations();
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_AMQP, "PhpAmqpLib\\Connection\\AbstractConnection", "__construct",
-                                        "DDTrace\\Integrations\\AMQP\\AMQPIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_CAKEPHP, "App", "init",
-                                         "DDTrace\\Integrations\\CakePHP\\CakePHPIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_CAKEPHP, "Dispatcher", "__construct",
-                                         "DDTrace\\Integrations\\CakePHP\\CakePHPIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(DDTRACE_INTEGRATION_CURL, "curl_exec",
-                                           "DDTrace\\Integrations\\Curl\\CurlIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD_POST(DDTRACE_INTEGRATION_CODEIGNITER, "CI_Router", "_set_routing",
-                                         "DDTrace\\Integrations\\CodeIgniter\\V2\\CodeIgniterIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_ELASTICSEARCH, "elasticsearch\\client", "__construct",
-                                         "DDTrace\\Integrations\\ElasticSearch\\V1\\ElasticSearchIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_ELASTICSEARCH, "elastic\\elasticsearch\\client", "__construct",
-                                         "DDTrace\\Integrations\\ElasticSearch\\V8\\ElasticSearchIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_ELOQUENT, "Illuminate\\Database\\Eloquent\\Builder", "__construct",
-                                         "DDTrace\\Integrations\\Eloquent\\EloquentIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_ELOQUENT, "Illuminate\\Database\\Eloquent\\Model", "__construct",
-                                         "DDTrace\\Integrations\\Eloquent\\EloquentIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_ELOQUENT, "Illuminate\\Database\\Eloquent\\Model", "destroy",
-                                         "DDTrace\\Integrations\\Eloquent\\EloquentIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_GUZZLE, "GuzzleHttp\\Client", "__construct",
-                                         "DDTrace\\Integrations\\Guzzle\\GuzzleIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LAMINAS, "Laminas\\Mvc\\Application", "init",
-                                         "DDTrace\\Integrations\\Laminas\\LaminasIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LAMINAS, "Laminas\\Mvc\\Application", "__construct",
-                                         "DDTrace\\Integrations\\Laminas\\LaminasIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LARAVEL, "Illuminate\\Foundation\\Application", "__construct",
-                                         "DDTrace\\Integrations\\Laravel\\LaravelIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LARAVEL, "Laravel\\Lumen\\Application", "__construct",
-                                         "DDTrace\\Integrations\\Laravel\\LaravelIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LUMEN, "Laravel\\Lumen\\Application", "__construct",
-                                         "DDTrace\\Integrations\\Lumen\\LumenIntegration");
-
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_MEMCACHE, "Memcache", "connect",
-                                         "DDTrace\\Integrations\\Memcache\\MemcacheIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_MEMCACHE, "Memcache", "pconnect",
-                                         "DDTrace\\Integrations\\Memcache\\MemcacheIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_MEMCACHE, "Memcache", "addServer",
-                                         "DDTrace\\Integrations\\Memcache\\MemcacheIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(DDTRACE_INTEGRATION_MEMCACHE, "memcache_connect",
-                                         "DDTrace\\Integrations\\Memcache\\MemcacheIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(DDTRACE_INTEGRATION_MEMCACHE, "memcache_pconnect",
-                                         "DDTrace\\Integrations\\Memcache\\MemcacheIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(DDTRACE_INTEGRATION_MEMCACHE, "memcache_add_server",
-                                         "DDTrace\\Integrations\\Memcache\\MemcacheIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_MEMCACHED, "Memcached", "__construct",
-                                         "DDTrace\\Integrations\\Memcached\\MemcachedIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LOGS, "Psr\\Log\\LoggerInterface", "emergency",
-                                         "DDTrace\\Integrations\\Logs\\LogsIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LOGS, "Psr\\Log\\LoggerInterface", "alert",
-                                         "DDTrace\\Integrations\\Logs\\LogsIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LOGS, "Psr\\Log\\LoggerInterface", "critical",
-                                         "DDTrace\\Integrations\\Logs\\LogsIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LOGS, "Psr\\Log\\LoggerInterface", "error",
-                                         "DDTrace\\Integrations\\Logs\\LogsIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LOGS, "Psr\\Log\\LoggerInterface", "warning",
-                                         "DDTrace\\Integrations\\Logs\\LogsIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LOGS, "Psr\\Log\\LoggerInterface", "notice",
-                                         "DDTrace\\Integrations\\Logs\\LogsIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LOGS, "Psr\\Log\\LoggerInterface", "info",
-                                         "DDTrace\\Integrations\\Logs\\LogsIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LOGS, "Psr\\Log\\LoggerInterface", "debug",
-                                         "DDTrace\\Integrations\\Logs\\LogsIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LOGS, "Psr\\Log\\LoggerInterface", "log",
-                                         "DDTrace\\Integrations\\Logs\\LogsIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_MONGO, "MongoClient", "__construct",
-                                         "DDTrace\\Integrations\\Mongo\\MongoIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_MONGODB, "mongodb\\driver\\manager", "__construct",
-                                         "DDTrace\\Integrations\\MongoDB\\MongoDBIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_MONGODB, "mongodb\\driver\\query", "__construct",
-                                         "DDTrace\\Integrations\\MongoDB\\MongoDBIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_MONGODB, "mongodb\\driver\\command", "__construct",
-                                         "DDTrace\\Integrations\\MongoDB\\MongoDBIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_MONGODB, "mongodb\\driver\\bulkwrite", "__construct",
-                                         "DDTrace\\Integrations\\MongoDB\\MongoDBIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(DDTRACE_INTEGRATION_MYSQLI, "mysqli_init",
-                                           "DDTrace\\Integrations\\Mysqli\\MysqliIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(DDTRACE_INTEGRATION_MYSQLI, "mysqli_connect",
-                                           "DDTrace\\Integrations\\Mysqli\\MysqliIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(DDTRACE_INTEGRATION_MYSQLI, "mysqli_real_connect",
-                                           "DDTrace\\Integrations\\Mysqli\\MysqliIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_MYSQLI, "mysqli", "__construct",
-                                         "DDTrace\\Integrations\\Mysqli\\MysqliIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_NETTE, "Nette\\Configurator", "__construct",
-                                         "DDTrace\\Integrations\\Nette\\NetteIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_NETTE, "Nette\\Bootstrap\\Configurator", "__construct",
-                                         "DDTrace\\Integrations\\Nette\\NetteIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(DDTRACE_INTEGRATION_PCNTL, "pcntl_fork",
-                                         "DDTrace\\Integrations\\Pcntl\\PcntlIntegration");
-#if PHP_VERSION_ID >= 80100
-    DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(DDTRACE_INTEGRATION_PCNTL, "pcntl_rfork",
-                                         "DDTrace\\Integrations\\Pcntl\\PcntlIntegration");
-#endif
-#if PHP_VERSION_ID >= 80200
-    DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(DDTRACE_INTEGRATION_PCNTL, "pcntl_forkx",
-                                         "DDTrace\\Integrations\\Pcntl\\PcntlIntegration");
-#endif
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_PDO, "PDO", "__construct",
-                                         "DDTrace\\Integrations\\PDO\\PDOIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_PHPREDIS, "Redis", "__construct",
-                                         "DDTrace\\Integrations\\PHPRedis\\PHPRedisIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_PHPREDIS, "RedisCluster", "__construct",
-                                         "DDTrace\\Integrations\\PHPRedis\\PHPRedisIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_PREDIS, "Predis\\Client", "__construct",
-                                         "DDTrace\\Integrations\\Predis\\PredisIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_PSR18, "Psr\\Http\\Client\\ClientInterface", "sendRequest",
-                                         "DDTrace\\Integrations\\Psr18\\Psr18Integration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_ROADRUNNER, "Spiral\\RoadRunner\\Http\\HttpWorker", "waitRequest",
-                                         "DDTrace\\Integrations\\Roadrunner\\RoadrunnerIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_SLIM, "Slim\\App", "__construct",
-                                         "DDTrace\\Integrations\\Slim\\SlimIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LARAVELQUEUE, "Illuminate\\Queue\\Worker", "__construct",
-                                         "DDTrace\\Integrations\\LaravelQueue\\LaravelQueueIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LARAVELQUEUE, "Illuminate\\Contracts\\Queue\\Queue", "push",
-                                         "DDTrace\\Integrations\\LaravelQueue\\LaravelQueueIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LARAVELQUEUE, "Illuminate\\Contracts\\Queue\\Queue", "later",
-                                             "DDTrace\\Integrations\\LaravelQueue\\LaravelQueueIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LARAVELQUEUE, "Illuminate\\Bus\\PendingBatch", "__construct",
-                                         "DDTrace\\Integrations\\LaravelQueue\\LaravelQueueIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_LARAVELQUEUE, "Illuminate\\Foundation\\Bus\\PendingChain", "__construct",
-                                             "DDTrace\\Integrations\\LaravelQueue\\LaravelQueueIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_SYMFONY, "Symfony\\Component\\HttpKernel\\Kernel", "__construct",
-                                         "DDTrace\\Integrations\\Symfony\\SymfonyIntegration");
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_SYMFONY, "Symfony\\Component\\HttpKernel\\HttpKernel", "__construct",
-                                         "DDTrace\\Integrations\\Symfony\\SymfonyIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(DDTRACE_INTEGRATION_SQLSRV, "sqlsrv_connect",
-                                         "DDTrace\\Integrations\\SQLSRV\\SQLSRVIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_FUNCTION(DDTRACE_INTEGRATION_WORDPRESS, "wp_check_php_mysql_versions",
-                                           "DDTrace\\Integrations\\WordPress\\WordPressIntegration");
-
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_YII, "yii\\di\\Container", "__construct",
-                                         "DDTrace\\Integrations\\Yii\\YiiIntegration");
+    for (size_t i = 0; i < DD_DEFERRED_LOADERS_COUNT; ++i) {
+        dd_install_deferred_loader(&dd_deferred_loaders[i]);
+    }
 
-    DD_SET_UP_DEFERRED_LOADING_BY_METHOD(DDTRACE_INTEGRATION_ZENDFRAMEWORK, "Zend_Controller_Plugin_Broker", "preDispatch",
-                                         "DDTrace\\Integrations\\ZendFramework\\ZendFrameworkIntegration");
+    if (getenv("_DD_LOAD_TEST_INTEGRATIONS")) {
+        dd_install_deferred_loader(&dd_test_deferred_loader);
+    }
 }
 
 ddtrace_integration* ddtrace_get_integration_from_string(ddtrace_string integration) {
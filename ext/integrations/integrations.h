@@ -41,7 +41,7 @@
     INTEGRATION(ZENDFRAMEWORK, "zendframework")
 
 #define INTEGRATION(id, ...) DDTRACE_INTEGRATION_##id,
-typedef enum { DD_INTEGRATIONS } ddtrace_integration_name;
+typedef enum { DD_INTEGRATIONS DDTRACE_INTEGRATIONS_COUNT } ddtrace_integration_name;
 #undef INTEGRATION
 
 struct ddtrace_integration {
@@ -52,7 +52,6 @@ struct ddtrace_integration {
     bool (*is_enabled)(void);
     bool (*is_analytics_enabled)(void);
     double (*get_sample_rate)(void);
-    void *aux[10]; // Needs to be the max number of deferred loading hooks for any integration plus one NULL sentinel
 };
 typedef struct ddtrace_integration ddtrace_integration;
 
@@ -0,0 +1,149 @@
+#include "overhead.h"
+
+#include <inttypes.h>
+#include <time.h>
+
+#include <dogstatsd_client/client.h>
+
+#include "../configuration.h"
+#include "../ddtrace.h"
+#include "../dogstatsd_client.h"
+#include "../logging.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(ddtrace);
+
+#define DD_OVERHEAD_METRIC_PREFIX "_dd.tracer_overhead."
+
+ZEND_TLS bool dd_overhead_enabled = false;
+ZEND_TLS zend_long dd_overhead_sample_interval = 1;
+ZEND_TLS zend_long dd_overhead_sample_counter = 0;
+ZEND_TLS uint32_t dd_overhead_depth = 0;
+ZEND_TLS ddtrace_integration_name dd_overhead_owner = DDTRACE_INTEGRATION_NONE;
+
+// Nanoseconds since the last root span, respectively since the last dogstatsd flush of this process
+ZEND_TLS uint64_t dd_overhead_trace[DDTRACE_INTEGRATIONS_COUNT];
+ZEND_TLS uint64_t dd_overhead_process[DDTRACE_INTEGRATIONS_COUNT];
+
+static inline uint64_t dd_thread_cpu_nanoseconds(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t ddtrace_integration_overhead_start(ddtrace_integration_name integration) {
+    if (!dd_overhead_enabled || integration == DDTRACE_INTEGRATION_NONE) {
+        return 0;
+    }
+
+    if (dd_overhead_depth++) {
+        return 0;
+    }
+
+    // Only one out of sample_interval handler runs is timed, and weighted accordingly
+    if (++dd_overhead_sample_counter < dd_overhead_sample_interval) {
+        return 0;
+    }
+    dd_overhead_sample_counter = 0;
+
+    uint64_t now = dd_thread_cpu_nanoseconds();
+    return now ? now : 1;
+}
+
+void ddtrace_integration_overhead_stop(ddtrace_integration_name integration, uint64_t start) {
+    if (!dd_overhead_enabled || integration == DDTRACE_INTEGRATION_NONE) {
+        return;
+    }
+
+    if (dd_overhead_depth) {
+        --dd_overhead_depth;
+    }
+
+    if (!start) {
+        return;
+    }
+
+    uint64_t end = dd_thread_cpu_nanoseconds();
+    if (end > start) {
+        uint64_t elapsed = (end - start) * (uint64_t)dd_overhead_sample_interval;
+        dd_overhead_trace[integration] += elapsed;
+        dd_overhead_process[integration] += elapsed;
+    }
+}
+
+ddtrace_integration_name ddtrace_integration_overhead_owner(void) { return dd_overhead_owner; }
+
+ddtrace_integration_name ddtrace_integration_overhead_set_owner(ddtrace_integration_name integration) {
+    ddtrace_integration_name previous = dd_overhead_owner;
+    dd_overhead_owner = integration;
+    return previous;
+}
+
+void ddtrace_integration_overhead_flush(ddtrace_span_data *root_span) {
+    if (!dd_overhead_enabled) {
+        return;
+    }
+
+    zend_array *metrics = ddtrace_spandata_property_metrics(root_span);
+    for (size_t i = 0; i < DDTRACE_INTEGRATIONS_COUNT; ++i) {
+        if (dd_overhead_trace[i]) {
+            char name[sizeof(DD_OVERHEAD_METRIC_PREFIX) + DDTRACE_LONGEST_INTEGRATION_NAME_LEN];
+            size_t len = sizeof(DD_OVERHEAD_METRIC_PREFIX) - 1;
+            memcpy(name, DD_OVERHEAD_METRIC_PREFIX, len);
+            memcpy(name + len, ddtrace_integrations[i].name_lcase, ddtrace_integrations[i].name_len);
+            len += ddtrace_integrations[i].name_len;
+
+            zval zv;
+            ZVAL_DOUBLE(&zv, (double)dd_overhead_trace[i]);
+            zend_hash_str_update(metrics, name, len, &zv);
+            dd_overhead_trace[i] = 0;
+        }
+    }
+}
+
+void ddtrace_integration_overhead_rinit(void) {
+    dd_overhead_enabled = get_DD_TRACE_INTEGRATION_OVERHEAD_ENABLED();
+    dd_overhead_sample_interval = MAX(get_DD_TRACE_INTEGRATION_OVERHEAD_SAMPLE_INTERVAL(), 1);
+    dd_overhead_depth = 0;
+    dd_overhead_owner = DDTRACE_INTEGRATION_NONE;
+    memset(dd_overhead_trace, 0, sizeof(dd_overhead_trace));
+}
+
+void ddtrace_integration_overhead_rshutdown(void) {
+    // a bailout or an exception escaping a handler may skip the matching stop
+    dd_overhead_depth = 0;
+    dd_overhead_owner = DDTRACE_INTEGRATION_NONE;
+
+    if (!dd_overhead_enabled) {
+        return;
+    }
+
+    bool pending = false;
+    for (size_t i = 0; i < DDTRACE_INTEGRATIONS_COUNT; ++i) {
+        pending |= dd_overhead_process[i] != 0;
+    }
+
+    dogstatsd_client *client = &DDTRACE_G(dogstatsd_client);
+    if (!pending || dogstatsd_client_is_default_client(*client)) {
+        return;
+    }
+
+    for (size_t i = 0; i < DDTRACE_INTEGRATIONS_COUNT; ++i) {
+        if (dd_overhead_process[i]) {
+            char value[24], tags[sizeof("integration:") + DDTRACE_LONGEST_INTEGRATION_NAME_LEN];
+            snprintf(value, sizeof(value), "%" PRIu64, dd_overhead_process[i]);
+            snprintf(tags, sizeof(tags), "integration:%s", ddtrace_integrations[i].name_lcase);
+
+            dogstatsd_client_status status = dogstatsd_client_count(client, "datadog.tracer.integration_overhead", value, tags);
+            if (status != DOGSTATSD_CLIENT_OK) {
+                ddtrace_log_debugf("Integration overhead metric failed to send: %s", dogstatsd_client_status_to_str(status) ?: "(unknown dogstatsd_client_status)");
+                if (status == DOGSTATSD_CLIENT_EWRITE) {
+                    ddtrace_dogstatsd_client_reconnect();
+                }
+                return;
+            }
+            dd_overhead_process[i] = 0;
+        }
+    }
+}
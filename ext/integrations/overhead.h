@@ -0,0 +1,43 @@
+#ifndef DD_INTEGRATIONS_OVERHEAD_H
+#define DD_INTEGRATIONS_OVERHEAD_H
+#include <php.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../span.h"
+#include "integrations.h"
+
+#define DDTRACE_INTEGRATION_NONE ((ddtrace_integration_name)-1)
+
+/* Accounting of the thread CPU time spent by each integration in the tracer's begin and end handlers.
+ * Only the outermost handler is measured: hooked calls made from within a handler are part of its cost.
+ * The totals are added to the root span as _dd.tracer_overhead.<integration> metrics (in nanoseconds) and sent to
+ * dogstatsd as datadog.tracer.integration_overhead when health metrics are enabled. */
+uint64_t ddtrace_integration_overhead_start(ddtrace_integration_name integration);
+void ddtrace_integration_overhead_stop(ddtrace_integration_name integration, uint64_t start);
+
+// The integration whose code is running; userland hooks installed meanwhile are attributed to it
+ddtrace_integration_name ddtrace_integration_overhead_owner(void);
+ddtrace_integration_name ddtrace_integration_overhead_set_owner(ddtrace_integration_name integration);
+
+void ddtrace_integration_overhead_flush(ddtrace_span_data *root_span);
+
+void ddtrace_integration_overhead_rinit(void);
+void ddtrace_integration_overhead_rshutdown(void);
+
+#define DDTRACE_MEASURED_BEGIN_HANDLER(name, integration, handler)                                                \
+    static bool name(zend_ulong invocation, zend_execute_data *execute_data, void *auxiliary, void *dynamic) {   \
+        uint64_t overhead_start = ddtrace_integration_overhead_start(integration);                                \
+        bool result = handler(invocation, execute_data, auxiliary, dynamic);                                     \
+        ddtrace_integration_overhead_stop(integration, overhead_start);                                          \
+        return result;                                                                                           \
+    }
+
+#define DDTRACE_MEASURED_END_HANDLER(name, integration, handler)                                                          \
+    static void name(zend_ulong invocation, zend_execute_data *execute_data, zval *retval, void *auxiliary, void *dynamic) { \
+        uint64_t overhead_start = ddtrace_integration_overhead_start(integration);                                        \
+        handler(invocation, execute_data, retval, auxiliary, dynamic);                                                    \
+        ddtrace_integration_overhead_stop(integration, overhead_start);                                                   \
+    }
+
+#endif  // DD_INTEGRATIONS_OVERHEAD_H
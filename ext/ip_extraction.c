@@ -6,6 +6,8 @@
 #include <zend_smart_str.h>
 
 #include "compatibility.h"
+#include "configuration.h"
+#include "dynamic_config.h"
 #include "logging.h"
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
@@ -48,11 +50,42 @@ typedef enum _priority_header_id {
 static header_map_node priority_header_map[MAX_HEADER_ID];
 static zend_string *remote_addr_key;
 
+// $_SERVER key or raw header name => index into priority_header_map, times two, plus one for raw header names
+static HashTable dd_ip_header_lookup;
+#define DD_REMOTE_ADDR_LOOKUP_ID (2 * MAX_HEADER_ID)
+
+/*
+ Addresses of proxies, i.e. of private networks and DD_TRACE_CLIENT_IP_TRUSTED_PROXIES, are compiled into a CIDR trie
+ with 8-bit strides: each node has a slot per value of the next address byte, holding either the next node, or that
+ all addresses starting with the bytes so far are proxies. Prefixes not ending on a byte boundary are expanded to all
+ slots they cover, so that a lookup takes at most one step per address byte.
+*/
+#define DD_CIDR_TRIE_NONE 0
+#define DD_CIDR_TRIE_MATCH UINT32_MAX
+#define DD_CIDR_TRIE_V4_ROOT 0
+#define DD_CIDR_TRIE_V6_ROOT 1
+
+typedef struct {
+    uint32_t (*nodes)[256];
+    uint32_t count;
+    uint32_t capacity;
+} dd_cidr_trie;
+
+// True global - only modify during MINIT
+static dd_cidr_trie dd_private_networks;
+
+ZEND_TLS struct {
+    zend_array *trusted_proxies;
+    uint32_t config_generation;
+    dd_cidr_trie trie;
+} dd_trusted_proxies;
+
 static zend_string *dd_fetch_arr_str(const zval *server, zend_string *key);
 static bool dd_is_private(const ipaddr *addr);
 static zend_string *dd_ipaddr_to_zstr(const ipaddr *ipaddr);
-static zend_string *dd_try_extract(const zval *server, zend_string *key, extract_func_t extract_func);
 static zend_string *dd_try_extract_ip_from_custom_header(const zval *server, zend_string *ipheader);
+static bool dd_parse_ip_address(const char *_addr, size_t addr_len, bool ip_or_error, ipaddr *out);
+static void dd_cidr_trie_add_private_networks(dd_cidr_trie *trie);
 
 void dd_ip_extraction_startup() {
     priority_header_map[X_FORWARDED_FOR] = (header_map_node){zend_string_init_interned(ZEND_STRL("HTTP_X_FORWARDED_FOR"), 1),
@@ -78,6 +111,159 @@ void dd_ip_extraction_startup() {
                                                                 zend_string_init_interned(ZEND_STRL("cf-connecting-ipv6"), 1), &dd_parse_plain};
 
     remote_addr_key = zend_string_init_interned(ZEND_STRL("REMOTE_ADDR"), 1);
+
+    zend_hash_init(&dd_ip_header_lookup, MAX_HEADER_ID * 2 + 1, NULL, NULL, 1);
+    for (unsigned i = 0; i < ARRAY_SIZE(priority_header_map); i++) {
+        zval id;
+        ZVAL_LONG(&id, 2 * i);
+        zend_hash_add(&dd_ip_header_lookup, priority_header_map[i].key, &id);
+        ZVAL_LONG(&id, 2 * i + 1);
+        zend_hash_add(&dd_ip_header_lookup, priority_header_map[i].name, &id);
+    }
+    zval remote_addr_id;
+    ZVAL_LONG(&remote_addr_id, DD_REMOTE_ADDR_LOOKUP_ID);
+    zend_hash_add(&dd_ip_header_lookup, remote_addr_key, &remote_addr_id);
+
+    dd_cidr_trie_add_private_networks(&dd_private_networks);
+}
+
+static uint32_t dd_cidr_trie_new_node(dd_cidr_trie *trie) {
+    if (trie->count == trie->capacity) {
+        trie->capacity = trie->capacity ? trie->capacity * 2 : 8;
+        trie->nodes = perealloc(trie->nodes, sizeof(*trie->nodes) * trie->capacity, 1);
+    }
+    memset(trie->nodes[trie->count], 0, sizeof(*trie->nodes));
+    return trie->count++;
+}
+
+static void dd_cidr_trie_insert(dd_cidr_trie *trie, uint32_t root, const uint8_t *addr, unsigned prefix_len) {
+    while (trie->count <= DD_CIDR_TRIE_V6_ROOT) {
+        dd_cidr_trie_new_node(trie);
+    }
+
+    uint32_t node = root;
+    for (; prefix_len > 8; prefix_len -= 8, ++addr) {
+        uint32_t next = trie->nodes[node][*addr];
+        if (next == DD_CIDR_TRIE_MATCH) {
+            return;  // covered by a shorter prefix already
+        }
+        if (next == DD_CIDR_TRIE_NONE) {
+            next = dd_cidr_trie_new_node(trie);
+            trie->nodes[node][*addr] = next;
+        }
+        node = next;
+    }
+
+    // a shorter prefix supersedes whatever was below it
+    unsigned first = *addr & (0xFF << (8 - prefix_len)) & 0xFF, span = 1u << (8 - prefix_len);
+    for (unsigned i = first; i < first + span; ++i) {
+        trie->nodes[node][i] = DD_CIDR_TRIE_MATCH;
+    }
+}
+
+static bool dd_cidr_trie_contains(const dd_cidr_trie *trie, const ipaddr *addr) {
+    const uint8_t *bytes = addr->af == AF_INET ? (const uint8_t *)&addr->v4.s_addr : addr->v6.s6_addr;
+    unsigned len = addr->af == AF_INET ? 4 : 16;
+    uint32_t node = addr->af == AF_INET ? DD_CIDR_TRIE_V4_ROOT : DD_CIDR_TRIE_V6_ROOT;
+    for (unsigned i = 0; i < len; ++i) {
+        node = trie->nodes[node][bytes[i]];
+        if (node == DD_CIDR_TRIE_MATCH) {
+            return true;
+        }
+        if (node == DD_CIDR_TRIE_NONE) {
+            return false;
+        }
+    }
+    return false;
+}
+
+static void dd_cidr_trie_add_private_networks(dd_cidr_trie *trie) {
+    static const struct {
+        uint32_t root;
+        uint8_t addr[16];
+        unsigned prefix_len;
+    } private_networks[] = {
+        {DD_CIDR_TRIE_V4_ROOT, {10}, 8},
+        {DD_CIDR_TRIE_V4_ROOT, {172, 16}, 12},
+        {DD_CIDR_TRIE_V4_ROOT, {192, 168}, 16},
+        {DD_CIDR_TRIE_V4_ROOT, {127}, 8},
+        {DD_CIDR_TRIE_V4_ROOT, {169, 254}, 16},
+        {DD_CIDR_TRIE_V6_ROOT, {[15] = 1}, 128},   // loopback
+        {DD_CIDR_TRIE_V6_ROOT, {0xFE, 0x80}, 10},  // link-local
+        {DD_CIDR_TRIE_V6_ROOT, {0xFE, 0xC0}, 10},  // site-local
+        {DD_CIDR_TRIE_V6_ROOT, {0xFC}, 7},         // unique local address
+    };
+
+    for (unsigned i = 0; i < ARRAY_SIZE(private_networks); i++) {
+        dd_cidr_trie_insert(trie, private_networks[i].root, private_networks[i].addr, private_networks[i].prefix_len);
+    }
+}
+
+static void dd_trusted_proxies_free(void) {
+    if (dd_trusted_proxies.trie.nodes) {
+        pefree(dd_trusted_proxies.trie.nodes, 1);
+    }
+    dd_trusted_proxies.trie = (dd_cidr_trie){0};
+    if (dd_trusted_proxies.trusted_proxies) {
+        zai_config_array_cache_release(dd_trusted_proxies.trusted_proxies);
+    }
+    dd_trusted_proxies.trusted_proxies = NULL;
+}
+
+static void dd_trusted_proxies_compile(zend_array *trusted_proxies) {
+    dd_trusted_proxies_free();
+    zai_config_array_cache_addref(trusted_proxies);
+    dd_trusted_proxies.trusted_proxies = trusted_proxies;
+    dd_trusted_proxies.config_generation = ddtrace_dynamic_config_generation();
+    dd_cidr_trie_add_private_networks(&dd_trusted_proxies.trie);
+
+    zend_string *cidr;
+    ZEND_HASH_FOREACH_STR_KEY(trusted_proxies, cidr) {
+        if (!cidr) {
+            continue;
+        }
+        const char *slash = memchr(ZSTR_VAL(cidr), '/', ZSTR_LEN(cidr));
+        size_t addr_len = slash ? (size_t)(slash - ZSTR_VAL(cidr)) : ZSTR_LEN(cidr);
+
+        ipaddr addr;
+        if (!dd_parse_ip_address(ZSTR_VAL(cidr), addr_len, false, &addr)) {
+            ddtrace_log_errf("Invalid address in DD_TRACE_CLIENT_IP_TRUSTED_PROXIES: %s", ZSTR_VAL(cidr));
+            continue;
+        }
+        unsigned max_len = addr.af == AF_INET ? 32 : 128, prefix_len = max_len;
+        if (slash) {
+            char *prefix_end;
+            unsigned long parsed = strtoul(slash + 1, &prefix_end, 10);
+            if (prefix_end == slash + 1 || *prefix_end || parsed > max_len) {
+                ddtrace_log_errf("Invalid prefix length in DD_TRACE_CLIENT_IP_TRUSTED_PROXIES: %s", ZSTR_VAL(cidr));
+                continue;
+            }
+            prefix_len = (unsigned)parsed;
+        }
+
+        if (addr.af == AF_INET) {
+            dd_cidr_trie_insert(&dd_trusted_proxies.trie, DD_CIDR_TRIE_V4_ROOT, (const uint8_t *)&addr.v4.s_addr, prefix_len);
+        } else {
+            dd_cidr_trie_insert(&dd_trusted_proxies.trie, DD_CIDR_TRIE_V6_ROOT, addr.v6.s6_addr, prefix_len);
+        }
+    }
+    ZEND_HASH_FOREACH_END();
+}
+
+void dd_ip_extraction_rshutdown(void) {
+    // the trie may stay for the next request, but not the reference to proxies passed to ini_set()
+    if (dd_trusted_proxies.trusted_proxies && !zai_config_array_is_persistent(dd_trusted_proxies.trusted_proxies)) {
+        dd_trusted_proxies_free();
+    }
+}
+
+void dd_ip_extraction_shutdown(void) {
+    dd_trusted_proxies_free();
+    zend_hash_destroy(&dd_ip_header_lookup);
+    if (dd_private_networks.nodes) {
+        pefree(dd_private_networks.nodes, 1);
+        dd_private_networks = (dd_cidr_trie){0};
+    }
 }
 
 static zend_string *dd_get_ipheader(zend_string *value) {
@@ -116,11 +302,28 @@ void ddtrace_extract_ip_from_headers(zval *server, zend_array *meta) {
         }
         zend_string_release(ipheader);
     } else {
-        for (unsigned i = 0; i < ARRAY_SIZE(priority_header_map); i++) {
-            zval *val = zend_hash_find(Z_ARR_P(server), priority_header_map[i].key);
-            if (!val) {
-                val = zend_hash_find(Z_ARR_P(server), priority_header_map[i].name);
+        // a single pass over the server array finds all candidate headers, which are then considered by priority
+        zval *headers[MAX_HEADER_ID * 2] = {0}, *remote_addr = NULL;
+        zend_string *key;
+        zval *val;
+        ZEND_HASH_FOREACH_STR_KEY_VAL(Z_ARR_P(server), key, val) {
+            if (!key || ZSTR_LEN(key) < sizeof("x-real-ip") - 1 || ZSTR_LEN(key) > sizeof("HTTP_X_CLUSTER_CLIENT_IP") - 1) {
+                continue;
+            }
+            zval *id = zend_hash_find(&dd_ip_header_lookup, key);
+            if (!id) {
+                continue;
+            }
+            if (Z_LVAL_P(id) == DD_REMOTE_ADDR_LOOKUP_ID) {
+                remote_addr = val;
+            } else {
+                headers[Z_LVAL_P(id)] = val;
             }
+        }
+        ZEND_HASH_FOREACH_END();
+
+        for (unsigned i = 0; i < ARRAY_SIZE(priority_header_map); i++) {
+            val = headers[2 * i] ? headers[2 * i] : headers[2 * i + 1];
             if (val && Z_TYPE_P(val) == IS_STRING && Z_STRLEN_P(val) > 0) {
                 zend_string *headertag = zend_strpprintf(0, "http.request.headers.%s", ZSTR_VAL(priority_header_map[i].name));
                 zval headerzv;
@@ -136,8 +339,12 @@ void ddtrace_extract_ip_from_headers(zval *server, zend_array *meta) {
             }
         }
         // We didn't find any valid IPs, extract from remote_addr
-        if (client_ip == NULL) {
-            client_ip = dd_try_extract(server, remote_addr_key, dd_parse_plain_raw);
+        if (client_ip == NULL && remote_addr) {
+            ZVAL_DEREF(remote_addr);
+            ipaddr out;
+            if (Z_TYPE_P(remote_addr) == IS_STRING && dd_parse_plain_raw(Z_STR_P(remote_addr), &out)) {
+                client_ip = dd_ipaddr_to_zstr(&out);
+            }
         }
     }
 
@@ -169,18 +376,6 @@ static zend_string *dd_try_extract_ip_from_custom_header(const zval *server, zen
     return NULL;
 }
 
-static zend_string *dd_try_extract(const zval *server, zend_string *key, extract_func_t extract_func) {
-    zend_string *value = dd_fetch_arr_str(server, key);
-    if (!value) {
-        return NULL;
-    }
-    ipaddr out;
-    if ((*extract_func)(value, &out)) {
-        return dd_ipaddr_to_zstr(&out);
-    }
-    return NULL;
-}
-
 static zend_string *dd_fetch_arr_str(const zval *server, zend_string *key) {
     zval *value = zend_hash_find(Z_ARR_P(server), key);
     if (!value) {
@@ -316,12 +511,17 @@ static bool dd_parse_ip_address(const char *_addr, size_t addr_len, bool ip_or_e
     if (addr_len == 0) {
         return false;
     }
-    char *addr = safe_emalloc(addr_len, 1, 1);
+    // no textual address is longer than that, thus there is no need for a heap copy of long values
+    if (addr_len >= INET6_ADDRSTRLEN) {
+        if (ip_or_error) {
+            ddtrace_log_errf("Not recognized as IP address: \"%.*s\"", (int)addr_len, _addr);
+        }
+        return false;
+    }
+    char addr[INET6_ADDRSTRLEN];
     memcpy(addr, _addr, addr_len);
     addr[addr_len] = '\0';
 
-    bool res = true;
-
     int ret = inet_pton(AF_INET, addr, &out->v4);
     if (ret != 1) {
         ret = inet_pton(AF_INET6, addr, &out->v6);
@@ -329,8 +529,7 @@ static bool dd_parse_ip_address(const char *_addr, size_t addr_len, bool ip_or_e
             if (ip_or_error) {
                 ddtrace_log_errf("Not recognized as IP address: \"%s\"", addr);
             }
-            res = false;
-            goto err;
+            return false;
         }
 
         uint8_t *s6addr = out->v6.s6_addr;
@@ -349,9 +548,7 @@ static bool dd_parse_ip_address(const char *_addr, size_t addr_len, bool ip_or_e
         out->af = AF_INET;
     }
 
-err:
-    efree(addr);
-    return res;
+    return true;
 }
 
 static bool dd_parse_ip_address_maybe_port_pair(const char *addr, size_t addr_len, bool ip_or_error, ipaddr *out) {
@@ -374,94 +571,13 @@ static bool dd_parse_ip_address_maybe_port_pair(const char *addr, size_t addr_le
     return dd_parse_ip_address(addr, addr_len, ip_or_error, out);
 }
 
-#define CT_HTONL(x) ((((x) >> 24) & 0x000000FFU) | (((x) >> 8) & 0x0000FF00U) | (((x) << 8) & 0x00FF0000U) | (((x) << 24) & 0xFF000000U))
-
-static bool dd_is_private_v4(const struct in_addr *addr) {
-    static const struct {
-        struct in_addr base;
-        struct in_addr mask;
-    } priv_ranges[] = {
-        {
-            .base.s_addr = CT_HTONL(0x0A000000U),  // 10.0.0.0
-            .mask.s_addr = CT_HTONL(0xFF000000U),  // 255.0.0.0
-        },
-        {
-            .base.s_addr = CT_HTONL(0xAC100000U),  // 172.16.0.0
-            .mask.s_addr = CT_HTONL(0xFFF00000U),  // 255.240.0.0
-        },
-        {
-            .base.s_addr = CT_HTONL(0xC0A80000U),  // 192.168.0.0
-            .mask.s_addr = CT_HTONL(0xFFFF0000U),  // 255.255.0.0
-        },
-        {
-            .base.s_addr = CT_HTONL(0x7F000000U),  // 127.0.0.0
-            .mask.s_addr = CT_HTONL(0xFF000000U),  // 255.0.0.0
-        },
-        {
-            .base.s_addr = CT_HTONL(0xA9FE0000U),  // 169.254.0.0
-            .mask.s_addr = CT_HTONL(0xFFFF0000U),  // 255.255.0.0
-        },
-    };
-
-    for (unsigned i = 0; i < ARRAY_SIZE(priv_ranges); i++) {
-        __auto_type range = priv_ranges[i];
-        if ((addr->s_addr & range.mask.s_addr) == range.base.s_addr) {
-            return true;
-        }
-    }
-    return false;
-}
-
-static bool dd_is_private_v6(const struct in6_addr *addr) {
-    // clang-format off
-    static const struct {
-        union {
-            struct in6_addr base;
-            uint64_t base_i[2];
-        };
-        union {
-            struct in6_addr mask;
-            uint64_t mask_i[2];
-        };
-    } priv_ranges[] = {
-        {
-            .base.s6_addr = {[15] = 1}, // loopback
-            .mask.s6_addr = {[0 ... 15] = 0xFF}, // /128
-        },
-        {
-            .base.s6_addr = {0xFE, 0x80}, // link-local
-            .mask.s6_addr = {0xFF, 0xC0}, // /10
-        },
-        {
-            .base.s6_addr = {0xFE, 0xC0}, // site-local
-            .mask.s6_addr = {0xFF, 0xC0}, // /10
-        },
-        {
-            .base.s6_addr = {0xFD}, // unique local address
-            .mask.s6_addr = {0xFF}, // /8
-        },
-        {
-            .base.s6_addr = {0xFC},
-            .mask.s6_addr = {0xFE}, // /7
-        },
-    };
-    // clang-format on
-
-    uint64_t addr_i[2];
-    memcpy(&addr_i[0], addr->s6_addr, sizeof(addr_i));
-
-    for (unsigned i = 0; i < ARRAY_SIZE(priv_ranges); i++) {
-        if ((addr_i[0] & priv_ranges[i].mask_i[0]) == priv_ranges[i].base_i[0] &&
-            (addr_i[1] & priv_ranges[i].mask_i[1]) == priv_ranges[i].base_i[1]) {
-            return true;
-        }
-    }
-    return false;
-}
-
 static bool dd_is_private(const ipaddr *addr) {
-    if (addr->af == AF_INET) {
-        return dd_is_private_v4(&addr->v4);
+    zend_array *trusted_proxies = get_DD_TRACE_CLIENT_IP_TRUSTED_PROXIES();
+    if (!zend_hash_num_elements(trusted_proxies)) {
+        return dd_cidr_trie_contains(&dd_private_networks, addr);
+    }
+    if (trusted_proxies != dd_trusted_proxies.trusted_proxies || ddtrace_dynamic_config_generation() != dd_trusted_proxies.config_generation) {
+        dd_trusted_proxies_compile(trusted_proxies);
     }
-    return dd_is_private_v6(&addr->v6);
+    return dd_cidr_trie_contains(&dd_trusted_proxies.trie, addr);
 }
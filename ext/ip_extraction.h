@@ -4,6 +4,8 @@
 #include <php.h>
 
 void dd_ip_extraction_startup(void);
+void dd_ip_extraction_rshutdown(void);
+void dd_ip_extraction_shutdown(void);
 void ddtrace_extract_ip_from_headers(zval *server, zend_array *meta);
 
 #endif
@@ -1,36 +1,55 @@
 #include "limiter.h"
 
-#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
 
 // clang-format Off
 
 #define NANOSECONDS_PER_SECOND 1000000000
-
+#define NANOSECONDS_PER_MILLISECOND 1000000
+#define WINDOW_MILLISECONDS 1000
+
+/*
+ The limiter lives in a page shared among forks, hence it must not rely on any lock: a worker being killed or stalled
+ while holding one would wedge every other worker. All of the window state is packed into a single 64-bit word, which
+ is only ever updated with compare-and-swap: lock-free 64-bit atomics are address-free, thus work across processes.
+*/
 typedef struct {
     /* limit from configuration DD_TRACE_RATE_LIMIT */
     uint32_t limit;
-    struct {
-        /* beginning of window */
-        uint64_t open;
-        /* last hit inside this window */
-        uint64_t current;
-        /* total count for this window */
-        uint32_t samples;
-        /* allowed count for this window */
-        uint32_t allowed;
-        /* limit (tokens) for this window */
-        uint32_t limit;
-        /* rate for the last window that passed */
-        uint32_t rate;
-    } window;
-
-    pthread_mutex_t lock;
+    /* clock at creation, window timestamps are relative to it */
+    uint64_t epoch;
+    /* high 32 bits: beginning of the window in milliseconds, low 32 bits: total count for this window */
+    _Atomic uint64_t window;
+    /* rate for the last window that passed, as double bits, 0 if no window passed yet */
+    _Atomic uint64_t previous_rate;
 } ddtrace_limiter;
 
 static ddtrace_limiter* dd_limiter;
 
+/*
+ Per rule leaky buckets, e.g. for span sampling rules max_per_second, likewise shared among forks so that configured
+ rates hold for the whole pool rather than for each worker. The table has a fixed size as it cannot grow after fork:
+ buckets are claimed by storing the hash of their rule key and rate, so rules with different rates never share a
+ bucket. A bucket which was idle for longer than it takes to drain is indistinguishable from an unclaimed one, thus
+ may be claimed again, e.g. by the rules replacing it after a configuration change.
+*/
+typedef struct {
+    /* hash of the rule key and rate, 0 for unclaimed buckets */
+    _Atomic uint64_t key;
+    /* hits scaled by NANOSECONDS_PER_SECOND */
+    _Atomic int64_t hit_count;
+    /* clock at last hit */
+    _Atomic uint64_t last_update;
+    /* nanoseconds after the last hit from which on the bucket is empty */
+    _Atomic uint64_t drain_time;
+} ddtrace_rule_limiter;
+
+static ddtrace_rule_limiter* dd_rule_limiters;
+static size_t dd_rule_limiters_count;
+
 static inline uint64_t ddtrace_limiter_clock() {
     struct timespec ts;
 
@@ -40,11 +59,48 @@ static inline uint64_t ddtrace_limiter_clock() {
         return 0;
     }
 
-    return (ts.tv_sec * NANOSECONDS_PER_SECOND) + /* seconds as nanoseconds */
-            ts.tv_nsec;                           /* plus remaining nanoseconds */
+    return ((uint64_t) ts.tv_sec * NANOSECONDS_PER_SECOND) + /* seconds as nanoseconds */
+            ts.tv_nsec;                                      /* plus remaining nanoseconds */
+}
+
+static inline uint32_t ddtrace_limiter_now() {
+    /* wraps after ~49 days, window comparisons are done modulo 2^32 */
+    return (uint32_t) ((ddtrace_limiter_clock() - dd_limiter->epoch) / NANOSECONDS_PER_MILLISECOND);
+}
+
+static inline uint32_t ddtrace_limiter_allowed(uint32_t samples) {
+    /* a sample is allowed if and only if fewer than limit samples were seen before it within the window */
+    return samples < dd_limiter->limit ? samples : dd_limiter->limit;
+}
+
+static inline uint64_t ddtrace_limiter_rate_bits(double rate) {
+    uint64_t bits;
+    memcpy(&bits, &rate, sizeof(bits));
+    return bits;
+}
+
+static inline double ddtrace_limiter_bits_rate(uint64_t bits) {
+    double rate;
+    memcpy(&rate, &bits, sizeof(rate));
+    return rate;
+}
+
+static void ddtrace_rule_limiters_create() {
+    dd_rule_limiters = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+
+    if (dd_rule_limiters == MAP_FAILED) {
+        dd_rule_limiters = NULL;
+        return;
+    }
+
+    /* anonymous mappings are zeroed, i.e. all buckets are unclaimed */
+    dd_rule_limiters_count = sysconf(_SC_PAGESIZE) / sizeof(ddtrace_rule_limiter);
 }
 
 void ddtrace_limiter_create() {
+    /* rules may be changed at runtime, so the table must always exist before we fork */
+    ddtrace_rule_limiters_create();
+
     uint32_t limit = (uint32_t) get_global_DD_TRACE_RATE_LIMIT();
 
     if (!limit) {
@@ -54,7 +110,7 @@ void ddtrace_limiter_create() {
     /*
      We share the limiter among forks (ie, forks need to write this memory), this requires that we map the memory as anonymous and shared
     */
-    dd_limiter = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    dd_limiter = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
 
     if ( dd_limiter == MAP_FAILED) {
         dd_limiter = NULL;
@@ -62,19 +118,9 @@ void ddtrace_limiter_create() {
     }
 
     dd_limiter->limit = limit;
-    dd_limiter->window.open = ddtrace_limiter_clock();
-    dd_limiter->window.limit = limit;
-
-    pthread_mutexattr_t mattr;
-
-    /*
-     Mutex must have PROCESS_SHARED set to be usable among forks
-    */
-    pthread_mutexattr_init(&mattr);
-    pthread_mutexattr_setpshared(
-        &mattr, PTHREAD_PROCESS_SHARED);
-    pthread_mutex_init(&dd_limiter->lock, &mattr);
-    pthread_mutexattr_destroy(&mattr);
+    dd_limiter->epoch = ddtrace_limiter_clock();
+    atomic_init(&dd_limiter->window, 0);
+    atomic_init(&dd_limiter->previous_rate, 0);
 }
 
 bool ddtrace_limiter_active() {
@@ -88,62 +134,135 @@ bool ddtrace_limiter_active() {
 bool ddtrace_limiter_allow() {
     ZEND_ASSERT(dd_limiter);
 
-    pthread_mutex_lock(&dd_limiter->lock);
+    uint32_t now = ddtrace_limiter_now();
+    uint64_t window = atomic_load_explicit(&dd_limiter->window, memory_order_relaxed);
+
+    while (true) {
+        uint32_t open = (uint32_t) (window >> 32);
+        uint32_t samples = (uint32_t) window;
+
+        /* another worker may have opened a window after our clock was read: a negative age is within that window,
+           rather than a passed one to be reopened at our earlier clock */
+        if ((int32_t) (now - open) > WINDOW_MILLISECONDS) {
+            /* window passed, move it; the first sample of the new window is always allowed */
+            if (atomic_compare_exchange_weak_explicit(&dd_limiter->window, &window, ((uint64_t) now << 32) | 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                /* store the passed window rate for effective rate calculation */
+                double rate = samples ? (double) ddtrace_limiter_allowed(samples) / samples : 1;
+                atomic_store_explicit(&dd_limiter->previous_rate, ddtrace_limiter_rate_bits(rate), memory_order_relaxed);
+                return true;
+            }
+            continue;
+        }
+
+        if (samples == UINT32_MAX) {
+            return false;
+        }
+
+        if (atomic_compare_exchange_weak_explicit(&dd_limiter->window, &window, window + 1,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            return samples < dd_limiter->limit;
+        }
+    }
+}
 
-    dd_limiter->window.current  = ddtrace_limiter_clock();
+double ddtrace_limiter_rate() {
+    uint32_t samples = (uint32_t) atomic_load_explicit(&dd_limiter->window, memory_order_relaxed);
+    double previous = ddtrace_limiter_bits_rate(atomic_load_explicit(&dd_limiter->previous_rate, memory_order_relaxed));
 
-    if (dd_limiter->window.current > (dd_limiter->window.open + NANOSECONDS_PER_SECOND)) {
-        /* window passed, reset */
+    if (!samples) {
+        /* nothing sampled in this window yet */
+        return previous ? previous : 1;
+    }
 
-        /* store current window rate for effective rate calculation */
-        dd_limiter->window.rate = dd_limiter->window.samples ?
-            (double) dd_limiter->window.allowed / dd_limiter->window.samples : 1;
+    double current = (double) ddtrace_limiter_allowed(samples) / samples;
+    if (!previous) {
+        /* no previous window */
+        return current;
+    }
 
-        /* move window */
-        dd_limiter->window.open = dd_limiter->window.current;
-        dd_limiter->window.samples = 0;
-        dd_limiter->window.allowed = 0;
+    return (current + previous) / 2.0; /* spread over last two windows */
+}
+
+static ddtrace_rule_limiter* ddtrace_rule_limiter_find(uint64_t key, uint64_t now, uint64_t drain_time) {
+    size_t home = key % dd_rule_limiters_count;
+
+    for (size_t i = 0; i < dd_rule_limiters_count; ++i) {
+        ddtrace_rule_limiter *bucket = &dd_rule_limiters[(home + i) % dd_rule_limiters_count];
+        uint64_t bucket_key = atomic_load_explicit(&bucket->key, memory_order_relaxed);
+
+        if (bucket_key == key) {
+            return bucket;
+        }
+
+        /* unclaimed buckets have neither a last hit nor a drain time */
+        uint64_t last_update = atomic_load_explicit(&bucket->last_update, memory_order_relaxed);
+        if (bucket_key == 0 || (now > last_update && now - last_update > atomic_load_explicit(&bucket->drain_time, memory_order_relaxed))) {
+            if (atomic_compare_exchange_strong(&bucket->key, &bucket_key, key)) {
+                atomic_store(&bucket->hit_count, 0);
+                atomic_store(&bucket->drain_time, drain_time);
+                atomic_store(&bucket->last_update, now);
+                return bucket;
+            }
+            if (bucket_key == key) {
+                return bucket;
+            }
+        }
     }
 
-    if (dd_limiter->window.samples++ < dd_limiter->window.limit) {
-        dd_limiter->window.allowed++;
+    return NULL;
+}
 
-        pthread_mutex_unlock(&dd_limiter->lock);
+bool ddtrace_limiter_rule_allow(zend_string *rule_key, double max_per_second) {
+    if (!dd_rule_limiters) {
         return true;
     }
 
-    pthread_mutex_unlock(&dd_limiter->lock);
-    return false;
-}
+    uint64_t now = ddtrace_limiter_clock();
 
-double ddtrace_limiter_rate() {
-    double effective = 0;
+    /* the bucket holds at most one second worth of hits, or one hit below one per second */
+    long double max_elapsed = max_per_second > 0 && max_per_second < 1 ? NANOSECONDS_PER_SECOND / (long double)max_per_second : NANOSECONDS_PER_SECOND;
 
-    pthread_mutex_lock(&dd_limiter->lock);
+    uint64_t rate_bits = ddtrace_limiter_rate_bits(max_per_second);
+    uint64_t key = ZSTR_HASH(rule_key) ^ (rate_bits * 0x9e3779b97f4a7c15);
+    ddtrace_rule_limiter *bucket = ddtrace_rule_limiter_find(key ? key : 1, now, (uint64_t)max_elapsed);
+    if (!bucket) {
+        /* all buckets are in use by other rules: sharing one would limit this rule at a foreign rate */
+        return true;
+    }
 
-    if (!dd_limiter->window.rate ||
-        !dd_limiter->window.samples) {
-        /* no previous window, or samples */
-        effective = (double) dd_limiter->window.allowed / dd_limiter->window.samples;
-    } else {
-        effective = (double) (
-            (double) dd_limiter->window.allowed / dd_limiter->window.samples +  /* current rate */
-            dd_limiter->window.rate                                             /* previous window rate */
-        ) / 2.0;                                                                /* spread over last two windows */
+    /* restore allowed time basis */
+    uint64_t old_time = atomic_exchange(&bucket->last_update, now);
+    uint64_t elapsed = now > old_time ? now - old_time : 0; /* another worker may have stored a later clock */
+    if (elapsed > max_elapsed) {
+        elapsed = (uint64_t)max_elapsed;
     }
+    int64_t clear_counter = (int64_t)((long double)elapsed * max_per_second);
 
-    pthread_mutex_unlock(&dd_limiter->lock);
+    int64_t previous_hits = atomic_fetch_sub(&bucket->hit_count, clear_counter);
+    if (previous_hits < clear_counter) {
+        atomic_fetch_add(&bucket->hit_count, previous_hits > 0 ? clear_counter - previous_hits : clear_counter);
+    }
+
+    previous_hits = atomic_fetch_add(&bucket->hit_count, NANOSECONDS_PER_SECOND);
+    if ((long double)previous_hits / NANOSECONDS_PER_SECOND >= max_per_second) {
+        atomic_fetch_sub(&bucket->hit_count, NANOSECONDS_PER_SECOND);
+        return false;
+    }
 
-    return effective;
+    return true;
 }
 
 void ddtrace_limiter_destroy() {
+    if (dd_rule_limiters) {
+        munmap(dd_rule_limiters, sysconf(_SC_PAGESIZE));
+        dd_rule_limiters = NULL;
+    }
+
     if (!dd_limiter) {
         return;
     }
 
-    pthread_mutex_destroy(&dd_limiter->lock);
-
     munmap(dd_limiter, sysconf(_SC_PAGESIZE));
 
     dd_limiter = NULL;
@@ -8,5 +8,6 @@ void ddtrace_limiter_create();
 bool ddtrace_limiter_active();
 bool ddtrace_limiter_allow();
 double ddtrace_limiter_rate();
+bool ddtrace_limiter_rule_allow(zend_string *rule_key, double max_per_second);
 void ddtrace_limiter_destroy();
 #endif
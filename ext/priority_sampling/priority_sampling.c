@@ -1,13 +1,17 @@
 #include "priority_sampling.h"
 
-#include <mt19937-64.h>
+#include <SAPI.h>
+#include <Zend/zend_exceptions.h>
 
+#include <hook/hook.h>
 #include <uri_normalization/uri_normalization.h>
 
 #include "../compat_string.h"
 #include "../configuration.h"
+#include "../dynamic_config.h"
 
 #include "../limiter/limiter.h"
+#include "../random.h"
 
 ZEND_EXTERN_MODULE_GLOBALS(ddtrace);
 
@@ -30,15 +34,187 @@ static void dd_update_decision_maker_tag(ddtrace_span_data *span, enum dd_sampli
     }
 }
 
-static bool dd_rule_matches(zval *pattern, zval *prop) {
-    if (Z_TYPE_P(pattern) != IS_STRING) {
-        return false;
+// Once a trace is known to be rejected, hooks stop creating spans (see zai_hook_lightweight)
+static bool dd_sampling_keep_rules_configured(void) {
+    return get_DD_TRACE_SAMPLING_KEEP_SLOWER_THAN_MS() > 0 || get_DD_TRACE_SAMPLING_KEEP_ERRORS() || get_DD_TRACE_SAMPLING_KEEP_HTTP_5XX();
+}
+
+// A rejected trace may still be kept by a keep rule, which then needs all its spans
+static void dd_update_lightweight_tracing(zend_long priority) {
+    zai_hook_lightweight = get_DD_TRACE_LIGHTWEIGHT_REJECTED_TRACES() && priority <= 0 && !dd_sampling_keep_rules_configured();
+}
+
+/*
+ Sampling rules are compiled once per configuration generation, i.e. per pair of DD_TRACE_SAMPLING_RULES and
+ DD_SERVICE_MAPPING arrays, into a flat program holding only rules which can possibly apply. As most root spans of
+ a worker share few distinct service and name pairs, the index of the matching rule is then memoized per pair, so that
+ a decision usually costs a single hash lookup instead of mapping the service and matching regexes for each rule.
+ The program outlives requests as long as it was compiled from the persistent (i.e. not ini_set()) configuration; the
+ arrays are referenced while compiled, so that their address identifies them for as long as that.
+*/
+typedef struct {
+    zend_string *service;  // NULL if the rule does not restrict services
+    zend_string *name;     // NULL if the rule does not restrict names
+    bool service_invalid;  // a non-string service pattern only matches spans without service
+    double sample_rate;
+} dd_sampling_rule;
+
+#define DD_SAMPLING_RULES_CACHE_MAX_ENTRIES 256
+#define DD_SAMPLING_RULES_NO_MATCH (-1)
+
+ZEND_TLS struct {
+    zend_array *rules;
+    zend_array *service_mapping;
+    uint32_t config_generation;
+    dd_sampling_rule *program;
+    uint32_t program_len;
+    HashTable decisions;  // (service, name) => index into program or DD_SAMPLING_RULES_NO_MATCH
+} dd_sampling_rules;
+
+static void dd_sampling_rules_free(void) {
+    if (!dd_sampling_rules.rules) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < dd_sampling_rules.program_len; ++i) {
+        if (dd_sampling_rules.program[i].service) {
+            zend_string_release(dd_sampling_rules.program[i].service);
+        }
+        if (dd_sampling_rules.program[i].name) {
+            zend_string_release(dd_sampling_rules.program[i].name);
+        }
+    }
+    if (dd_sampling_rules.program) {
+        pefree(dd_sampling_rules.program, 1);
+    }
+    zend_hash_destroy(&dd_sampling_rules.decisions);
+    zai_config_array_cache_release(dd_sampling_rules.rules);
+    zai_config_array_cache_release(dd_sampling_rules.service_mapping);
+
+    dd_sampling_rules.rules = NULL;
+    dd_sampling_rules.service_mapping = NULL;
+    dd_sampling_rules.program = NULL;
+    dd_sampling_rules.program_len = 0;
+}
+
+static void dd_sampling_rules_compile(zend_array *rules, zend_array *service_mapping) {
+    dd_sampling_rules_free();
+
+    zai_config_array_cache_addref(rules);
+    zai_config_array_cache_addref(service_mapping);
+    dd_sampling_rules.rules = rules;
+    dd_sampling_rules.service_mapping = service_mapping;
+    dd_sampling_rules.config_generation = ddtrace_dynamic_config_generation();
+    zend_hash_init(&dd_sampling_rules.decisions, 8, NULL, NULL, 1);
+
+    uint32_t count = zend_hash_num_elements(rules);
+    if (!count) {
+        return;
+    }
+    dd_sampling_rules.program = pemalloc(sizeof(dd_sampling_rule) * count, 1);
+
+    zval *rule;
+    ZEND_HASH_FOREACH_VAL(rules, rule) {
+        if (Z_TYPE_P(rule) != IS_ARRAY) {
+            continue;
+        }
+
+        // a matching rule without sample rate is skipped at evaluation, hence it can be dropped altogether
+        zval *sample_rate_zv = zend_hash_str_find(Z_ARR_P(rule), ZEND_STRL("sample_rate"));
+        if (!sample_rate_zv) {
+            continue;
+        }
+
+        // a non-string name pattern never matches
+        zval *name = zend_hash_str_find(Z_ARR_P(rule), ZEND_STRL("name"));
+        if (name && Z_TYPE_P(name) != IS_STRING) {
+            continue;
+        }
+        zval *service = zend_hash_str_find(Z_ARR_P(rule), ZEND_STRL("service"));
+        bool service_invalid = service && Z_TYPE_P(service) != IS_STRING;
+
+        dd_sampling_rule *compiled = &dd_sampling_rules.program[dd_sampling_rules.program_len++];
+        compiled->service_invalid = service_invalid;
+        compiled->service = service && !service_invalid ? zend_string_init(Z_STRVAL_P(service), Z_STRLEN_P(service), 1) : NULL;
+        compiled->name = name ? zend_string_init(Z_STRVAL_P(name), Z_STRLEN_P(name), 1) : NULL;
+        compiled->sample_rate = zval_get_double(sample_rate_zv);
     }
-    if (Z_TYPE_P(prop) != IS_STRING) {
-        return true;  // default case unset or null must be true, everything else is too then...
+    ZEND_HASH_FOREACH_END();
+}
+
+static zend_long dd_sampling_rules_evaluate(zval *service, zval *name) {
+    zval *mapped_service = NULL;
+    if (Z_TYPE_P(service) == IS_STRING) {
+        mapped_service = zend_hash_find(dd_sampling_rules.service_mapping, Z_STR_P(service));
+        if (!mapped_service) {
+            mapped_service = service;
+        }
     }
 
-    return zai_match_regex(Z_STR_P(pattern), Z_STR_P(prop));
+    for (uint32_t i = 0; i < dd_sampling_rules.program_len; ++i) {
+        dd_sampling_rule *rule = &dd_sampling_rules.program[i];
+        if (rule->service_invalid && mapped_service) {
+            continue;
+        }
+        // default case unset or null must be true, everything else is too then...
+        if (rule->service && mapped_service && Z_TYPE_P(mapped_service) == IS_STRING && !zai_match_regex(rule->service, Z_STR_P(mapped_service))) {
+            continue;
+        }
+        if (rule->name && Z_TYPE_P(name) == IS_STRING && !zai_match_regex(rule->name, Z_STR_P(name))) {
+            continue;
+        }
+        return i;
+    }
+
+    return DD_SAMPLING_RULES_NO_MATCH;
+}
+
+static dd_sampling_rule *dd_find_sampling_rule(ddtrace_span_data *span) {
+    zend_array *rules = get_DD_TRACE_SAMPLING_RULES(), *service_mapping = get_DD_SERVICE_MAPPING();
+    if (rules != dd_sampling_rules.rules || service_mapping != dd_sampling_rules.service_mapping
+        || ddtrace_dynamic_config_generation() != dd_sampling_rules.config_generation) {
+        dd_sampling_rules_compile(rules, service_mapping);
+    }
+
+    if (!dd_sampling_rules.program_len) {
+        return NULL;
+    }
+
+    zval *service = ddtrace_spandata_property_service(span), *name = ddtrace_spandata_property_name(span);
+
+    // key: whether service and name are strings, followed by service, a NUL separator and name
+    size_t service_len = Z_TYPE_P(service) == IS_STRING ? Z_STRLEN_P(service) : 0;
+    size_t name_len = Z_TYPE_P(name) == IS_STRING ? Z_STRLEN_P(name) : 0;
+    size_t key_len = 1 + service_len + 1 + name_len;
+    ALLOCA_FLAG(use_heap)
+    char *key = do_alloca(key_len, use_heap);
+    key[0] = (char)('0' + (Z_TYPE_P(service) == IS_STRING) + 2 * (Z_TYPE_P(name) == IS_STRING));
+    if (service_len) {
+        memcpy(key + 1, Z_STRVAL_P(service), service_len);
+    }
+    key[1 + service_len] = 0;
+    if (name_len) {
+        memcpy(key + 2 + service_len, Z_STRVAL_P(name), name_len);
+    }
+
+    zend_long index;
+    zval *decision = zend_hash_str_find(&dd_sampling_rules.decisions, key, key_len);
+    if (decision) {
+        index = Z_LVAL_P(decision);
+    } else {
+        index = dd_sampling_rules_evaluate(service, name);
+
+        // names are usually few, but do not let a high cardinality of them grow the cache without bound
+        if (zend_hash_num_elements(&dd_sampling_rules.decisions) >= DD_SAMPLING_RULES_CACHE_MAX_ENTRIES) {
+            zend_hash_clean(&dd_sampling_rules.decisions);
+        }
+        zval index_zv;
+        ZVAL_LONG(&index_zv, index);
+        zend_hash_str_add_new(&dd_sampling_rules.decisions, key, key_len, &index_zv);
+    }
+    free_alloca(key, use_heap);
+
+    return index == DD_SAMPLING_RULES_NO_MATCH ? NULL : &dd_sampling_rules.program[index];
 }
 
 static void dd_decide_on_sampling(ddtrace_span_data *span) {
@@ -46,42 +222,16 @@ static void dd_decide_on_sampling(ddtrace_span_data *span) {
     // manual if it's not just inherited, otherwise this value is irrelevant (as sampling priority will be default)
     enum dd_sampling_mechanism mechanism = DD_MECHANISM_MANUAL;
     if (priority == DDTRACE_PRIORITY_SAMPLING_UNKNOWN) {
-        zval *rule;
         bool explicit_rule = zai_config_memoized_entries[DDTRACE_CONFIG_DD_TRACE_SAMPLE_RATE].name_index >= 0;
         double default_sample_rate = get_DD_TRACE_SAMPLE_RATE(), sample_rate = default_sample_rate;
 
-        ZEND_HASH_FOREACH_VAL(get_DD_TRACE_SAMPLING_RULES(), rule) {
-            if (Z_TYPE_P(rule) != IS_ARRAY) {
-                continue;
-            }
-
-            bool rule_matches = true;
-
-            zval *rule_pattern;
-            if ((rule_pattern = zend_hash_str_find(Z_ARR_P(rule), ZEND_STRL("service")))) {
-                zval *service = ddtrace_spandata_property_service(span);
-                if (Z_TYPE_P(service) == IS_STRING) {
-                    zval *mapped_service = zend_hash_find(get_DD_SERVICE_MAPPING(), Z_STR_P(service));
-                    if (!mapped_service) {
-                        mapped_service = service;
-                    }
-                    rule_matches &= dd_rule_matches(rule_pattern, mapped_service);
-                }
-            }
-            if ((rule_pattern = zend_hash_str_find(Z_ARR_P(rule), ZEND_STRL("name")))) {
-                rule_matches &= dd_rule_matches(rule_pattern, ddtrace_spandata_property_name(span));
-            }
-
-            zval *sample_rate_zv;
-            if (rule_matches && (sample_rate_zv = zend_hash_str_find(Z_ARR_P(rule), ZEND_STRL("sample_rate")))) {
-                sample_rate = zval_get_double(sample_rate_zv);
-                explicit_rule = true;
-                break;
-            }
-        }
-        ZEND_HASH_FOREACH_END();
-
-        bool sampling = (double)genrand64_int64() < sample_rate * (double)~0ULL;
+        dd_sampling_rule *rule = dd_find_sampling_rule(span);
+        if (rule) {
+            sample_rate = rule->sample_rate;
+            explicit_rule = true;
+        }
+
+        bool sampling = (double)ddtrace_generate_random() < sample_rate * (double)~0ULL;
         bool limited  = ddtrace_limiter_active() && (sampling && !ddtrace_limiter_allow());
 
         if (explicit_rule) {
@@ -111,6 +261,82 @@ static void dd_decide_on_sampling(ddtrace_span_data *span) {
                          &priority_zv);
 
     dd_update_decision_maker_tag(span, mechanism);
+    dd_update_lightweight_tracing(priority);
+}
+
+static bool dd_root_has_error(ddtrace_span_data *span) {
+    zend_array *meta = ddtrace_spandata_property_meta(span);
+    zval *ignored = zend_hash_str_find(meta, ZEND_STRL("error.ignored"));
+    zval *exception = ddtrace_spandata_property_exception(span);
+
+    if (Z_TYPE_P(exception) == IS_OBJECT && instanceof_function(Z_OBJCE_P(exception), zend_ce_throwable)) {
+        return true;
+    }
+    if (ignored && zend_is_true(ignored)) {
+        return false;
+    }
+    return zend_hash_str_exists(meta, ZEND_STRL("error.message")) || zend_hash_str_exists(meta, ZEND_STRL("error.type"));
+}
+
+static bool dd_root_has_http_5xx(ddtrace_span_data *span) {
+    // the status of the web request root is only added to meta at serialization, see _serialize_meta()
+    if (span->parent_id == DDTRACE_G(distributed_parent_trace_id) && SG(sapi_headers).http_response_code) {
+        return SG(sapi_headers).http_response_code >= 500 && SG(sapi_headers).http_response_code < 600;
+    }
+
+    zval *status = zend_hash_str_find(ddtrace_spandata_property_meta(span), ZEND_STRL("http.status_code"));
+    if (!status) {
+        return false;
+    }
+    if (Z_TYPE_P(status) == IS_LONG) {
+        return Z_LVAL_P(status) >= 500 && Z_LVAL_P(status) < 600;
+    }
+    return Z_TYPE_P(status) == IS_STRING && Z_STRLEN_P(status) == 3 && Z_STRVAL_P(status)[0] == '5';
+}
+
+/*
+ Keep rules run when a root span closes and may only turn a rejection of the sampler into a keep: traces which are
+ slow, erroneous or answered with a 5xx status are those worth keeping despite a low DD_TRACE_SAMPLE_RATE.
+ Propagated and manually enforced decisions are left alone, and kept traces still account against the rate limiter.
+*/
+void ddtrace_apply_sampling_keep_rules(ddtrace_span_data *root_span) {
+    if (!dd_sampling_keep_rules_configured()) {
+        return;
+    }
+    zend_long slower_than_ms = get_DD_TRACE_SAMPLING_KEEP_SLOWER_THAN_MS();
+    bool keep_errors = get_DD_TRACE_SAMPLING_KEEP_ERRORS(), keep_http_5xx = get_DD_TRACE_SAMPLING_KEEP_HTTP_5XX();
+
+    if (DDTRACE_G(default_priority_sampling) != DDTRACE_PRIORITY_SAMPLING_UNKNOWN) {
+        return;
+    }
+
+    zend_array *metrics = ddtrace_spandata_property_metrics(root_span);
+    zval *priority_zv = zend_hash_str_find(metrics, ZEND_STRL("_sampling_priority_v1"));
+    // only decisions taken by dd_decide_on_sampling() carry _dd.rule_psr
+    if (!priority_zv || zval_get_long(priority_zv) > 0 || !zend_hash_str_exists(metrics, ZEND_STRL("_dd.rule_psr"))) {
+        return;
+    }
+
+    if (!((slower_than_ms > 0 && root_span->duration >= (uint64_t)slower_than_ms * 1000000)
+          || (keep_errors && dd_root_has_error(root_span))
+          || (keep_http_5xx && dd_root_has_http_5xx(root_span)))) {
+        return;
+    }
+
+    if (ddtrace_limiter_active() && !ddtrace_limiter_allow()) {
+        zval limit_zv;
+        ZVAL_DOUBLE(&limit_zv, ddtrace_limiter_rate());
+        zend_hash_str_update(metrics, ZEND_STRL("_dd.limit_psr"), &limit_zv);
+        return;
+    }
+
+    // _dd.rule_psr keeps the rate the trace was rejected with
+    zval zv;
+    ZVAL_LONG(&zv, PRIORITY_SAMPLING_USER_KEEP);
+    zend_hash_str_update(metrics, ZEND_STRL("_sampling_priority_v1"), &zv);
+
+    dd_update_decision_maker_tag(root_span, DD_MECHANISM_RULE);
+    dd_update_lightweight_tracing(PRIORITY_SAMPLING_USER_KEEP);
 }
 
 zend_long ddtrace_fetch_prioritySampling_from_root(void) {
@@ -149,11 +375,24 @@ void ddtrace_set_prioritySampling_on_root(zend_long priority, enum dd_sampling_m
     zend_array *root_metrics = ddtrace_spandata_property_metrics(root_span);
     if (priority == DDTRACE_PRIORITY_SAMPLING_UNKNOWN || priority == DDTRACE_PRIORITY_SAMPLING_UNSET) {
         zend_hash_str_del(root_metrics, ZEND_STRL("_sampling_priority_v1"));
+        zai_hook_lightweight = false;
     } else {
         zval zv;
         ZVAL_LONG(&zv, priority);
         zend_hash_str_update(root_metrics, ZEND_STRL("_sampling_priority_v1"), &zv);
 
         dd_update_decision_maker_tag(root_span, mechanism);
+        dd_update_lightweight_tracing(priority);
     }
 }
+
+void ddtrace_priority_sampling_rshutdown(void) {
+    // the references to rules passed to ini_set() must not outlive the request memory
+    if (dd_sampling_rules.rules && (!zai_config_array_is_persistent(dd_sampling_rules.rules) || !zai_config_array_is_persistent(dd_sampling_rules.service_mapping))) {
+        dd_sampling_rules_free();
+    }
+}
+
+void ddtrace_priority_sampling_mshutdown(void) {
+    dd_sampling_rules_free();
+}
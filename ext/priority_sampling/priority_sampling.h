@@ -22,5 +22,9 @@ enum dd_sampling_mechanism {
 void ddtrace_set_prioritySampling_on_root(zend_long priority, enum dd_sampling_mechanism mechanism);
 zend_long ddtrace_fetch_prioritySampling_from_span(ddtrace_span_data *root_span);
 zend_long ddtrace_fetch_prioritySampling_from_root(void);
+void ddtrace_apply_sampling_keep_rules(ddtrace_span_data *root_span);
+
+void ddtrace_priority_sampling_rshutdown(void);
+void ddtrace_priority_sampling_mshutdown(void);
 
 #endif  // DDTRACE_PRIORITY_SAMPLING_H
@@ -0,0 +1,143 @@
+#include "query_string_obfuscation.h"
+
+#include <uri_normalization/uri_normalization.h>
+
+#include "configuration.h"
+
+/* Custom regexes are applied to at most the first 8 KiB of a query string, bounding the cost of patterns which backtrack
+ * heavily: the remainder is replaced by a single <redacted>, and longer strings are always considered sensitive by
+ * ddtrace_query_string_is_sensitive(). The default regex is exempt, as it is only run from the candidates found by
+ * dd_find_sensitive_candidate() on. */
+#define DD_QUERY_STRING_OBFUSCATION_MAX_LEN 8192
+
+static bool dd_is_default_obfuscation_regex(zend_string *pattern) {
+    return zend_string_equals_literal(pattern, DD_TRACE_OBFUSCATION_QUERY_STRING_REGEXP_DEFAULT);
+}
+
+static inline bool dd_starts_with_ci(const char *cur, const char *end, const char *lower, size_t len) {
+    return (size_t)(end - cur) >= len && zend_binary_strncasecmp(cur, len, lower, len, len) == 0;
+}
+
+// (?:api_?|private_?|public_?|access_?|secret_?)key, the prefix having been matched already
+static inline bool dd_is_key_suffix(const char *cur, const char *end) {
+    if (cur < end && *cur == '_') {
+        ++cur;
+    }
+    return dd_starts_with_ci(cur, end, "key", 3);
+}
+
+/*
+ Every alternative of the default regex starts with a literal (matched case-insensitively), which is looked for here:
+ a match can only ever start at one of the returned positions. The scan is exact in that direction only: the regex
+ still decides whether there is an actual match from there on.
+*/
+static const char *dd_find_sensitive_candidate(const char *cur, const char *end) {
+    for (; cur < end; ++cur) {
+        switch (*cur | 0x20) {
+            case 'p':  // p(?:ass)?w(?:or)?d, pass(?:_?phrase)?, private_?key, public_?key
+                if (dd_starts_with_ci(cur, end, "pw", 2) || dd_starts_with_ci(cur, end, "pass", 4) ||
+                    (dd_starts_with_ci(cur, end, "private", 7) && dd_is_key_suffix(cur + 7, end)) ||
+                    (dd_starts_with_ci(cur, end, "public", 6) && dd_is_key_suffix(cur + 6, end))) {
+                    return cur;
+                }
+                break;
+            case 'a':  // api_?key, access_?key, auth(?:entication|orization)?
+                if ((dd_starts_with_ci(cur, end, "api", 3) && dd_is_key_suffix(cur + 3, end)) ||
+                    (dd_starts_with_ci(cur, end, "access", 6) && dd_is_key_suffix(cur + 6, end)) ||
+                    dd_starts_with_ci(cur, end, "auth", 4)) {
+                    return cur;
+                }
+                break;
+            case 's':  // secret, secret_?key, sign(?:ed|ature)?, ssh-rsa
+                if (dd_starts_with_ci(cur, end, "secret", 6) || dd_starts_with_ci(cur, end, "sign", 4) ||
+                    dd_starts_with_ci(cur, end, "ssh-rsa", 7)) {
+                    return cur;
+                }
+                break;
+            case 't':  // token, token(?::|%3A)[a-z0-9]{13}
+                if (dd_starts_with_ci(cur, end, "token", 5)) {
+                    return cur;
+                }
+                break;
+            case 'c':  // consumer_?(?:id|key|secret)
+                if (dd_starts_with_ci(cur, end, "consumer", 8)) {
+                    return cur;
+                }
+                break;
+            case 'b':  // bearer(?:\s|%20)+
+                if (dd_starts_with_ci(cur, end, "bearer", 6)) {
+                    return cur;
+                }
+                break;
+            case 'g':  // gh[opsu]_
+                if (end - cur >= 4 && (cur[1] | 0x20) == 'h' && strchr("opsu", cur[2] | 0x20) && cur[3] == '_') {
+                    return cur;
+                }
+                break;
+            case 'e':  // ey[I-L]
+                if (end - cur >= 3 && (cur[1] | 0x20) == 'y' && (cur[2] | 0x20) >= 'i' && (cur[2] | 0x20) <= 'l') {
+                    return cur;
+                }
+                break;
+            case '-':  // [\-]{5}BEGIN
+                if (dd_starts_with_ci(cur, end, "-----begin", 10)) {
+                    return cur;
+                }
+                break;
+        }
+    }
+    return NULL;
+}
+
+static bool dd_is_wildcard(zend_array *whitelist) {
+    return zend_hash_num_elements(whitelist) == 1 && zend_hash_str_exists(whitelist, ZEND_STRL("*"));
+}
+
+zend_string *ddtrace_filter_query_string(zai_string_view query_string, zend_array *whitelist) {
+    zend_string *pattern = get_DD_TRACE_OBFUSCATION_QUERY_STRING_REGEXP();
+    if (!dd_is_wildcard(whitelist) || !ZSTR_LEN(pattern)) {
+        return zai_filter_query_string(query_string, whitelist, NULL);
+    }
+
+    const char *start = query_string.ptr, *end = start + query_string.len;
+    if (!dd_is_default_obfuscation_regex(pattern)) {
+        if (query_string.len <= DD_QUERY_STRING_OBFUSCATION_MAX_LEN) {
+            return zai_filter_query_string(query_string, whitelist, pattern);
+        }
+        zend_string *obfuscated = zai_filter_query_string(
+            (zai_string_view){.len = DD_QUERY_STRING_OBFUSCATION_MAX_LEN, .ptr = start}, whitelist, pattern);
+        zend_string *capped = zend_strpprintf(0, "%s<redacted>", ZSTR_VAL(obfuscated));
+        zend_string_release(obfuscated);
+        return capped;
+    }
+
+    const char *sensitive = dd_find_sensitive_candidate(start, end);
+    if (!sensitive) {
+        return zend_string_init(start, query_string.len, 0);
+    }
+
+    // the default regex has neither anchors nor lookbehinds, hence matching on the remainder is equivalent
+    zend_string *obfuscated =
+        zai_filter_query_string((zai_string_view){.len = end - sensitive, .ptr = sensitive}, whitelist, pattern);
+    if (sensitive == start) {
+        return obfuscated;
+    }
+
+    zend_string *result = zend_string_alloc((sensitive - start) + ZSTR_LEN(obfuscated), 0);
+    memcpy(ZSTR_VAL(result), start, sensitive - start);
+    memcpy(ZSTR_VAL(result) + (sensitive - start), ZSTR_VAL(obfuscated), ZSTR_LEN(obfuscated) + 1);  // incl. trailing 0 byte
+    zend_string_release(obfuscated);
+    return result;
+}
+
+bool ddtrace_query_string_is_sensitive(zend_string *str) {
+    zend_string *pattern = get_DD_TRACE_OBFUSCATION_QUERY_STRING_REGEXP();
+    if (dd_is_default_obfuscation_regex(pattern)) {
+        if (!dd_find_sensitive_candidate(ZSTR_VAL(str), ZSTR_VAL(str) + ZSTR_LEN(str))) {
+            return false;
+        }
+    } else if (ZSTR_LEN(pattern) && ZSTR_LEN(str) > DD_QUERY_STRING_OBFUSCATION_MAX_LEN) {
+        return true;
+    }
+    return zai_match_regex(pattern, str);
+}
@@ -0,0 +1,17 @@
+#ifndef DD_QUERY_STRING_OBFUSCATION_H
+#define DD_QUERY_STRING_OBFUSCATION_H
+
+#include <php.h>
+#include <stdbool.h>
+#include <zai_string/string.h>
+
+/* Filters a query string by the given allowed parameters. With the '*' wildcard, the parts matching
+ * DD_TRACE_OBFUSCATION_QUERY_STRING_REGEXP are replaced by <redacted> instead.
+ * The default rule set only hands the query string to PCRE from the first place where one of the sensitive keys or
+ * token prefixes it covers occurs, so that most query strings are never scanned by the regex at all. */
+zend_string *ddtrace_filter_query_string(zai_string_view query_string, zend_array *whitelist);
+
+/* Whether a "key=value" pair contains anything matching DD_TRACE_OBFUSCATION_QUERY_STRING_REGEXP */
+bool ddtrace_query_string_is_sensitive(zend_string *str);
+
+#endif  // DD_QUERY_STRING_OBFUSCATION_H
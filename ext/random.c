@@ -2,6 +2,7 @@
 
 #include <php.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include <ext/standard/php_rand.h>
 #include <ext/standard/php_random.h>
@@ -12,15 +13,70 @@
 
 ZEND_EXTERN_MODULE_GLOBALS(ddtrace);
 
-static void ddtrace_seed_prng_with_optional_seed(zend_long seedconfig) {
-    unsigned long long seed;
-    if (seedconfig > 0) {
-        seed = seedconfig;
-    } else if (php_random_int_silent(ZEND_LONG_MIN, ZEND_LONG_MAX, (zend_long *)&seed) == FAILURE) {
-        seed = GENERATE_SEED();
+/*
+ Span ids come from xoshiro256** (https://prng.di.unimi.it/), whose 32 bytes of state stay in cache, unlike the 2.5 KB
+ of mt19937-64 and its periodic twist. Ids are generated in batches into a per-thread buffer. The generator is seeded
+ lazily and reseeded when a request starts in a different process than the one it was seeded in, or in the child of
+ pcntl_fork(), so that no two processes ever hand out the same ids. DD_TRACE_DEBUG_PRNG_SEED keeps selecting the
+ reproducible mt19937-64 sequence.
+*/
+#define DD_SPAN_ID_BATCH_SIZE 64
+
+ZEND_TLS uint64_t dd_xoshiro_state[4];
+ZEND_TLS bool dd_xoshiro_seeded = false;
+ZEND_TLS bool dd_prng_deterministic = false;
+ZEND_TLS uint64_t dd_span_id_batch[DD_SPAN_ID_BATCH_SIZE];
+ZEND_TLS uint32_t dd_span_id_batch_left = 0;
+ZEND_TLS pid_t dd_random_pid = 0;
+
+static inline uint64_t dd_rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+static inline uint64_t dd_xoshiro_next(uint64_t s[4]) {
+    uint64_t result = dd_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = dd_rotl(s[3], 45);
+
+    return result;
+}
+
+static uint64_t dd_splitmix64(uint64_t *x) {
+    uint64_t z = (*x += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+static void dd_xoshiro_seed(void) {
+    if (php_random_bytes_silent(dd_xoshiro_state, sizeof(dd_xoshiro_state)) == FAILURE) {
+        uint64_t x = (uint64_t)GENERATE_SEED() ^ ((uint64_t)getpid() << 32) ^ (uint64_t)(uintptr_t)&x;
+        for (int i = 0; i < 4; ++i) {
+            dd_xoshiro_state[i] = dd_splitmix64(&x);
+        }
+    }
+    if (!(dd_xoshiro_state[0] | dd_xoshiro_state[1] | dd_xoshiro_state[2] | dd_xoshiro_state[3])) {
+        dd_xoshiro_state[0] = 1;  // the all-zero state is the only invalid one
     }
-    init_genrand64(seed);
 
+    dd_xoshiro_seeded = true;
+    dd_span_id_batch_left = 0;
+    dd_random_pid = getpid();
+}
+
+static void ddtrace_seed_prng_with_optional_seed(zend_long seedconfig) {
+    dd_span_id_batch_left = 0;
+    if (dd_xoshiro_seeded && getpid() != dd_random_pid) {
+        dd_xoshiro_seeded = false;  // forked, the parent keeps using the same state
+    }
+    dd_prng_deterministic = seedconfig > 0;
+    if (dd_prng_deterministic) {
+        init_genrand64(seedconfig);
+    }
 }
 
 void ddtrace_seed_prng(void) {
@@ -34,19 +90,56 @@ bool ddtrace_reseed_seed_change(zval *old_value, zval *new_value) {
     return true;
 }
 
+void ddtrace_generate_random_batch(uint64_t *ids, size_t count) {
+    if (dd_prng_deterministic) {
+        for (size_t i = 0; i < count; ++i) {
+            ids[i] = (uint64_t)genrand64_int64();
+        }
+        return;
+    }
+
+    if (!dd_xoshiro_seeded) {
+        dd_xoshiro_seed();
+    }
+
+    // operate on a local copy, allowing the compiler to keep the state in registers
+    uint64_t state[4];
+    memcpy(state, dd_xoshiro_state, sizeof(state));
+    for (size_t i = 0; i < count; ++i) {
+        ids[i] = dd_xoshiro_next(state);
+    }
+    memcpy(dd_xoshiro_state, state, sizeof(state));
+}
+
+uint64_t ddtrace_generate_random(void) {
+    uint64_t random;
+    ddtrace_generate_random_batch(&random, 1);
+    return random;
+}
+
+// 0-9 and a-f map to their value plus one, everything else to 0; propagated ids are parsed on every request
+static const uint8_t dd_hex_digits[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
 uint64_t ddtrace_parse_userland_span_id(zval *zid) {
     if (!zid || Z_TYPE_P(zid) != IS_STRING) {
         return 0U;
     }
-    const char *id = Z_STRVAL_P(zid);
+    const unsigned char *id = (const unsigned char *)Z_STRVAL_P(zid);
+    uint64_t uid = 0;
     for (size_t i = 0; i < Z_STRLEN_P(zid); i++) {
-        if (id[i] < '0' || id[i] > '9') {
+        uint8_t digit = dd_hex_digits[id[i]] - 1;
+        if (digit > 9) {  // wraps around for invalid characters
             return 0U;
         }
+        if (uid > (UINT64_MAX - digit) / 10) {
+            return 0U;  // out of range
+        }
+        uid = uid * 10 + digit;
     }
-    errno = 0;
-    uint64_t uid = (uint64_t)strtoull(id, NULL, 10);
-    return (uid && errno == 0) ? uid : 0U;
+    return uid;
 }
 
 ddtrace_trace_id ddtrace_parse_userland_trace_id(zend_string *tid) {
@@ -68,24 +161,23 @@ ddtrace_trace_id ddtrace_parse_userland_trace_id(zend_string *tid) {
 }
 
 uint64_t ddtrace_parse_hex_span_id_str(const char *id, size_t len) {
-    if (len == 0) {
-        return 0U;
-    }
+    const unsigned char *digits = (const unsigned char *)id;
+    bool invalid = false;
 
-    for (size_t i = 0; i < len; i++) {
-        if ((id[i] < '0' || id[i] > '9') && (id[i] < 'a' || id[i] > 'f')) {
-            return 0U;
-        }
+    // only the last 16 digits are significant, but all of them must be valid
+    size_t skip = len > 16 ? len - 16 : 0;
+    for (size_t i = 0; i < skip; i++) {
+        invalid |= !dd_hex_digits[digits[i]];
     }
 
-    char buf[17];
-    size_t num_len = MIN(len, 16);
-    memcpy(buf, id + MAX(0, (ssize_t)len - 16), num_len);
-    buf[num_len] = 0;
+    uint64_t uid = 0;
+    for (size_t i = skip; i < len; i++) {
+        uint8_t digit = dd_hex_digits[digits[i]];
+        invalid |= !digit;
+        uid = (uid << 4) | (uint8_t)(digit - 1);
+    }
 
-    errno = 0;
-    uint64_t uid = (uint64_t)strtoull(buf, NULL, 16);
-    return (uid && errno == 0) ? uid : 0U;
+    return invalid ? 0U : uid;
 }
 
 uint64_t ddtrace_parse_hex_span_id(zval *zid) {
@@ -95,7 +187,24 @@ uint64_t ddtrace_parse_hex_span_id(zval *zid) {
     return ddtrace_parse_hex_span_id_str(Z_STRVAL_P(zid), Z_STRLEN_P(zid));
 }
 
-uint64_t ddtrace_generate_span_id(void) { return (uint64_t)genrand64_int64(); }
+uint64_t ddtrace_generate_span_id(void) {
+    if (!dd_span_id_batch_left) {
+        if (dd_prng_deterministic) {
+            return ddtrace_generate_random();  // keep the mt19937-64 sequence shared with sampling decisions
+        }
+        ddtrace_generate_random_batch(dd_span_id_batch, DD_SPAN_ID_BATCH_SIZE);
+        dd_span_id_batch_left = DD_SPAN_ID_BATCH_SIZE;
+    }
+    return dd_span_id_batch[--dd_span_id_batch_left];
+}
+
+ddtrace_trace_id ddtrace_generate_trace_id(uint64_t root_span_id, uint64_t start_ns) {
+    // 128-bit trace ids carry the start time in seconds in the upper 32 bits, followed by 32 zero bits
+    return (ddtrace_trace_id){
+        .low = root_span_id,
+        .time = get_DD_TRACE_128_BIT_TRACEID_GENERATION_ENABLED() ? start_ns / UINT64_C(1000000000) : 0,
+    };
+}
 
 uint64_t ddtrace_peek_span_id(void) {
     ddtrace_span_data *span = DDTRACE_G(active_stack) ? DDTRACE_G(active_stack)->active : NULL;
@@ -12,7 +12,10 @@
 
 void ddtrace_seed_prng(void);
 bool ddtrace_reseed_seed_change(zval *old_value, zval *new_value);
+uint64_t ddtrace_generate_random(void);
+void ddtrace_generate_random_batch(uint64_t *ids, size_t count);
 uint64_t ddtrace_generate_span_id(void);
+ddtrace_trace_id ddtrace_generate_trace_id(uint64_t root_span_id, uint64_t start_ns);
 uint64_t ddtrace_peek_span_id(void);
 ddtrace_trace_id ddtrace_peek_trace_id(void);
 uint64_t ddtrace_parse_userland_span_id(zval *zid);
@@ -26,10 +26,13 @@
 #include "engine_api.h"
 #include "engine_hooks.h"
 #include "ip_extraction.h"
+#include "limiter/limiter.h"
 #include "logging.h"
 #include "mpack/mpack.h"
 #include "priority_sampling/priority_sampling.h"
+#include "query_string_obfuscation.h"
 #include "span.h"
+#include "sql_obfuscation.h"
 #include "uri_normalization.h"
 
 ZEND_EXTERN_MODULE_GLOBALS(ddtrace);
@@ -476,7 +479,7 @@ static void dd_add_post_fields_to_meta_recursive(zend_array *meta, const char *t
                 zend_string_release(postvalstr);
 
                 // Match it with the regex to redact if needed
-                if (zai_match_regex(get_DD_TRACE_OBFUSCATION_QUERY_STRING_REGEXP(), postvalconcat)) {
+                if (ddtrace_query_string_is_sensitive(postvalconcat)) {
                     zend_string *replacement = zend_string_init(ZEND_STRL("<redacted>"), 0);
                     dd_add_post_fields_to_meta(meta, type, postkey, replacement);
                     zend_string_release(replacement);
@@ -580,9 +583,9 @@ static zend_string *dd_build_req_url() {
     zend_string *query_string = ZSTR_EMPTY_ALLOC();
     if (question_mark) {
         uri_len = question_mark - uri;
-        query_string = zai_filter_query_string(
+        query_string = ddtrace_filter_query_string(
             (zai_string_view){.len = strlen(uri) - uri_len - 1, .ptr = question_mark + 1},
-            get_DD_TRACE_HTTP_URL_QUERY_PARAM_ALLOWED(), get_DD_TRACE_OBFUSCATION_QUERY_STRING_REGEXP());
+            get_DD_TRACE_HTTP_URL_QUERY_PARAM_ALLOWED());
     } else {
         uri_len = strlen(uri);
     }
@@ -664,9 +667,8 @@ void ddtrace_set_root_span_properties(ddtrace_span_data *span) {
                 const char *query_str = dd_get_query_string();
                 if (query_str) {
                     query_string =
-                        zai_filter_query_string((zai_string_view){.len = strlen(query_str), .ptr = query_str},
-                                                get_DD_TRACE_RESOURCE_URI_QUERY_PARAM_ALLOWED(),
-                                                get_DD_TRACE_OBFUSCATION_QUERY_STRING_REGEXP());
+                        ddtrace_filter_query_string((zai_string_view){.len = strlen(query_str), .ptr = query_str},
+                                                    get_DD_TRACE_RESOURCE_URI_QUERY_PARAM_ALLOWED());
                 }
 
                 ZVAL_STR(prop_resource, zend_strpprintf(0, "%s %s%s%.*s", method, ZSTR_VAL(normalized),
@@ -999,36 +1001,6 @@ static bool dd_rule_matches(zval *pattern, zend_string* value) {
     return true;
 }
 
-static HashTable dd_span_sampling_limiters;
-#if ZTS
-static pthread_rwlock_t dd_span_sampling_limiter_lock;
-#endif
-
-struct dd_sampling_bucket {
-    _Atomic int64_t hit_count;
-    _Atomic uint64_t last_update;
-};
-
-void ddtrace_clear_span_sampling_limiter(zval *zv) {
-    free(Z_PTR_P(zv));
-}
-
-void ddtrace_initialize_span_sampling_limiter(void) {
-#if ZTS
-    pthread_rwlock_init(&dd_span_sampling_limiter_lock, NULL);
-#endif
-
-    zend_hash_init(&dd_span_sampling_limiters, 8, obsolete, ddtrace_clear_span_sampling_limiter, 1);
-}
-
-void ddtrace_shutdown_span_sampling_limiter(void) {
-#if ZTS
-    pthread_rwlock_destroy(&dd_span_sampling_limiter_lock);
-#endif
-
-    zend_hash_destroy(&dd_span_sampling_limiters);
-}
-
 void ddtrace_serialize_span_to_array(ddtrace_span_data *span, zval *array) {
     bool top_level_span = span->parent_id == DDTRACE_G(distributed_parent_trace_id);
     zval *el;
@@ -1074,6 +1046,20 @@ void ddtrace_serialize_span_to_array(ddtrace_span_data *span, zval *array) {
         ZVAL_COPY(&prop_resource_as_string, prop_name);
     }
 
+    // SQL statements are sent obfuscated, sparing the agent from doing it and keeping literals out of payloads
+    if (Z_TYPE(prop_resource_as_string) == IS_STRING && get_DD_TRACE_SQL_OBFUSCATION_ENABLED()) {
+        zval *sql_type = ddtrace_spandata_property_type(span);
+        ZVAL_DEREF(sql_type);
+        if (Z_TYPE_P(sql_type) == IS_STRING && zend_string_equals_literal(Z_STR_P(sql_type), "sql")) {
+            zval *db_system = zend_hash_str_find(ddtrace_spandata_property_meta(span), ZEND_STRL("db.system"));
+            bool backslash_escapes = db_system && Z_TYPE_P(db_system) == IS_STRING
+                && (zend_string_equals_literal(Z_STR_P(db_system), "mysql") || zend_string_equals_literal(Z_STR_P(db_system), "mariadb"));
+            zend_string *obfuscated = ddtrace_sql_obfuscate(Z_STR(prop_resource_as_string), backslash_escapes);
+            zval_ptr_dtor(&prop_resource_as_string);
+            ZVAL_STR(&prop_resource_as_string, obfuscated);
+        }
+    }
+
     if (Z_TYPE(prop_resource_as_string) == IS_STRING) {
         _add_assoc_zval_copy(el, "resource", &prop_resource_as_string);
     }
@@ -1169,64 +1155,21 @@ void ddtrace_serialize_span_to_array(ddtrace_span_data *span, zval *array) {
             if ((max_per_second_zv = zend_hash_str_find(Z_ARR_P(rule), ZEND_STRL("max_per_second")))) {
                 max_per_second = zval_get_double(max_per_second_zv);
                 size_t service_pattern_len = rule_service ? Z_STRLEN_P(rule_service) : 0;
-                zend_string *rule_key = zend_string_alloc(service_pattern_len + (rule_name ? Z_STRLEN_P(rule_name) + (service_pattern_len != 0) : 0), 1);
+                zend_string *rule_key = zend_string_alloc(service_pattern_len + (rule_name ? Z_STRLEN_P(rule_name) + (service_pattern_len != 0) : 0), 0);
                 if (rule_service) {
                     memcpy(ZSTR_VAL(rule_key), Z_STRVAL_P(rule_service), Z_STRLEN_P(rule_service));
                 }
                 if (rule_name) {
+                    size_t name_offset = service_pattern_len + (service_pattern_len != 0);
                     ZSTR_VAL(rule_key)[service_pattern_len] = 0;
-                    memcpy(ZSTR_VAL(rule_key) + service_pattern_len + 1, Z_STRVAL_P(rule_name), Z_STRLEN_P(rule_name));
+                    memcpy(ZSTR_VAL(rule_key) + name_offset, Z_STRVAL_P(rule_name), Z_STRLEN_P(rule_name));
                 }
                 ZSTR_VAL(rule_key)[ZSTR_LEN(rule_key)] = 0;
 
-#if ZTS
-                pthread_rwlock_rdlock(&dd_span_sampling_limiter_lock);
-#endif
-                struct dd_sampling_bucket *sampling_bucket = zend_hash_find_ptr(&dd_span_sampling_limiters, rule_key);
-#if ZTS
-                pthread_rwlock_unlock(&dd_span_sampling_limiter_lock);
-#endif
-
-                struct timespec timespec;
-                clock_gettime(CLOCK_MONOTONIC, &timespec);
-                uint64_t timeval = timespec.tv_sec * 1000000000 + timespec.tv_nsec;
-
-                if (!sampling_bucket) {
-                    struct dd_sampling_bucket *new_sampling_bucket = malloc(sizeof(*new_sampling_bucket));
-                    new_sampling_bucket->hit_count = 1;
-                    new_sampling_bucket->last_update = timeval;
-
-#if ZTS
-                    pthread_rwlock_wrlock(&dd_span_sampling_limiter_lock);
-#endif
-                    if (!zend_hash_add_ptr(&dd_span_sampling_limiters, rule_key, new_sampling_bucket)) {
-                        free(new_sampling_bucket);
-                        sampling_bucket = zend_hash_find_ptr(&dd_span_sampling_limiters, rule_key);
-                    }
-#if ZTS
-                    pthread_rwlock_unlock(&dd_span_sampling_limiter_lock);
-#endif
-                }
-
+                bool allowed = ddtrace_limiter_rule_allow(rule_key, max_per_second);
                 zend_string_release(rule_key);
-
-                if (sampling_bucket) {
-                    const int nanosecond = 1000000000;
-
-                    // restore allowed time basis
-                    uint64_t old_time = atomic_exchange(&sampling_bucket->last_update, timeval);
-                    int64_t clear_counter = (int64_t)((long double)(timeval - old_time) * max_per_second);
-
-                    int64_t previous_hits = atomic_fetch_sub(&sampling_bucket->hit_count, clear_counter);
-                    if (previous_hits < clear_counter) {
-                        atomic_fetch_add(&sampling_bucket->hit_count, previous_hits > 0 ? clear_counter - previous_hits : clear_counter);
-                    }
-
-                    previous_hits = atomic_fetch_add(&sampling_bucket->hit_count, nanosecond);
-                    if ((long double)previous_hits / nanosecond >= max_per_second) {
-                        atomic_fetch_sub(&sampling_bucket->hit_count, nanosecond);
-                        break; // limit exceeded
-                    }
+                if (!allowed) {
+                    break; // limit exceeded
                 }
             }
 
@@ -9,6 +9,7 @@
 #include "compat_string.h"
 #include "configuration.h"
 #include "ddtrace.h"
+#include "integrations/overhead.h"
 #include "logging.h"
 #include "random.h"
 #include "serializer.h"
@@ -165,10 +166,7 @@ void ddtrace_open_span(ddtrace_span_data *span) {
         // custom new traces
         span->parent_id = 0;
 set_trace_id_from_span_id:
-        span->trace_id = (ddtrace_trace_id){
-            .low = span->span_id,
-            .time = get_DD_TRACE_128_BIT_TRACEID_GENERATION_ENABLED() ? span->start / UINT64_C(1000000000) : 0,
-        };
+        span->trace_id = ddtrace_generate_trace_id(span->span_id, span->start);
     }
 
     ddtrace_span_data *parent_span = DDTRACE_G(active_stack)->active;
@@ -185,6 +183,12 @@ set_trace_id_from_span_id:
         span->parent = NULL;
 
         ddtrace_set_root_span_properties(span);
+
+        // An inherited decision is final: decide right away so that hooks may switch to lightweight tracing
+        if (get_DD_TRACE_LIGHTWEIGHT_REJECTED_TRACES() && DDTRACE_G(default_priority_sampling) != DDTRACE_PRIORITY_SAMPLING_UNKNOWN
+         && DDTRACE_G(default_priority_sampling) != DDTRACE_PRIORITY_SAMPLING_UNSET) {
+            ddtrace_fetch_prioritySampling_from_span(span);
+        }
     } else {
         // do not copy the parent, it was active span before, just transfer that reference
         ZVAL_OBJ(&span->property_parent, &parent_span->std);
@@ -492,6 +496,34 @@ static void dd_mark_closed_spans_flushable(ddtrace_span_stack *stack) {
     }
 }
 
+uint64_t ddtrace_monotonic_nanoseconds(void) { return _get_nanoseconds(USE_MONOTONIC_CLOCK); }
+
+uint64_t ddtrace_lightweight_skip_span(void) {
+    ++DDTRACE_G(lightweight_skipped_spans);
+    return _get_nanoseconds(USE_MONOTONIC_CLOCK);
+}
+
+void ddtrace_lightweight_skipped_span_end(uint64_t start) {
+    DDTRACE_G(lightweight_skipped_duration) += _get_nanoseconds(USE_MONOTONIC_CLOCK) - start;
+}
+
+// Spans skipped in lightweight mode are still accounted for on the root span, for stats computation.
+// The counters cover the whole request so far, they are only reset at request start.
+// Hooks which zai_hook_continue did not even run (#[Trace]) are counted, but not timed.
+static void dd_flush_lightweight_counters(ddtrace_span_data *root_span) {
+    if (DDTRACE_G(lightweight_skipped_spans) || zai_hook_lightweight_skipped) {
+        zend_array *metrics = ddtrace_spandata_property_metrics(root_span);
+        zval zv;
+        ZVAL_DOUBLE(&zv, (double)(DDTRACE_G(lightweight_skipped_spans) + zai_hook_lightweight_skipped));
+        zend_hash_str_update(metrics, ZEND_STRL("_dd.lightweight.skipped_spans"), &zv);
+        ZVAL_DOUBLE(&zv, (double)DDTRACE_G(lightweight_skipped_duration));
+        zend_hash_str_update(metrics, ZEND_STRL("_dd.lightweight.skipped_duration"), &zv);
+    }
+
+    // the sampling decision is per trace though
+    zai_hook_lightweight = false;
+}
+
 // closing a chunks last span:
 // check if any parent has open spans
 // if not, autoflush / add to closed stacks chain
@@ -509,6 +541,10 @@ static void dd_close_entry_span_of_stack(ddtrace_span_stack *stack) {
 
             // Enforce a sampling decision here
             ddtrace_fetch_prioritySampling_from_span(root_span);
+            ddtrace_apply_sampling_keep_rules(root_span);
+
+            dd_flush_lightweight_counters(root_span);
+            ddtrace_integration_overhead_flush(root_span);
         }
         if (stack == stack->root_stack && DDTRACE_G(active_stack) == stack) {
             // We are always active stack except if ddtrace_close_top_span_without_stack_swap is used
@@ -116,6 +116,11 @@ void ddtrace_clear_execute_data_span(zend_ulong invocation, bool keep);
 DDTRACE_PUBLIC bool ddtrace_root_span_add_tag(zend_string *tag, zval *value);
 
 void dd_trace_stop_span_time(ddtrace_span_data *span);
+uint64_t ddtrace_monotonic_nanoseconds(void);
+
+// Account for a hook which did not create its span because the trace is rejected; returns the start timestamp
+uint64_t ddtrace_lightweight_skip_span(void);
+void ddtrace_lightweight_skipped_span_end(uint64_t start);
 bool ddtrace_has_top_internal_span(ddtrace_span_data *end);
 void ddtrace_close_stack_userland_spans_until(ddtrace_span_data *until);
 int ddtrace_close_userland_spans_until(ddtrace_span_data *until);
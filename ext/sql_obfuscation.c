@@ -0,0 +1,311 @@
+#include "sql_obfuscation.h"
+
+#include <php.h>
+#include <stdbool.h>
+
+#include "configuration.h"
+
+// Statements longer than this are still obfuscated, but not memoized
+#define DD_SQL_CACHE_MAX_QUERY_LEN 8192
+
+typedef struct dd_sql_cache_entry {
+    struct dd_sql_cache_entry *prev, *next;
+    zend_string *query;
+    zend_string *obfuscated;
+    bool backslash_escapes;
+} dd_sql_cache_entry;
+
+// Persistent per-worker state, it is kept across requests
+ZEND_TLS HashTable dd_sql_cache;
+ZEND_TLS bool dd_sql_cache_initialized = false;
+ZEND_TLS dd_sql_cache_entry *dd_sql_cache_head = NULL, *dd_sql_cache_tail = NULL;
+
+typedef enum {
+    DD_SQL_TOKEN_OTHER,
+    DD_SQL_TOKEN_VALUE,
+    DD_SQL_TOKEN_COMMA,
+    DD_SQL_TOKEN_OPEN,
+} dd_sql_token;
+
+typedef enum {
+    DD_SQL_LIST_NONE,
+    DD_SQL_LIST_OPEN,
+    DD_SQL_LIST_VALUE,
+    DD_SQL_LIST_COMMA,  // a comma following a value inside a list was deferred
+} dd_sql_list_state;
+
+typedef struct {
+    char *out;
+    size_t len;
+    bool pending_space;
+    dd_sql_list_state list;
+} dd_sql_writer;
+
+static inline bool dd_sql_is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v'; }
+
+static inline bool dd_sql_is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static inline bool dd_sql_is_ident_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || dd_sql_is_digit(c) || c == '_' || c == '$' || (unsigned char)c >= 0x80;
+}
+
+static void dd_sql_write(dd_sql_writer *w, const char *str, size_t len, dd_sql_token token) {
+    // Collapse lists of literals: (?, ?, ?) becomes (?)
+    if (w->list == DD_SQL_LIST_COMMA) {
+        if (token == DD_SQL_TOKEN_VALUE) {
+            w->list = DD_SQL_LIST_VALUE;
+            w->pending_space = false;
+            return;
+        }
+        w->out[w->len++] = ',';
+    } else if (w->list == DD_SQL_LIST_VALUE && token == DD_SQL_TOKEN_COMMA) {
+        w->list = DD_SQL_LIST_COMMA;
+        w->pending_space = false;
+        return;
+    }
+
+    if (w->pending_space && w->len > 0) {
+        w->out[w->len++] = ' ';
+    }
+    w->pending_space = false;
+
+    memcpy(w->out + w->len, str, len);
+    w->len += len;
+
+    if (token == DD_SQL_TOKEN_OPEN) {
+        w->list = DD_SQL_LIST_OPEN;
+    } else if (token == DD_SQL_TOKEN_VALUE && (w->list == DD_SQL_LIST_OPEN || w->list == DD_SQL_LIST_VALUE)) {
+        w->list = DD_SQL_LIST_VALUE;
+    } else {
+        w->list = DD_SQL_LIST_NONE;
+    }
+}
+
+static inline void dd_sql_write_literal(dd_sql_writer *w) { dd_sql_write(w, "?", 1, DD_SQL_TOKEN_VALUE); }
+
+// String literal prefixes like N'...', E'...', X'...' and B'...' are part of the literal
+static inline bool dd_sql_is_string_prefix(const char *str, size_t len) {
+    char c = str[0] | 0x20;
+    return len >= 2 && str[1] == '\'' && (c == 'n' || c == 'e' || c == 'x' || c == 'b');
+}
+
+// Returns the position of the closing tag of a PostgreSQL dollar-quoted string, or 0 if str does not start one
+static size_t dd_sql_dollar_quote_len(const char *str, size_t len) {
+    size_t tag_len = 1;
+    while (tag_len < len && str[tag_len] != '$') {
+        char c = str[tag_len];
+        if (!dd_sql_is_ident_char(c) || (tag_len == 1 && dd_sql_is_digit(c))) {
+            return 0;  // $1 placeholders and similar
+        }
+        ++tag_len;
+    }
+    if (tag_len >= len) {
+        return 0;
+    }
+    ++tag_len;
+
+    for (size_t i = tag_len; i + tag_len <= len; ++i) {
+        if (str[i] == '$' && memcmp(str + i, str, tag_len) == 0) {
+            return i + tag_len;
+        }
+    }
+    return len;
+}
+
+zend_string *ddtrace_sql_obfuscate_uncached(const char *query, size_t len, bool backslash_escapes) {
+    // The output is never longer than the input
+    zend_string *result = zend_string_alloc(len, 0);
+    dd_sql_writer w = {.out = ZSTR_VAL(result), .len = 0, .pending_space = false, .list = DD_SQL_LIST_NONE};
+
+    size_t i = 0;
+    while (i < len) {
+        char c = query[i];
+        if (dd_sql_is_space(c)) {
+            w.pending_space = true;
+            ++i;
+        } else if (c == '-' && i + 1 < len && query[i + 1] == '-') {
+            while (i < len && query[i] != '\n') {
+                ++i;
+            }
+            w.pending_space = true;
+        } else if (c == '/' && i + 1 < len && query[i + 1] == '*') {
+            i += 2;
+            while (i < len && !(query[i] == '*' && i + 1 < len && query[i + 1] == '/')) {
+                ++i;
+            }
+            i = MIN(i + 2, len);
+            w.pending_space = true;
+        } else if (c == '\'' || dd_sql_is_string_prefix(query + i, len - i)) {
+            // standard SQL strings have no escapes: 'C:\' is complete, e.g. in PostgreSQL with standard_conforming_strings
+            bool escapes = backslash_escapes || (c | 0x20) == 'e';
+            i += c == '\'' ? 1 : 2;
+            while (i < len) {
+                if (escapes && query[i] == '\\') {
+                    i += 2;
+                } else if (query[i] == '\'') {
+                    if (i + 1 < len && query[i + 1] == '\'') {
+                        i += 2;
+                    } else {
+                        ++i;
+                        break;
+                    }
+                } else {
+                    ++i;
+                }
+            }
+            i = MIN(i, len);
+            dd_sql_write_literal(&w);
+        } else if (c == '"' || c == '`') {
+            // Quoted identifiers are kept verbatim
+            size_t start = i++;
+            while (i < len) {
+                if (query[i] == c) {
+                    if (i + 1 < len && query[i + 1] == c) {
+                        i += 2;
+                        continue;
+                    }
+                    ++i;
+                    break;
+                }
+                ++i;
+            }
+            dd_sql_write(&w, query + start, i - start, DD_SQL_TOKEN_OTHER);
+        } else if (c == '$' && dd_sql_dollar_quote_len(query + i, len - i)) {
+            i += dd_sql_dollar_quote_len(query + i, len - i);
+            dd_sql_write_literal(&w);
+        } else if (dd_sql_is_digit(c) || (c == '.' && i + 1 < len && dd_sql_is_digit(query[i + 1]))) {
+            ++i;
+            while (i < len) {
+                char n = query[i];
+                if (dd_sql_is_ident_char(n) || n == '.') {
+                    ++i;
+                } else if ((n == '+' || n == '-') && (query[i - 1] | 0x20) == 'e') {
+                    ++i;
+                } else {
+                    break;
+                }
+            }
+            dd_sql_write_literal(&w);
+        } else if (dd_sql_is_ident_char(c)) {
+            size_t start = i++;
+            while (i < len && dd_sql_is_ident_char(query[i])) {
+                ++i;
+            }
+            dd_sql_write(&w, query + start, i - start, DD_SQL_TOKEN_OTHER);
+        } else {
+            dd_sql_token token = DD_SQL_TOKEN_OTHER;
+            if (c == ',') {
+                token = DD_SQL_TOKEN_COMMA;
+            } else if (c == '(') {
+                token = DD_SQL_TOKEN_OPEN;
+            } else if (c == '?') {
+                token = DD_SQL_TOKEN_VALUE;
+            }
+            dd_sql_write(&w, query + i, 1, token);
+            ++i;
+        }
+    }
+
+    if (w.list == DD_SQL_LIST_COMMA) {
+        w.out[w.len++] = ',';
+    }
+
+    w.out[w.len] = '\0';
+    ZSTR_LEN(result) = w.len;
+    return result;
+}
+
+static void dd_sql_cache_unlink(dd_sql_cache_entry *entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        dd_sql_cache_head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        dd_sql_cache_tail = entry->prev;
+    }
+}
+
+static void dd_sql_cache_push_front(dd_sql_cache_entry *entry) {
+    entry->prev = NULL;
+    entry->next = dd_sql_cache_head;
+    if (dd_sql_cache_head) {
+        dd_sql_cache_head->prev = entry;
+    } else {
+        dd_sql_cache_tail = entry;
+    }
+    dd_sql_cache_head = entry;
+}
+
+static void dd_sql_cache_free(dd_sql_cache_entry *entry) {
+    zend_string_release(entry->query);
+    zend_string_release(entry->obfuscated);
+    pefree(entry, 1);
+}
+
+static void dd_sql_cache_evict(dd_sql_cache_entry *entry) {
+    dd_sql_cache_unlink(entry);
+    zend_hash_index_del(&dd_sql_cache, ZSTR_H(entry->query));
+    dd_sql_cache_free(entry);
+}
+
+zend_string *ddtrace_sql_obfuscate(zend_string *query, bool backslash_escapes) {
+    zend_long max_entries = get_DD_TRACE_SQL_OBFUSCATION_CACHE_SIZE();
+    if (max_entries <= 0 || ZSTR_LEN(query) > DD_SQL_CACHE_MAX_QUERY_LEN) {
+        return ddtrace_sql_obfuscate_uncached(ZSTR_VAL(query), ZSTR_LEN(query), backslash_escapes);
+    }
+
+    if (!dd_sql_cache_initialized) {
+        zend_hash_init(&dd_sql_cache, 64, NULL, NULL, 1);
+        dd_sql_cache_initialized = true;
+    }
+
+    zend_ulong hash = zend_string_hash_val(query);
+    dd_sql_cache_entry *entry = zend_hash_index_find_ptr(&dd_sql_cache, hash);
+    if (entry) {
+        if (entry->backslash_escapes == backslash_escapes && zend_string_equals(entry->query, query)) {
+            if (entry != dd_sql_cache_head) {
+                dd_sql_cache_unlink(entry);
+                dd_sql_cache_push_front(entry);
+            }
+            return zend_string_init(ZSTR_VAL(entry->obfuscated), ZSTR_LEN(entry->obfuscated), 0);
+        }
+        // hash collision or another dialect: the most recent statement wins
+        dd_sql_cache_evict(entry);
+    }
+
+    zend_string *obfuscated = ddtrace_sql_obfuscate_uncached(ZSTR_VAL(query), ZSTR_LEN(query), backslash_escapes);
+
+    while (dd_sql_cache_tail && zend_hash_num_elements(&dd_sql_cache) >= (zend_ulong)max_entries) {
+        dd_sql_cache_evict(dd_sql_cache_tail);
+    }
+
+    entry = pemalloc(sizeof(*entry), 1);
+    entry->query = zend_string_init(ZSTR_VAL(query), ZSTR_LEN(query), 1);
+    ZSTR_H(entry->query) = hash;
+    entry->obfuscated = zend_string_init(ZSTR_VAL(obfuscated), ZSTR_LEN(obfuscated), 1);
+    entry->backslash_escapes = backslash_escapes;
+    zend_hash_index_add_new_ptr(&dd_sql_cache, hash, entry);
+    dd_sql_cache_push_front(entry);
+
+    return obfuscated;
+}
+
+void ddtrace_sql_obfuscation_gshutdown(void) {
+    if (!dd_sql_cache_initialized) {
+        return;
+    }
+
+    dd_sql_cache_entry *entry = dd_sql_cache_head;
+    while (entry) {
+        dd_sql_cache_entry *next = entry->next;
+        dd_sql_cache_free(entry);
+        entry = next;
+    }
+    dd_sql_cache_head = dd_sql_cache_tail = NULL;
+
+    zend_hash_destroy(&dd_sql_cache);
+    dd_sql_cache_initialized = false;
+}
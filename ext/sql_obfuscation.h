@@ -0,0 +1,15 @@
+#ifndef DD_SQL_OBFUSCATION_H
+#define DD_SQL_OBFUSCATION_H
+
+#include <php.h>
+
+/* Replaces string and numeric literals of a SQL statement by '?', strips comments, collapses whitespace and
+ * literal lists like IN (?, ?, ?) to a single placeholder.
+ * Backslashes only escape within E'...' strings, or within all strings if backslash_escapes is set (MySQL).
+ * Results are memoized in a bounded per-worker LRU cache, so repeated statements are only lexed once. */
+zend_string *ddtrace_sql_obfuscate(zend_string *query, bool backslash_escapes);
+zend_string *ddtrace_sql_obfuscate_uncached(const char *query, size_t len, bool backslash_escapes);
+
+void ddtrace_sql_obfuscation_gshutdown(void);
+
+#endif  // DD_SQL_OBFUSCATION_H
@@ -0,0 +1,80 @@
+#include "uri_normalization.h"
+
+#include "dynamic_config.h"
+
+/*
+ Fragment regexes and mappings are compiled once per configuration generation, i.e. per pair of
+ DD_TRACE_RESOURCE_URI_FRAGMENT_REGEX and DD_TRACE_RESOURCE_URI_MAPPING_* arrays, into a normalizer which also
+ remembers the most recently normalized paths of the worker. Like sampling rules, the normalizer outlives requests as
+ long as it was compiled from the persistent (i.e. not ini_set()) configuration, and holds on to arrays from ini_set()
+ until it is recompiled or the request ends.
+*/
+#define DD_URI_NORMALIZATION_CACHE_MAX_ENTRIES 256
+
+typedef struct {
+    zend_array *fragment_regex;
+    zend_array *mapping;
+    uint32_t config_generation;
+    zai_uri_normalizer *normalizer;
+} dd_uri_normalizer;
+
+ZEND_TLS dd_uri_normalizer dd_incoming_uri_normalizer;
+ZEND_TLS dd_uri_normalizer dd_outgoing_uri_normalizer;
+
+static void dd_uri_normalizer_free(dd_uri_normalizer *normalizer) {
+    if (normalizer->normalizer) {
+        zai_uri_normalizer_free(normalizer->normalizer);
+    }
+    if (normalizer->fragment_regex) {
+        zai_config_array_cache_release(normalizer->fragment_regex);
+        zai_config_array_cache_release(normalizer->mapping);
+    }
+    normalizer->fragment_regex = NULL;
+    normalizer->mapping = NULL;
+    normalizer->normalizer = NULL;
+}
+
+static bool dd_uri_normalizer_is_persistent(dd_uri_normalizer *normalizer) {
+    return zai_config_array_is_persistent(normalizer->fragment_regex) && zai_config_array_is_persistent(normalizer->mapping);
+}
+
+static zend_string *dd_uri_normalize_path(dd_uri_normalizer *normalizer, zai_config_id mapping_id, zend_string *path) {
+    zend_array *fragment_regex = get_DD_TRACE_RESOURCE_URI_FRAGMENT_REGEX();
+    zend_array *mapping = Z_ARR_P(zai_config_get_value(mapping_id));
+    if (!normalizer->normalizer || fragment_regex != normalizer->fragment_regex || mapping != normalizer->mapping
+        || ddtrace_dynamic_config_generation() != normalizer->config_generation) {
+        dd_uri_normalizer_free(normalizer);
+        zai_config_array_cache_addref(fragment_regex);
+        zai_config_array_cache_addref(mapping);
+        normalizer->fragment_regex = fragment_regex;
+        normalizer->mapping = mapping;
+        normalizer->config_generation = ddtrace_dynamic_config_generation();
+        normalizer->normalizer = zai_uri_normalizer_compile(fragment_regex, mapping, DD_URI_NORMALIZATION_CACHE_MAX_ENTRIES,
+                                                            dd_uri_normalizer_is_persistent(normalizer));
+    }
+
+    return zai_uri_normalizer_apply(normalizer->normalizer, path);
+}
+
+zend_string *ddtrace_uri_normalize_incoming_path(zend_string *path) {
+    return dd_uri_normalize_path(&dd_incoming_uri_normalizer, DDTRACE_CONFIG_DD_TRACE_RESOURCE_URI_MAPPING_INCOMING, path);
+}
+
+zend_string *ddtrace_uri_normalize_outgoing_path(zend_string *path) {
+    return dd_uri_normalize_path(&dd_outgoing_uri_normalizer, DDTRACE_CONFIG_DD_TRACE_RESOURCE_URI_MAPPING_OUTGOING, path);
+}
+
+void ddtrace_uri_normalization_rshutdown(void) {
+    // normalizers compiled from ini_set() values are allocated per request, along with their references to these
+    if (dd_incoming_uri_normalizer.fragment_regex && !dd_uri_normalizer_is_persistent(&dd_incoming_uri_normalizer)) {
+        dd_uri_normalizer_free(&dd_incoming_uri_normalizer);
+    }
+    if (dd_outgoing_uri_normalizer.fragment_regex && !dd_uri_normalizer_is_persistent(&dd_outgoing_uri_normalizer)) {
+        dd_uri_normalizer_free(&dd_outgoing_uri_normalizer);
+    }
+}
+
+void ddtrace_uri_normalization_mshutdown(void) {
+    dd_uri_normalizer_free(&dd_incoming_uri_normalizer);
+    dd_uri_normalizer_free(&dd_outgoing_uri_normalizer);
+}
@@ -5,13 +5,10 @@
 
 #include "configuration.h"
 
-static inline zend_string *ddtrace_uri_normalize_incoming_path(zend_string *path) {
-    return zai_uri_normalize_path(path, get_DD_TRACE_RESOURCE_URI_FRAGMENT_REGEX(),
-                                  get_DD_TRACE_RESOURCE_URI_MAPPING_INCOMING());
-}
-static inline zend_string *ddtrace_uri_normalize_outgoing_path(zend_string *path) {
-    return zai_uri_normalize_path(path, get_DD_TRACE_RESOURCE_URI_FRAGMENT_REGEX(),
-                                  get_DD_TRACE_RESOURCE_URI_MAPPING_OUTGOING());
-}
+zend_string *ddtrace_uri_normalize_incoming_path(zend_string *path);
+zend_string *ddtrace_uri_normalize_outgoing_path(zend_string *path);
+
+void ddtrace_uri_normalization_rshutdown(void);
+void ddtrace_uri_normalization_mshutdown(void);
 
 #endif  // DD_TRACE_URI_NORMALIZATION_H
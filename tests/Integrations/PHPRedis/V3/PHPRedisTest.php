@@ -1482,6 +1482,20 @@ class PHPRedisTest extends IntegrationTestCase
 
         $this->assertSame([true, 'v1'], $return);
 
+        if (\PHP_VERSION_ID >= 80000) {
+            // traced natively: a single span covering the whole transaction
+            $this->assertFlameGraph($traces, [
+                SpanAssertion::build(
+                    "Redis.exec",
+                    'phpredis',
+                    'redis',
+                    "Redis.exec"
+                )->withExactTags($this->baseTags('exec'))
+                ->withExactMetrics(['redis.pipeline_length' => 2]),
+            ]);
+            return;
+        }
+
         $this->assertFlameGraph($traces, [
             SpanAssertion::build(
                 "Redis.multi",
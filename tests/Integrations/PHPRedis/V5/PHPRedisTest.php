@@ -1645,6 +1645,21 @@ class PHPRedisTest extends IntegrationTestCase
 
         $this->assertSame([true, 'v1'], $return);
 
+        if (\PHP_VERSION_ID >= 80000) {
+            // traced natively: a single span covering the whole transaction
+            $this->assertFlameGraph($traces, [
+                SpanAssertion::build(
+                    "Redis.exec",
+                    'phpredis',
+                    'redis',
+                    "Redis.exec"
+                )->withExactTags(['redis.raw_command' => 'exec', Tag::SPAN_KIND => 'client',
+                    Tag::COMPONENT => 'phpredis', Tag::DB_SYSTEM => 'redis', Tag::TARGET_HOST => $this->host])
+                ->withExactMetrics(['redis.pipeline_length' => 2]),
+            ]);
+            return;
+        }
+
         $this->assertFlameGraph($traces, [
             SpanAssertion::build(
                 "Redis.multi",
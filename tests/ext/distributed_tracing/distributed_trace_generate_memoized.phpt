@@ -0,0 +1,48 @@
+--TEST--
+generate_distributed_tracing_headers() follows changes of the propagation context
+--ENV--
+HTTP_X_DATADOG_TRACE_ID=42
+HTTP_X_DATADOG_PARENT_ID=10
+HTTP_X_DATADOG_ORIGIN=datadog
+HTTP_X_DATADOG_SAMPLING_PRIORITY=3
+DD_TRACE_GENERATE_ROOT_SPAN=0
+DD_TRACE_PROPAGATION_STYLE_INJECT=datadog
+--FILE--
+<?php
+
+function show() {
+    $headers = DDTrace\generate_distributed_tracing_headers();
+    echo $headers["x-datadog-parent-id"] == 10 ? "distributed parent" : ($headers["x-datadog-parent-id"] == DDTrace\active_span()->id ? "active span" : "unknown"), ", ";
+    echo $headers["x-datadog-tags"], ", ", $headers["x-datadog-sampling-priority"], "\n";
+    return $headers;
+}
+
+$headers = show();
+$headers["x-datadog-tags"] = "modified";
+show();
+
+$span = DDTrace\start_span();
+show();
+$span->meta["_dd.p.dm"] = "-4";
+show();
+DDTrace\set_priority_sampling(2);
+show();
+
+$child = DDTrace\start_span();
+show();
+DDTrace\close_span();
+show();
+
+DDTrace\close_span();
+show();
+
+?>
+--EXPECT--
+distributed parent, _dd.p.dm=-0, 3
+distributed parent, _dd.p.dm=-0, 3
+active span, _dd.p.dm=-0, 3
+active span, _dd.p.dm=-4, 3
+active span, _dd.p.dm=-4, 2
+active span, _dd.p.dm=-4, 2
+active span, _dd.p.dm=-4, 2
+distributed parent, _dd.p.dm=-0, 3
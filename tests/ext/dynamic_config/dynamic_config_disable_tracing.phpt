@@ -0,0 +1,20 @@
+--TEST--
+Tracing can be disabled through DD_TRACE_DYNAMIC_CONFIG_FILE
+--INI--
+datadog.trace.dynamic_config_file={PWD}/dynamic_config_disable_tracing.conf
+--FILE--
+<?php
+
+var_dump(dd_trace_env_config("DD_TRACE_ENABLED"));
+var_dump(ini_get("datadog.trace.enabled"));
+var_dump(DDTrace\root_span());
+
+ini_set("datadog.trace.enabled", "1");
+var_dump(DDTrace\root_span() instanceof DDTrace\SpanData);
+
+?>
+--EXPECT--
+bool(false)
+string(5) "false"
+NULL
+bool(true)
@@ -0,0 +1,35 @@
+--TEST--
+Settings from DD_TRACE_DYNAMIC_CONFIG_FILE are applied to the request like ini_set()
+--ENV--
+DD_SERVICE=env-service
+DD_VERSION=1.0
+--INI--
+datadog.trace.dynamic_config_file={PWD}/dynamic_config_file.conf
+--FILE--
+<?php
+
+var_dump(dd_trace_env_config("DD_SERVICE"));
+var_dump(ini_get("datadog.service"));
+var_dump(dd_trace_env_config("DD_ENV"));
+var_dump(ini_get("datadog.env"));
+var_dump(dd_trace_env_config("DD_VERSION"));
+var_dump(ini_get("datadog.trace.retain_thread_capabilities"));
+var_dump(dd_trace_env_config("DD_TRACE_DEBUG_PRNG_SEED"));
+
+ini_set("datadog.service", "user-service");
+var_dump(dd_trace_env_config("DD_SERVICE"));
+
+?>
+--EXPECTF--
+Ignoring 'DD_TRACE_DYNAMIC_CONFIG_FILE' in %sdynamic_config_file.conf, it can only be changed on startup
+Ignoring 'DD_TRACE_RETAIN_THREAD_CAPABILITIES' in %sdynamic_config_file.conf, it can only be changed on startup
+Ignoring unknown setting 'DD_TRACE_UNKNOWN_SETTING' in %sdynamic_config_file.conf
+Ignoring invalid value 'not-a-number' for DD_TRACE_DEBUG_PRNG_SEED in %sdynamic_config_file.conf
+string(15) "dynamic-service"
+string(15) "dynamic-service"
+string(11) "dynamic-env"
+string(11) "dynamic-env"
+string(3) "1.0"
+string(5) "false"
+int(-1)
+string(12) "user-service"
@@ -0,0 +1,48 @@
+--TEST--
+Extract client IP address skipping trusted proxies
+--INI--
+datadog.trace.client_ip_trusted_proxies=1.2.3.0/24,2001:db8::/32,9.9.9.9,invalid,5.5.5.5/33
+--FILE--
+<?php
+
+function test($header, $value) {
+    echo "$header: $value\n";
+    $res = DDTrace\extract_ip_from_headers(['HTTP_' . strtoupper($header) => $value]);
+    if (array_key_exists('http.client_ip', $res)) {
+        var_dump($res['http.client_ip']);
+    } else {
+        echo "NULL\n";
+    }
+    echo "\n";
+}
+
+test('x_forwarded_for', '1.2.3.4, 2001:db8::1, 10.0.0.1, 9.9.9.9, 8.8.8.8');
+test('x_forwarded_for', '1.2.3.4, 1.2.4.4');
+test('x_forwarded_for', '9.9.9.8');
+test('x_real_ip', '1.2.3.255');
+test('x_forwarded', 'for="[2001:db8::1]",for=5.5.5.5');
+
+ini_set('datadog.trace.client_ip_trusted_proxies', '8.0.0.0/8');
+test('x_forwarded_for', '1.2.3.4, 8.8.8.8, 7.7.7.7');
+
+?>
+--EXPECT--
+x_forwarded_for: 1.2.3.4, 2001:db8::1, 10.0.0.1, 9.9.9.9, 8.8.8.8
+Invalid address in DD_TRACE_CLIENT_IP_TRUSTED_PROXIES: invalid
+Invalid prefix length in DD_TRACE_CLIENT_IP_TRUSTED_PROXIES: 5.5.5.5/33
+string(7) "8.8.8.8"
+
+x_forwarded_for: 1.2.3.4, 1.2.4.4
+string(7) "1.2.4.4"
+
+x_forwarded_for: 9.9.9.8
+string(7) "9.9.9.8"
+
+x_real_ip: 1.2.3.255
+NULL
+
+x_forwarded: for="[2001:db8::1]",for=5.5.5.5
+string(7) "5.5.5.5"
+
+x_forwarded_for: 1.2.3.4, 8.8.8.8, 7.7.7.7
+string(7) "1.2.3.4"
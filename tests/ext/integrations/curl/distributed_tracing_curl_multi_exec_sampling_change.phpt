@@ -0,0 +1,59 @@
+--TEST--
+Distributed tracing headers shared by multi handles follow sampling decision changes of the active span
+--SKIPIF--
+<?php if (!extension_loaded('curl')) die('skip: curl extension required'); ?>
+<?php if (!getenv('HTTPBIN_HOSTNAME')) die('skip: HTTPBIN_HOSTNAME env var required'); ?>
+--INI--
+ddtrace.request_init_hook={PWD}/distributed_tracing_curl_inject.inc
+--ENV--
+DD_TRACE_SAMPLE_RATE=1
+--FILE--
+<?php
+include 'curl_helper.inc';
+include 'distributed_tracing.inc';
+
+function doMulti($url)
+{
+    $mh = curl_multi_init();
+
+    $handles = [];
+    for ($i = 0; $i < 2; ++$i) {
+        $ch = curl_init();
+        curl_setopt($ch, CURLOPT_URL, $url);
+        curl_setopt($ch, CURLOPT_RETURNTRANSFER, true);
+        curl_multi_add_handle($mh, $ch);
+        $handles[] = $ch;
+    }
+
+    do {
+        $status = curl_multi_exec($mh, $active);
+        curl_multi_select($mh);
+    } while ($active > 0 && $status === CURLM_OK);
+
+    show_curl_multi_error_on_fail($status);
+    foreach ($handles as $ch) {
+        show_curl_error_on_fail($ch);
+        $headers = dt_decode_headers_from_httpbin(curl_multi_getcontent($ch));
+        dt_dump_headers_from_httpbin($headers, ['x-datadog-sampling-priority']);
+        curl_multi_remove_handle($mh, $ch);
+    }
+
+    curl_multi_close($mh);
+}
+
+$port = getenv('HTTPBIN_PORT') ?: '80';
+$url = 'http://' . getenv('HTTPBIN_HOSTNAME') . ':' . $port .'/headers';
+
+doMulti($url);
+\DDTrace\set_priority_sampling(\DD_TRACE_PRIORITY_SAMPLING_USER_KEEP);
+doMulti($url);
+
+echo 'Done.' . PHP_EOL;
+
+?>
+--EXPECT--
+x-datadog-sampling-priority: 1
+x-datadog-sampling-priority: 1
+x-datadog-sampling-priority: 2
+x-datadog-sampling-priority: 2
+Done.
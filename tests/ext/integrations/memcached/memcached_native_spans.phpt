@@ -0,0 +1,32 @@
+--TEST--
+Memcached commands are traced natively and the server list is refreshed when it changes
+--SKIPIF--
+<?php if (PHP_VERSION_ID < 80000) die('skip: native memcached instrumentation requires PHP 8'); ?>
+<?php if (!extension_loaded('memcached')) die('skip: memcached extension required'); ?>
+--ENV--
+DD_TRACE_GENERATE_ROOT_SPAN=0
+DD_TRACE_AUTO_FLUSH_ENABLED=0
+--FILE--
+<?php
+
+$m = new Memcached();
+$m->addServer('127.0.0.1', 1);
+$m->get('key');
+$m->getMulti(['a', 'b', 'c']);
+$m->resetServerList();
+$m->addServer('localhost', 2);
+$m->setByKey('server', 'key', 'value');
+
+$spans = dd_trace_serialize_closed_spans();
+usort($spans, function ($a, $b) { return $a['start'] <=> $b['start']; });
+foreach ($spans as $span) {
+    echo $span['name'], ' | ', $span['resource'], ' | ', $span['type'], ' | ', $span['meta']['memcached.query'], ' | ',
+        $span['meta']['out.host'], ':', $span['meta']['out.port'],
+        isset($span['metrics']['db.row_count']) ? ' | rows=' . $span['metrics']['db.row_count'] : '', "\n";
+}
+
+?>
+--EXPECT--
+Memcached.get | get | memcached | get ? | 127.0.0.1:1 | rows=0
+Memcached.getMulti | getMulti | memcached | getMulti ?,?,? | 127.0.0.1:1 | rows=0
+Memcached.setByKey | setByKey | memcached | setByKey ? | localhost:2
@@ -0,0 +1,37 @@
+--TEST--
+PDO is traced natively with connection tags shared by its statements
+--SKIPIF--
+<?php if (PHP_VERSION_ID < 80000) die('skip: native PDO instrumentation requires PHP 8'); ?>
+<?php if (!extension_loaded('pdo_sqlite')) die('skip: pdo_sqlite extension required'); ?>
+--ENV--
+DD_TRACE_GENERATE_ROOT_SPAN=0
+DD_TRACE_AUTO_FLUSH_ENABLED=0
+--FILE--
+<?php
+
+$pdo = new PDO('sqlite::memory:', null, null, [PDO::ATTR_ERRMODE => PDO::ERRMODE_SILENT]);
+$pdo->exec('CREATE TABLE t (id INTEGER)');
+$pdo->exec('INSERT INTO t VALUES (1), (2)');
+$stmt = $pdo->prepare('SELECT * FROM t WHERE id > ?');
+$stmt->execute([0]);
+$pdo->query('SELECT * FROM t');
+$pdo->exec('SELECT * FROM missing_table');
+
+$spans = dd_trace_serialize_closed_spans();
+usort($spans, function ($a, $b) { return $a['start'] <=> $b['start']; });
+foreach ($spans as $span) {
+    echo $span['name'], ' | ', $span['resource'], ' | ', $span['service'], ' | ', $span['type'], ' | ',
+        $span['meta']['db.system'], ' | ', $span['meta']['component'],
+        isset($span['metrics']['db.row_count']) ? ' | rows=' . $span['metrics']['db.row_count'] : '',
+        isset($span['meta']['error.type']) ? ' | ' . $span['meta']['error.type'] : '', "\n";
+}
+
+?>
+--EXPECT--
+PDO.__construct | PDO.__construct | pdo | sql | sqlite | pdo
+PDO.exec | CREATE TABLE t (id INTEGER) | pdo | sql | sqlite | pdo | rows=0
+PDO.exec | INSERT INTO t VALUES (1), (2) | pdo | sql | sqlite | pdo | rows=2
+PDO.prepare | SELECT * FROM t WHERE id > ? | pdo | sql | sqlite | pdo
+PDOStatement.execute | SELECT * FROM t WHERE id > ? | pdo | sql | sqlite | pdo | rows=0
+PDO.query | SELECT * FROM t | pdo | sql | sqlite | pdo | rows=0
+PDO.exec | SELECT * FROM missing_table | pdo | sql | sqlite | pdo | PDO error
@@ -0,0 +1,32 @@
+--TEST--
+CPU time spent in the PDO handlers is reported on the root span
+--SKIPIF--
+<?php if (PHP_VERSION_ID < 80000) die('skip: native PDO instrumentation requires PHP 8'); ?>
+<?php if (!extension_loaded('pdo_sqlite')) die('skip: pdo_sqlite extension required'); ?>
+--ENV--
+DD_TRACE_GENERATE_ROOT_SPAN=0
+DD_TRACE_AUTO_FLUSH_ENABLED=0
+DD_TRACE_INTEGRATION_OVERHEAD_ENABLED=1
+--FILE--
+<?php
+
+$root = \DDTrace\start_span();
+$pdo = new PDO('sqlite::memory:');
+for ($i = 0; $i < 100; ++$i) {
+    $pdo->query('SELECT 1');
+}
+\DDTrace\close_span();
+
+$spans = dd_trace_serialize_closed_spans();
+$root = array_filter($spans, function ($span) { return !isset($span['parent_id']); });
+$root = reset($root);
+var_dump($root['metrics']['_dd.tracer_overhead.pdo'] > 0);
+var_dump(array_key_exists('_dd.tracer_overhead.phpredis', $root['metrics']));
+$child = array_filter($spans, function ($span) { return $span['name'] == 'PDO.query'; });
+var_dump(array_key_exists('_dd.tracer_overhead.pdo', reset($child)['metrics'] ?? []));
+
+?>
+--EXPECT--
+bool(true)
+bool(false)
+bool(false)
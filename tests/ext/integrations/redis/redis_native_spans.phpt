@@ -0,0 +1,49 @@
+--TEST--
+phpredis commands are traced natively, with a single span per transaction or pipeline
+--SKIPIF--
+<?php if (PHP_VERSION_ID < 80000) die('skip: native phpredis instrumentation requires PHP 8'); ?>
+<?php if (!extension_loaded('redis')) die('skip: redis extension required'); ?>
+<?php if (!@fsockopen('redis_integration', 6379)) die('skip: redis server required'); ?>
+--ENV--
+DD_TRACE_GENERATE_ROOT_SPAN=0
+DD_TRACE_AUTO_FLUSH_ENABLED=0
+--FILE--
+<?php
+
+$redis = new Redis();
+$redis->connect('redis_integration', 6379);
+$redis->set('k0', str_repeat('x', 101));
+var_dump($redis->multi()->set('k1', 'v1')->get('k1')->exec());
+var_dump($redis->pipeline()->set('k2', 'v2')->get('k2')->del('k2')->exec());
+$redis->close();
+
+$spans = dd_trace_serialize_closed_spans();
+usort($spans, function ($a, $b) { return $a['start'] <=> $b['start']; });
+foreach ($spans as $span) {
+    echo $span['name'], ' | ', $span['resource'], ' | ', $span['service'], ' | ', $span['type'], ' | ',
+        $span['meta']['out.host'] ?? '', isset($span['meta']['out.port']) ? ':' . $span['meta']['out.port'] : '',
+        isset($span['meta']['redis.raw_command']) ? ' | ' . $span['meta']['redis.raw_command'] : '',
+        isset($span['metrics']['redis.pipeline_length']) ? ' | length=' . $span['metrics']['redis.pipeline_length'] : '', "\n";
+}
+
+?>
+--EXPECT--
+array(2) {
+  [0]=>
+  bool(true)
+  [1]=>
+  string(2) "v1"
+}
+array(3) {
+  [0]=>
+  bool(true)
+  [1]=>
+  string(2) "v2"
+  [2]=>
+  int(1)
+}
+Redis.connect | Redis.connect | phpredis | redis | redis_integration:6379
+Redis.set | Redis.set | phpredis | redis | redis_integration | set k0 xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx...
+Redis.exec | Redis.exec | phpredis | redis | redis_integration | exec | length=2
+Redis.exec | Redis.exec | phpredis | redis | redis_integration | exec | length=3
+Redis.close | Redis.close | phpredis | redis | redis_integration
@@ -0,0 +1,59 @@
+--TEST--
+Resources of SQL spans are obfuscated natively
+--ENV--
+DD_TRACE_GENERATE_ROOT_SPAN=0
+DD_TRACE_AUTO_FLUSH_ENABLED=0
+DD_TRACE_SQL_OBFUSCATION_ENABLED=1
+DD_TRACE_SQL_OBFUSCATION_CACHE_SIZE=2
+--FILE--
+<?php
+
+$queries = [
+    "SELECT * FROM users WHERE id IN (1, 2, 3) AND name = 'o''brien' -- trailing comment\n  LIMIT 10",
+    "INSERT INTO t VALUES (1, 'a', 3.5e-3), (2, N'b', 0x1F)",
+    "SELECT $1, \$tag\$raw\$tag\$ FROM \"Table\" /* inline */ WHERE b IN (?, ?, ?)",
+    "SELECT * FROM users WHERE id IN (1, 2, 3) AND name = 'o''brien' -- trailing comment\n  LIMIT 10",
+];
+
+foreach ($queries as $query) {
+    $span = \DDTrace\start_span();
+    $span->name = 'query';
+    $span->type = 'sql';
+    $span->resource = $query;
+    \DDTrace\close_span();
+}
+
+// backslashes only escape in MySQL strings and E'...' strings
+$dialects = [
+    'mysql' => "SELECT 'it\\'s' AS q, 1",
+    'postgresql' => "SELECT 'C:\\' AS p, E'x\\'y' AS r",
+];
+foreach ($dialects as $system => $query) {
+    $span = \DDTrace\start_span();
+    $span->name = 'query';
+    $span->type = 'sql';
+    $span->meta['db.system'] = $system;
+    $span->resource = $query;
+    \DDTrace\close_span();
+}
+
+$span = \DDTrace\start_span();
+$span->name = 'other';
+$span->resource = "GET 'literal' 42";
+\DDTrace\close_span();
+
+$spans = dd_trace_serialize_closed_spans();
+usort($spans, function ($a, $b) { return $a['start'] <=> $b['start']; });
+foreach ($spans as $span) {
+    echo $span['resource'], "\n";
+}
+
+?>
+--EXPECT--
+SELECT * FROM users WHERE id IN (?) AND name = ? LIMIT ?
+INSERT INTO t VALUES (?), (?)
+SELECT $1, ? FROM "Table" WHERE b IN (?)
+SELECT * FROM users WHERE id IN (?) AND name = ? LIMIT ?
+SELECT ? AS q, ?
+SELECT ? AS p, ? AS r
+GET 'literal' 42
@@ -0,0 +1,49 @@
+--TEST--
+rate limiter is shared by forked workers
+--SKIPIF--
+<?php if (!extension_loaded('pcntl')) die('skip: pcntl extension required'); ?>
+<?php if (getenv('USE_ZEND_ALLOC') === '0') die('skip timing sensitive test, does not make sense with valgrind'); ?>
+--ENV--
+DD_TRACE_GENERATE_ROOT_SPAN=0
+DD_TRACE_AUTO_FLUSH_ENABLED=0
+DD_TRACE_SAMPLE_RATE=1
+DD_TRACE_RATE_LIMIT=10
+--FILE--
+<?php
+const WORKERS = 64;
+const TRACES_PER_WORKER = 20;
+
+$start = microtime(true);
+$children = [];
+for ($i = 0; $i < WORKERS; ++$i) {
+    $pid = pcntl_fork();
+    if ($pid == 0) {
+        $kept = 0;
+        for ($j = 0; $j < TRACES_PER_WORKER; ++$j) {
+            \DDTrace\start_span();
+            \DDTrace\close_span();
+            foreach (\dd_trace_serialize_closed_spans() as $span) {
+                $kept += $span["metrics"]["_sampling_priority_v1"] > 0;
+            }
+        }
+        exit($kept);
+    }
+    $children[] = $pid;
+}
+
+$kept = 0;
+foreach ($children as $pid) {
+    pcntl_waitpid($pid, $status);
+    $kept += pcntl_wexitstatus($status);
+}
+
+// every started window allows up to 10 traces, across all the workers
+$windows = (int)ceil(microtime(true) - $start) + 1;
+if ($kept >= 10 && $kept <= 10 * $windows) {
+    echo "OK\n";
+} else {
+    echo "Fail: $kept traces kept within $windows windows\n";
+}
+?>
+--EXPECT--
+OK
@@ -0,0 +1,45 @@
+--TEST--
+Hooks do not create spans for a trace propagated as rejected in lightweight mode
+--ENV--
+HTTP_X_DATADOG_TRACE_ID=42
+HTTP_X_DATADOG_PARENT_ID=10
+HTTP_X_DATADOG_SAMPLING_PRIORITY=-1
+DD_TRACE_GENERATE_ROOT_SPAN=0
+DD_TRACE_LIGHTWEIGHT_REJECTED_TRACES=1
+--FILE--
+<?php
+
+function traced() {}
+
+DDTrace\trace_function('traced', function (DDTrace\SpanData $span) {
+    echo "traced closure\n";
+    $span->name = 'traced';
+});
+
+$root = DDTrace\start_span();
+$root->name = 'root';
+traced();
+traced();
+echo "limited: ", var_export(dd_trace_tracer_is_limited(), true), "\n";
+DDTrace\close_span();
+
+echo "limited after close: ", var_export(dd_trace_tracer_is_limited(), true), "\n";
+
+$spans = dd_trace_serialize_closed_spans();
+echo "spans: ", count($spans), "\n";
+echo "name: ", $spans[0]["name"], "\n";
+echo "priority: ", $spans[0]["metrics"]["_sampling_priority_v1"], "\n";
+echo "skipped: ", $spans[0]["metrics"]["_dd.lightweight.skipped_spans"], "\n";
+echo "skipped duration recorded: ", var_export(isset($spans[0]["metrics"]["_dd.lightweight.skipped_duration"]), true), "\n";
+
+?>
+--EXPECT--
+traced closure
+traced closure
+limited: false
+limited after close: false
+spans: 1
+name: root
+priority: -1
+skipped: 2
+skipped duration recorded: true
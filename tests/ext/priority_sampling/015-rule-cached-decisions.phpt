@@ -0,0 +1,41 @@
+--TEST--
+priority_sampling rule decisions are reused across roots and follow runtime rule changes
+--ENV--
+DD_TRACE_SAMPLING_RULES=[{"sample_rate": 0.3, "name": "fo.*ame"}, {"sample_rate": 0.5, "service": "mapped"}]
+DD_SERVICE_MAPPING=original:mapped
+DD_TRACE_GENERATE_ROOT_SPAN=0
+--FILE--
+<?php
+
+function root($name, $service) {
+    $root = DDTrace\start_span();
+    $root->name = $name;
+    $root->service = $service;
+    DDTrace\close_span();
+    echo "$name $service: ", $root->metrics["_dd.rule_psr"], "\n";
+}
+
+root("fooname", "foo");
+root("other", "original");
+root("fooname", "foo");
+root("other", "original");
+root("other", "foo");
+
+ini_set("datadog.trace.sampling_rules", '[{"sample_rate": 0.7, "name": "other"}]');
+root("fooname", "foo");
+root("other", "original");
+
+ini_set("datadog.service_mapping", "original:other");
+ini_set("datadog.trace.sampling_rules", '[{"sample_rate": 0.9, "service": "other"}]');
+root("fooname", "original");
+
+?>
+--EXPECT--
+fooname foo: 0.3
+other original: 0.5
+fooname foo: 0.3
+other original: 0.5
+other foo: 1
+fooname foo: 1
+other original: 0.7
+fooname original: 0.9
@@ -0,0 +1,38 @@
+--TEST--
+priority_sampling keep rules retain slow, erroneous and 5xx roots rejected by the sampler
+--ENV--
+DD_TRACE_SAMPLE_RATE=0
+DD_TRACE_SAMPLING_KEEP_SLOWER_THAN_MS=50
+DD_TRACE_SAMPLING_KEEP_ERRORS=1
+DD_TRACE_SAMPLING_KEEP_HTTP_5XX=1
+DD_TRACE_GENERATE_ROOT_SPAN=0
+--FILE--
+<?php
+
+function root($name, $callback = null) {
+    $root = DDTrace\start_span();
+    $root->name = $name;
+    if ($callback) {
+        $callback($root);
+    }
+    DDTrace\close_span();
+    echo "$name: ", $root->metrics["_sampling_priority_v1"], " dm: ", isset($root->meta["_dd.p.dm"]) ? $root->meta["_dd.p.dm"] : "-", " psr: ", $root->metrics["_dd.rule_psr"], "\n";
+}
+
+root("fast");
+root("slow", function () { usleep(60000); });
+root("exception", function ($root) { $root->exception = new Exception("boom"); });
+root("error", function ($root) { $root->meta["error.message"] = "boom"; });
+root("ignored", function ($root) { $root->meta["error.message"] = "boom"; $root->meta["error.ignored"] = 1; });
+root("client error", function ($root) { $root->meta["http.status_code"] = "404"; });
+root("server error", function ($root) { $root->meta["http.status_code"] = "503"; });
+
+?>
+--EXPECT--
+fast: -1 dm: - psr: 0
+slow: 2 dm: -3 psr: 0
+exception: 2 dm: -3 psr: 0
+error: 2 dm: -3 psr: 0
+ignored: -1 dm: - psr: 0
+client error: -1 dm: - psr: 0
+server error: 2 dm: -3 psr: 0
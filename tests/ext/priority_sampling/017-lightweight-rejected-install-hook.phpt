@@ -0,0 +1,58 @@
+--TEST--
+Hook closures keep their side effects in lightweight mode, only their spans are dummies
+--ENV--
+HTTP_X_DATADOG_TRACE_ID=42
+HTTP_X_DATADOG_PARENT_ID=10
+HTTP_X_DATADOG_SAMPLING_PRIORITY=-1
+DD_TRACE_GENERATE_ROOT_SPAN=0
+DD_TRACE_LIGHTWEIGHT_REJECTED_TRACES=1
+--FILE--
+<?php
+
+function query($sql) {
+    echo "query: $sql\n";
+}
+
+function publish($headers) {
+    echo "published with ", count($headers), " headers\n";
+}
+
+// like the database integrations injecting comments into queries
+DDTrace\install_hook('query', function (DDTrace\HookData $hook) {
+    $hook->span()->name = 'query';
+    $hook->overrideArguments(["/* injected */ " . $hook->args[0]]);
+});
+
+// like the AMQP integration injecting context into the published message
+DDTrace\trace_function('publish', [
+    'prehook' => function (DDTrace\SpanData $span, $args) {
+        $span->name = 'publish';
+        $headers = DDTrace\generate_distributed_tracing_headers(['datadog']);
+        echo "trace id: ", $headers['x-datadog-trace-id'], "\n";
+        echo "priority: ", $headers['x-datadog-sampling-priority'], "\n";
+    },
+]);
+
+$root = DDTrace\start_span();
+$root->name = 'root';
+query("SELECT 1");
+query("SELECT 2");
+$headers = ['a' => 'b'];
+publish($headers);
+echo "limited: ", var_export(dd_trace_tracer_is_limited(), true), "\n";
+DDTrace\close_span();
+
+$spans = dd_trace_serialize_closed_spans();
+echo "spans: ", count($spans), "\n";
+echo "skipped: ", $spans[0]["metrics"]["_dd.lightweight.skipped_spans"], "\n";
+
+?>
+--EXPECT--
+query: /* injected */ SELECT 1
+query: /* injected */ SELECT 2
+trace id: 42
+priority: -1
+published with 1 headers
+limited: false
+spans: 1
+skipped: 3
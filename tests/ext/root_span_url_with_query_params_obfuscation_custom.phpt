@@ -0,0 +1,23 @@
+--TEST--
+Root span with http.url and query string obfuscated by a custom regex
+--ENV--
+DD_TRACE_GENERATE_ROOT_SPAN=0
+DD_TRACE_HTTP_URL_QUERY_PARAM_ALLOWED=*
+DD_TRACE_OBFUSCATION_QUERY_STRING_REGEXP=(?:foo|bar)=[^&]+
+HTTPS=off
+HTTP_HOST=localhost:9999
+SCRIPT_NAME=/foo.php
+REQUEST_URI=/foo?key1=val1&foo=secret&password=something&bar=baz&other=value
+QUERY_STRING=key1=val1&foo=secret&password=something&bar=baz&other=value
+METHOD=GET
+--GET--
+key1=val1&foo=secret&password=something&bar=baz&other=value
+--FILE--
+<?php
+DDTrace\start_span();
+DDTrace\close_span();
+$spans = dd_trace_serialize_closed_spans();
+var_dump($spans[0]['meta']["http.url"]);
+?>
+--EXPECT--
+string(89) "https://localhost:9999/foo?key1=val1&<redacted>&password=something&<redacted>&other=value"
@@ -0,0 +1,32 @@
+--TEST--
+[Sandbox] Hooks on abstract methods are inherited through intermediate classes not implementing them
+--FILE--
+<?php
+
+DDTrace\hook_method("AbstractBase", "foo", function() {
+    echo "AbstractBase HOOK\n";
+});
+
+// Ensure run-time resolving
+if (true) {
+    abstract class AbstractBase {
+        abstract public function foo();
+    }
+
+    abstract class Intermediate extends AbstractBase {
+        public function bar() {}
+    }
+
+    class Concrete extends Intermediate {
+        public function foo() {
+            echo "METHOD Concrete\n";
+        }
+    }
+}
+
+(new Concrete())->foo();
+
+?>
+--EXPECT--
+AbstractBase HOOK
+METHOD Concrete
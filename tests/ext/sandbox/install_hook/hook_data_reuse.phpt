@@ -0,0 +1,43 @@
+--TEST--
+HookData objects and bound hook closures do not leak state between invocations
+--INI--
+datadog.trace.generate_root_span=0
+--FILE--
+<?php
+
+class A {
+    public $name;
+    function __construct($name) { $this->name = $name; }
+    function foo($arg) { return $arg; }
+}
+class B extends A {}
+
+$retained = [];
+\DDTrace\install_hook('A::foo', function (\DDTrace\HookData $hook) use (&$retained) {
+    echo "begin ", $this->name, ": data=", var_export(isset($hook->data), true), " arg=", $hook->args[0], "\n";
+    $hook->data = $hook->args[0];
+    if ($hook->args[0] == 2) {
+        $retained[] = $hook;
+    }
+}, function (\DDTrace\HookData $hook) {
+    echo "end ", static::class, ": data=", $hook->data, " returned=", $hook->returned, "\n";
+});
+
+(new A("a"))->foo(1);
+(new B("b"))->foo(2);
+(new A("c"))->foo(3);
+(new B("d"))->foo(4);
+
+echo "retained: ", $retained[0]->data, " ", $retained[0]->returned, "\n";
+
+?>
+--EXPECT--
+begin a: data=false arg=1
+end A: data=1 returned=1
+begin b: data=false arg=2
+end B: data=2 returned=2
+begin c: data=false arg=3
+end A: data=3 returned=3
+begin d: data=false arg=4
+end B: data=4 returned=4
+retained: 2 2
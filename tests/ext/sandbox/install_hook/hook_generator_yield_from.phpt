@@ -0,0 +1,86 @@
+--TEST--
+install_hook() on many plain generators and along yield from chains
+--INI--
+datadog.trace.generate_root_span=0
+--FILE--
+<?php
+
+function plain($n) {
+    for ($i = 0; $i < $n; ++$i) {
+        yield $i;
+    }
+    return "plain";
+}
+
+function inner() {
+    yield 1;
+    yield 2;
+    return "inner";
+}
+
+// not hooked itself, but part of the chain of hooked generators
+function middle() {
+    $ret = yield from inner();
+    yield from [3, 4];
+    return $ret;
+}
+
+function outer() {
+    $ret = yield from middle();
+    yield 5;
+    return $ret;
+}
+
+$ended = 0;
+DDTrace\install_hook('plain', null, function (\DDTrace\HookData $hook) use (&$ended) {
+    if ($hook->returned === "plain") {
+        ++$ended;
+    }
+});
+DDTrace\install_hook('inner', function () {
+    echo "inner begin\n";
+}, function (\DDTrace\HookData $hook) {
+    echo "inner end: {$hook->returned}\n";
+});
+DDTrace\install_hook('outer', function () {
+    echo "outer begin\n";
+}, function (\DDTrace\HookData $hook) {
+    echo "outer end: {$hook->returned}\n";
+});
+
+// keep more generators alive at once than a single page of frame memory slots holds
+$generators = [];
+for ($i = 0; $i < 300; ++$i) {
+    $generators[] = plain(3);
+}
+$sum = 0;
+foreach ($generators as $generator) {
+    foreach ($generator as $value) {
+        $sum += $value;
+    }
+}
+echo "plain: $ended ended, sum $sum\n";
+
+// the slots of the freed generators are reused
+unset($generators, $generator);
+foreach (plain(2) as $value) {
+}
+echo "plain: $ended ended\n";
+
+foreach (outer() as $value) {
+    echo "$value\n";
+}
+
+?>
+--EXPECT--
+plain: 300 ended, sum 900
+plain: 301 ended
+outer begin
+inner begin
+1
+2
+inner end: inner
+3
+4
+5
+outer end: inner
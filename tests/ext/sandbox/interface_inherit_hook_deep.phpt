@@ -0,0 +1,55 @@
+--TEST--
+[Sandbox] Hooks are inherited through deep hierarchies amidst many unhooked classes
+--FILE--
+<?php
+
+DDTrace\hook_method("Ancestor", "Method", function() {
+    echo "Ancestor HOOK\n";
+});
+
+DDTrace\hook_method("ArrayIterator", "count", function() {
+    echo "ArrayIterator HOOK\n";
+});
+
+for ($i = 0; $i < 500; ++$i) {
+    eval("class Unhooked$i { public function Method() {} }");
+}
+
+// Ensure run-time resolving
+if (true) {
+    interface Ancestor {
+        public function Method();
+    }
+
+    abstract class Base implements Ancestor {
+    }
+
+    class Middle extends Base {
+        public function Method() {
+            echo "METHOD Middle\n";
+        }
+    }
+
+    class Child extends Middle {
+        public function Method() {
+            echo "METHOD Child\n";
+        }
+    }
+
+    class MyIterator extends ArrayIterator {
+    }
+
+    class MyChildIterator extends MyIterator {
+    }
+}
+
+(new Child())->Method();
+(new Unhooked0())->Method();
+echo (new MyChildIterator([1, 2]))->count(), "\n";
+
+?>
+--EXPECT--
+Ancestor HOOK
+METHOD Child
+ArrayIterator HOOK
+2
@@ -0,0 +1,29 @@
+--TEST--
+Test max_per_second single span limiting below one span per second
+--SKIPIF--
+<?php if (getenv('USE_ZEND_ALLOC') === '0') die('skip timing sensitive test, does not make sense with valgrind'); ?>
+--ENV--
+DD_SAMPLING_RATE=0
+DD_SPAN_SAMPLING_RULES=[{"name":"fractional","sample_rate":1,"max_per_second":0.5}]
+DD_TRACE_GENERATE_ROOT_SPAN=0
+--FILE--
+<?php
+
+function sampled() {
+    $span = DDTrace\start_span();
+    $span->name = "fractional";
+    DDTrace\close_span();
+
+    return isset(dd_trace_serialize_closed_spans()[0]["metrics"]["_dd.span_sampling.mechanism"]);
+}
+
+echo "first: ", var_export(sampled(), true), "\n";
+echo "immediately after: ", var_export(sampled(), true), "\n";
+usleep(2100000);
+echo "after two seconds: ", var_export(sampled(), true), "\n";
+
+?>
+--EXPECT--
+first: true
+immediately after: false
+after two seconds: true
@@ -0,0 +1,14 @@
+<?php
+
+// Client IP resolution of root spans, with the X-Forwarded-For chain given through the environment
+$spans = $argc > 1 ? (int)$argv[1] : 20000;
+
+for ($i = 0; $i < $spans; $i++) {
+    \DDTrace\start_span();
+    \DDTrace\close_span();
+    if ($i % 1000 == 999) {
+        \dd_trace_serialize_closed_spans();
+    }
+}
+
+echo $spans . "\n";
@@ -0,0 +1,31 @@
+<?php
+
+// Extraction of distributed tracing headers from realistic browser and service-to-service header sets
+$headers = [
+    "host" => "shop.example.com",
+    "user-agent" => "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0 Safari/537.36",
+    "accept" => "text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8",
+    "accept-language" => "en-US,en;q=0.5",
+    "accept-encoding" => "gzip, deflate, br",
+    "cookie" => "session=5f2b9c0e7a1d4e3f; theme=dark; consent=1",
+    "cache-control" => "no-cache",
+    "connection" => "keep-alive",
+    "x-forwarded-for" => "203.0.113.7, 10.0.0.12",
+    "x-request-id" => "0b6c2e0e-4c0b-4b8e-9a3a-0f5d8b7c6a51",
+];
+
+if ($argc > 1 && $argv[1] == "propagated") {
+    $headers += [
+        "x-datadog-trace-id" => "1645963497285912316",
+        "x-datadog-parent-id" => "8021391224383916042",
+        "x-datadog-sampling-priority" => "1",
+        "x-datadog-origin" => "rum",
+        "x-datadog-tags" => "_dd.p.dm=-4,_dd.p.tid=640cfd8d00000000",
+        "traceparent" => "00-640cfd8d00000000e4d84aeb3b0ec6fc-6f5b1ecd2e7d3a0a-01",
+        "tracestate" => "dd=s:1;o:rum;t.dm:-4,congo=t61rcWkgMzE",
+    ];
+}
+
+for ($i = 0; $i < 1000000; $i++) {
+    \DDTrace\consume_distributed_tracing_headers($headers);
+}
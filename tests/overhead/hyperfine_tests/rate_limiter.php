@@ -0,0 +1,25 @@
+<?php
+
+// Root span sampling decisions of concurrently forked workers, all contending on the shared rate limiter
+$workers = $argc > 1 ? (int)$argv[1] : 64;
+$traces = 20000;
+
+$children = [];
+for ($i = 0; $i < $workers; $i++) {
+    $pid = pcntl_fork();
+    if ($pid == 0) {
+        for ($j = 0; $j < $traces; $j++) {
+            \DDTrace\start_span();
+            \DDTrace\close_span();
+            \dd_trace_serialize_closed_spans();
+        }
+        exit(0);
+    }
+    $children[] = $pid;
+}
+
+foreach ($children as $pid) {
+    pcntl_waitpid($pid, $status);
+}
+
+echo $workers * $traces . "\n";
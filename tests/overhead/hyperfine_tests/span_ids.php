@@ -0,0 +1,16 @@
+<?php
+
+// Span and trace id generation of many short lived spans, forked workers must not share id sequences
+$spans = $argc > 1 ? (int)$argv[1] : 200000;
+
+$ids = [];
+for ($i = 0; $i < $spans; $i++) {
+    \DDTrace\start_span();
+    $ids[] = \DDTrace\active_span()->id;
+    \DDTrace\close_span();
+    if ($i % 1000 == 999) {
+        \dd_trace_serialize_closed_spans();
+    }
+}
+
+echo count(array_unique($ids)) . "\n";
@@ -20,6 +20,22 @@ static bool zai_config_get_env_value(zai_string_view name, zai_env_buffer buf) {
     return zai_getenv_ex(name, buf, true) == ZAI_ENV_SUCCESS;
 }
 
+bool zai_config_is_decoded_from(zai_config_memoized_entry *memoized, zai_string_view encoded) {
+    if (memoized->decoded_from) {
+        return ZSTR_LEN(memoized->decoded_from) == encoded.len && memcmp(ZSTR_VAL(memoized->decoded_from), encoded.ptr, encoded.len) == 0;
+    }
+    return memoized->default_encoded_value.len == encoded.len && memcmp(memoized->default_encoded_value.ptr, encoded.ptr, encoded.len) == 0;
+}
+
+void zai_config_memoize_decoded_value(zai_config_memoized_entry *memoized, zval *decoded, zai_string_view encoded) {
+    zai_config_dtor_pzval(&memoized->decoded_value);
+    ZVAL_COPY_VALUE(&memoized->decoded_value, decoded);
+    if (memoized->decoded_from) {
+        zend_string_release(memoized->decoded_from);
+    }
+    memoized->decoded_from = zend_string_init(encoded.ptr, encoded.len, 1);
+}
+
 static void zai_config_find_and_set_value(zai_config_memoized_entry *memoized, zai_config_id id) {
     // TODO Use less buffer space
     // TODO Make a more generic zai_string_buffer
@@ -35,10 +51,12 @@ static void zai_config_find_and_set_value(zai_config_memoized_entry *memoized, z
         zai_string_view name = {.len = memoized->names[name_index].len, .ptr = memoized->names[name_index].ptr};
         if (zai_config_get_env_value(name, buf)) {
             zai_string_view env_value = {.len = strlen(buf.ptr), .ptr = buf.ptr};
-            if (!zai_config_decode_value(env_value, memoized->type, memoized->parser, &tmp, /* persistent */ true)) {
+            if (zai_config_is_decoded_from(memoized, env_value)) {
+                value = env_value;
+            } else if (!zai_config_decode_value(env_value, memoized->type, memoized->parser, &tmp, /* persistent */ true)) {
                 // TODO Log decoding error
             } else {
-                zai_config_dtor_pzval(&tmp);
+                // keep the decoded value, it is used unless a runtime ini value takes precedence
                 value = env_value;
             }
             break;
@@ -53,13 +71,22 @@ static void zai_config_find_and_set_value(zai_config_memoized_entry *memoized, z
 
     if (value.ptr) {
         // TODO If name_index > 0, log deprecation notice
-        zai_config_decode_value(value, memoized->type, memoized->parser, &tmp, /* persistent */ true);
-        assert(Z_TYPE(tmp) > IS_NULL);
-        zai_config_dtor_pzval(&memoized->decoded_value);
-        ZVAL_COPY_VALUE(&memoized->decoded_value, &tmp);
+        /* Values unchanged since they were decoded on MINIT, i.e. in the master process of forking SAPIs, are kept as
+         * is: no decoding on each worker startup and the decoded values stay on memory pages shared with the master. */
+        if (!zai_config_is_decoded_from(memoized, value)) {
+            if (value.ptr != buf.ptr || Z_TYPE(tmp) <= IS_NULL) {
+                zai_config_dtor_pzval(&tmp);
+                zai_config_decode_value(value, memoized->type, memoized->parser, &tmp, /* persistent */ true);
+            }
+            assert(Z_TYPE(tmp) > IS_NULL);
+            zai_config_memoize_decoded_value(memoized, &tmp, value);
+            ZVAL_UNDEF(&tmp);
+        }
         memoized->name_index = name_index;
     }
 
+    zai_config_dtor_pzval(&tmp);
+
     // Nothing to do; default value was already decoded at MINIT
 }
 
@@ -90,6 +117,7 @@ static zai_config_memoized_entry *zai_config_memoize_entry(zai_config_entry *ent
     if (!zai_config_decode_value(entry->default_encoded_value, memoized->type, memoized->parser, &memoized->decoded_value, /* persistent */ true)) {
         assert(0 && "Error decoding default value");
     }
+    memoized->decoded_from = NULL;
     memoized->name_index = -1;
     memoized->original_on_modify = NULL;
     memoized->ini_change = entry->ini_change;
@@ -125,6 +153,10 @@ bool zai_config_minit(zai_config_entry entries[], size_t entries_count, zai_conf
 static void zai_config_dtor_memoized_zvals(void) {
     for (uint8_t i = 0; i < zai_config_memoized_entries_count; i++) {
         zai_config_dtor_pzval(&zai_config_memoized_entries[i].decoded_value);
+        if (zai_config_memoized_entries[i].decoded_from) {
+            zend_string_release(zai_config_memoized_entries[i].decoded_from);
+            zai_config_memoized_entries[i].decoded_from = NULL;
+        }
     }
 }
 
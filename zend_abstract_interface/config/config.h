@@ -58,6 +58,8 @@ struct zai_config_memoized_entry_s {
     uint8_t names_count;
     zai_config_type type;
     zval decoded_value;
+    // The env/ini value decoded_value was decoded from, NULL for the default value
+    zend_string *decoded_from;
     zai_string_view default_encoded_value;
     // The index of the name that was used to set the value
     //     anything > 0 is deprecated
@@ -82,6 +84,11 @@ void zai_config_mshutdown(void);
 // Update decoded_value with env/ini value if exists
 void zai_config_first_time_rinit(void);
 
+// Whether decoded_value was decoded from that exact encoded value, i.e. decoding it again can be skipped
+bool zai_config_is_decoded_from(zai_config_memoized_entry *memoized, zai_string_view encoded);
+// Takes ownership of the persistent decoded value
+void zai_config_memoize_decoded_value(zai_config_memoized_entry *memoized, zval *decoded, zai_string_view encoded);
+
 // Runtime config ctor (++rc)
 void zai_config_rinit(void);
 // dtor run-time zvals  (--rc)
@@ -90,6 +97,20 @@ void zai_config_rshutdown(void);
 // Directly replace the config value for the current request. Copies the passed argument.
 void zai_config_replace_runtime_config(zai_config_id id, zval *value);
 
+// Per thread: a runtime change of the entry to exactly the encoded value uses the persistent decoded value instead of
+// decoding it again, so that values set again on every request keep their address. The caller keeps ownership of both
+// and must unset them (decoded NULL) before freeing them.
+void zai_config_set_predecoded_value(zai_config_id id, zend_string *encoded, zval *decoded);
+zval *zai_config_get_predecoded_value(zai_config_id id, zend_string *encoded);
+
+// Caches keyed by the address of a decoded array must not outlive it. Arrays decoded on a runtime change (ini_set())
+// are freed on the next change or along with the request, hence caches hold a reference to them and must release it
+// before the request ends. Persistent arrays are not refcounted across threads; they are only freed on mshutdown, or
+// when a predecoded value is replaced, which its owner has to signal otherwise.
+bool zai_config_array_is_persistent(zend_array *array);
+void zai_config_array_cache_addref(zend_array *array);
+void zai_config_array_cache_release(zend_array *array);
+
 extern uint8_t zai_config_memoized_entries_count;
 extern zai_config_memoized_entry zai_config_memoized_entries[ZAI_CONFIG_ENTRIES_COUNT_MAX];
 
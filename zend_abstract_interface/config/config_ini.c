@@ -52,13 +52,15 @@ int16_t zai_config_initialize_ini_value(zend_ini_entry **entries, int16_t ini_co
             // Try working around ...
             zend_string *ini_str = entries[i]->modified ? entries[i]->orig_value : entries[i]->value;
             if (ZSTR_LEN(ini_str) != default_value.len || strcmp(ZSTR_VAL(ini_str), default_value.ptr) != 0) {
-                // validate
-                zval new_zv;
-                ZVAL_UNDEF(&new_zv);
-                if (!zai_config_decode_value(ZAI_STRING_FROM_ZSTR(ini_str), memoized->type, memoized->parser, &new_zv, true)) {
-                    continue;
+                // validate, unless already decoded successfully
+                if (!zai_config_is_decoded_from(memoized, ZAI_STRING_FROM_ZSTR(ini_str))) {
+                    zval new_zv;
+                    ZVAL_UNDEF(&new_zv);
+                    if (!zai_config_decode_value(ZAI_STRING_FROM_ZSTR(ini_str), memoized->type, memoized->parser, &new_zv, true)) {
+                        continue;
+                    }
+                    zai_config_dtor_pzval(&new_zv);
                 }
-                zai_config_dtor_pzval(&new_zv);
 
                 parsed_ini_value = zend_string_copy(ini_str);
                 name_index = i;
@@ -76,13 +78,15 @@ int16_t zai_config_initialize_ini_value(zend_ini_entry **entries, int16_t ini_co
         }
         zval *inizv = cfg_get_entry(ZSTR_VAL(entries[i]->name), ZSTR_LEN(entries[i]->name));
         if (inizv != NULL && !parsed_ini_value) {
-            // validate
-            zval new_zv;
-            ZVAL_UNDEF(&new_zv);
-            if (!zai_config_decode_value(ZAI_STRING_FROM_ZSTR(Z_STR_P(inizv)), memoized->type, memoized->parser, &new_zv, true)) {
-                continue;
+            // validate, unless already decoded successfully
+            if (!zai_config_is_decoded_from(memoized, ZAI_STRING_FROM_ZSTR(Z_STR_P(inizv)))) {
+                zval new_zv;
+                ZVAL_UNDEF(&new_zv);
+                if (!zai_config_decode_value(ZAI_STRING_FROM_ZSTR(Z_STR_P(inizv)), memoized->type, memoized->parser, &new_zv, true)) {
+                    continue;
+                }
+                zai_config_dtor_pzval(&new_zv);
             }
-            zai_config_dtor_pzval(&new_zv);
 
             parsed_ini_value = zend_string_copy(Z_STR_P(inizv));
             name_index = i;
@@ -171,7 +175,10 @@ static ZEND_INI_MH(ZaiConfigOnUpdateIni) {
     zval new_zv;
     ZVAL_UNDEF(&new_zv);
 
-    if (!zai_config_decode_value(value_view, memoized->type, memoized->parser, &new_zv, /* persistent */ stage != PHP_INI_STAGE_RUNTIME)) {
+    zval *predecoded = stage == PHP_INI_STAGE_RUNTIME ? zai_config_get_predecoded_value(id, new_value) : NULL;
+    if (predecoded) {
+        ZVAL_COPY(&new_zv, predecoded);
+    } else if (!zai_config_decode_value(value_view, memoized->type, memoized->parser, &new_zv, /* persistent */ stage != PHP_INI_STAGE_RUNTIME)) {
         // TODO Log decoding error
 
         return FAILURE;
@@ -185,12 +192,12 @@ static ZEND_INI_MH(ZaiConfigOnUpdateIni) {
     }
 
     if (!zai_config_is_initialized()) {
-        zval_dtor(&new_zv);
+        zval_ptr_dtor_nogc(&new_zv);
         return SUCCESS;
     }
 
     if (memoized->ini_change && !memoized->ini_change(zai_config_get_value(id), &new_zv)) {
-        zval_dtor(&new_zv);
+        zval_ptr_dtor_nogc(&new_zv);
         return FAILURE;
     }
 
@@ -220,7 +227,7 @@ static ZEND_INI_MH(ZaiConfigOnUpdateIni) {
     }
 
     zai_config_replace_runtime_config(id, &new_zv);
-    zval_dtor(&new_zv);
+    zval_ptr_dtor_nogc(&new_zv);
     return SUCCESS;
 }
 
@@ -247,8 +254,7 @@ static void zai_config_add_ini_entry(zai_config_memoized_entry *memoized, zai_st
             zval decoded;
             // This should never fail, ideally, as all usages should validate the same way, but at least not crash, just don't accept the value then
             if (zai_config_decode_value(value_view, memoized->type, memoized->parser, &decoded, 1)) {
-                zai_config_dtor_pzval(&memoized->decoded_value);
-                ZVAL_COPY_VALUE(&memoized->decoded_value, &decoded);
+                zai_config_memoize_decoded_value(memoized, &decoded, value_view);
             }
         }
         existing->on_modify = ZaiConfigOnUpdateIni;
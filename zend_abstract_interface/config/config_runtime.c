@@ -4,36 +4,101 @@
 
 extern HashTable zai_config_name_map;
 
+/* Only entries overridden within the request (ini_set(), per-dir ini, env at rinit) are stored here, all other entries
+ * are read from the memoized values directly. The table is allocated on the first override, thus requests not changing
+ * any configuration do not copy anything. */
 ZEND_TLS zval *runtime_config;  // dynamically allocated, otherwise TLS alignment limits may be exceeded
 ZEND_TLS bool runtime_config_initialized = false;
 
 void zai_config_replace_runtime_config(zai_config_id id, zval *value) {
+    if (!runtime_config) {
+        runtime_config = emalloc(sizeof(zval) * ZAI_CONFIG_ENTRIES_COUNT_MAX);
+        for (uint8_t i = 0; i < zai_config_memoized_entries_count; i++) {
+            ZVAL_UNDEF(&runtime_config[i]);
+        }
+    }
+
     zval *rt_value = &runtime_config[id];
     zval_ptr_dtor(rt_value);
 
     ZVAL_COPY(rt_value, value);
 }
 
+/* Entries set on every request to the same value, e.g. by dynamic configuration, are decoded once per thread by their
+ * owner instead, see zai_config_set_predecoded_value(). */
+ZEND_TLS struct {
+    zend_string *encoded;
+    zval *decoded;
+} *predecoded_values;  // dynamically allocated on first use, like runtime_config
+ZEND_TLS uint32_t predecoded_values_count = 0;
+
+void zai_config_set_predecoded_value(zai_config_id id, zend_string *encoded, zval *decoded) {
+    if (!predecoded_values) {
+        if (!decoded) {
+            return;
+        }
+        predecoded_values = pecalloc(ZAI_CONFIG_ENTRIES_COUNT_MAX, sizeof(*predecoded_values), 1);
+    }
+
+    predecoded_values_count += (decoded != NULL) - (predecoded_values[id].decoded != NULL);
+    predecoded_values[id].encoded = decoded ? encoded : NULL;
+    predecoded_values[id].decoded = decoded;
+
+    if (!predecoded_values_count) {
+        pefree(predecoded_values, 1);
+        predecoded_values = NULL;
+    }
+}
+
+zval *zai_config_get_predecoded_value(zai_config_id id, zend_string *encoded) {
+    if (predecoded_values && predecoded_values[id].decoded && zend_string_equals(predecoded_values[id].encoded, encoded)) {
+        return predecoded_values[id].decoded;
+    }
+    return NULL;
+}
+
+bool zai_config_array_is_persistent(zend_array *array) {
+#if PHP_VERSION_ID < 70300
+    return (array->u.flags & HASH_FLAG_PERSISTENT) || (GC_FLAGS(array) & IS_ARRAY_IMMUTABLE);
+#else
+    return (GC_FLAGS(array) & (IS_ARRAY_PERSISTENT | IS_ARRAY_IMMUTABLE)) != 0;
+#endif
+}
+
+void zai_config_array_cache_addref(zend_array *array) {
+    if (!zai_config_array_is_persistent(array)) {
+#if PHP_VERSION_ID < 70300
+        ++GC_REFCOUNT(array);
+#else
+        GC_ADDREF(array);
+#endif
+    }
+}
+
+void zai_config_array_cache_release(zend_array *array) {
+    if (!zai_config_array_is_persistent(array)) {
+        zval zv;
+        ZVAL_ARR(&zv, array);
+        zval_ptr_dtor(&zv);
+    }
+}
+
 bool zai_config_is_initialized(void) {
     return runtime_config_initialized;
 }
 
 void zai_config_runtime_config_ctor(void) {
-    if (runtime_config_initialized == true) return;
-    runtime_config = emalloc(sizeof(zval) * ZAI_CONFIG_ENTRIES_COUNT_MAX);
-
-    for (uint8_t i = 0; i < zai_config_memoized_entries_count; i++) {
-        ZVAL_COPY(&runtime_config[i], &zai_config_memoized_entries[i].decoded_value);
-    }
     runtime_config_initialized = true;
 }
 
 void zai_config_runtime_config_dtor(void) {
-    if (runtime_config_initialized != true) return;
-    for (uint8_t i = 0; i < zai_config_memoized_entries_count; i++) {
-        zval_ptr_dtor(&runtime_config[i]);
+    if (runtime_config) {
+        for (uint8_t i = 0; i < zai_config_memoized_entries_count; i++) {
+            zval_ptr_dtor(&runtime_config[i]);
+        }
+        efree(runtime_config);
+        runtime_config = NULL;
     }
-    efree(runtime_config);
     runtime_config_initialized = false;
 }
 
@@ -42,11 +107,14 @@ zval *zai_config_get_value(zai_config_id id) {
         assert(false && "Config ID is out of bounds");
         return &EG(error_zval);
     }
-    if (Z_ISUNDEF(runtime_config[id])) {
+    if (!runtime_config_initialized) {
         assert(false && "runtime config is not yet initialized");
         return &EG(error_zval);
     }
-    return &runtime_config[id];
+    if (runtime_config && !Z_ISUNDEF(runtime_config[id])) {
+        return &runtime_config[id];
+    }
+    return &zai_config_memoized_entries[id].decoded_value;
 }
 
 void zai_config_register_config_id(zai_config_name *name, zai_config_id id) {
@@ -207,3 +207,27 @@ TEA_TEST_CASE_BARE("config/env", "change after memoization", {
     tea_sapi_mshutdown();
     tea_sapi_sshutdown();
 })
+
+TEA_TEST_CASE_BARE("config/env", "unchanged value decoded before first rinit is kept", {
+    REQUIRE(tea_sapi_sinit());
+    ext_zai_config_ctor(PHP_MINIT(zai_config_env));
+    REQUIRE_SETENV("FOO_MAP", "one:1");
+
+    REQUIRE(tea_sapi_minit());
+    // as done on MINIT by forking SAPIs, before the workers get to their first rinit
+    zai_config_first_time_rinit();
+    zend_array *decoded = Z_ARR(zai_config_memoized_entries[EXT_CFG_FOO_MAP].decoded_value);
+
+    REQUEST_BEGIN();
+
+    zval *value = zai_config_get_value(EXT_CFG_FOO_MAP);
+
+    REQUIRE(value != NULL);
+    REQUIRE(Z_TYPE_P(value) == IS_ARRAY);
+    REQUIRE(Z_ARR_P(value) == decoded);
+    REQUIRE(zend_hash_num_elements(Z_ARR_P(value)) == 1);
+
+    REQUEST_END();
+    tea_sapi_mshutdown();
+    tea_sapi_sshutdown();
+})
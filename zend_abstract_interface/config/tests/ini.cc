@@ -518,3 +518,26 @@ TEST_INI("change before request startup", {
     REQUIRE(Z_LVAL_P(value) == 3);
     REQUEST_END();
 })
+
+TEST_INI("user value only overrides its own entry within the request", {
+    REQUIRE(tea_sapi_append_system_ini_entry("zai_config.INI_FOO_INT", "1"));
+}, {
+    REQUEST_BEGIN()
+
+    zval *unmodified = zai_config_get_value(EXT_CFG_INI_FOO_STRING);
+    REQUIRE(Z_LVAL_P(zai_config_get_value(EXT_CFG_INI_FOO_INT)) == 1);
+
+    REQUIRE_SET_INI("zai_config.INI_FOO_INT", "2");
+
+    REQUIRE(Z_LVAL_P(zai_config_get_value(EXT_CFG_INI_FOO_INT)) == 2);
+    REQUIRE(zai_config_get_value(EXT_CFG_INI_FOO_STRING) == unmodified);
+    REQUIRE(zend_string_equals_literal(Z_STR_P(unmodified), "foo string"));
+
+    REQUEST_END()
+
+    REQUEST_BEGIN()
+
+    REQUIRE(Z_LVAL_P(zai_config_get_value(EXT_CFG_INI_FOO_INT)) == 1);
+
+    REQUEST_END()
+})
@@ -3,11 +3,7 @@
 #include <php.h>
 #include <zai_assert/zai_assert.h>
 
-zai_header_result zai_read_header(zai_string_view uppercase_header_name, zend_string **header_value) {
-    if (!zai_string_stuffed(uppercase_header_name) || !header_value) return ZAI_HEADER_ERROR;
-
-    zai_assert_is_upper(uppercase_header_name.ptr, "Header names must be uppercase.");
-
+static zai_header_result zai_server_vars(zend_array **server_vars) {
     if (!PG(modules_activated) && !PG(during_request_startup)) return ZAI_HEADER_NOT_READY;
 
     if (PG(auto_globals_jit)) {
@@ -28,6 +24,7 @@ zai_header_result zai_read_header(zai_string_view uppercase_header_name, zend_st
     if (Z_TYPE_P(server_var) != IS_ARRAY) {
         return ZAI_HEADER_NOT_READY;  // should be impossible to reach
     }
+    *server_vars = Z_ARR_P(server_var);
 
     // note that ext/filter stores a raw (unfiltered, unmangled) version of the headers in IF_G(server_array)
     // but ext/filter is an optional module, so we cannot rely on this. Thus we directly access the _SERVER track vars
@@ -35,6 +32,20 @@ zai_header_result zai_read_header(zai_string_view uppercase_header_name, zend_st
     // is a default filter configured via ini. This should not impact us, but if it turns out to, we may have to
     // optionally access filter globals in a best-effort attempt at getting the original raw headers.
 
+    return ZAI_HEADER_SUCCESS;
+}
+
+zai_header_result zai_read_header(zai_string_view uppercase_header_name, zend_string **header_value) {
+    if (!zai_string_stuffed(uppercase_header_name) || !header_value) return ZAI_HEADER_ERROR;
+
+    zai_assert_is_upper(uppercase_header_name.ptr, "Header names must be uppercase.");
+
+    zend_array *server_vars;
+    zai_header_result result = zai_server_vars(&server_vars);
+    if (result != ZAI_HEADER_SUCCESS) {
+        return result;
+    }
+
     // headers are present in HTTP_HEADERNAME from in the _SERVER array
     ALLOCA_FLAG(use_heap)
     zend_string *var_name;
@@ -44,7 +55,7 @@ zai_header_result zai_read_header(zai_string_view uppercase_header_name, zend_st
     memcpy(ZSTR_VAL(var_name) + 5, uppercase_header_name.ptr, uppercase_header_name.len);
     ZSTR_VAL(var_name)[var_len] = 0;
 
-    zval *header_zv = zend_hash_find(Z_ARR_P(server_var), var_name);
+    zval *header_zv = zend_hash_find(server_vars, var_name);
 
     ZSTR_ALLOCA_FREE(var_name, use_heap);
 
@@ -56,3 +67,27 @@ zai_header_result zai_read_header(zai_string_view uppercase_header_name, zend_st
 
     return ZAI_HEADER_SUCCESS;
 }
+
+zai_header_result zai_visit_headers(zai_header_visitor visitor, void *data) {
+    if (!visitor) return ZAI_HEADER_ERROR;
+
+    zend_array *server_vars;
+    zai_header_result result = zai_server_vars(&server_vars);
+    if (result != ZAI_HEADER_SUCCESS) {
+        return result;
+    }
+
+    zend_string *var_name;
+    zval *header_zv;
+    ZEND_HASH_FOREACH_STR_KEY_VAL(server_vars, var_name, header_zv) {
+        if (!var_name || ZSTR_LEN(var_name) <= sizeof("HTTP_") - 1 || Z_TYPE_P(header_zv) != IS_STRING
+            || memcmp(ZSTR_VAL(var_name), "HTTP_", sizeof("HTTP_") - 1) != 0) {
+            continue;
+        }
+
+        zai_string_view header_name = {ZSTR_LEN(var_name) - (sizeof("HTTP_") - 1), ZSTR_VAL(var_name) + sizeof("HTTP_") - 1};
+        visitor(header_name, Z_STR_P(header_zv), data);
+    } ZEND_HASH_FOREACH_END();
+
+    return ZAI_HEADER_SUCCESS;
+}
@@ -17,6 +17,12 @@ typedef enum {
 
 zai_header_result zai_read_header(zai_string_view uppercase_header_name, zend_string **header_value);
 
+/* Calls the visitor with the uppercase name (without HTTP_ prefix) and unowned value of every request header,
+ * allowing to classify many headers within a single pass rather than looking up each of them. */
+typedef void (*zai_header_visitor)(zai_string_view uppercase_header_name, zend_string *header_value, void *data);
+
+zai_header_result zai_visit_headers(zai_header_visitor visitor, void *data);
+
 #define zai_read_header_literal(uppercase_header_name, header_value) \
     zai_read_header(ZAI_STRL_VIEW(uppercase_header_name), header_value)
 
@@ -8,6 +8,7 @@ extern "C" {
 
 #include "tea/testing/catch2.hpp"
 #include <cstring>
+#include <string>
 
 static void define_server_value(zval *arr) {
     add_assoc_string(arr, "HTTP_MY_HEADER", (char *) "Datadog");
@@ -46,6 +47,33 @@ TEA_TEST_CASE("headers", "erroneous read_header input", {
     REQUIRE(zai_read_header_literal("abc", nullptr) == ZAI_HEADER_ERROR);
 })
 
+static void define_server_values(zval *arr) {
+    add_assoc_string(arr, "HTTP_MY_HEADER", (char *) "Datadog");
+    add_assoc_string(arr, "HTTP_OTHER_HEADER", (char *) "Tracer");
+    add_assoc_string(arr, "NOT_A_HEADER", (char *) "Ignored");
+    add_assoc_long(arr, "HTTP_NOT_A_STRING", 1);
+}
+
+static void visit_header(zai_string_view name, zend_string *value, void *data) {
+    std::string *visited = (std::string *) data;
+    visited->append(name.ptr, name.len).append("=").append(ZSTR_VAL(value), ZSTR_LEN(value)).append(";");
+}
+
+TEA_TEST_CASE_WITH_PROLOGUE("headers", "visiting all header values", {
+    tea_sapi_register_custom_server_variables = define_server_values;
+},{
+    std::string visited;
+    REQUIRE(zai_visit_headers(visit_header, &visited) == ZAI_HEADER_SUCCESS);
+    REQUIRE(visited.find("MY_HEADER=Datadog;") != std::string::npos);
+    REQUIRE(visited.find("OTHER_HEADER=Tracer;") != std::string::npos);
+    REQUIRE(visited.find("Ignored") == std::string::npos);
+    REQUIRE(visited.find("NOT_A_STRING") == std::string::npos);
+})
+
+TEA_TEST_CASE("headers", "erroneous visit_headers input", {
+    REQUIRE(zai_visit_headers(nullptr, nullptr) == ZAI_HEADER_ERROR);
+})
+
 /****************************** Access from RINIT *****************************/
 
 zai_header_result zai_rinit_last_res;
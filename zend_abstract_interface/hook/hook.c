@@ -43,6 +43,36 @@ typedef struct {
     size_t dynamic_offset;
 } zai_hook_info;
 
+/* {{{ resolution index
+        Most declared classes and functions are never hooked. Rather than probing the pending hook tables and the
+        function tables of all parents and interfaces for each declared symbol, we keep two tiny bloom filters:
+        one over the lowercased names having pending hooks, one over the class entries having resolved hooks.
+        Bits are only ever set during a request, false positives merely fall back to the regular lookups. */
+#define ZAI_HOOK_INDEX_BITS 4096
+#define ZAI_HOOK_INDEX_WORD_BITS (sizeof(zend_ulong) * 8)
+
+typedef struct {
+    zend_ulong bits[ZAI_HOOK_INDEX_BITS / ZAI_HOOK_INDEX_WORD_BITS];
+} zai_hook_index;
+
+static inline void zai_hook_index_set(zai_hook_index *index, zend_ulong hash) {
+    uint32_t first = hash & (ZAI_HOOK_INDEX_BITS - 1), second = (hash >> 12) & (ZAI_HOOK_INDEX_BITS - 1);
+    index->bits[first / ZAI_HOOK_INDEX_WORD_BITS] |= ((zend_ulong)1) << (first % ZAI_HOOK_INDEX_WORD_BITS);
+    index->bits[second / ZAI_HOOK_INDEX_WORD_BITS] |= ((zend_ulong)1) << (second % ZAI_HOOK_INDEX_WORD_BITS);
+}
+
+static inline bool zai_hook_index_test(const zai_hook_index *index, zend_ulong hash) {
+    uint32_t first = hash & (ZAI_HOOK_INDEX_BITS - 1), second = (hash >> 12) & (ZAI_HOOK_INDEX_BITS - 1);
+    return (index->bits[first / ZAI_HOOK_INDEX_WORD_BITS] & (((zend_ulong)1) << (first % ZAI_HOOK_INDEX_WORD_BITS)))
+        && (index->bits[second / ZAI_HOOK_INDEX_WORD_BITS] & (((zend_ulong)1) << (second % ZAI_HOOK_INDEX_WORD_BITS)));
+}
+
+static inline zend_ulong zai_hook_index_ptr_hash(const void *ptr) {
+    // class entries are at least 8 byte aligned, spread the remaining bits over the whole word
+    zend_ulong hash = ((zend_ulong)(uintptr_t)ptr >> 3) * (zend_ulong)0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 23);
+} /* }}} */
+
 /* {{{ private tables */
 ZEND_TLS struct {
     zend_ulong invocation;
@@ -55,6 +85,10 @@ ZEND_TLS struct {
     zai_hooks_entry request_files;
     // zai_hook_tls->inheritors is a map of class entries (interfaces and abstract classes) to a list of class entries
     HashTable inheritors;
+    // zai_hook_tls->name_index is a bloom filter over the keys of request_functions and request_classes
+    zai_hook_index name_index;
+    // zai_hook_tls->scope_index is a bloom filter over the class entries which own a resolved hooks entry
+    zai_hook_index scope_index;
 } *zai_hook_tls;
 
 // zai_hook_static is a simple array of persistently allocated zai_hook_t
@@ -64,6 +98,8 @@ static HashTable zai_hook_static;
 // zai_hook_resolved is a map op_array/internal_function -> array<zai_hook_t>
 // if indirect, then it's pointing to some hashtable in zai_hook_tls->request_functions/classes
 TSRM_TLS HashTable zai_hook_resolved;
+TSRM_TLS bool zai_hook_lightweight;
+TSRM_TLS uint32_t zai_hook_lightweight_skipped;
 
 // zai_hook_static_inheritors is a map of persistent class entries (interfaces and abstract classes) to a list of persistent class entries
 static HashTable zai_hook_static_inheritors;
@@ -73,6 +109,29 @@ typedef struct {
     zend_class_entry *inheritor[];
 } zai_hook_inheritor_list;
 
+// Inheritors are split between zai_hook_static_inheritors (linked at startup), zai_hook_immutable_inheritors (immutable classes
+// linked by any request of this worker) and zai_hook_tls->inheritors (linked during the request, all other classes).
+// The static and immutable ones are never copied into the request, iterate the request-local (newest) ones first.
+// Immutable inheritors are skipped unless they have been linked in this request too.
+#define ZAI_HOOK_FOREACH_INHERITOR(scope, inheritor) do { \
+    zend_ulong _ce_addr = ((zend_ulong)(scope)) << 3; \
+    zai_hook_inheritor_list *_inheritor_lists[3] = { \
+        zend_hash_index_find_ptr(&zai_hook_tls->inheritors, _ce_addr), \
+        ZAI_HOOK_IMMUTABLE_INHERITORS(_ce_addr), \
+        zend_hash_index_find_ptr(&zai_hook_static_inheritors, _ce_addr), \
+    }; \
+    for (int _list = 0; _list < 3; ++_list) { \
+        if (!_inheritor_lists[_list]) { \
+            continue; \
+        } \
+        for (size_t _i = _inheritor_lists[_list]->size; _i--;) { \
+            zend_class_entry *inheritor = _inheritor_lists[_list]->inheritor[_i]; \
+            if (_list == 1 && !ZAI_HOOK_IMMUTABLE_INHERITOR_IS_LINKED(inheritor)) { \
+                continue; \
+            }
+
+#define ZAI_HOOK_FOREACH_INHERITOR_END() } } } while (0)
+
 typedef struct {
     uint32_t ordered;
     uint32_t size;
@@ -80,10 +139,80 @@ typedef struct {
 } zai_function_location_entry;
 
 // zai_function_location_map maps from a filename to a possibly ordered array of values
-ZEND_TLS HashTable zai_function_location_map; /* }}} */
+ZEND_TLS HashTable zai_function_location_map;
+// zai_function_location_pending is a list of class entries whose methods are yet to be added to zai_function_location_map
+ZEND_TLS HashTable zai_function_location_pending;
+
+#if PHP_VERSION_ID >= 70400
+// Classes loaded from opcache shm are immutable and identical across requests, as long as opcache is not restarted.
+// zai_hook_immutable_classes is a persistent per-worker map from immutable class entries to whether any of their methods carries attributes,
+// zai_hook_immutable_inheritors holds their parents and interfaces, like zai_hook_tls->inheritors: a class seen by a previous request
+// is neither scanned nor registered again, so that linking it costs a single lookup.
+// A restart of opcache may reuse the memory of any class entry for another class, hence the maps are only valid for one opcache generation.
+typedef struct {
+    zend_long restarts;
+    zend_long last_restart_time;
+} zai_hook_opcache_generation;
+
+// whether the maps may be used in this request, determined on activation: usable (1) or not (0)
+ZEND_TLS int zai_hook_immutable_classes_state;
+ZEND_TLS zai_hook_opcache_generation zai_hook_immutable_classes_generation;
+
+// bound the memory used by the maps, e.g. when the workers keep loading new scripts
+#define ZAI_HOOK_IMMUTABLE_CLASSES_MAX 65536
+
+ZEND_TLS HashTable zai_hook_immutable_classes;
+ZEND_TLS HashTable zai_hook_immutable_inheritors;
+
+#define ZAI_HOOK_IMMUTABLE_INHERITORS(addr) \
+    (zai_hook_immutable_classes_state > 0 ? zend_hash_index_find_ptr(&zai_hook_immutable_inheritors, addr) : NULL)
+#define ZAI_HOOK_IMMUTABLE_INHERITOR_IS_LINKED(ce) zai_hook_immutable_class_is_linked(ce)
+
+// the immutable inheritors include classes which were only linked by previous requests
+static bool zai_hook_immutable_class_is_linked(zend_class_entry *ce) {
+    zend_string *lcname = zend_string_tolower(ce->name);
+    bool linked = zend_hash_find_ptr(EG(class_table), lcname) == ce;
+    zend_string_release(lcname);
+    return linked;
+}
+#else
+#define ZAI_HOOK_IMMUTABLE_INHERITORS(addr) NULL
+#define ZAI_HOOK_IMMUTABLE_INHERITOR_IS_LINKED(ce) true
+#endif
+/* }}} */
 
 #define ZAI_IS_SHARED_HOOK_PTR (IS_PTR+1)
 
+static inline void zai_hook_index_add_name(zend_string *lcname) {
+    zai_hook_index_set(&zai_hook_tls->name_index, zend_string_hash_val(lcname));
+}
+
+static inline bool zai_hook_index_has_name(zend_string *lcname) {
+    return zai_hook_index_test(&zai_hook_tls->name_index, zend_string_hash_val(lcname));
+}
+
+static inline void zai_hook_index_add_scope(zend_class_entry *ce) {
+    if (ce) {
+        zai_hook_index_set(&zai_hook_tls->scope_index, zai_hook_index_ptr_hash(ce));
+    }
+}
+
+// whether any ancestor or interface of ce may own hooks which need to be merged into the methods of ce
+static inline bool zai_hook_index_inherits_hooks(zend_class_entry *ce) {
+    // intermediate classes not overriding a hooked method are never indexed themselves, hence walk the whole chain
+    for (zend_class_entry *parent = ce->parent; parent; parent = parent->parent) {
+        if (zai_hook_index_test(&zai_hook_tls->scope_index, zai_hook_index_ptr_hash(parent))) {
+            return true;
+        }
+    }
+    for (uint32_t i = 0; i < ce->num_interfaces; ++i) {
+        if (zai_hook_index_test(&zai_hook_tls->scope_index, zai_hook_index_ptr_hash(ce->interfaces[i]))) {
+            return true;
+        }
+    }
+    return false;
+}
+
 #if PHP_VERSION_ID >= 80000
 static void zai_hook_on_update_empty(zend_function *func, bool remove) { (void)func, (void)remove; }
 void (*zai_hook_on_update)(zend_function *func, bool remove) = zai_hook_on_update_empty;
@@ -412,6 +541,7 @@ static inline zai_hooks_entry *zai_hook_resolved_ensure_hooks_entry(zend_functio
     }
 
     zai_hook_resolve_hooks_entry(hooks, resolved);
+    zai_hook_index_add_scope(ce ? ce : resolved->common.scope);
 
     return hooks;
 }
@@ -433,36 +563,26 @@ static inline void zai_hook_resolved_install_shared_hook(zai_hook_t *hook, zend_
 
 static inline void zai_hook_resolved_install_abstract_recursive(zai_hook_t *hook, zend_ulong index, zend_class_entry *scope) {
     // find implementers by searching through all inheritors, recursively, stopping upon finding a non-abstract implementation
-    zai_hook_inheritor_list *inheritors;
-    zend_ulong ce_addr = ((zend_ulong)scope) << 3;
-    if ((inheritors = zend_hash_index_find_ptr(&zai_hook_tls->inheritors, ce_addr))) {
-        for (size_t i = inheritors->size; i--;) {
-            zend_class_entry *inheritor = inheritors->inheritor[i];
-            zend_function *override = zend_hash_find_ptr(&inheritor->function_table, hook->function);
-            if (override) {
-                zai_hook_resolved_install_shared_hook(hook, index, override, inheritor);
-            }
-            if (!override || (override->common.fn_flags & ZEND_ACC_ABSTRACT) != 0) {
-                zai_hook_resolved_install_abstract_recursive(hook, index, inheritor);
-            }
+    ZAI_HOOK_FOREACH_INHERITOR(scope, inheritor) {
+        zend_function *override = zend_hash_find_ptr(&inheritor->function_table, hook->function);
+        if (override) {
+            zai_hook_resolved_install_shared_hook(hook, index, override, inheritor);
         }
-    }
+        if (!override || (override->common.fn_flags & ZEND_ACC_ABSTRACT) != 0) {
+            zai_hook_resolved_install_abstract_recursive(hook, index, inheritor);
+        }
+    } ZAI_HOOK_FOREACH_INHERITOR_END();
 }
 
 static inline void zai_hook_resolved_install_inherited_internal_function_recursive(zai_hook_t *hook, zend_ulong index, zend_class_entry *scope, zif_handler handler) {
     // find implementers by searching through all inheritors, recursively, stopping upon finding an explicit override
-    zai_hook_inheritor_list *inheritors;
-    zend_ulong ce_addr = ((zend_ulong)scope) << 3;
-    if ((inheritors = zend_hash_index_find_ptr(&zai_hook_tls->inheritors, ce_addr))) {
-        for (size_t i = inheritors->size; i--;) {
-            zend_class_entry *inheritor = inheritors->inheritor[i];
-            zend_function *child_function = zend_hash_find_ptr(&inheritor->function_table, hook->function);
-            if (child_function && !ZEND_USER_CODE(child_function->type) && child_function->internal_function.handler == handler) {
-                zai_hook_resolved_install_shared_hook(hook, index, child_function, inheritor);
-                zai_hook_resolved_install_inherited_internal_function_recursive(hook, index, inheritor, handler);
-            }
+    ZAI_HOOK_FOREACH_INHERITOR(scope, inheritor) {
+        zend_function *child_function = zend_hash_find_ptr(&inheritor->function_table, hook->function);
+        if (child_function && !ZEND_USER_CODE(child_function->type) && child_function->internal_function.handler == handler) {
+            zai_hook_resolved_install_shared_hook(hook, index, child_function, inheritor);
+            zai_hook_resolved_install_inherited_internal_function_recursive(hook, index, inheritor, handler);
         }
-    }
+    } ZAI_HOOK_FOREACH_INHERITOR_END();
 }
 
 static zend_long zai_hook_resolved_install(zai_hook_t *hook, zend_function *resolved, zend_class_entry *ce) {
@@ -493,6 +613,7 @@ static zend_long zai_hook_request_install(zai_hook_t *hook) {
     }
 
     HashTable *funcs;
+    zai_hook_index_add_name(hook->scope ? hook->scope : hook->function);
     if (hook->scope) {
         funcs = zend_hash_find_ptr(&zai_hook_tls->request_classes, hook->scope);
         if (!funcs) {
@@ -513,13 +634,12 @@ static zend_long zai_hook_request_install(zai_hook_t *hook) {
     return zai_hook_add_entry(hooks, hook);
 }
 
-static inline void zai_hook_register_inheritor(zend_class_entry *child, zend_class_entry *parent, bool persistent) {
+static inline void zai_hook_register_inheritor(HashTable *ht, zend_class_entry *child, zend_class_entry *parent, bool persistent) {
     const size_t min_size = 7;
 
     zend_ulong addr = ((zend_ulong)parent) << 3;
     zai_hook_inheritor_list *inheritors;
     zval *inheritors_zv;
-    HashTable *ht = persistent ? &zai_hook_static_inheritors : &zai_hook_tls->inheritors;
     if (!(inheritors_zv = zend_hash_index_find(ht, addr))) {
         inheritors = pemalloc(sizeof(zai_hook_inheritor_list) + sizeof(zend_class_entry *) * min_size, persistent);
         zend_hash_index_add_new_ptr(ht, addr, inheritors);
@@ -535,12 +655,12 @@ static inline void zai_hook_register_inheritor(zend_class_entry *child, zend_cla
     inheritors->inheritor[inheritors->size - 1] = child;
 }
 
-static inline void zai_hook_register_all_inheritors(zend_class_entry *ce, bool persistent) {
+static inline void zai_hook_register_all_inheritors(HashTable *ht, zend_class_entry *ce, bool persistent) {
     if (ce->parent) {
-        zai_hook_register_inheritor(ce, ce->parent, persistent);
+        zai_hook_register_inheritor(ht, ce, ce->parent, persistent);
     }
     for (uint32_t i = 0; i < ce->num_interfaces; ++i) {
-        zai_hook_register_inheritor(ce, ce->interfaces[i], persistent);
+        zai_hook_register_inheritor(ht, ce, ce->interfaces[i], persistent);
     }
 }
 
@@ -555,9 +675,8 @@ static inline void zai_hook_merge_inherited_hooks(zai_hooks_entry **hooks_entry,
 #if PHP_VERSION_ID >= 80200
             // Internal functions duplicated onto userland classes share their run_time_cache with their parent function
             zai_hook_handle_internal_duplicate_function(hooks, ce, function);
-#else
-            (void)ce;
 #endif
+            zai_hook_index_add_scope(ce);
         }
 
         zval *hook_zv;
@@ -622,6 +741,22 @@ static inline void zai_store_func_location(zend_function *func) {
     entry->functions[entry->size - 1] = func;
 }
 
+static inline void zai_store_class_location(zend_class_entry *ce) {
+    // methods are only added to the location map once a containing function is actually looked up
+    zend_hash_next_index_insert_ptr(&zai_function_location_pending, ce);
+}
+
+static void zai_flush_pending_locations(void) {
+    zend_class_entry *ce;
+    ZEND_HASH_FOREACH_PTR(&zai_function_location_pending, ce) {
+        zend_function *function;
+        ZEND_HASH_FOREACH_PTR(&ce->function_table, function) {
+            zai_store_func_location(function);
+        } ZEND_HASH_FOREACH_END();
+    } ZEND_HASH_FOREACH_END();
+    zend_hash_clean(&zai_function_location_pending);
+}
+
 static int zai_function_location_map_cmp(const void *a, const void *b) {
     return (int)(*(zend_op_array **)a)->line_start - (int)(*(zend_op_array **)b)->line_start;
 }
@@ -631,6 +766,10 @@ zend_function *zai_hook_find_containing_function(zend_function *func) {
         return NULL;
     }
 
+    if (zend_hash_num_elements(&zai_function_location_pending)) {
+        zai_flush_pending_locations();
+    }
+
     zai_function_location_entry *entry;
     if (!(entry = zend_hash_find_ptr(&zai_function_location_map, func->op_array.filename))) {
         return NULL;
@@ -665,8 +804,10 @@ zend_function *zai_hook_find_containing_function(zend_function *func) {
 }
 
 static inline void zai_hook_resolve(HashTable *base_ht, zend_class_entry *ce, zend_function *function, zend_string *lcname) {
-    zai_hooks_entry *hooks;
-    if ((hooks = zend_hash_find_ptr(base_ht, lcname))) {
+    zai_hooks_entry *hooks = NULL;
+    if ((ce || zai_hook_index_has_name(lcname)) && (hooks = zend_hash_find_ptr(base_ht, lcname))) {
+        zai_hook_index_add_scope(ce);
+
         bool is_abstract = (function->common.fn_flags & ZEND_ACC_ABSTRACT) != 0;
         // We do not support tracing abstract trait methods for now.
         // At least symmetric support (i.e. supporting after renames for example) is hard.
@@ -717,7 +858,9 @@ static inline void zai_hook_resolve(HashTable *base_ht, zend_class_entry *ce, ze
     if (function->common.scope == ce || !ZEND_USER_CODE(function->type)) {
         zai_hook_resolve_lookup_inherited(hooks, ce, function, lcname);
 #if PHP_VERSION_ID >= 80000
-        zai_hook_on_function_resolve(function);
+        if (function->common.attributes) {
+            zai_hook_on_function_resolve(function);
+        }
 #endif
     }
 }
@@ -728,20 +871,156 @@ void zai_hook_resolve_function(zend_function *function, zend_string *lcname) {
     zai_store_func_location(function);
 }
 
+#if PHP_VERSION_ID >= 80000
+static inline bool zai_hook_function_has_attributes(zend_function *function, zend_class_entry *ce) {
+    return (function->common.scope == ce || !ZEND_USER_CODE(function->type)) && function->common.attributes;
+}
+#endif
+
+#if PHP_VERSION_ID >= 70400
+static zend_long zai_hook_opcache_status_long(HashTable *ht, const char *key, size_t key_len) {
+    zval *zv = zend_hash_str_find(ht, key, key_len);
+    return zv && Z_TYPE_P(zv) == IS_LONG ? Z_LVAL_P(zv) : 0;
+}
+
+// fetches the opcache restart state, returns false if it is unavailable or a restart is yet to complete
+// only called on activation, where calling into opcache is safe, as opposed to the middle of linking or compiling a class
+static bool zai_hook_opcache_generation_fetch(zai_hook_opcache_generation *generation) {
+    if (!zend_hash_str_exists(CG(function_table), ZEND_STRL("opcache_get_status"))) {
+        return false;
+    }
+
+    // with a restricted api, opcache_get_status() warns unless the requested script is within the allowed path
+    char *restrict_api = zend_ini_string_ex(ZEND_STRL("opcache.restrict_api"), 0, NULL);
+    if (restrict_api && *restrict_api) {
+        const char *path = SG(request_info).path_translated;
+        if (!path || strncmp(path, restrict_api, strlen(restrict_api)) != 0) {
+            return false;
+        }
+    }
+
+    zval fname, retval, include_scripts;
+    ZVAL_STRINGL(&fname, "opcache_get_status", sizeof("opcache_get_status") - 1);
+    ZVAL_FALSE(&include_scripts);
+    ZVAL_UNDEF(&retval);
+    bool ok = call_user_function(CG(function_table), NULL, &fname, &retval, 1, &include_scripts) == SUCCESS
+              && Z_TYPE(retval) == IS_ARRAY;
+    zval_ptr_dtor(&fname);
+
+    if (ok) {
+        zval *pending = zend_hash_str_find(Z_ARR(retval), ZEND_STRL("restart_pending"));
+        zval *in_progress = zend_hash_str_find(Z_ARR(retval), ZEND_STRL("restart_in_progress"));
+        zval *stats = zend_hash_str_find(Z_ARR(retval), ZEND_STRL("opcache_statistics"));
+        if ((pending && zend_is_true(pending)) || (in_progress && zend_is_true(in_progress)) || !stats || Z_TYPE_P(stats) != IS_ARRAY) {
+            ok = false;
+        } else {
+            // restart counters are incremented when a restart is scheduled, the time is updated once it happened
+            generation->restarts = zai_hook_opcache_status_long(Z_ARR_P(stats), ZEND_STRL("oom_restarts"))
+                                   + zai_hook_opcache_status_long(Z_ARR_P(stats), ZEND_STRL("hash_restarts"))
+                                   + zai_hook_opcache_status_long(Z_ARR_P(stats), ZEND_STRL("manual_restarts"));
+            generation->last_restart_time = zai_hook_opcache_status_long(Z_ARR_P(stats), ZEND_STRL("last_restart_time"));
+        }
+    }
+    zval_ptr_dtor(&retval);
+
+    return ok;
+}
+
+static void zai_hook_immutable_classes_clean(void) {
+    zend_hash_clean(&zai_hook_immutable_classes);
+    zend_hash_clean(&zai_hook_immutable_inheritors);
+}
+
+static void zai_hook_immutable_classes_activate(void) {
+    zai_hook_opcache_generation generation;
+    if (!zai_hook_opcache_generation_fetch(&generation)) {
+        zai_hook_immutable_classes_clean();
+        zai_hook_immutable_classes_state = 0;
+        return;
+    }
+
+    if (generation.restarts != zai_hook_immutable_classes_generation.restarts
+        || generation.last_restart_time != zai_hook_immutable_classes_generation.last_restart_time
+        || zend_hash_num_elements(&zai_hook_immutable_classes) >= ZAI_HOOK_IMMUTABLE_CLASSES_MAX) {
+        zai_hook_immutable_classes_clean();
+        zai_hook_immutable_classes_generation = generation;
+    }
+    zai_hook_immutable_classes_state = 1;
+}
+
+// registers the inheritors of an immutable class and returns whether any of its methods needs to be passed to
+// zai_hook_on_function_resolve, doing both only once per worker; returns false if the class has to be handled per request
+static bool zai_hook_immutable_class_lookup(zend_class_entry *ce, bool *has_attributes) {
+    zend_ulong addr = ((zend_ulong)ce) << 3;
+    zval *cached;
+    if ((cached = zend_hash_index_find(&zai_hook_immutable_classes, addr))) {
+        *has_attributes = Z_TYPE_P(cached) == IS_TRUE;
+        return true;
+    }
+    // not cleaned before the next activation, as the inheritors registered so far are in use
+    if (zend_hash_num_elements(&zai_hook_immutable_classes) >= ZAI_HOOK_IMMUTABLE_CLASSES_MAX) {
+        return false;
+    }
+
+    *has_attributes = false;
+#if PHP_VERSION_ID >= 80000
+    zend_function *function;
+    ZEND_HASH_FOREACH_PTR(&ce->function_table, function) {
+        if (zai_hook_function_has_attributes(function, ce)) {
+            *has_attributes = true;
+            break;
+        }
+    } ZEND_HASH_FOREACH_END();
+#endif
+
+    zai_hook_register_all_inheritors(&zai_hook_immutable_inheritors, ce, true);
+
+    zval zv;
+    ZVAL_BOOL(&zv, *has_attributes);
+    zend_hash_index_add_new(&zai_hook_immutable_classes, addr, &zv);
+    return true;
+}
+#endif
+
 void zai_hook_resolve_class(zend_class_entry *ce, zend_string *lcname) {
     zend_function *function;
 
-    zai_hook_register_all_inheritors(ce, false);
+#if PHP_VERSION_ID >= 70400
+    bool has_attributes = true;
+    bool immutable = (ce->ce_flags & ZEND_ACC_IMMUTABLE) && zai_hook_immutable_classes_state > 0
+                     && zai_hook_immutable_class_lookup(ce, &has_attributes);
+    if (!immutable)
+#endif
+    {
+        zai_hook_register_all_inheritors(&zai_hook_tls->inheritors, ce, false);
+    }
+    if (ce->type == ZEND_USER_CLASS) {
+        zai_store_class_location(ce);
+    }
 
     zend_string *fnname;
-    HashTable *method_table = zend_hash_find_ptr(&zai_hook_tls->request_classes, lcname);
+    HashTable *method_table = NULL;
+    if (zai_hook_index_has_name(lcname)) {
+        method_table = zend_hash_find_ptr(&zai_hook_tls->request_classes, lcname);
+    }
     if (!method_table) {
+        // skip the per-method prototype lookups if no parent or interface may carry hooks
+        bool inherits_hooks = zai_hook_index_inherits_hooks(ce);
+#if PHP_VERSION_ID >= 70400
+        // neither hooks nor attributes to resolve: nothing to do for this class
+        if (!inherits_hooks && immutable && !has_attributes) {
+            return;
+        }
+#endif
         ZEND_HASH_FOREACH_STR_KEY_PTR(&ce->function_table, fnname, function) {
-            zai_store_func_location(function);
             if (function->common.scope == ce || !ZEND_USER_CODE(function->type)) {
-                zai_hook_resolve_lookup_inherited(NULL, ce, function, fnname);
+                if (inherits_hooks) {
+                    zai_hook_resolve_lookup_inherited(NULL, ce, function, fnname);
+                }
 #if PHP_VERSION_ID >= 80000
-                zai_hook_on_function_resolve(function);
+                if (function->common.attributes) {
+                    zai_hook_on_function_resolve(function);
+                }
 #endif
             }
         } ZEND_HASH_FOREACH_END();
@@ -750,7 +1029,6 @@ void zai_hook_resolve_class(zend_class_entry *ce, zend_string *lcname) {
 
     ZEND_HASH_FOREACH_STR_KEY_PTR(&ce->function_table, fnname, function) {
         zai_hook_resolve(method_table, ce, function, fnname);
-        zai_store_func_location(function);
     } ZEND_HASH_FOREACH_END();
 
     if (zend_hash_num_elements(method_table) == 0) {
@@ -794,36 +1072,26 @@ static inline void zai_hook_remove_shared_hook(zend_function *func, zend_ulong h
 
 static void zai_hook_remove_abstract_recursive(zai_hooks_entry *base_hooks, zend_class_entry *scope, zend_string *function_name, zend_ulong hook_id) {
     // find implementers by searching through all inheritors, recursively, stopping upon finding a non-abstract implementation
-    zai_hook_inheritor_list *inheritors;
-    zend_ulong ce_addr = ((zend_ulong)scope) << 3;
-    if ((inheritors = zend_hash_index_find_ptr(&zai_hook_tls->inheritors, ce_addr))) {
-        for (size_t i = inheritors->size; i--;) {
-            zend_class_entry *inheritor = inheritors->inheritor[i];
-            zend_function *override = zend_hash_find_ptr(&inheritor->function_table, function_name);
-            if (override) {
-                zai_hook_remove_shared_hook(override, hook_id, base_hooks);
-            }
-            if (!override || (override->common.fn_flags & ZEND_ACC_ABSTRACT) != 0) {
-                zai_hook_remove_abstract_recursive(base_hooks, inheritor, function_name, hook_id);
-            }
+    ZAI_HOOK_FOREACH_INHERITOR(scope, inheritor) {
+        zend_function *override = zend_hash_find_ptr(&inheritor->function_table, function_name);
+        if (override) {
+            zai_hook_remove_shared_hook(override, hook_id, base_hooks);
         }
-    }
+        if (!override || (override->common.fn_flags & ZEND_ACC_ABSTRACT) != 0) {
+            zai_hook_remove_abstract_recursive(base_hooks, inheritor, function_name, hook_id);
+        }
+    } ZAI_HOOK_FOREACH_INHERITOR_END();
 }
 
 static void zai_hook_remove_internal_inherited_recursive(zend_class_entry *scope, zend_string *function_name, zend_ulong hook_id, zif_handler handler) {
     // find implementers by searching through all inheritors, recursively, stopping upon finding an explicit override
-    zai_hook_inheritor_list *inheritors;
-    zend_ulong ce_addr = ((zend_ulong)scope) << 3;
-    if ((inheritors = zend_hash_index_find_ptr(&zai_hook_tls->inheritors, ce_addr))) {
-        for (size_t i = inheritors->size; i--;) {
-            zend_class_entry *inheritor = inheritors->inheritor[i];
-            zend_function *child_function = zend_hash_find_ptr(&inheritor->function_table, function_name);
-            if (child_function && !ZEND_USER_CODE(child_function->type) && child_function->internal_function.handler == handler) {
-                zai_hook_remove_shared_hook(child_function, hook_id, NULL);
-                zai_hook_remove_internal_inherited_recursive(inheritor, function_name, hook_id, handler);
-            }
+    ZAI_HOOK_FOREACH_INHERITOR(scope, inheritor) {
+        zend_function *child_function = zend_hash_find_ptr(&inheritor->function_table, function_name);
+        if (child_function && !ZEND_USER_CODE(child_function->type) && child_function->internal_function.handler == handler) {
+            zai_hook_remove_shared_hook(child_function, hook_id, NULL);
+            zai_hook_remove_internal_inherited_recursive(inheritor, function_name, hook_id, handler);
         }
-    }
+    } ZAI_HOOK_FOREACH_INHERITOR_END();
 }
 
 static bool zai_hook_remove_from_entry(zai_hooks_entry *hooks, zend_ulong index) {
@@ -889,6 +1157,11 @@ zai_hook_continued zai_hook_continue(zend_execute_data *ex, zai_hook_memory_t *m
             }
         }
 
+        if (UNEXPECTED(zai_hook_lightweight) && hook->aux.lightweight_skip) {
+            ++zai_hook_lightweight_skipped;
+            continue;
+        }
+
         // increase dynamic memory if new hooks get added during iteration
         if (UNEXPECTED(dynamic_offset + hook->dynamic > dynamic_size || allocated_hook_count <= hook_num)) {
             for (uint32_t i = 0; i < hook_num; ++i) {
@@ -1024,6 +1297,10 @@ bool zai_hook_minit(void) {
 
 bool zai_hook_ginit(void) {
     zai_hook_tls = calloc(1, sizeof(*zai_hook_tls));
+#if PHP_VERSION_ID >= 70400
+    zend_hash_init(&zai_hook_immutable_classes, 8, NULL, NULL, 1);
+    zend_hash_init(&zai_hook_immutable_inheritors, 8, NULL, zai_hook_static_inheritors_destroy, 1);
+#endif
     return true;
 }
 
@@ -1034,31 +1311,18 @@ bool zai_hook_rinit(void) {
     zend_hash_init(&zai_hook_tls->request_classes, 8, NULL, zai_hook_hash_destroy, 0);
     zend_hash_init(&zai_hook_resolved, 8, NULL, NULL, 0);
     zend_hash_init(&zai_function_location_map, 8, NULL, zai_function_location_destroy, 0);
+    zend_hash_init(&zai_function_location_pending, 8, NULL, NULL, 0);
+    memset(&zai_hook_tls->name_index, 0, sizeof(zai_hook_tls->name_index));
+    memset(&zai_hook_tls->scope_index, 0, sizeof(zai_hook_tls->scope_index));
+#if PHP_VERSION_ID >= 70400
+    zai_hook_immutable_classes_state = 0;  // until activation
+#endif
+    zai_hook_lightweight = false;
+    zai_hook_lightweight_skipped = 0;
 
     // reserve low hook ids for static hooks
     zai_hook_tls->id = (zend_ulong)zai_hook_static.nNextFreeElement;
 
-    zend_ulong index;
-    zai_hook_inheritor_list *inheritors;
-    ZEND_HASH_FOREACH_NUM_KEY_PTR(&zai_hook_static_inheritors, index, inheritors) {
-        // round to nearest power of two minus 1
-        size_t size = inheritors->size;
-        if (size < 7) {
-            size = 7;
-        } else {
-            size |= size >> 1;
-            size |= size >> 2;
-            size |= size >> 4;
-            size |= size >> 8;
-            size |= size >> 16;
-            size |= size >> 32;
-        }
-
-        zai_hook_inheritor_list *copy = emalloc(sizeof(zai_hook_inheritor_list) + size * sizeof(zend_class_entry *));
-        memcpy(copy, inheritors, sizeof(zai_hook_inheritor_list) + inheritors->size * sizeof(zend_class_entry *));
-        zend_hash_index_add_new_ptr(&zai_hook_tls->inheritors, index, copy);
-    } ZEND_HASH_FOREACH_END();
-
     return true;
 }
 
@@ -1070,12 +1334,16 @@ void zai_hook_post_startup(void) {
         if (ce->ce_flags & ZEND_ACC_LINKED)
 #endif
         {
-            zai_hook_register_all_inheritors(ce, true);
+            zai_hook_register_all_inheritors(&zai_hook_static_inheritors, ce, true);
         }
     } ZEND_HASH_FOREACH_END();
 }
 
 void zai_hook_activate(void) {
+#if PHP_VERSION_ID >= 70400
+    zai_hook_immutable_classes_activate();
+#endif
+
     zend_ulong current_hook_id = zai_hook_tls->id;
     zai_hook_tls->id = 0;
 
@@ -1108,10 +1376,17 @@ void zai_hook_rshutdown(void) {
         zend_hash_destroy(&zai_hook_tls->request_classes);
         zend_hash_destroy(&zai_hook_tls->request_files.hooks);
         zend_hash_destroy(&zai_function_location_map);
+        zend_hash_destroy(&zai_function_location_pending);
     }
 }
 
-void zai_hook_gshutdown(void) { free(zai_hook_tls); }
+void zai_hook_gshutdown(void) {
+#if PHP_VERSION_ID >= 70400
+    zend_hash_destroy(&zai_hook_immutable_classes);
+    zend_hash_destroy(&zai_hook_immutable_inheritors);
+#endif
+    free(zai_hook_tls);
+}
 
 void zai_hook_mshutdown(void) { zend_hash_destroy(&zai_hook_static); } /* }}} */
 
@@ -1262,6 +1537,7 @@ void zai_hook_clean(void) {
     zai_hook_tls->request_files.dynamic = 0;
 
     zend_hash_clean(&zai_function_location_map);
+    zend_hash_clean(&zai_function_location_pending);
 }
 
 static void zai_hook_iterator_set_current_and_advance(zai_hook_iterator *it) {
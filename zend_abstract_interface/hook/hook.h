@@ -25,10 +25,12 @@ typedef void (*zai_hook_generator_yield)(zend_ulong invocation, zend_execute_dat
 typedef struct {
     void *data;
     void (*dtor)(void *data);
+    bool lightweight_skip; // not run at all while zai_hook_lightweight is set
 } zai_hook_aux; /* }}} */
 
 /* {{{ zai_hook_aux ZAI_HOOK_AUX(void *pointer, void (*destructor)(void *pointer)) */
 #define ZAI_HOOK_AUX(pointer, destructor) (zai_hook_aux){ .data = (pointer), .dtor = (destructor) }
+#define ZAI_HOOK_AUX_LIGHTWEIGHT_SKIP(pointer, destructor) (zai_hook_aux){ .data = (pointer), .dtor = (destructor), .lightweight_skip = true }
 #define ZAI_HOOK_AUX_UNUSED ZAI_HOOK_AUX(NULL, NULL)
 /* }}} */
 
@@ -94,13 +96,20 @@ void zai_hook_resolve_file(zend_op_array *op_array);
 /* cleanup function to avoid memory leaking */
 void zai_hook_unresolve_op_array(zend_op_array *op_array);
 
+/* {{{ zai_hook_lightweight is set for the remainder of a request whose data is known to be discarded: zai_hook_continue
+        then skips the hooks installed with ZAI_HOOK_AUX_LIGHTWEIGHT_SKIP and only counts them in zai_hook_lightweight_skipped.
+        Other hooks still run and may check the flag themselves. Both are reset on rinit. */
+extern TSRM_TLS bool zai_hook_lightweight;
+extern TSRM_TLS uint32_t zai_hook_lightweight_skipped; /* }}} */
+
 /* {{{ private but externed for performance reasons */
 extern TSRM_TLS HashTable zai_hook_resolved;
 /* }}} */
 
 #if PHP_VERSION_ID >= 80000
 extern void (*zai_hook_on_update)(zend_function *func, bool remove);
-extern void (*zai_hook_on_function_resolve)(zend_function *func);
+/* {{{ zai_hook_on_function_resolve is only invoked for resolved functions carrying attributes */
+extern void (*zai_hook_on_function_resolve)(zend_function *func); /* }}} */
 #endif
 
 zend_function *zai_hook_find_containing_function(zend_function *func);
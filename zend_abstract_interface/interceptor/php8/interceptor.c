@@ -40,6 +40,63 @@ static inline bool zai_hook_memory_table_del(zend_execute_data *index) {
     return zend_hash_index_del(&zai_hook_memory, ((zend_ulong)index) >> 4);
 }
 
+// Generators are looked up on every resumption and yield, and along each yield from chain. Their frame memory lives inline in
+// a side table indexed by the object handle, which is unique among live objects and dense: a lookup is an array access and
+// a slot is reused by later generators, instead of hashing and allocating per generator.
+// Slots are allocated in pages which are never moved, frame memory pointers stay valid while hooks run and create generators.
+#define ZAI_GENERATOR_MEMORY_PAGE_SHIFT 8
+#define ZAI_GENERATOR_MEMORY_PAGE_SIZE (1 << ZAI_GENERATOR_MEMORY_PAGE_SHIFT)
+
+typedef struct {
+    zend_generator *generator;
+    zai_frame_memory frame_memory;
+} zai_generator_memory_slot;
+
+ZEND_TLS zai_generator_memory_slot **zai_generator_memory_pages;
+ZEND_TLS uint32_t zai_generator_memory_page_count;
+
+static inline zai_generator_memory_slot *zai_generator_memory_slot_get(zend_generator *generator) {
+    uint32_t page = generator->std.handle >> ZAI_GENERATOR_MEMORY_PAGE_SHIFT;
+    if (page >= zai_generator_memory_page_count || !zai_generator_memory_pages[page]) {
+        return NULL;
+    }
+    return &zai_generator_memory_pages[page][generator->std.handle & (ZAI_GENERATOR_MEMORY_PAGE_SIZE - 1)];
+}
+
+static inline void zai_generator_memory_insert(zend_generator *generator, zai_frame_memory *inserting) {
+    uint32_t page = generator->std.handle >> ZAI_GENERATOR_MEMORY_PAGE_SHIFT;
+    if (page >= zai_generator_memory_page_count) {
+        uint32_t page_count = MAX(page + 1, zai_generator_memory_page_count * 2);
+        zai_generator_memory_pages = erealloc(zai_generator_memory_pages, page_count * sizeof(*zai_generator_memory_pages));
+        memset(zai_generator_memory_pages + zai_generator_memory_page_count, 0, (page_count - zai_generator_memory_page_count) * sizeof(*zai_generator_memory_pages));
+        zai_generator_memory_page_count = page_count;
+    }
+    if (!zai_generator_memory_pages[page]) {
+        zai_generator_memory_pages[page] = ecalloc(ZAI_GENERATOR_MEMORY_PAGE_SIZE, sizeof(zai_generator_memory_slot));
+    }
+
+    zai_generator_memory_slot *slot = &zai_generator_memory_pages[page][generator->std.handle & (ZAI_GENERATOR_MEMORY_PAGE_SIZE - 1)];
+    slot->generator = generator;
+    slot->frame_memory = *inserting;
+}
+
+static inline bool zai_generator_memory_find(zend_generator *generator, zai_frame_memory **found) {
+    zai_generator_memory_slot *slot = zai_generator_memory_slot_get(generator);
+    // the slot may still be occupied by a generator whose handle was freed without running its destructor
+    if (slot && slot->generator == generator) {
+        *found = &slot->frame_memory;
+        return true;
+    }
+    return false;
+}
+
+static inline void zai_generator_memory_del(zend_generator *generator) {
+    zai_generator_memory_slot *slot = zai_generator_memory_slot_get(generator);
+    if (slot && slot->generator == generator) {
+        slot->generator = NULL;
+    }
+}
+
 #if defined(__x86_64__) || defined(__aarch64__)
 # if defined(__GNUC__) && !defined(__clang__)
 __attribute__((no_sanitize_address))
@@ -174,17 +231,26 @@ static void zai_interceptor_generator_yielded(zend_execute_data *ex, zval *key,
             }
             generator = leaf;
         }
-    } while (zai_hook_memory_table_find((zend_execute_data *)generator, &frame_memory));
+    } while (zai_generator_memory_find(generator, &frame_memory));
 }
 
 static void zai_interceptor_generator_resumption(zend_execute_data *ex, zval *sent, zai_frame_memory *frame_memory) {
     zend_generator *generator = (zend_generator *)ex->return_value;
+    // fast path: the generator is not part of any yield from chain, no need to look up other generators
+    if (!generator->node.parent && generator->node.children == 0) {
+        if (!frame_memory->implicit && !frame_memory->resumed) {
+            frame_memory->resumed = true;
+            zai_hook_generator_resumption(generator->execute_data, sent, &frame_memory->hook_data);
+        }
+        return;
+    }
+
     if (generator->node.ptr.leaf) {
         generator = generator->node.ptr.leaf;
     }
     // resumptions occur from outside to inside
     do {
-        if (zai_hook_memory_table_find((zend_execute_data *)generator, &frame_memory) && !frame_memory->implicit && !frame_memory->resumed) {
+        if (zai_generator_memory_find(generator, &frame_memory) && !frame_memory->implicit && !frame_memory->resumed) {
             frame_memory->resumed = true;
             zai_hook_generator_resumption(generator->execute_data, sent, &frame_memory->hook_data);
         }
@@ -195,7 +261,7 @@ static void zai_interceptor_observer_generator_resumption_handler(zend_execute_d
     zend_generator *generator = (zend_generator *)execute_data->return_value;
 
     zai_frame_memory *frame_memory;
-    if (zai_hook_memory_table_find((zend_execute_data *)generator, &frame_memory)) {
+    if (zai_generator_memory_find(generator, &frame_memory)) {
         zval *received = !EG(exception) && generator->send_target ? generator->send_target : &EG(uninitialized_zval);
         zai_interceptor_generator_resumption(execute_data, received, frame_memory);
     }
@@ -338,7 +404,7 @@ static void zai_interceptor_observer_generator_yield(zend_execute_data *ex, zval
                     zval one;
                     ZVAL_LONG(&one, 1);
                     zend_hash_index_add(&zai_interceptor_implicit_generators, genaddr, &one);
-                } else if (zai_hook_memory_table_find((zend_execute_data *)generator, &frame_memory)) {
+                } else if (zai_generator_memory_find(generator, &frame_memory)) {
                     break;
                 } else {
                     ++Z_LVAL_P(count);
@@ -347,7 +413,7 @@ static void zai_interceptor_observer_generator_yield(zend_execute_data *ex, zval
                 generator_memory.implicit = true;
                 generator_memory.resumed = false;
                 generator_memory.ex = generator->execute_data;
-                zai_hook_memory_table_insert((zend_execute_data *)generator, &generator_memory);
+                zai_generator_memory_insert(generator, &generator_memory);
                 generator = generator->node.parent;
                 if (!generator) {
                     break;
@@ -387,14 +453,14 @@ static void zai_interceptor_handle_ended_generator(zend_generator *generator, ze
     } else {
         zai_hook_safe_finish(ex, retval, frame_memory);
     }
-    zai_hook_memory_table_del((zend_execute_data *)generator);
+    zai_generator_memory_del(generator);
 }
 
 static void zai_interceptor_observer_generator_end_handler(zend_execute_data *execute_data, zval *retval) {
     zend_generator *generator = (zend_generator *)execute_data->return_value;
 
     zai_frame_memory *frame_memory;
-    if (zai_hook_memory_table_find((zend_execute_data *)generator, &frame_memory)) {
+    if (zai_generator_memory_find(generator, &frame_memory)) {
         if (!EG(exception) && Z_ISUNDEF(generator->retval)) {
             zai_interceptor_observer_generator_yield(execute_data, retval, generator, frame_memory);
         } else {
@@ -659,7 +725,7 @@ static zend_object *zai_interceptor_generator_create(zend_class_entry *class_typ
             frame_memory.resumed = false;
             frame_memory.implicit = false;
             frame_memory.ex = execute_data;
-            zai_hook_memory_table_insert((zend_execute_data *) generator, &frame_memory);
+            zai_generator_memory_insert(generator, &frame_memory);
         }
     }
 
@@ -671,14 +737,14 @@ static void zai_interceptor_generator_dtor_wrapper(zend_object *object) {
     zend_generator *generator = (zend_generator *)object;
 
     zai_frame_memory *frame_memory;
-    if (zai_hook_memory_table_find((zend_execute_data *)generator, &frame_memory)) {
+    if (zai_generator_memory_find(generator, &frame_memory)) {
         // generator dtor frees it
         zend_execute_data ex = *generator->execute_data;
 
         zai_interceptor_generator_dtor_obj(object);
 
         // may have returned in the dtor, don't execute twice
-        if (zai_hook_memory_table_find((zend_execute_data *)generator, &frame_memory)) {
+        if (zai_generator_memory_find(generator, &frame_memory)) {
             // aborted generator
             zval retval;
             ZVAL_NULL(&retval);
@@ -714,17 +780,15 @@ static inline void zai_interceptor_execute_internal_impl(zend_execute_data *exec
             zai_frame_memory *frame;
             ZEND_HASH_REVERSE_FOREACH_PTR(&zai_hook_memory, frame) {
                 // TODO: fibers. We probably need a hashtable _per fiber_?
+                // generators are not in this table, they are freed separately, upon their normal destruction
                 zend_execute_data *frame_ex = frame->ex;
-                if (!(frame_ex->func->common.fn_flags & ZEND_ACC_GENERATOR)) {
-                    // generators are freed separately, upon their normal destruction
-                    // avoid confusing the observers: prev_execute_data is set to current_execute_data which otherwise may be NULL in zai symbol calls
-                    EG(current_execute_data) = execute_data;
-                    zai_hook_safe_finish(execute_data, &EG(uninitialized_zval), frame);
-                    zai_hook_memory_table_del(execute_data);
-
-                    if (frame_ex == execute_data) {
-                        break;
-                    }
+                // avoid confusing the observers: prev_execute_data is set to current_execute_data which otherwise may be NULL in zai symbol calls
+                EG(current_execute_data) = execute_data;
+                zai_hook_safe_finish(execute_data, &EG(uninitialized_zval), frame);
+                zai_hook_memory_table_del(execute_data);
+
+                if (frame_ex == execute_data) {
+                    break;
                 }
             } ZEND_HASH_FOREACH_END();
 
@@ -835,6 +899,8 @@ void zai_interceptor_reset_resolver(void);
 void zai_interceptor_activate(void) {
     zend_hash_init(&zai_hook_memory, 8, nothing, zai_hook_memory_dtor, 0);
     zend_hash_init(&zai_interceptor_implicit_generators, 8, nothing, NULL, 0);
+    zai_generator_memory_pages = NULL;
+    zai_generator_memory_page_count = 0;
 
 #if PHP_VERSION_ID < 80200
     zai_interceptor_reset_resolver();
@@ -844,4 +910,15 @@ void zai_interceptor_activate(void) {
 void zai_interceptor_deactivate(void) {
     zend_hash_destroy(&zai_hook_memory);
     zend_hash_destroy(&zai_interceptor_implicit_generators);
+
+    for (uint32_t page = 0; page < zai_generator_memory_page_count; ++page) {
+        if (zai_generator_memory_pages[page]) {
+            efree(zai_generator_memory_pages[page]);
+        }
+    }
+    if (zai_generator_memory_pages) {
+        efree(zai_generator_memory_pages);
+    }
+    zai_generator_memory_pages = NULL;
+    zai_generator_memory_page_count = 0;
 }
@@ -99,6 +99,44 @@ TEST_URI_NORMALIZATION("pattern mapping & fragment regexes: working with full UR
     add_assoc_null(&fragment_regex, "^abc$");
 })
 
+TEST_URI_NORMALIZATION("pattern mapping: wildcards are greedy within a fragment", "/a-something-somethingX/b", "/?-somethingX/b", {
+    add_assoc_null(&mapping, "*-something");
+})
+TEST_URI_NORMALIZATION("default replacement test: uuid_wrong_version_is_not_replaced", "/b968fb04-2be9-094b-8b26-efb8a816e7a5", "/b968fb04-2be9-094b-8b26-efb8a816e7a5", {})
+
+TEA_TEST_CASE("uri_normalization", "normalizer: cached paths are normalized like uncached ones", {
+    zval fragment_regex, mapping;
+    array_init(&fragment_regex);
+    array_init(&mapping);
+    add_assoc_null(&fragment_regex, "^abc$");
+    add_assoc_null(&mapping, "nested/*");
+
+    zai_uri_normalizer *normalizer = zai_uri_normalizer_compile(Z_ARRVAL(fragment_regex), Z_ARRVAL(mapping), 2, false);
+
+    const char *paths[][2] = {
+        {"/int/123/path/abc?a=b", "/int/?/path/?"},
+        {"/nested/some", "/nested/?"},
+        {"/int/123/path/abc?c=d", "/int/?/path/?"},  // cached under the same path, but different query string
+        {"/other", "/other"},                        // evicts /nested/some, the least recently used
+        {"/nested/some", "/nested/?"},
+        {"/int/123/path/abc", "/int/?/path/?"},
+    };
+    for (auto &path : paths) {
+        zend_string *path_str = zend_string_init(path[0], strlen(path[0]), 0);
+        zend_string *res = zai_uri_normalizer_apply(normalizer, path_str);
+
+        REQUIRE(ZSTR_LEN(res) == strlen(path[1]));
+        REQUIRE(memcmp(ZSTR_VAL(res), path[1], ZSTR_LEN(res)) == 0);
+
+        zend_string_release(path_str);
+        zend_string_release(res);
+    }
+
+    zai_uri_normalizer_free(normalizer);
+    zval_dtor(&mapping);
+    zval_dtor(&fragment_regex);
+})
+
 #undef TEST_BODY
 #define TEST_BODY(output, query_string, ...)          \
 {                                                     \
@@ -23,6 +23,19 @@ static inline zend_string *zai_php_pcre_replace(zend_string *regex, zend_string
     php_pcre_replace(regex, subj, subjstr, subjlen, replace, limit, (int *)replacements)
 #endif
 
+/* The obfuscation and normalization regexes run on every request, hence they are JIT compiled even with pcre.jit=0,
+ * pcre2_match() then uses the JIT code on its own. This is a no-op for patterns PHP compiled already, and a pattern
+ * failing to compile (e.g. without executable memory) keeps being matched by the interpreter. */
+static pcre_cache_entry *zai_get_compiled_regex(zend_string *regex) {
+    pcre_cache_entry *pce = pcre_get_compiled_regex_cache(regex);
+#if PHP_VERSION_ID >= 70300 && defined(HAVE_PCRE_JIT_SUPPORT)
+    if (pce) {
+        pcre2_jit_compile(php_pcre_pce_re(pce), PCRE2_JIT_COMPLETE);
+    }
+#endif
+    return pce;
+}
+
 static zend_bool zai_starts_with_protocol(zend_string *str) {
     // See: https://tools.ietf.org/html/rfc3986#page-17
     if (ZSTR_VAL(str)[0] < 'a' || ZSTR_VAL(str)[0] > 'z') {
@@ -40,102 +53,320 @@ static zend_bool zai_starts_with_protocol(zend_string *str) {
     return false;
 }
 
-static void zai_apply_fragment_regex(zend_string **path, char *fragment_regex, int fragment_len) {
-    // limit regex to only apply between two slashes (or slash and end)
-    bool start_anchor = fragment_regex[0] == '^', end_anchor = fragment_regex[fragment_len - 1] == '$';
-    zend_string *regex = zend_strpprintf(0, "((?<=/)(?=[^/]++(.*$))%s%.*s%s(?=\\1))", start_anchor ? "" : "[^/]*",
-                                         fragment_len - start_anchor - end_anchor, fragment_regex + start_anchor,
-                                         end_anchor ? "(?=/|$)" : "[^/]*");
-    size_t replacements;
-    zend_string *question_mark = ZSTR_CHAR('?');
-    zend_string *substituted_path =
-        php_pcre_replace(regex, *path, ZSTR_VAL(*path), ZSTR_LEN(*path), question_mark, -1, &replacements);
-    if (substituted_path) {  // NULL on invalid regex
-        zend_string_release(*path);
-        *path = substituted_path;
-    }
-    zend_string_release(question_mark);
-    zend_string_release(regex);
-}
+#define ZAI_URI_DIGIT 1
+#define ZAI_URI_HEX 2
 
-zend_string *zai_uri_normalize_path(zend_string *path, zend_array *fragmentRegex, zend_array *mapping) {
-    if (path == NULL || ZSTR_LEN(path) == 0 || (ZSTR_LEN(path) == 1 && ZSTR_VAL(path)[0] == '/') ||
-        ZSTR_VAL(path)[0] == '?') {
-        return ZSTR_CHAR('/');
-    }
+static const uint8_t zai_uri_char_class[256] = {
+    ['0' ... '9'] = ZAI_URI_DIGIT | ZAI_URI_HEX,
+    ['a' ... 'f'] = ZAI_URI_HEX,
+    ['A' ... 'F'] = ZAI_URI_HEX,
+};
 
-    path = zend_string_copy(path);
+struct zai_uri_normalizer_s {
+    bool persistent;
+    uint32_t mappings_count;
+    zend_string **mappings;  // trimmed patterns, '*' matching one or more characters within a fragment
+    uint32_t fragment_regexes_count;
+    zend_string **fragment_regexes;  // delimited, only holding the ones which compiled
+    uint32_t cache_size;
+    HashTable cache;  // path without query string => normalized path, least recently used first
+};
 
-    // Removing query string
-    char *query_str = strchr(ZSTR_VAL(path), '?');
-    if (query_str) {
-        size_t new_len = query_str - ZSTR_VAL(path);
-        path = zend_string_truncate(path, new_len, 0);
-        ZSTR_VAL(path)[new_len] = 0;
-    }
+static void zai_uri_normalizer_cache_dtor(zval *zv) { zend_string_release(Z_STR_P(zv)); }
 
-    // We always expect leading slash if it is a pure path, while urls with RFC3986 complaint schemes are preserved.
-    if (ZSTR_VAL(path)[0] != '/' && !zai_starts_with_protocol(path)) {
-        path = zend_string_realloc(path, ZSTR_LEN(path) + 1, 0);
-        memmove(ZSTR_VAL(path) + 1, ZSTR_VAL(path), ZSTR_LEN(path));  // incl. trailing 0 byte
-        ZSTR_VAL(path)[0] = '/';
-    }
+zai_uri_normalizer *zai_uri_normalizer_compile(zend_array *fragmentRegex, zend_array *mapping, uint32_t cache_size,
+                                               bool persistent) {
+    zai_uri_normalizer *normalizer = pecalloc(1, sizeof(*normalizer), persistent);
+    normalizer->persistent = persistent;
+    normalizer->mappings = pemalloc(sizeof(zend_string *) * MAX(zend_hash_num_elements(mapping), 1), persistent);
+    normalizer->fragment_regexes =
+        pemalloc(sizeof(zend_string *) * MAX(zend_hash_num_elements(fragmentRegex), 1), persistent);
 
     zend_string *pattern;
     ZEND_HASH_FOREACH_STR_KEY(mapping, pattern) {
-        pattern = php_trim(pattern, NULL, 0, 3);
-        if (ZSTR_LEN(pattern)) {
-            // build a regex starting with a /, properly escaped and * replaced by [^/]+
-            smart_str regex = {0}, replacement = {0};
-            smart_str_alloc(&regex, ZSTR_LEN(pattern) * 4 + 10, 0);
-            smart_str_alloc(&replacement, ZSTR_LEN(pattern), 0);
-            smart_str_appends(&regex, "((?<=/)");
-            for (char *ptr = ZSTR_VAL(pattern), *end = ZSTR_VAL(pattern) + ZSTR_LEN(pattern); ptr < end; ++ptr) {
-                if (*ptr == '*') {
-                    smart_str_appends(&regex, "[^/]+");
-                    smart_str_appendc(&replacement, '?');
-                } else {
-                    if (strchr(".\\+?[^]$(){}=!><|:-#", *ptr)) {
-                        smart_str_appendc(&regex, '\\');
-                    }
-                    smart_str_appendc(&regex, *ptr);
-                    smart_str_appendc(&replacement, *ptr);
-                }
-            }
-            smart_str_appendc(&regex, ')');
-            smart_str_0(&regex);
-            smart_str_0(&replacement);
-
-            size_t replacements;
-            zend_string *substituted_path =
-                php_pcre_replace(regex.s, path, ZSTR_VAL(path), ZSTR_LEN(path), replacement.s, -1, &replacements);
-            zend_string_release(path);
-            path = substituted_path;
-
-            smart_str_free(&regex);
-            smart_str_free(&replacement);
+        if (!pattern) {
+            continue;
         }
-        zend_string_release(pattern);
+        zend_string *trimmed_pattern = php_trim(pattern, NULL, 0, 3);
+        if (ZSTR_LEN(trimmed_pattern)) {
+            normalizer->mappings[normalizer->mappings_count++] =
+                zend_string_init(ZSTR_VAL(trimmed_pattern), ZSTR_LEN(trimmed_pattern), persistent);
+        }
+        zend_string_release(trimmed_pattern);
     }
     ZEND_HASH_FOREACH_END();
 
-    zai_apply_fragment_regex(&path, ZEND_STRL("^\\d+$"));
-    zai_apply_fragment_regex(
-        &path,
-        ZEND_STRL("^[0-9a-fA-F]{8}-?[0-9a-fA-F]{4}-?[1-5][0-9a-fA-F]{3}-?[89abAB][0-9a-fA-F]{3}-?[0-9a-fA-F]{12}$"));
-    zai_apply_fragment_regex(&path, ZEND_STRL("^[0-9a-fA-F]{8,128}$"));
+    zai_error_state error_state;
+    zai_sandbox_error_state_backup(&error_state);
+    zend_replace_error_handling(EH_NORMAL, NULL, NULL);
 
     zend_string *fragment_regex;
     ZEND_HASH_FOREACH_STR_KEY(fragmentRegex, fragment_regex) {
+        if (!fragment_regex) {
+            continue;
+        }
         zend_string *trimmed_regex = php_trim(fragment_regex, ZEND_STRL(" \t\n\r\v\0/"), 3);
         if (ZSTR_LEN(trimmed_regex)) {
-            zai_apply_fragment_regex(&path, ZSTR_VAL(trimmed_regex), ZSTR_LEN(trimmed_regex));
+            // fragments are matched in isolation, hence ^ and $ anchor to the fragment boundaries
+            zend_string *regex = zend_strpprintf(0, "(%s)", ZSTR_VAL(trimmed_regex));
+            if (zai_get_compiled_regex(regex)) {  // invalid regex fragments are ignored
+                normalizer->fragment_regexes[normalizer->fragment_regexes_count++] =
+                    persistent ? zend_string_init(ZSTR_VAL(regex), ZSTR_LEN(regex), 1) : zend_string_copy(regex);
+            }
+            zend_string_release(regex);
         }
         zend_string_release(trimmed_regex);
     }
     ZEND_HASH_FOREACH_END();
 
-    return path;
+    zai_sandbox_error_state_restore(&error_state);
+
+    normalizer->cache_size = cache_size;
+    if (cache_size) {
+        zend_hash_init(&normalizer->cache, 8, NULL, zai_uri_normalizer_cache_dtor, persistent);
+    }
+
+    return normalizer;
+}
+
+void zai_uri_normalizer_free(zai_uri_normalizer *normalizer) {
+    for (uint32_t i = 0; i < normalizer->mappings_count; ++i) {
+        zend_string_release(normalizer->mappings[i]);
+    }
+    pefree(normalizer->mappings, normalizer->persistent);
+    for (uint32_t i = 0; i < normalizer->fragment_regexes_count; ++i) {
+        zend_string_release(normalizer->fragment_regexes[i]);
+    }
+    pefree(normalizer->fragment_regexes, normalizer->persistent);
+    if (normalizer->cache_size) {
+        zend_hash_destroy(&normalizer->cache);
+    }
+    pefree(normalizer, normalizer->persistent);
+}
+
+// Returns the end of the match of the pattern at subject, or NULL. Like the regex [^/]+, '*' is greedy and backtracks.
+static const char *zai_uri_mapping_match(const char *pattern, const char *pattern_end, const char *subject,
+                                         const char *subject_end) {
+    for (; pattern < pattern_end; ++pattern, ++subject) {
+        if (*pattern == '*') {
+            const char *fragment_end = subject;
+            while (fragment_end < subject_end && *fragment_end != '/') {
+                ++fragment_end;
+            }
+            for (; fragment_end > subject; --fragment_end) {
+                const char *match_end = zai_uri_mapping_match(pattern + 1, pattern_end, fragment_end, subject_end);
+                if (match_end) {
+                    return match_end;
+                }
+            }
+            return NULL;
+        }
+        if (subject == subject_end || *subject != *pattern) {
+            return NULL;
+        }
+    }
+    return subject;
+}
+
+static zend_string *zai_uri_apply_mapping(zend_string *path, zend_string *pattern) {
+    smart_str replaced = {0};
+    const char *start = ZSTR_VAL(path), *end = start + ZSTR_LEN(path), *copied = start;
+    for (const char *cur = start + 1; cur < end; ++cur) {
+        // mappings only apply starting right after a slash
+        if (cur[-1] != '/') {
+            continue;
+        }
+        const char *match_end = zai_uri_mapping_match(ZSTR_VAL(pattern), ZSTR_VAL(pattern) + ZSTR_LEN(pattern), cur, end);
+        if (!match_end) {
+            continue;
+        }
+        smart_str_appendl(&replaced, copied, cur - copied);
+        for (const char *ptr = ZSTR_VAL(pattern), *pattern_end = ptr + ZSTR_LEN(pattern); ptr < pattern_end; ++ptr) {
+            smart_str_appendc(&replaced, *ptr == '*' ? '?' : *ptr);
+        }
+        copied = match_end;
+        cur = match_end - 1;
+    }
+
+    if (!replaced.s) {
+        return path;
+    }
+    smart_str_appendl(&replaced, copied, end - copied);
+    smart_str_0(&replaced);
+    zend_string_release(path);
+    return replaced.s;
+}
+
+// ^[0-9a-fA-F]{8}-?[0-9a-fA-F]{4}-?[1-5][0-9a-fA-F]{3}-?[89abAB][0-9a-fA-F]{3}-?[0-9a-fA-F]{12}$
+static bool zai_uri_fragment_is_uuid(const unsigned char *fragment, size_t len) {
+    static const uint8_t group_lengths[] = {8, 4, 4, 4, 12};
+    const unsigned char *cur = fragment, *end = fragment + len, *version = NULL, *variant = NULL;
+    for (int group = 0; group < 5; ++group) {
+        if (group && cur < end && *cur == '-') {
+            ++cur;
+        }
+        if (group == 2) {
+            version = cur;
+        } else if (group == 3) {
+            variant = cur;
+        }
+        for (int i = 0; i < group_lengths[group]; ++i, ++cur) {
+            if (cur == end || !(zai_uri_char_class[*cur] & ZAI_URI_HEX)) {
+                return false;
+            }
+        }
+    }
+    return cur == end && *version >= '1' && *version <= '5' &&
+           (*variant == '8' || *variant == '9' || (*variant | 0x20) == 'a' || (*variant | 0x20) == 'b');
+}
+
+static bool zai_uri_fragment_matches(zend_string *regex, const char *fragment, size_t len) {
+    pcre_cache_entry *pce = zai_get_compiled_regex(regex);
+    if (!pce) {
+        return false;
+    }
+
+    zval ret;
+#if PHP_VERSION_ID < 70400
+    php_pcre_match_impl(pce, (char *)fragment, len, &ret, NULL, 0, 0, 0, 0);
+#else
+    zend_string *subject = zend_string_init(fragment, len, 0);
+    php_pcre_match_impl(pce, subject, &ret, NULL, 0, 0, 0, 0);
+    zend_string_release(subject);
+#endif
+    return Z_TYPE(ret) == IS_LONG && Z_LVAL(ret) > 0;
+}
+
+static bool zai_uri_fragment_is_replaced(zai_uri_normalizer *normalizer, const char *fragment, size_t len) {
+    // the default fragment regexes ^\d+$, ^[0-9a-fA-F]{8,128}$ and uuids, in a single pass over the fragment
+    uint8_t classes = ZAI_URI_DIGIT | ZAI_URI_HEX;
+    for (size_t i = 0; i < len && classes; ++i) {
+        classes &= zai_uri_char_class[(unsigned char)fragment[i]];
+    }
+    if ((classes & ZAI_URI_DIGIT) || ((classes & ZAI_URI_HEX) && len >= 8 && len <= 128)) {
+        return true;
+    }
+    if (len >= 32 && len <= 36 && zai_uri_fragment_is_uuid((const unsigned char *)fragment, len)) {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < normalizer->fragment_regexes_count; ++i) {
+        if (zai_uri_fragment_matches(normalizer->fragment_regexes[i], fragment, len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static zend_string *zai_uri_replace_fragments(zai_uri_normalizer *normalizer, zend_string *path) {
+    smart_str replaced = {0};
+    const char *start = ZSTR_VAL(path), *end = start + ZSTR_LEN(path), *copied = start;
+    for (const char *cur = start; cur < end; ++cur) {
+        if (*cur != '/') {
+            continue;
+        }
+        const char *fragment = cur + 1, *fragment_end = memchr(fragment, '/', end - fragment);
+        if (!fragment_end) {
+            fragment_end = end;
+        }
+        if (fragment_end > fragment && zai_uri_fragment_is_replaced(normalizer, fragment, fragment_end - fragment)) {
+            smart_str_appendl(&replaced, copied, fragment - copied);
+            smart_str_appendc(&replaced, '?');
+            copied = fragment_end;
+        }
+        cur = fragment_end - 1;
+    }
+
+    if (!replaced.s) {
+        return path;
+    }
+    smart_str_appendl(&replaced, copied, end - copied);
+    smart_str_0(&replaced);
+    zend_string_release(path);
+    return replaced.s;
+}
+
+static zend_string *zai_uri_normalizer_cache_find(zai_uri_normalizer *normalizer, const char *path, size_t len) {
+    zval *cached = zend_hash_str_find(&normalizer->cache, path, len);
+    if (!cached) {
+        return NULL;
+    }
+
+    zend_string *normalized = Z_STR_P(cached);
+    // move the entry to the end, unless it is the most recently used one already
+    if (cached != &normalizer->cache.arData[normalizer->cache.nNumUsed - 1].val) {
+        zend_string_addref(normalized);
+        zend_hash_str_del(&normalizer->cache, path, len);
+        zval normalized_zv;
+        ZVAL_STR(&normalized_zv, normalized);
+        zend_hash_str_add_new(&normalizer->cache, path, len, &normalized_zv);
+    }
+    return normalized;
+}
+
+static void zai_uri_normalizer_cache_add(zai_uri_normalizer *normalizer, const char *path, size_t len,
+                                         zend_string *normalized) {
+    if (zend_hash_num_elements(&normalizer->cache) >= normalizer->cache_size) {
+        zend_string *least_recently_used;
+        ZEND_HASH_FOREACH_STR_KEY(&normalizer->cache, least_recently_used) {
+            zend_hash_del(&normalizer->cache, least_recently_used);
+            break;
+        }
+        ZEND_HASH_FOREACH_END();
+    }
+
+    zval normalized_zv;
+    ZVAL_STR(&normalized_zv, normalizer->persistent
+                                 ? zend_string_init(ZSTR_VAL(normalized), ZSTR_LEN(normalized), 1)
+                                 : zend_string_copy(normalized));
+    zend_hash_str_add_new(&normalizer->cache, path, len, &normalized_zv);
+}
+
+zend_string *zai_uri_normalizer_apply(zai_uri_normalizer *normalizer, zend_string *path) {
+    if (path == NULL || ZSTR_LEN(path) == 0 || (ZSTR_LEN(path) == 1 && ZSTR_VAL(path)[0] == '/') ||
+        ZSTR_VAL(path)[0] == '?') {
+        return ZSTR_CHAR('/');
+    }
+
+    // Removing query string
+    char *query_str = memchr(ZSTR_VAL(path), '?', ZSTR_LEN(path));
+    size_t len = query_str ? (size_t)(query_str - ZSTR_VAL(path)) : ZSTR_LEN(path);
+
+    if (normalizer->cache_size) {
+        zend_string *cached = zai_uri_normalizer_cache_find(normalizer, ZSTR_VAL(path), len);
+        if (cached) {
+            return normalizer->persistent ? zend_string_init(ZSTR_VAL(cached), ZSTR_LEN(cached), 0)
+                                          : zend_string_copy(cached);
+        }
+    }
+
+    zend_string *normalized = zend_string_init(ZSTR_VAL(path), len, 0);
+
+    // We always expect leading slash if it is a pure path, while urls with RFC3986 complaint schemes are preserved.
+    if (ZSTR_VAL(normalized)[0] != '/' && !zai_starts_with_protocol(normalized)) {
+        normalized = zend_string_realloc(normalized, ZSTR_LEN(normalized) + 1, 0);
+        memmove(ZSTR_VAL(normalized) + 1, ZSTR_VAL(normalized), ZSTR_LEN(normalized));  // incl. trailing 0 byte
+        ZSTR_VAL(normalized)[0] = '/';
+    }
+
+    for (uint32_t i = 0; i < normalizer->mappings_count; ++i) {
+        normalized = zai_uri_apply_mapping(normalized, normalizer->mappings[i]);
+    }
+
+    normalized = zai_uri_replace_fragments(normalizer, normalized);
+
+    if (normalizer->cache_size) {
+        zai_uri_normalizer_cache_add(normalizer, ZSTR_VAL(path), len, normalized);
+    }
+
+    return normalized;
+}
+
+zend_string *zai_uri_normalize_path(zend_string *path, zend_array *fragmentRegex, zend_array *mapping) {
+    zai_uri_normalizer *normalizer = zai_uri_normalizer_compile(fragmentRegex, mapping, 0, false);
+    zend_string *normalized = zai_uri_normalizer_apply(normalizer, path);
+    zai_uri_normalizer_free(normalizer);
+    return normalized;
 }
 
 zend_string *zai_filter_query_string(zai_string_view queryString, zend_array *whitelist, zend_string *pattern) {
@@ -152,8 +383,10 @@ zend_string *zai_filter_query_string(zai_string_view queryString, zend_array *wh
                 zend_string *replacement = zend_string_init(ZEND_STRL("<redacted>"), 0);
                 zend_string *regex = zend_strpprintf(0, "(%.*s)", (int)ZSTR_LEN(pattern), ZSTR_VAL(pattern));
 
-                zend_string *redacted_qs =
-                    php_pcre_replace(regex, qs, ZSTR_VAL(qs), ZSTR_LEN(qs), replacement, -1, NULL);
+                zend_string *redacted_qs = NULL;
+                if (zai_get_compiled_regex(regex)) {  // php_pcre_replace() then finds it in the cache
+                    redacted_qs = php_pcre_replace(regex, qs, ZSTR_VAL(qs), ZSTR_LEN(qs), replacement, -1, NULL);
+                }
 
                 zend_string_release(regex);
                 zend_string_release(replacement);
@@ -209,7 +442,7 @@ bool zai_match_regex(zend_string *pattern, zend_string *subject) {
     zai_sandbox_error_state_backup(&error_state);
     zend_replace_error_handling(EH_NORMAL, NULL, NULL);
 
-    pcre_cache_entry *pce = pcre_get_compiled_regex_cache(regex);
+    pcre_cache_entry *pce = zai_get_compiled_regex(regex);
 
     // TODO: error loggins
 
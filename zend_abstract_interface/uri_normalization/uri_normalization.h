@@ -10,6 +10,18 @@
  * Note: it also accepts full urls which are preserved: http://example.com/int/123 ---> http://example.com/int/?
  */
 zend_string *zai_uri_normalize_path(zend_string *path, zend_array *fragmentRegex, zend_array *mapping);
+
+/*
+ * A normalizer holds the fragment regexes and mappings compiled once, for normalizing many paths with the same rules.
+ * Up to cache_size normalized paths are remembered, keyed by their path without query string, evicting the least
+ * recently used one. A persistent normalizer may outlive the request it was compiled in.
+ */
+typedef struct zai_uri_normalizer_s zai_uri_normalizer;
+zai_uri_normalizer *zai_uri_normalizer_compile(zend_array *fragmentRegex, zend_array *mapping, uint32_t cache_size,
+                                               bool persistent);
+zend_string *zai_uri_normalizer_apply(zai_uri_normalizer *normalizer, zend_string *path);
+void zai_uri_normalizer_free(zai_uri_normalizer *normalizer);
+
 zend_string *zai_filter_query_string(zai_string_view queryString, zend_array *whitelist, zend_string *pattern);
 bool zai_match_regex(zend_string *pattern, zend_string *subject);
 #endif  // ZAI_URI_NORMALIZATION_H